@@ -0,0 +1,176 @@
+#pragma once
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fmt/format.h>
+#include "math/interpolation.h"
+#include "force_model.h"
+
+/// Tabulated atmosphere: density, pressure and temperature against geometric altitude. Density and
+/// pressure are interpolated in log space, so each segment is an exponential with its own scale
+/// height (the form of the standard atmospheres), and above the last node they keep decaying with
+/// the last one. The three tables share their nodes, so the hint of one lookup serves the others.
+class atmosphere
+{
+public:
+    static constexpr double γ = 1.4;           ///< Heat capacity ratio of air
+    static constexpr double R_air = 287.05287; ///< Specific gas constant of air, J/(kg K)
+
+    atmosphere() = default;
+    atmosphere(std::vector<double> altitude, const std::vector<double> &density, const std::vector<double> &pressure,
+               const std::vector<double> &temperature, interpolation_method method = interpolation_method::monotone_cubic)
+    {
+        set(std::move(altitude), density, pressure, temperature, method);
+    }
+
+    void set(std::vector<double> altitude, const std::vector<double> &density, const std::vector<double> &pressure,
+             const std::vector<double> &temperature, interpolation_method method = interpolation_method::monotone_cubic)
+    {
+        size_t n = altitude.size();
+        if (density.size() != n || pressure.size() != n || temperature.size() != n)
+        {
+            fmt::println("ERROR: atmosphere tables need one density, pressure and temperature per altitude");
+            return;
+        }
+        std::vector<double> log_ρ(n), log_p(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            log_ρ[i] = std::log(density[i]);
+            log_p[i] = std::log(pressure[i]);
+        }
+        _log_ρ.set(altitude, std::move(log_ρ), method);
+        _log_p.set(altitude, std::move(log_p), method);
+        _T.set(std::move(altitude), temperature, method);
+    }
+
+    /// Text table of "altitude(m) density(kg/m³) pressure(Pa) temperature(K)" lines, '#' for comments
+    bool load(const std::string &path, interpolation_method method = interpolation_method::monotone_cubic)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            fmt::println("ERROR: cannot open atmosphere file {}", path);
+            return false;
+        }
+        std::vector<double> h, ρ, p, T;
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+                continue;
+            std::istringstream in(line);
+            double values[4];
+            if (!(in >> values[0] >> values[1] >> values[2] >> values[3]))
+            {
+                fmt::println("ERROR: malformed atmosphere line \"{}\"", line);
+                return false;
+            }
+            h.push_back(values[0]);
+            ρ.push_back(values[1]);
+            p.push_back(values[2]);
+            T.push_back(values[3]);
+        }
+        set(std::move(h), ρ, p, T, method);
+        return true;
+    }
+
+    /// U.S. Standard Atmosphere 1976: below 86 km from its layers of constant lapse rate in
+    /// geopotential altitude, every step metres (the molecular weight variation above 80 km, under
+    /// 0.04 %, is neglected), above from its tables up to 1000 km
+    static atmosphere us76(double step = 1000., interpolation_method method = interpolation_method::monotone_cubic)
+    {
+        constexpr double r0 = 6356766., g0 = 9.80665, M0 = 0.0289644, R_star = 8.31432;
+        constexpr double layers[8][2] = {{0., -6.5e-3}, {11000., 0.}, {20000., 1e-3}, {32000., 2.8e-3},
+                                         {47000., 0.}, {51000., -2.8e-3}, {71000., -2e-3}, {84852., 0.}};
+        double T_base[8], p_base[8];
+        T_base[0] = 288.15;
+        p_base[0] = 101325.;
+        auto layer_state = [&](size_t k, double H, double &T, double &p)
+        {
+            double L = layers[k][1], dH = H - layers[k][0];
+            T = T_base[k] + L * dH;
+            p = L == 0 ? p_base[k] * std::exp(-g0 * M0 * dH / (R_star * T_base[k]))
+                       : p_base[k] * std::pow(T_base[k] / T, g0 * M0 / (R_star * L));
+        };
+        for (size_t k = 1; k < 8; k++)
+            layer_state(k - 1, layers[k][0], T_base[k], p_base[k]);
+
+        std::vector<double> h, ρ, p, T;
+        for (double z = 0; z < 86000.; z += step)
+        {
+            double H = r0 * z / (r0 + z), T_z, p_z;
+            size_t k = 0;
+            while (k < 7 && H >= layers[k + 1][0])
+                k++;
+            layer_state(k, H, T_z, p_z);
+            h.push_back(z);
+            ρ.push_back(p_z * M0 / (R_star * T_z));
+            p.push_back(p_z);
+            T.push_back(T_z);
+        }
+        constexpr double upper[][4] = {
+            {86e3, 6.958e-6, 3.7338e-1, 186.87}, {90e3, 3.416e-6, 1.8359e-1, 186.87}, {100e3, 5.604e-7, 3.2011e-2, 195.08},
+            {110e3, 9.708e-8, 7.1042e-3, 240.00}, {120e3, 2.222e-8, 2.5382e-3, 360.00}, {130e3, 8.152e-9, 1.2505e-3, 469.27},
+            {140e3, 3.831e-9, 7.2028e-4, 559.63}, {150e3, 2.076e-9, 4.5422e-4, 634.39}, {160e3, 1.233e-9, 3.0395e-4, 696.29},
+            {180e3, 5.194e-10, 1.5271e-4, 790.07}, {200e3, 2.541e-10, 8.4736e-5, 854.56}, {250e3, 6.073e-11, 2.4767e-5, 941.33},
+            {300e3, 1.916e-11, 8.7704e-6, 976.01}, {350e3, 7.014e-12, 3.4498e-6, 990.06}, {400e3, 2.803e-12, 1.4518e-6, 995.83},
+            {450e3, 1.184e-12, 6.4468e-7, 998.22}, {500e3, 5.215e-13, 3.0236e-7, 999.24}, {600e3, 1.137e-13, 8.2130e-8, 999.85},
+            {700e3, 3.070e-14, 3.1908e-8, 999.97}, {800e3, 1.136e-14, 1.7036e-8, 999.99}, {900e3, 5.759e-15, 1.0873e-8, 1000.},
+            {1000e3, 3.561e-15, 7.5138e-9, 1000.}};
+        for (const auto &row : upper)
+        {
+            h.push_back(row[0]);
+            ρ.push_back(row[1]);
+            p.push_back(row[2]);
+            T.push_back(row[3]);
+        }
+        return atmosphere(std::move(h), ρ, p, T, method);
+    }
+
+    double density(double h) const { return std::exp(_log_ρ(h)); }
+    double density(double h, size_t &hint) const { return std::exp(_log_ρ(h, hint)); }
+    double pressure(double h, size_t &hint) const { return std::exp(_log_p(h, hint)); }
+    /// Temperature, held at its last tabulated value beyond the top
+    double temperature(double h, size_t &hint) const
+    {
+        const std::vector<double> &nodes = _T.nodes();
+        return h >= nodes.back() ? _T.values().back() : _T(h, hint);
+    }
+    double speed_of_sound(double h, size_t &hint) const { return std::sqrt(γ * R_air * temperature(h, hint)); }
+
+    /// Densities at many altitudes
+    void density(std::span<const double> h, std::span<double> ρ) const
+    {
+        _log_ρ(h, ρ);
+        for (double &value : ρ)
+            value = std::exp(value);
+    }
+
+    const std::vector<double> &altitudes() const { return _T.nodes(); }
+
+private:
+    table_1d _log_ρ, _log_p, _T;
+};
+
+/// Tabulated atmosphere as a force_model term (the density provider of drag), rotating with the body
+/// at ω around z. The lookup hint is kept between evaluations, so a model instance is meant to be
+/// used by one thread at a time.
+struct tabulated_atmosphere
+{
+    static constexpr bool uses_velocity = true;
+    static constexpr bool provides_density = true;
+
+    const atmosphere *model;
+    double R, ω = 0;
+    mutable size_t hint = 0;
+
+    void prepare(force_context &c) const
+    {
+        c.altitude = c.r_norm - R;
+        c.density = model->density(c.altitude, hint);
+        c.v_rel = vec3d(c.v.x + ω * c.r.y, c.v.y - ω * c.r.x, c.v.z);
+        c.v_rel_norm = c.v_rel.norm();
+    }
+};
@@ -0,0 +1,106 @@
+#pragma once
+#include <cmath>
+#include <functional>
+#include <vector>
+#include "solver/buffer.h"
+#include "solver/inplace.h"
+#include "solver/solver.h"
+#include "universal_kepler.h"
+
+/// Encke's method: the trajectory is the analytic Kepler orbit osculating at the last rectification
+/// (ρ, from universal_kepler) plus a deviation δ, and only δ is integrated:
+///     δ'' = -μ / |ρ|³ (f(q) r + δ) + perturbation(t, r, v),    r = ρ + δ
+/// with Battin's f(q) = (1 + q)^(3/2) - 1 evaluated without cancellation. δ stays small and smooth
+/// so much larger steps than a direct (Cowell) integration of the full acceleration keep the same
+/// accuracy. When |δ| exceeds threshold |ρ| the reference is reset to the current state.
+template <typename T>
+class encke
+{
+public:
+    encke(double μ) : _μ(μ) {}
+
+    void set_initial_state(double t0, T x0, T v0)
+    {
+        _t0 = t0;
+        _x0 = x0;
+        _v0 = v0;
+    }
+    void set_timestep(double dt) { _dt = dt; }
+    void set_rectification_threshold(double threshold) { _threshold = threshold; }
+
+    /// RK4 on the deviation. The reference is evaluated at the step ends and midpoint only.
+    T solve_RK4(double tf, std::function<T(double t, T x, T v)> perturbation)
+    {
+        size_t N = get_number_of_steps(_t0, tf, _dt);
+        double h = (tf - _t0) / N;
+        resize_buffer(_positions, N + 1);
+        resize_buffer(_velocities, N + 1);
+        _positions[0] = _x0;
+        _velocities[0] = _v0;
+        _rectifications = 0;
+
+        auto deviation = [&](double t, const T &ρ, const T &ρv, const T &δ, const T &δv) -> T
+        {
+            T r = ρ + δ;
+            double q = δ.dot(δ - 2. * r) / r.dot(r); ///< |ρ|² = (1 + q) |r|²
+            double f = q * (3 + q * (3 + q)) / (1 + std::pow(1 + q, 1.5));
+            double ρ_norm = ρ.norm();
+            return -_μ / (ρ_norm * ρ_norm * ρ_norm) * (f * r + δ) + perturbation(t, r, ρv + δv);
+        };
+
+        universal_kepler<T> reference(_x0, _v0, _μ, _t0);
+        T ρ = _x0, ρv = _v0;
+        T ρ_half, ρv_half, ρ_end, ρv_end;
+        T δ = 0. * _x0, δv = 0. * _v0;
+        for (size_t i = 0; i < N; i++)
+        {
+            double t = _t0 + i * h;
+            reference.state_at(t + h / 2, ρ_half, ρv_half);
+            reference.state_at(t + h, ρ_end, ρv_end);
+
+            T v1 = δv;
+            T a1 = deviation(t, ρ, ρv, δ, δv);
+            T v2 = δv + h / 2 * a1;
+            T a2 = deviation(t + h / 2, ρ_half, ρv_half, δ + h / 2 * v1, v2);
+            T v3 = δv + h / 2 * a2;
+            T a3 = deviation(t + h / 2, ρ_half, ρv_half, δ + h / 2 * v2, v3);
+            T v4 = δv + h * a3;
+            T a4 = deviation(t + h, ρ_end, ρv_end, δ + h * v3, v4);
+            rk4_update(δ, h, v1, v2, v3, v4);
+            rk4_update(δv, h, a1, a2, a3, a4);
+
+            ρ = ρ_end;
+            ρv = ρv_end;
+            _positions[i + 1] = ρ + δ;
+            _velocities[i + 1] = ρv + δv;
+
+            /// Rectification: the current state becomes the new osculating reference
+            if (δ.norm() > _threshold * ρ.norm())
+            {
+                reference = universal_kepler<T>(_positions[i + 1], _velocities[i + 1], _μ, t + h);
+                ρ = _positions[i + 1];
+                ρv = _velocities[i + 1];
+                δ = 0. * _x0;
+                δv = 0. * _v0;
+                _rectifications++;
+            }
+        }
+        return _positions[N];
+    }
+
+    const std::vector<T> &get_positions() const { return _positions; }
+    const std::vector<T> &get_velocities() const { return _velocities; }
+    /// Number of reference resets during the last solve
+    size_t get_rectification_count() const { return _rectifications; }
+
+private:
+    double _μ;
+    double _t0;
+    double _dt;
+    double _threshold = 1e-3;
+    size_t _rectifications = 0;
+    T _x0;
+    T _v0;
+    std::vector<T> _positions;
+    std::vector<T> _velocities;
+};
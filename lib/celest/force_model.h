@@ -0,0 +1,264 @@
+#pragma once
+#include <cmath>
+#include <tuple>
+#include <utility>
+#include "math/vec3d.h"
+#include "geopotential.h"
+
+/// Quantities of one evaluation shared by the terms of a force_model. The geometry is computed once
+/// by the model, the other fields by the prepare step of the terms that provide them.
+struct force_context
+{
+    force_context(double t, const vec3d &r, const vec3d &v) : t(t), r(r), v(v)
+    {
+        r2 = r.norm_2();
+        r_norm = std::sqrt(r2);
+        inv_r3 = 1 / (r2 * r_norm);
+    }
+
+    double t;
+    vec3d r, v;
+    double r2, r_norm, inv_r3;
+
+    double altitude = 0, density = 0; ///< From an atmosphere term
+    vec3d v_rel;                      ///< Velocity relative to the atmosphere
+    double v_rel_norm = 0;
+
+    vec3d sun;         ///< Position of the Sun, from a sun term
+    double sun_norm = 0;
+    vec3d sun_to_body; ///< r - sun
+    double sun_distance = 0;
+};
+
+/// Traits of the force terms, declared by static members of the term types
+template <typename F>
+concept force_prepares = requires(const F &f, force_context &c) { f.prepare(c); };
+template <typename F>
+concept force_accelerates = requires(const F &f, const force_context &c, vec3d &a) { f.accelerate(c, a); };
+template <typename F>
+constexpr bool force_uses_velocity = requires { requires F::uses_velocity; };
+template <typename F>
+constexpr bool force_needs_density = requires { requires F::needs_density; };
+template <typename F>
+constexpr bool force_provides_density = requires { requires F::provides_density; };
+template <typename F>
+constexpr bool force_needs_sun = requires { requires F::needs_sun; };
+template <typename F>
+constexpr bool force_provides_sun = requires { requires F::provides_sun; };
+
+/// Sum of force terms, each a type with
+///     void accelerate(const force_context &c, vec3d &a) const    (adds its acceleration to a)
+/// and/or void prepare(force_context &c) const, run for every term before any accelerate.
+/// The terms are stored by value in a tuple and called directly, so the whole evaluation is inlined
+/// into a single function: r, r², 1/r³, the density or the Sun position are computed once however
+/// many terms use them. The model is a right-hand side for solver_degree_II (returned or in-place
+/// accelerations, and position-only ones when no term depends on the velocity) and a perturbation
+/// for encke:
+///     force_model model(point_mass{μ}, zonal_J2{μ, R, J2}, exponential_atmosphere{ρ0, H, R, ω}, drag{B});
+///     solver.solve_RK4(tf, acceleration_xv_inplace<vec3d>(std::ref(model)));
+template <typename... F>
+class force_model
+{
+public:
+    static constexpr bool uses_velocity = (force_uses_velocity<F> || ...);
+
+    static_assert(!(force_needs_density<F> || ...) || (force_provides_density<F> || ...),
+                  "drag needs an atmosphere term");
+    static_assert(!(force_needs_sun<F> || ...) || (force_provides_sun<F> || ...),
+                  "radiation pressure needs a sun term");
+
+    force_model(F... terms) : _terms(std::move(terms)...) {}
+
+    /// Term of type G, to change its parameters between solves
+    template <typename G>
+    G &get() { return std::get<G>(_terms); }
+    template <size_t I>
+    auto &get() { return std::get<I>(_terms); }
+
+    void operator()(double t, const vec3d &r, const vec3d &v, vec3d &a) const
+    {
+        force_context c(t, r, v);
+        std::apply([&](const F &...f)
+        {
+            (prepare(f, c), ...);
+            a = vec3d(0.);
+            (accelerate(f, c, a), ...);
+        }, _terms);
+    }
+
+    vec3d operator()(double t, const vec3d &r, const vec3d &v) const
+    {
+        vec3d a;
+        (*this)(t, r, v, a);
+        return a;
+    }
+
+    void operator()(double t, const vec3d &r, vec3d &a) const
+        requires(!uses_velocity)
+    {
+        (*this)(t, r, vec3d(0.), a);
+    }
+
+    vec3d operator()(double t, const vec3d &r) const
+        requires(!uses_velocity)
+    {
+        vec3d a;
+        (*this)(t, r, vec3d(0.), a);
+        return a;
+    }
+
+private:
+    template <typename G>
+    static void prepare(const G &f, force_context &c)
+    {
+        if constexpr (force_prepares<G>)
+            f.prepare(c);
+    }
+    template <typename G>
+    static void accelerate(const G &f, const force_context &c, vec3d &a)
+    {
+        if constexpr (force_accelerates<G>)
+            f.accelerate(c, a);
+    }
+
+    std::tuple<F...> _terms;
+};
+
+/// -μ r / r³
+struct point_mass
+{
+    double μ;
+
+    void accelerate(const force_context &c, vec3d &a) const { a -= μ * c.inv_r3 * c.r; }
+};
+
+/// Oblateness alone, in closed form (the z axis being the polar axis):
+///     a = 3/2 J2 μ R² / r⁵ (x (5z²/r² - 1), y (5z²/r² - 1), z (5z²/r² - 3))
+struct zonal_J2
+{
+    double μ, R, J2;
+
+    void accelerate(const force_context &c, vec3d &a) const
+    {
+        double k = 1.5 * J2 * μ * R * R * c.inv_r3 / c.r2;
+        double q = 5 * c.r.z * c.r.z / c.r2;
+        a += k * vec3d(c.r.x * (q - 1), c.r.y * (q - 1), c.r.z * (q - 3));
+    }
+};
+
+/// Full spherical harmonic field (see geopotential), in the inertial frame of its set_rotation. The
+/// field is not copied. With a point_mass term in the same model, its central term must be disabled.
+struct harmonics
+{
+    const geopotential *field;
+
+    void accelerate(const force_context &c, vec3d &a) const { a += (*field)(c.t, c.r); }
+};
+
+/// Density ρ0 exp(-h / H) at altitude h above the sphere of radius R, the atmosphere rotating with
+/// the body at ω around z
+struct exponential_atmosphere
+{
+    static constexpr bool uses_velocity = true;
+    static constexpr bool provides_density = true;
+
+    double ρ0, H, R, ω = 0;
+
+    void prepare(force_context &c) const
+    {
+        c.altitude = c.r_norm - R;
+        c.density = ρ0 * std::exp(-c.altitude / H);
+        c.v_rel = vec3d(c.v.x + ω * c.r.y, c.v.y - ω * c.r.x, c.v.z);
+        c.v_rel_norm = c.v_rel.norm();
+    }
+};
+
+/// Aerodynamic drag -1/2 ρ B |v| v relative to the atmosphere, B = Cd A / m
+struct drag
+{
+    static constexpr bool uses_velocity = true;
+    static constexpr bool needs_density = true;
+
+    double B;
+
+    void accelerate(const force_context &c, vec3d &a) const { a -= 0.5 * c.density * B * c.v_rel_norm * c.v_rel; }
+};
+
+/// Thrust direction along the velocity
+struct prograde
+{
+    vec3d operator()(const force_context &c) const { return c.v / c.v.norm(); }
+};
+
+/// Thrust of constant magnitude (F / m), along the unit vector returned by steering(c)
+template <typename Steering = prograde>
+struct thrust
+{
+    static constexpr bool uses_velocity = true;
+
+    double acceleration;
+    Steering steering = {};
+
+    void accelerate(const force_context &c, vec3d &a) const { a += acceleration * steering(c); }
+};
+
+/// Perturbation of a third body of gravitational parameter μ at position(t), relative to the
+/// central body (whose own acceleration towards it is subtracted):
+///     a = μ ((s - r) / |s - r|³ - s / |s|³)
+template <typename Ephemeris>
+struct third_body
+{
+    double μ;
+    Ephemeris position;
+
+    void accelerate(const force_context &c, vec3d &a) const
+    {
+        vec3d s = position(c.t);
+        vec3d d = s - c.r;
+        double d2 = d.norm_2(), s2 = s.norm_2();
+        a += μ * (d / (d2 * std::sqrt(d2)) - s / (s2 * std::sqrt(s2)));
+    }
+};
+
+/// The Sun as a third body: its position is also shared with the radiation pressure
+template <typename Ephemeris>
+struct sun
+{
+    static constexpr bool provides_sun = true;
+
+    double μ;
+    Ephemeris position;
+
+    void prepare(force_context &c) const
+    {
+        c.sun = position(c.t);
+        c.sun_norm = c.sun.norm();
+        c.sun_to_body = c.r - c.sun;
+        c.sun_distance = c.sun_to_body.norm();
+    }
+
+    void accelerate(const force_context &c, vec3d &a) const
+    {
+        double s = c.sun_norm, d = c.sun_distance;
+        a -= μ * (c.sun_to_body / (d * d * d) + c.sun / (s * s * s));
+    }
+};
+
+/// Solar radiation pressure k (1 AU / d)² along the Sun-body direction, k = P Cr A / m at 1 AU
+/// (P = 4.56e-6 N/m²), zero in the cylindrical shadow of the central body of radius R
+struct radiation_pressure
+{
+    static constexpr bool needs_sun = true;
+    static constexpr double AU = 1.495978707e11;
+
+    double k, R;
+
+    void accelerate(const force_context &c, vec3d &a) const
+    {
+        double d = c.sun_distance;
+        double along = c.r.dot(c.sun) / c.sun_norm;
+        if (along < 0 && c.r2 - along * along < R * R)
+            return;
+        a += k * AU * AU / (d * d * d) * c.sun_to_body;
+    }
+};
@@ -0,0 +1,407 @@
+#pragma once
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <span>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <fmt/format.h>
+#include "math/double_pack.h"
+#include "math/parallel.h"
+#include "math/vec3d.h"
+#include "math/vec_pack.h"
+
+/// Spherical harmonic gravity field of a central body, from fully normalized coefficients C̄nm, S̄nm:
+///     U = μ/R Σ_n Σ_m (C̄nm V̄nm + S̄nm W̄nm),    V̄nm + i W̄nm = (R/r)^(n+1) P̄nm(sin φ) e^(imλ)
+/// V̄ and W̄ follow the singularity-free Cartesian recursions of Cunningham (Montenbruck & Gill,
+/// section 3.2), normalized so that degrees in the hundreds neither overflow nor lose precision:
+///     V̄mm = c_m R/r² (x V̄m-1,m-1 - y W̄m-1,m-1),    W̄mm = c_m R/r² (x W̄m-1,m-1 + y V̄m-1,m-1)
+///     V̄nm = a_nm z R/r² V̄n-1,m - b_nm R²/r² V̄n-2,m
+/// and the acceleration combines the V̄, W̄ of degree n + 1 with the factors of the normalization
+/// ratios. Every factor is computed once, stored by order m (a column is contiguous in n), and the
+/// recursion runs one column at a time over three rolling columns, which stay in L1. The evaluation
+/// is written for double and double_pack<W>: the batched path evaluates native_lanes positions per
+/// pass, the lanes being positions. Positions and accelerations are in the body-fixed frame, or in an
+/// inertial frame through set_rotation.
+class geopotential
+{
+public:
+    static constexpr size_t max_degree = 2190;
+
+    geopotential(double μ = 3.986004418e14, double R = 6378137.) : _μ(μ), _R(R) { resize(0); }
+
+    /// Coefficients from an ICGEM .gfc file ("gfc n m C S ..." lines, earth_gravity_constant and radius
+    /// read from the header) or from plain "n m C S" lines, up to degree (0 for all)
+    bool load(const std::string &path, size_t degree = 0)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            fmt::println("ERROR: cannot open gravity field file {}", path);
+            return false;
+        }
+        struct term
+        {
+            size_t n, m;
+            double C, S;
+        };
+        std::vector<term> terms;
+        size_t loaded = 0;
+        /// Numbers may have Fortran exponents (1.0D-06)
+        auto number = [](std::string token)
+        {
+            std::replace(token.begin(), token.end(), 'D', 'e');
+            std::replace(token.begin(), token.end(), 'd', 'e');
+            return std::strtod(token.c_str(), nullptr);
+        };
+        std::string line;
+        while (std::getline(file, line))
+        {
+            std::istringstream in(line);
+            std::vector<std::string> tokens;
+            for (std::string token; in >> token;)
+                tokens.push_back(token);
+            if (tokens.size() >= 2 && (tokens[0] == "earth_gravity_constant" || tokens[0] == "gravity_constant"))
+                _μ = number(tokens[1]);
+            if (tokens.size() >= 2 && tokens[0] == "radius")
+                _R = number(tokens[1]);
+            size_t first = !tokens.empty() && tokens[0] == "gfc" ? 1 : 0;
+            if (tokens.size() < first + 4 || !std::isdigit((unsigned char)tokens[first][0]) ||
+                !std::isdigit((unsigned char)tokens[first + 1][0]))
+                continue;
+            term t{std::stoul(tokens[first]), std::stoul(tokens[first + 1]), number(tokens[first + 2]), number(tokens[first + 3])};
+            if (t.m <= t.n && (degree == 0 || t.n <= degree))
+            {
+                terms.push_back(t);
+                loaded = std::max(loaded, t.n);
+            }
+        }
+        if (terms.empty())
+        {
+            fmt::println("ERROR: no coefficient in gravity field file {}", path);
+            return false;
+        }
+        if (loaded > max_degree)
+        {
+            fmt::println("ERROR: gravity field degree limited to {}, got {}", max_degree, loaded);
+            return false;
+        }
+        resize(loaded);
+        for (const term &t : terms)
+            set_coefficient(t.n, t.m, t.C, t.S);
+        return true;
+    }
+
+    /// Binary cache of the coefficients: "GEOPOT01", degree (uint64), μ, R, then C̄ and S̄ by degree
+    bool save_binary(const std::string &path) const
+    {
+        std::ofstream file(path, std::ios::binary);
+        if (!file)
+        {
+            fmt::println("ERROR: cannot write gravity field file {}", path);
+            return false;
+        }
+        uint64_t degree = _n;
+        file.write("GEOPOT01", 8);
+        file.write((const char *)&degree, sizeof(degree));
+        file.write((const char *)&_μ, sizeof(double));
+        file.write((const char *)&_R, sizeof(double));
+        for (size_t n = 0; n <= _n; n++)
+            for (size_t m = 0; m <= n; m++)
+            {
+                double CS[2] = {_C[index(n, m)], _S[index(n, m)]};
+                file.write((const char *)CS, sizeof(CS));
+            }
+        return true;
+    }
+
+    bool load_binary(const std::string &path)
+    {
+        std::ifstream file(path, std::ios::binary);
+        char magic[8];
+        uint64_t degree;
+        if (!file || !file.read(magic, 8) || std::memcmp(magic, "GEOPOT01", 8) != 0 ||
+            !file.read((char *)&degree, sizeof(degree)) || degree > max_degree)
+        {
+            fmt::println("ERROR: {} is not a gravity field binary file", path);
+            return false;
+        }
+        file.read((char *)&_μ, sizeof(double));
+        file.read((char *)&_R, sizeof(double));
+        resize(degree);
+        for (size_t n = 0; n <= _n; n++)
+            for (size_t m = 0; m <= n; m++)
+            {
+                double CS[2];
+                file.read((char *)CS, sizeof(CS));
+                set_coefficient(n, m, CS[0], CS[1]);
+            }
+        if (!file)
+            fmt::println("ERROR: truncated gravity field binary file {}", path);
+        return bool(file);
+    }
+
+    /// Field of the given degree, all coefficients 0 but C̄00 = 1
+    void resize(size_t degree)
+    {
+        _n = std::min(degree, max_degree);
+        _degree = _n;
+        build_tables();
+        set_coefficient(0, 0, 1., 0.);
+    }
+
+    void set_coefficient(size_t n, size_t m, double C, double S)
+    {
+        if (m > n || n > _n)
+        {
+            fmt::println("ERROR: no coefficient ({}, {}) in a field of degree {}", n, m, _n);
+            return;
+        }
+        size_t k = index(n, m);
+        _degree_power[n] -= _C[k] * _C[k] + _S[k] * _S[k];
+        _C[k] = C;
+        _S[k] = m > 0 ? S : 0.;
+        _degree_power[n] += _C[k] * _C[k] + _S[k] * _S[k];
+    }
+    double get_C(size_t n, size_t m) const { return _C[index(n, m)]; }
+    double get_S(size_t n, size_t m) const { return _S[index(n, m)]; }
+    /// J_n = -C̄n0 sqrt(2n + 1)
+    double get_J(size_t n) const { return -_C[index(n, 0)] * std::sqrt(2. * n + 1); }
+
+    /// Evaluates up to degree (at most the loaded one), for instance 2 for J2 only
+    void set_degree(size_t degree) { _degree = std::min(degree, _n); }
+    /// Drops the degrees whose contribution to the acceleration is below tolerance relative to the
+    /// central term, from the degree variances of the field and the attenuation (R/r)^n at the
+    /// position: high orbits evaluate fewer terms. 0 evaluates every degree.
+    void set_truncation_tolerance(double tolerance) { _tolerance = tolerance; }
+    /// Without the central term μ/r (the perturbation only, e.g. for Encke's method)
+    void set_central_term(bool central) { _central = central; }
+    /// Body-fixed frame rotating at ω about z, at angle θ0 from the inertial frame at t = 0: the
+    /// operator() and batched positions are then inertial
+    void set_rotation(double ω, double θ0 = 0)
+    {
+        _ω = ω;
+        _θ0 = θ0;
+    }
+
+    double get_μ() const { return _μ; }
+    double get_radius() const { return _R; }
+    size_t get_degree() const { return _degree; }
+
+    /// Degree evaluated at distance r
+    size_t degree_at(double r) const
+    {
+        if (_tolerance <= 0)
+            return _degree;
+        double q = _R / r, attenuation = 1;
+        size_t degree = 0;
+        for (size_t n = 1; n <= _degree; n++)
+        {
+            attenuation *= q;
+            if ((n + 1) * std::sqrt(std::max(_degree_power[n], 0.)) * attenuation >= _tolerance)
+                degree = n;
+        }
+        return degree;
+    }
+
+    /// Acceleration at the body-fixed position r
+    vec3d acceleration(const vec3d &r) const
+    {
+        vec3d a;
+        evaluate<double>(r.x, r.y, r.z, degree_at(r.norm()), a.x, a.y, a.z, nullptr);
+        return a;
+    }
+
+    /// Gravitational potential U (positive, μ/r for a point mass) at the body-fixed position r
+    double potential(const vec3d &r) const
+    {
+        double ax, ay, az, U;
+        evaluate<double>(r.x, r.y, r.z, degree_at(r.norm()), ax, ay, az, &U);
+        return U;
+    }
+
+    /// Accelerations at many body-fixed positions (inertial at time t with set_rotation), native_lanes
+    /// per pass and the passes split between threads
+    void acceleration(std::span<const vec3d> positions, std::span<vec3d> accelerations, double t = 0) const
+    {
+        constexpr size_t W = native_lanes;
+        using D = double_pack<W>;
+        double c = std::cos(_θ0 + _ω * t), s = std::sin(_θ0 + _ω * t);
+        size_t packs = positions.size() / W;
+        parallel_for(packs, [&](size_t begin, size_t end)
+        {
+            for (size_t p = begin; p < end; p++)
+            {
+                vec3d_pack<W> r = vec3d_pack<W>::gather(positions, p * W), a;
+                D x = c * r.x + s * r.y, y = c * r.y - s * r.x;
+                double r_min = INFINITY;
+                for (size_t l = 0; l < W; l++)
+                    r_min = std::min(r_min, r.get(l).norm());
+                D ax, ay;
+                evaluate<D>(x, y, r.z, degree_at(r_min), ax, ay, a.z, nullptr);
+                a.x = c * ax - s * ay;
+                a.y = s * ax + c * ay;
+                a.scatter(accelerations, p * W);
+            }
+        });
+        for (size_t i = packs * W; i < positions.size(); i++)
+            accelerations[i] = (*this)(t, positions[i]);
+    }
+
+    /// Acceleration at the inertial position r at time t, for solver_degree_II
+    vec3d operator()(double t, const vec3d &r) const
+    {
+        double c = std::cos(_θ0 + _ω * t), s = std::sin(_θ0 + _ω * t);
+        vec3d a = acceleration(vec3d(c * r.x + s * r.y, c * r.y - s * r.x, r.z));
+        return vec3d(c * a.x - s * a.y, s * a.x + c * a.y, a.z);
+    }
+
+    void operator()(double t, const vec3d &r, vec3d &a) const { a = (*this)(t, r); }
+
+private:
+    /// Coefficients are stored by order: column m holds n = m .. degree + 1 (the recursion goes one
+    /// degree beyond the field)
+    size_t index(size_t n, size_t m) const { return _column[m] + n - m; }
+
+    void build_tables()
+    {
+        size_t N = _n + 1; ///< Degrees of the recursion
+        _column.resize(N + 2);
+        size_t size = 0;
+        for (size_t m = 0; m <= N + 1; m++)
+        {
+            _column[m] = size;
+            size += m <= N ? N + 1 - m : 0;
+        }
+        for (std::vector<double> *table : {&_C, &_S, &_a, &_b, &_x1, &_x2, &_zf})
+            table->assign(size, 0.);
+        _sectorial.assign(N + 1, 0.);
+        _degree_power.assign(_n + 1, 0.);
+        for (size_t m = 0; m <= N; m++)
+        {
+            _sectorial[m] = m == 0 ? 1 : m == 1 ? std::sqrt(3.) : std::sqrt((2. * m + 1) / (2. * m));
+            for (size_t n = m + 1; n <= N; n++)
+            {
+                double dn = n, dm = m;
+                _a[index(n, m)] = std::sqrt((2 * dn + 1) * (2 * dn - 1) / ((dn - dm) * (dn + dm)));
+                if (n >= m + 2)
+                    _b[index(n, m)] = std::sqrt((2 * dn + 1) * (dn + dm - 1) * (dn - dm - 1) / ((dn - dm) * (dn + dm) * (2 * dn - 3)));
+            }
+            /// Normalization ratios of the acceleration terms, with the 1/2 of the m > 0 terms
+            for (size_t n = m; n < N; n++)
+            {
+                double dn = n, dm = m, k = (2 * dn + 1) / (2 * dn + 3);
+                _x1[index(n, m)] = std::sqrt((m == 0 ? 0.5 : 1.) * k * (dn + dm + 1) * (dn + dm + 2)) * (m == 0 ? 1. : 0.5);
+                if (m > 0)
+                    _x2[index(n, m)] = std::sqrt((m == 1 ? 2. : 1.) * k * (dn - dm + 2) * (dn - dm + 1)) * 0.5;
+                _zf[index(n, m)] = std::sqrt(k * (dn + dm + 1) * (dn - dm + 1));
+            }
+        }
+    }
+
+    /// Acceleration (and potential when U is not null) up to degree n_max at the body-fixed (x, y, z)
+    template <typename D>
+    void evaluate(const D &x, const D &y, const D &z, size_t n_max, D &ax, D &ay, D &az, D *U) const
+    {
+        size_t N = n_max + 1;
+        thread_local std::vector<D> buffer;
+        buffer.resize(6 * (_n + 2));
+        D *V[3] = {&buffer[0], &buffer[_n + 2], &buffer[2 * (_n + 2)]}; ///< Columns m - 1, m, m + 1
+        D *Wc[3] = {&buffer[3 * (_n + 2)], &buffer[4 * (_n + 2)], &buffer[5 * (_n + 2)]};
+
+        D r2 = x * x + y * y + z * z;
+        D inv_r2 = 1. / r2;
+        D ρ = _R * inv_r2;
+        D xr = x * ρ, yr = y * ρ, zr = z * ρ, R2r2 = _R * ρ;
+        D Vd = _R * sqrt(inv_r2), Wd(0.); ///< V̄mm, W̄mm of the current diagonal
+
+        /// Column m from its diagonal term
+        auto column = [&](size_t m, D *Vm, D *Wm)
+        {
+            Vm[m] = Vd;
+            Wm[m] = Wd;
+            if (m + 1 <= N)
+            {
+                Vm[m + 1] = _a[index(m + 1, m)] * zr * Vd;
+                Wm[m + 1] = _a[index(m + 1, m)] * zr * Wd;
+            }
+            for (size_t n = m + 2; n <= N; n++)
+            {
+                double a = _a[index(n, m)], b = _b[index(n, m)];
+                Vm[n] = a * zr * Vm[n - 1] - b * R2r2 * Vm[n - 2];
+                Wm[n] = a * zr * Wm[n - 1] - b * R2r2 * Wm[n - 2];
+            }
+        };
+        auto next_diagonal = [&](size_t m)
+        {
+            double c = _sectorial[m];
+            D V_next = c * (xr * Vd - yr * Wd);
+            Wd = c * (xr * Wd + yr * Vd);
+            Vd = V_next;
+        };
+
+        column(0, V[1], Wc[1]);
+        next_diagonal(1);
+        column(1, V[2], Wc[2]);
+        D sx(0.), sy(0.), sz(0.), sU(0.);
+        for (size_t m = 0; m <= n_max; m++)
+        {
+            const D *Vm1 = V[0], *Wm1 = Wc[0], *Vm = V[1], *Wm = Wc[1], *Vp = V[2], *Wp = Wc[2];
+            const double *C = &_C[index(m, m)] - m, *S = &_S[index(m, m)] - m; ///< Indexed by n
+            const double *x1 = &_x1[index(m, m)] - m, *x2 = &_x2[index(m, m)] - m, *zf = &_zf[index(m, m)] - m;
+            size_t n0 = std::max<size_t>(m, _central ? 0 : 1);
+            if (m == 0)
+                for (size_t n = n0; n <= n_max; n++)
+                {
+                    sx -= C[n] * x1[n] * Vp[n + 1];
+                    sy -= C[n] * x1[n] * Wp[n + 1];
+                    sz -= C[n] * zf[n] * Vm[n + 1];
+                }
+            else
+                for (size_t n = n0; n <= n_max; n++)
+                {
+                    sx += x1[n] * (-C[n] * Vp[n + 1] - S[n] * Wp[n + 1]) + x2[n] * (C[n] * Vm1[n + 1] + S[n] * Wm1[n + 1]);
+                    sy += x1[n] * (S[n] * Vp[n + 1] - C[n] * Wp[n + 1]) + x2[n] * (S[n] * Vm1[n + 1] - C[n] * Wm1[n + 1]);
+                    sz -= zf[n] * (C[n] * Vm[n + 1] + S[n] * Wm[n + 1]);
+                }
+            if (U)
+                for (size_t n = n0; n <= n_max; n++)
+                    sU += C[n] * Vm[n] + S[n] * Wm[n];
+            /// Rotates the columns and computes column m + 2
+            std::swap(V[0], V[1]);
+            std::swap(V[1], V[2]);
+            std::swap(Wc[0], Wc[1]);
+            std::swap(Wc[1], Wc[2]);
+            if (m + 2 <= N)
+            {
+                next_diagonal(m + 2);
+                column(m + 2, V[2], Wc[2]);
+            }
+        }
+        double k = _μ / (_R * _R);
+        ax = k * sx;
+        ay = k * sy;
+        az = k * sz;
+        if (U)
+            *U = _μ / _R * sU;
+    }
+
+    double _μ, _R;
+    size_t _n = 0;      ///< Degree of the coefficients
+    size_t _degree = 0; ///< Degree evaluated
+    double _tolerance = 0;
+    bool _central = true;
+    double _ω = 0, _θ0 = 0;
+    std::vector<size_t> _column;
+    std::vector<double> _C, _S;
+    std::vector<double> _a, _b;           ///< Recursion factors
+    std::vector<double> _x1, _x2, _zf;    ///< Acceleration factors
+    std::vector<double> _sectorial;       ///< c_m
+    std::vector<double> _degree_power; ///< Σ_m C̄nm² + S̄nm², for set_truncation_tolerance
+};
@@ -1,30 +1,52 @@
 #pragma once
+#include <span>
+#include <vector>
 #include "../solver/coordinates.h"
+#include "kepler_equation.h"
+#include "universal_kepler.h"
+
+struct orbit_state
+{
+    xy position;
+    xy velocity;
+};
 
 class orbit
 {
 public:
     orbit(double M, double m, double G = 6.67430e-11) : M(M), m(m), G(G) {}
 
-    void set_from_current_state(xy position, xy velocity)
+    /// t is the epoch of the state, used as the time origin of state_at
+    void set_from_current_state(xy position, xy velocity, double t = 0)
     {
+        double μ = G * M;
         double r = position.norm();
         double v2 = velocity.dot(velocity);
-        xy er = position.normalized();
-        double v_rad = velocity.dot(er);
-        double v_ortho = sqrt(v2 - v_rad * v_rad);
+        double h = position[0] * velocity[1] - position[1] * velocity[0];
+        xy e_vec = ((v2 - μ / r) * position - position.dot(velocity) * velocity) / μ;
         double θ = atan2(position[1], position[0]);
-        a = r / (2 - r * v2 / (G * M));
-        p = r * r * v_ortho * v_ortho / (G * M);
-        e = sqrt(1 - p / a);
-        if (e != 0)
-            θ0 = θ - acos((p - r) / (r * e));
+        a = r / (2 - r * v2 / μ);
+        p = h * h / μ;
+        e = e_vec.norm();
+        θ0 = e != 0 ? atan2(e_vec[1], e_vec[0]) : θ; ///< Circular orbits are measured from the current position
+        direction = h < 0 ? -1 : 1;
+        t0 = t;
+        r0 = position;
+        v0 = velocity;
+        if (e < 1)
+        {
+            n = sqrt(μ / (a * a * a));
+            double ν = direction * (θ - θ0);
+            double E = atan2(sqrt(1 - e * e) * sin(ν), e + cos(ν));
+            M0 = E - e * sin(E);
+        }
     };
 
     double get_period()
     {
         return 2 * M_PI * sqrt(a * a * a / (G * M));
     }
+    double get_gravitational_parameter() const { return G * M; }
     double get_parameter() { return p; }
     double get_semi_major_axis() { return a; }
     double get_semi_minor_axis() { return a * sqrt(1 - e * e); }
@@ -44,7 +66,103 @@ public:
         return polar_to_cart(position);
     }
 
+    /// Position and velocity at time t, from the solution of Kepler's equation (no integration).
+    /// Parabolic and hyperbolic orbits go through the universal variable formulation.
+    orbit_state state_at(double t) const
+    {
+        orbit_state state;
+        if (e >= 1)
+        {
+            universal_kepler<xy>(r0, v0, G * M, t0).state_at(t, state.position, state.velocity);
+            return state;
+        }
+        double sinE, cosE;
+        solve_kepler(M0 + n * (t - t0), e, sinE, cosE);
+        anomaly_to_state(sinE, cosE, state.position[0], state.position[1], state.velocity[0], state.velocity[1]);
+        return state;
+    }
+
+    /// Batched state_at: Kepler's equation is solved for native_lanes epochs at a time
+    void state_at(std::span<const double> t, std::span<xy> positions, std::span<xy> velocities) const
+    {
+        if (e >= 1)
+        {
+            universal_kepler<xy>(r0, v0, G * M, t0).state_at(t, positions, velocities);
+            return;
+        }
+        sample(t.size(), [&](size_t i) { return t[i]; }, positions, velocities);
+    }
+
+    /// Time-parameterized trajectory: positions.size() states uniformly spaced from t_begin to t_end
+    /// (both included), written into the caller's buffers. With t_begin, t_end and N + 1 points equal
+    /// to an integrator's t0, tf and N steps, the samples match its output pointwise.
+    void get_trajectory(double t_begin, double t_end, std::span<xy> positions, std::span<xy> velocities) const
+    {
+        if (e >= 1)
+        {
+            universal_kepler<xy>(r0, v0, G * M, t0).state_at(t_begin, t_end, positions, velocities);
+            return;
+        }
+        double dt = positions.size() > 1 ? (t_end - t_begin) / (positions.size() - 1) : 0;
+        sample(positions.size(), [&](size_t i) { return t_begin + i * dt; }, positions, velocities);
+    }
+
+    std::vector<orbit_state> state_at(std::span<const double> t) const
+    {
+        std::vector<xy> positions(t.size());
+        std::vector<xy> velocities(t.size());
+        state_at(t, positions, velocities);
+        std::vector<orbit_state> states(t.size());
+        for (size_t i = 0; i < t.size(); i++)
+            states[i] = {positions[i], velocities[i]};
+        return states;
+    }
+
 private:
+    template <typename Time>
+    void sample(size_t count, Time time, std::span<xy> positions, std::span<xy> velocities) const
+    {
+        constexpr size_t W = native_lanes;
+        size_t i = 0;
+        for (; i + W <= count; i += W)
+        {
+            double_pack<W> t, sinE, cosE, x, y, vx, vy;
+            for (size_t j = 0; j < W; j++)
+                t[j] = time(i + j);
+            solve_kepler(M0 + n * (t - t0), e, sinE, cosE);
+            anomaly_to_state(sinE, cosE, x, y, vx, vy);
+            for (size_t j = 0; j < W; j++)
+            {
+                positions[i + j] = {x[j], y[j]};
+                velocities[i + j] = {vx[j], vy[j]};
+            }
+        }
+        for (; i < count; i++)
+        {
+            orbit_state state = state_at(time(i));
+            positions[i] = state.position;
+            velocities[i] = state.velocity;
+        }
+    }
+
+    /// Perifocal position and velocity from the eccentric anomaly, rotated by θ0 into the xy frame
+    template <typename D>
+    void anomaly_to_state(const D &sinE, const D &cosE, D &x, D &y, D &vx, D &vy) const
+    {
+        double b = a * sqrt(1 - e * e);
+        double c = cos(θ0);
+        double s = sin(θ0);
+        D x_p = a * (cosE - e);
+        D y_p = direction * b * sinE;
+        D k = n / (1. - e * cosE);
+        D vx_p = -a * k * sinE;
+        D vy_p = direction * b * k * cosE;
+        x = c * x_p - s * y_p;
+        y = s * x_p + c * y_p;
+        vx = c * vx_p - s * vy_p;
+        vy = s * vx_p + c * vy_p;
+    }
+
     double a = 1;
     double p = 1;
     double e = 0;
@@ -52,4 +170,10 @@ private:
     double M = 1;
     double m = 1;
     double θ0 = 0;
+    double direction = 1; ///< Sign of the angular momentum, -1 for clockwise orbits
+    double t0 = 0;
+    double n = 1;  ///< Mean motion
+    double M0 = 0; ///< Mean anomaly at t0
+    xy r0 = {1., 0.}; ///< State at t0
+    xy v0 = {0., 1.};
 };
\ No newline at end of file
@@ -0,0 +1,302 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <span>
+#include <vector>
+#include <Eigen/Dense>
+#include "math/parallel.h"
+#include "math/vec3d.h"
+#include "kepler_orbit.h"
+
+/// Transfer arc between r1 and r2: velocity at departure and at arrival
+struct lambert_arc
+{
+    vec3d v1;
+    vec3d v2;
+    size_t revolutions; ///< Number of complete revolutions before arrival
+};
+
+/// Lambert's problem (which conic joins r1 to r2 in a given time of flight), solved with Izzo's
+/// algorithm (Revisiting Lambert's problem, 2015): the time of flight is written as a function of
+/// a single variable x and inverted with Householder iterations, which converge in 2 to 3
+/// iterations for every geometry including the multi-revolution branches.
+class lambert_problem
+{
+public:
+    lambert_problem(const vec3d &r1, const vec3d &r2, double tof, double μ, bool prograde = true)
+        : _r1_norm(r1.norm()), _r2_norm(r2.norm())
+    {
+        double c = (r2 - r1).norm();
+        double s = (c + _r1_norm + _r2_norm) / 2;
+        _ir1 = r1 / _r1_norm;
+        _ir2 = r2 / _r2_norm;
+
+        /// Normal of the transfer plane, any normal when r1 and r2 are collinear
+        vec3d ih = _ir1.cross(_ir2);
+        double ih_norm = ih.norm();
+        if (ih_norm > 1e-12)
+            ih /= ih_norm;
+        else
+        {
+            ih = std::abs(_ir1.z) < 0.9 ? vec3d(0., 0., 1.) : vec3d(1., 0., 0.);
+            ih -= ih.dot(_ir1) * _ir1;
+            ih.normalize();
+        }
+
+        _λ = std::sqrt(std::max(0., 1 - c / s));
+        if (ih.z < 0)
+        {
+            _λ = -_λ;
+            _it1 = _ir1.cross(ih);
+            _it2 = _ir2.cross(ih);
+        }
+        else
+        {
+            _it1 = ih.cross(_ir1);
+            _it2 = ih.cross(_ir2);
+        }
+        if (!prograde)
+        {
+            _λ = -_λ;
+            _it1 = -_it1;
+            _it2 = -_it2;
+        }
+
+        _T = std::sqrt(2 * μ / (s * s * s)) * tof;
+        _γ = std::sqrt(μ * s / 2);
+        _ρ = c > 0 ? (_r1_norm - _r2_norm) / c : 0;
+        _σ = std::sqrt(1 - _ρ * _ρ);
+    }
+
+    /// Writes the single revolution arc, then the left and right branches of every multi-revolution
+    /// count up to max_revolutions that exists for this time of flight. Returns the number of arcs,
+    /// at most arcs.size().
+    size_t solve(std::span<lambert_arc> arcs, size_t max_revolutions = 0) const
+    {
+        if (!(_T > 0) || arcs.empty())
+            return 0;
+
+        /// Largest revolution count reachable in T: the minimum time of flight of the last branch
+        /// is found with Halley iterations on dT/dx = 0
+        size_t n_max = (size_t)std::floor(_T / M_PI);
+        double T00 = std::acos(_λ) + _λ * std::sqrt(1 - _λ * _λ);
+        if (n_max > 0 && _T < T00 + n_max * M_PI)
+        {
+            double x = 0;
+            double T_min = T00 + n_max * M_PI;
+            for (size_t i = 0; i < 12; i++)
+            {
+                double dT, d2T, d3T;
+                derivatives(x, T_min, dT, d2T, d3T);
+                double x_new = dT != 0 ? x - dT * d2T / (d2T * d2T - dT * d3T / 2) : x;
+                bool converged = std::abs(x_new - x) < 1e-13;
+                x = x_new;
+                T_min = time_of_flight(x, n_max);
+                if (converged)
+                    break;
+            }
+            if (T_min > _T)
+                n_max--;
+        }
+        n_max = std::min({n_max, max_revolutions, (arcs.size() - 1) / 2});
+
+        /// Single revolution, with the starter of Izzo's paper
+        double T1 = 2. / 3. * (1 - _λ * _λ * _λ);
+        double x0;
+        if (_T >= T00)
+            x0 = -(_T - T00) / (_T - T00 + 4);
+        else if (_T <= T1)
+            x0 = T1 * (T1 - _T) / (2. / 5. * (1 - std::pow(_λ, 5)) * _T) + 1;
+        else
+            x0 = std::pow(_T / T00, M_LN2 / std::log(T1 / T00)) - 1;
+        arcs[0] = arc(householder(x0, 0, 1e-5), 0);
+
+        size_t count = 1;
+        for (size_t n = 1; n <= n_max; n++)
+        {
+            double left = std::pow((n * M_PI + M_PI) / (8 * _T), 2. / 3.);
+            double right = std::pow(8 * _T / (n * M_PI), 2. / 3.);
+            arcs[count++] = arc(householder((left - 1) / (left + 1), n, 1e-8), n);
+            arcs[count++] = arc(householder((right - 1) / (right + 1), n, 1e-8), n);
+        }
+        return count;
+    }
+
+    std::vector<lambert_arc> solve(size_t max_revolutions = 0) const
+    {
+        std::vector<lambert_arc> arcs(2 * max_revolutions + 1);
+        arcs.resize(solve(arcs, max_revolutions));
+        return arcs;
+    }
+
+private:
+    double householder(double x, size_t revolutions, double tolerance) const
+    {
+        for (size_t i = 0; i < 15; i++)
+        {
+            double T = time_of_flight(x, revolutions);
+            double dT, d2T, d3T;
+            derivatives(x, T, dT, d2T, d3T);
+            double δ = T - _T;
+            double dT2 = dT * dT;
+            double x_new = x - δ * (dT2 - δ * d2T / 2) / (dT * (dT2 - δ * d2T) + d3T * δ * δ / 6);
+            double error = std::abs(x - x_new);
+            x = x_new;
+            if (error < tolerance)
+                break;
+        }
+        return x;
+    }
+
+    /// First three derivatives of the non-dimensional time of flight with respect to x
+    void derivatives(double x, double T, double &dT, double &d2T, double &d3T) const
+    {
+        double λ2 = _λ * _λ;
+        double λ3 = λ2 * _λ;
+        double umx2 = 1 - x * x;
+        double y = std::sqrt(1 - λ2 * umx2);
+        double y2 = y * y;
+        double y3 = y2 * y;
+        dT = (3 * T * x - 2 + 2 * λ3 * x / y) / umx2;
+        d2T = (3 * T + 5 * x * dT + 2 * (1 - λ2) * λ3 / y3) / umx2;
+        d3T = (7 * x * d2T + 8 * dT - 6 * (1 - λ2) * λ2 * λ3 * x / y3 / y2) / umx2;
+    }
+
+    /// Non-dimensional time of flight: Battin's series close to x = 1 (parabola), Lagrange's
+    /// equation a bit further, Lancaster's expression elsewhere
+    double time_of_flight(double x, size_t revolutions) const
+    {
+        double distance = std::abs(x - 1);
+        if (distance < 0.2 && distance > 0.01)
+            return time_of_flight_lagrange(x, revolutions);
+
+        double E = x * x - 1;
+        double ρ = std::abs(E);
+        double z = std::sqrt(1 + _λ * _λ * E);
+        if (distance < 0.01)
+        {
+            double η = z - _λ * x;
+            double S1 = 0.5 * (1 - _λ - x * η);
+            double Q = 4. / 3. * hypergeometric_F(S1, 1e-11);
+            return (η * η * η * Q + 4 * _λ * η) / 2 + revolutions * M_PI / std::pow(ρ, 1.5);
+        }
+        double y = std::sqrt(ρ);
+        double g = x * z - _λ * E;
+        double d;
+        if (E < 0)
+            d = revolutions * M_PI + std::acos(std::clamp(g, -1., 1.));
+        else
+            d = std::log(y * (z - _λ * x) + g);
+        return (x - _λ * z - d / y) / E;
+    }
+
+    double time_of_flight_lagrange(double x, size_t revolutions) const
+    {
+        double a = 1 / (1 - x * x);
+        if (a > 0)
+        {
+            double α = 2 * std::acos(x);
+            double β = std::copysign(2 * std::asin(std::sqrt(_λ * _λ / a)), _λ);
+            return a * std::sqrt(a) * ((α - std::sin(α)) - (β - std::sin(β)) + 2 * M_PI * revolutions) / 2;
+        }
+        double α = 2 * std::acosh(x);
+        double β = std::copysign(2 * std::asinh(std::sqrt(-_λ * _λ / a)), _λ);
+        return -a * std::sqrt(-a) * ((β - std::sinh(β)) - (α - std::sinh(α))) / 2;
+    }
+
+    /// Gauss hypergeometric function 2F1(3, 1, 5/2, z)
+    static double hypergeometric_F(double z, double tolerance)
+    {
+        double S = 1;
+        double C = 1;
+        for (size_t j = 0; std::abs(C) > tolerance && j < 1000; j++)
+        {
+            C *= (3 + j) * (1 + j) / (2.5 + j) * z / (j + 1);
+            S += C;
+        }
+        return S;
+    }
+
+    lambert_arc arc(double x, size_t revolutions) const
+    {
+        double y = std::sqrt(1 - _λ * _λ + _λ * _λ * x * x);
+        double vr1 = _γ * ((_λ * y - x) - _ρ * (_λ * y + x)) / _r1_norm;
+        double vr2 = -_γ * ((_λ * y - x) + _ρ * (_λ * y + x)) / _r2_norm;
+        double vt = _γ * _σ * (y + _λ * x);
+        return {vr1 * _ir1 + vt / _r1_norm * _it1, vr2 * _ir2 + vt / _r2_norm * _it2, revolutions};
+    }
+
+    double _r1_norm;
+    double _r2_norm;
+    vec3d _ir1, _ir2; ///< Radial directions
+    vec3d _it1, _it2; ///< Tangential directions, in the direction of motion
+    double _λ;
+    double _T; ///< Non-dimensional time of flight
+    double _γ;
+    double _ρ;
+    double _σ;
+};
+
+inline std::vector<lambert_arc> solve_lambert(const vec3d &r1, const vec3d &r2, double tof, double μ, size_t max_revolutions = 0, bool prograde = true)
+{
+    return lambert_problem(r1, r2, tof, μ, prograde).solve(max_revolutions);
+}
+
+/// States of a body at a list of dates
+struct ephemeris
+{
+    std::span<const double> t;
+    std::span<const vec3d> r;
+    std::span<const vec3d> v;
+};
+
+/// Porkchop plot data: Δv(i, j) is the smallest |v1 - v_departure| + |v_arrival - v2| over the prograde
+/// arcs (up to max_revolutions) leaving at departure.t[i] and arriving at arrival.t[j], NaN when
+/// arrival is not after departure. Arrival dates are split between threads, so each thread fills
+/// whole columns of the (column-major) matrix.
+inline void porkchop(const ephemeris &departure, const ephemeris &arrival, double μ, Eigen::MatrixXd &Δv, size_t max_revolutions = 0)
+{
+    Δv.resize(departure.t.size(), arrival.t.size());
+    parallel_for(arrival.t.size(), [&](size_t begin, size_t end)
+    {
+        std::vector<lambert_arc> arcs(2 * max_revolutions + 1);
+        for (size_t j = begin; j < end; j++)
+        {
+            for (size_t i = 0; i < departure.t.size(); i++)
+            {
+                double tof = arrival.t[j] - departure.t[i];
+                double best = NAN;
+                if (tof > 0)
+                {
+                    size_t count = lambert_problem(departure.r[i], arrival.r[j], tof, μ).solve(arcs, max_revolutions);
+                    for (size_t k = 0; k < count; k++)
+                        best = std::fmin(best, (arcs[k].v1 - departure.v[i]).norm() + (arrival.v[j] - arcs[k].v2).norm());
+                }
+                Δv(i, j) = best;
+            }
+        }
+    });
+}
+
+/// Porkchop between two coplanar orbits around the same body. Their states at every date come
+/// from the batched (vectorized) Kepler solve of orbit::state_at.
+inline void porkchop(const orbit &departure, std::span<const double> t_departure, const orbit &arrival, std::span<const double> t_arrival, Eigen::MatrixXd &Δv, size_t max_revolutions = 0)
+{
+    auto states = [](const orbit &body, std::span<const double> t, std::vector<vec3d> &r, std::vector<vec3d> &v)
+    {
+        std::vector<xy> positions(t.size());
+        std::vector<xy> velocities(t.size());
+        body.state_at(t, positions, velocities);
+        r.resize(t.size());
+        v.resize(t.size());
+        for (size_t i = 0; i < t.size(); i++)
+        {
+            r[i] = vec3d(positions[i][0], positions[i][1], 0.);
+            v[i] = vec3d(velocities[i][0], velocities[i][1], 0.);
+        }
+    };
+    std::vector<vec3d> r_departure, v_departure, r_arrival, v_arrival;
+    states(departure, t_departure, r_departure, v_departure);
+    states(arrival, t_arrival, r_arrival, v_arrival);
+    porkchop({t_departure, r_departure, v_departure}, {t_arrival, r_arrival, v_arrival}, departure.get_gravitational_parameter(), Δv, max_revolutions);
+}
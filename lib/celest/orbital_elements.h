@@ -0,0 +1,297 @@
+#pragma once
+#include <cmath>
+#include <span>
+#include <type_traits>
+#include "math/double_pack.h"
+#include "math/fast_trig.h"
+#include "math/vec3d.h"
+#include "math/vec_pack.h"
+
+/// 3D orbital elements and their conversions from/to Cartesian states. Every conversion is written
+/// once for (vec3d, double) and (vec3d_pack<W>, double_pack<W>) and is branch-free, so the batched
+/// versions below convert native_lanes states per iteration. Angles are in radians.
+
+/// Loads / stores the double (or the pack of lanes) at index j of an element history
+template <typename D>
+D load_lanes(std::span<const double> src, size_t j)
+{
+    if constexpr (std::is_same_v<D, double>)
+        return src[j];
+    else
+        return D::load(&src[j]);
+}
+
+template <typename D>
+void store_lanes(const D &x, std::span<double> dst, size_t j)
+{
+    if constexpr (std::is_same_v<D, double>)
+        dst[j] = x;
+    else
+        x.store(&dst[j]);
+}
+
+/// vec3d or vec3d_pack<W>: keeps the scalar templates from matching containers of states, which go
+/// to the batched overloads below
+template <typename V>
+concept state_vector = requires(const V &x) { x.cross(x); };
+
+/// Wraps an angle from (-π, π] to [0, 2π). A tiny negative angle rounds to 2π when shifted, and is
+/// mapped to 0 instead (ω of circular orbits is ±ε)
+template <typename D>
+D wrap_angle(const D &x)
+{
+    D y = select(x < 0., x + 2 * M_PI, x);
+    return select(y >= 2 * M_PI, y - 2 * M_PI, y);
+}
+
+/// Classical elements. Hyperbolic orbits have a < 0 and e > 1. Ω and ω are in [0, 2π), ν in (-π, π].
+/// Ω = 0 for equatorial orbits and ω = 0 for circular orbits, where they are undefined.
+template <typename D = double>
+struct classical_elements
+{
+    D a; ///< Semi-major axis
+    D e; ///< Eccentricity
+    D i; ///< Inclination
+    D Ω; ///< Longitude of the ascending node
+    D ω; ///< Argument of periapsis
+    D ν; ///< True anomaly
+
+    static classical_elements load(const classical_elements<std::span<const double>> &src, size_t j)
+    {
+        return {load_lanes<D>(src.a, j), load_lanes<D>(src.e, j), load_lanes<D>(src.i, j),
+                load_lanes<D>(src.Ω, j), load_lanes<D>(src.ω, j), load_lanes<D>(src.ν, j)};
+    }
+
+    void store(const classical_elements<std::span<double>> &dst, size_t j) const
+    {
+        store_lanes(a, dst.a, j);
+        store_lanes(e, dst.e, j);
+        store_lanes(i, dst.i, j);
+        store_lanes(Ω, dst.Ω, j);
+        store_lanes(ω, dst.ω, j);
+        store_lanes(ν, dst.ν, j);
+    }
+};
+
+/// Modified equinoctial elements (Walker, Ireland & Owens 1985). Non-singular for circular and
+/// equatorial orbits and valid for every conic; only retrograde equatorial orbits (i = π) are excluded.
+template <typename D = double>
+struct equinoctial_elements
+{
+    D p; ///< Semi-latus rectum
+    D f; ///< e cos(Ω + ω)
+    D g; ///< e sin(Ω + ω)
+    D h; ///< tan(i/2) cos(Ω)
+    D k; ///< tan(i/2) sin(Ω)
+    D L; ///< True longitude Ω + ω + ν, in [0, 2π)
+
+    static equinoctial_elements load(const equinoctial_elements<std::span<const double>> &src, size_t j)
+    {
+        return {load_lanes<D>(src.p, j), load_lanes<D>(src.f, j), load_lanes<D>(src.g, j),
+                load_lanes<D>(src.h, j), load_lanes<D>(src.k, j), load_lanes<D>(src.L, j)};
+    }
+
+    void store(const equinoctial_elements<std::span<double>> &dst, size_t j) const
+    {
+        store_lanes(p, dst.p, j);
+        store_lanes(f, dst.f, j);
+        store_lanes(g, dst.g, j);
+        store_lanes(h, dst.h, j);
+        store_lanes(k, dst.k, j);
+        store_lanes(L, dst.L, j);
+    }
+};
+
+template <typename V>
+V eccentricity_vector(const V &r, const V &v, double μ)
+{
+    auto r_norm = r.norm();
+    return ((v.dot(v) - μ / r_norm) * r - r.dot(v) * v) / μ;
+}
+
+template <state_vector V, typename D = decltype(std::declval<V>().norm())>
+classical_elements<D> state_to_classical(const V &r, const V &v, double μ)
+{
+    using std::sqrt;
+    V h = r.cross(v);
+    D h_norm = h.norm();
+    D h_xy = sqrt(h.x * h.x + h.y * h.y);
+    V e_vec = eccentricity_vector(r, v, μ);
+    D e = e_vec.norm();
+
+    /// Line of nodes ẑ × h, replaced by x̂ for equatorial orbits
+    auto equatorial = h_xy < 1e-12 * h_norm;
+    V node(select(equatorial, h_norm, -h.y), select(equatorial, D(0.), h.x), D(0.));
+
+    /// Periapsis direction, replaced by the line of nodes for circular orbits
+    auto circular = e < 1e-12;
+    V periapsis(select(circular, node.x, e_vec.x), select(circular, node.y, e_vec.y), select(circular, D(0.), e_vec.z));
+
+    classical_elements<D> out;
+    out.a = 1. / (2. / r.norm() - v.dot(v) / μ);
+    out.e = e;
+    out.i = fast_atan2(h_xy, h.z);
+    out.Ω = wrap_angle(fast_atan2(node.y, node.x));
+    out.ω = wrap_angle(fast_atan2(periapsis.dot(h.cross(node)) / h_norm, periapsis.dot(node)));
+    out.ν = fast_atan2(r.dot(h.cross(periapsis)) / h_norm, r.dot(periapsis));
+    return out;
+}
+
+template <state_vector V, typename D>
+void classical_to_state(const classical_elements<D> &elements, double μ, V &r, V &v)
+{
+    using std::sqrt;
+    D sinΩ, cosΩ, sinω, cosω, sin_i, cos_i, sinν, cosν;
+    fast_sincos(elements.Ω, sinΩ, cosΩ);
+    fast_sincos(elements.ω, sinω, cosω);
+    fast_sincos(elements.i, sin_i, cos_i);
+    fast_sincos(elements.ν, sinν, cosν);
+
+    /// Perifocal axes (towards periapsis, and 90° ahead in the orbit plane)
+    V P(cosΩ * cosω - sinΩ * sinω * cos_i, sinΩ * cosω + cosΩ * sinω * cos_i, sinω * sin_i);
+    V Q(-cosΩ * sinω - sinΩ * cosω * cos_i, -sinΩ * sinω + cosΩ * cosω * cos_i, cosω * sin_i);
+
+    D p = elements.a * (1. - elements.e * elements.e);
+    D r_norm = p / (1. + elements.e * cosν);
+    D k = sqrt(μ / p);
+    r = (r_norm * cosν) * P + (r_norm * sinν) * Q;
+    v = (-k * sinν) * P + (k * (elements.e + cosν)) * Q;
+}
+
+/// Equinoctial reference frame (f̂, ĝ) from h and k
+template <typename V, typename D>
+void equinoctial_frame(const D &h, const D &k, V &f_hat, V &g_hat)
+{
+    D s2 = 1. / (1. + h * h + k * k);
+    D hk = 2. * h * k * s2;
+    f_hat = V((1. - k * k + h * h) * s2, hk, -2. * k * s2);
+    g_hat = V(hk, (1. + k * k - h * h) * s2, 2. * h * s2);
+}
+
+template <state_vector V, typename D = decltype(std::declval<V>().norm())>
+equinoctial_elements<D> state_to_equinoctial(const V &r, const V &v, double μ)
+{
+    V h = r.cross(v);
+    D h_norm = h.norm();
+    D scale = 1. / (h_norm + h.z); ///< 1 / (|h| (1 + cos i))
+    V e_vec = eccentricity_vector(r, v, μ);
+
+    equinoctial_elements<D> out;
+    out.p = h.dot(h) / μ;
+    out.h = -h.y * scale;
+    out.k = h.x * scale;
+    V f_hat, g_hat;
+    equinoctial_frame(out.h, out.k, f_hat, g_hat);
+    out.f = e_vec.dot(f_hat);
+    out.g = e_vec.dot(g_hat);
+    out.L = wrap_angle(fast_atan2(r.dot(g_hat), r.dot(f_hat)));
+    return out;
+}
+
+template <state_vector V, typename D>
+void equinoctial_to_state(const equinoctial_elements<D> &elements, double μ, V &r, V &v)
+{
+    using std::sqrt;
+    D sinL, cosL;
+    fast_sincos(elements.L, sinL, cosL);
+    V f_hat, g_hat;
+    equinoctial_frame(elements.h, elements.k, f_hat, g_hat);
+
+    D r_norm = elements.p / (1. + elements.f * cosL + elements.g * sinL);
+    D k = sqrt(μ / elements.p);
+    r = (r_norm * cosL) * f_hat + (r_norm * sinL) * g_hat;
+    v = (-k * (elements.g + sinL)) * f_hat + (k * (elements.f + cosL)) * g_hat;
+}
+
+template <typename D>
+equinoctial_elements<D> classical_to_equinoctial(const classical_elements<D> &elements)
+{
+    D sinΩ, cosΩ, sinϖ, cosϖ, sin_i, cos_i;
+    fast_sincos(elements.Ω, sinΩ, cosΩ);
+    fast_sincos(elements.Ω + elements.ω, sinϖ, cosϖ);
+    fast_sincos(elements.i, sin_i, cos_i);
+    D tan_half_i = sin_i / (1. + cos_i);
+
+    equinoctial_elements<D> out;
+    out.p = elements.a * (1. - elements.e * elements.e);
+    out.f = elements.e * cosϖ;
+    out.g = elements.e * sinϖ;
+    out.h = tan_half_i * cosΩ;
+    out.k = tan_half_i * sinΩ;
+    D L = elements.Ω + elements.ω + elements.ν;
+    out.L = L - 2 * M_PI * round_nearest(L * (0.5 / M_PI) - 0.5); ///< [0, 2π)
+    return out;
+}
+
+/// Same conventions as state_to_classical: Ω = 0 for equatorial and ω = 0 for circular orbits
+template <typename D>
+classical_elements<D> equinoctial_to_classical(const equinoctial_elements<D> &elements)
+{
+    using std::sqrt;
+    D e = sqrt(elements.f * elements.f + elements.g * elements.g);
+    D tan_half_i = sqrt(elements.h * elements.h + elements.k * elements.k);
+    D Ω = fast_atan2(elements.k, elements.h);
+    D ϖ = select(e < 1e-12, Ω, fast_atan2(elements.g, elements.f)); ///< Longitude of periapsis Ω + ω
+
+    classical_elements<D> out;
+    out.a = elements.p / (1. - e * e);
+    out.e = e;
+    out.i = 2. * fast_atan2(tan_half_i, D(1.));
+    out.Ω = wrap_angle(Ω);
+    out.ω = wrap_angle(ϖ - Ω - 2 * M_PI * round_nearest((ϖ - Ω) * (0.5 / M_PI)));
+    D ν = elements.L - ϖ;
+    out.ν = ν - 2 * M_PI * round_nearest(ν * (0.5 / M_PI));
+    return out;
+}
+
+/// Batched conversions between state histories and element histories stored as one span per element
+/// (structure of arrays), e.g. the osculating elements along a trajectory returned by a solver.
+inline void state_to_classical(std::span<const vec3d> r, std::span<const vec3d> v, double μ, const classical_elements<std::span<double>> &out)
+{
+    constexpr size_t W = native_lanes;
+    size_t j = 0;
+    for (; j + W <= r.size(); j += W)
+        state_to_classical(vec3d_pack<W>::gather(r, j), vec3d_pack<W>::gather(v, j), μ).store(out, j);
+    for (; j < r.size(); j++)
+        state_to_classical(r[j], v[j], μ).store(out, j);
+}
+
+inline void classical_to_state(const classical_elements<std::span<const double>> &elements, double μ, std::span<vec3d> r, std::span<vec3d> v)
+{
+    constexpr size_t W = native_lanes;
+    size_t j = 0;
+    for (; j + W <= r.size(); j += W)
+    {
+        vec3d_pack<W> r_pack, v_pack;
+        classical_to_state(classical_elements<double_pack<W>>::load(elements, j), μ, r_pack, v_pack);
+        r_pack.scatter(r, j);
+        v_pack.scatter(v, j);
+    }
+    for (; j < r.size(); j++)
+        classical_to_state(classical_elements<double>::load(elements, j), μ, r[j], v[j]);
+}
+
+inline void state_to_equinoctial(std::span<const vec3d> r, std::span<const vec3d> v, double μ, const equinoctial_elements<std::span<double>> &out)
+{
+    constexpr size_t W = native_lanes;
+    size_t j = 0;
+    for (; j + W <= r.size(); j += W)
+        state_to_equinoctial(vec3d_pack<W>::gather(r, j), vec3d_pack<W>::gather(v, j), μ).store(out, j);
+    for (; j < r.size(); j++)
+        state_to_equinoctial(r[j], v[j], μ).store(out, j);
+}
+
+inline void equinoctial_to_state(const equinoctial_elements<std::span<const double>> &elements, double μ, std::span<vec3d> r, std::span<vec3d> v)
+{
+    constexpr size_t W = native_lanes;
+    size_t j = 0;
+    for (; j + W <= r.size(); j += W)
+    {
+        vec3d_pack<W> r_pack, v_pack;
+        equinoctial_to_state(equinoctial_elements<double_pack<W>>::load(elements, j), μ, r_pack, v_pack);
+        r_pack.scatter(r, j);
+        v_pack.scatter(v, j);
+    }
+    for (; j < r.size(); j++)
+        equinoctial_to_state(equinoctial_elements<double>::load(elements, j), μ, r[j], v[j]);
+}
@@ -0,0 +1,201 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <span>
+#include <fmt/format.h>
+
+/// Series coefficients 1/(2k+2)! and 1/(2k+3)! of the Stumpff functions c2 and c3, used for |ψ| <= 1
+/// where the closed forms lose accuracy. 11 terms reach double precision on that interval.
+constexpr size_t stumpff_terms = 11;
+
+constexpr std::array<double, stumpff_terms> stumpff_coefficients(size_t first)
+{
+    std::array<double, stumpff_terms> coefficients{};
+    double factorial = 1;
+    for (size_t i = 2; i <= first; i++)
+        factorial *= i;
+    for (size_t k = 0; k < stumpff_terms; k++)
+    {
+        coefficients[k] = 1. / factorial;
+        factorial *= (first + 2 * k + 1) * (first + 2 * k + 2);
+    }
+    return coefficients;
+}
+
+constexpr std::array<double, stumpff_terms> stumpff_c2_series = stumpff_coefficients(2);
+constexpr std::array<double, stumpff_terms> stumpff_c3_series = stumpff_coefficients(3);
+
+/// Stumpff functions c2(ψ) = (1 - cos√ψ) / ψ and c3(ψ) = (√ψ - sin√ψ) / √ψ³, continued to ψ < 0
+/// with the hyperbolic functions, so that one formula covers every conic
+inline void stumpff(double ψ, double &c2, double &c3)
+{
+    if (ψ > 1)
+    {
+        double s = std::sqrt(ψ);
+        c2 = (1 - std::cos(s)) / ψ;
+        c3 = (s - std::sin(s)) / (ψ * s);
+    }
+    else if (ψ < -1)
+    {
+        double s = std::sqrt(-ψ);
+        c2 = (std::cosh(s) - 1) / -ψ;
+        c3 = (std::sinh(s) - s) / (-ψ * s);
+    }
+    else
+    {
+        c2 = stumpff_c2_series[stumpff_terms - 1];
+        c3 = stumpff_c3_series[stumpff_terms - 1];
+        for (size_t k = stumpff_terms - 1; k-- > 0;)
+        {
+            c2 = stumpff_c2_series[k] - ψ * c2;
+            c3 = stumpff_c3_series[k] - ψ * c3;
+        }
+    }
+}
+
+struct lagrange_coefficients
+{
+    double f;
+    double g;
+    double fdot;
+    double gdot;
+};
+
+/// Two-body propagation with universal variables: r(t) = f r0 + g v0 and v(t) = ḟ r0 + ġ v0,
+/// valid for elliptic, parabolic and hyperbolic orbits alike. V is any vector type with
+/// dot() and norm() (xy, xyz, vec3d...). (r0, v0) is the state at the epoch t0 and the quantities
+/// that only depend on it are computed once, so many epochs can be evaluated from the same object.
+template <typename V>
+class universal_kepler
+{
+public:
+    universal_kepler(const V &r0, const V &v0, double μ, double t0 = 0) : _r0(r0), _v0(v0), _μ(μ), _t0(t0)
+    {
+        _sqrt_μ = std::sqrt(μ);
+        _r0_norm = r0.norm();
+        _σ0 = r0.dot(v0) / _sqrt_μ;
+        _α = 2 / _r0_norm - v0.dot(v0) / μ;
+    }
+
+    /// Reciprocal of the semi-major axis: > 0 for ellipses, 0 for parabolas, < 0 for hyperbolas
+    double get_alpha() const { return _α; }
+
+    /// Universal anomaly χ after dt = t - t0, solved with Laguerre-Conway iterations which converge from
+    /// rough guesses on every conic. guess is used as a starting point when it is not NaN.
+    double solve_anomaly(double dt, double guess = NAN) const
+    {
+        double χ = std::isnan(guess) ? initial_guess(dt) : guess;
+        const double n = 5;
+        for (size_t i = 0; i < 50; i++)
+        {
+            double ψ = χ * χ * _α;
+            double c2, c3;
+            stumpff(ψ, c2, c3);
+            double terms[4] = {_σ0 * χ * χ * c2, (1 - _α * _r0_norm) * χ * χ * χ * c3, _r0_norm * χ, -_sqrt_μ * dt};
+            double F = terms[0] + terms[1] + terms[2] + terms[3];
+            double dF = χ * χ * c2 + _σ0 * χ * (1 - ψ * c3) + _r0_norm * (1 - ψ * c2);
+            double ddF = _σ0 * (1 - ψ * c2) + (1 - _α * _r0_norm) * χ * (1 - ψ * c3);
+            double root = std::sqrt(std::abs((n - 1) * (n - 1) * dF * dF - n * (n - 1) * F * ddF));
+            double δ = n * F / (dF + std::copysign(root, dF));
+            χ -= δ;
+            /// The residual criterion stops at the rounding noise of F (the terms cancel for large χ),
+            /// which the step alone may keep oscillating around
+            double noise = 1e-15 * (std::abs(terms[0]) + std::abs(terms[1]) + std::abs(terms[2]) + std::abs(terms[3]));
+            if (std::abs(δ) <= 1e-15 * std::abs(χ) + 1e-300 || std::abs(F) <= noise)
+                return χ;
+        }
+        fmt::println("ERROR: universal anomaly did not converge for dt = {}", dt);
+        return χ;
+    }
+
+    lagrange_coefficients get_coefficients_from_anomaly(double dt, double χ) const
+    {
+        double ψ = χ * χ * _α;
+        double c2, c3;
+        stumpff(ψ, c2, c3);
+        double r = χ * χ * c2 + _σ0 * χ * (1 - ψ * c3) + _r0_norm * (1 - ψ * c2);
+        lagrange_coefficients lc;
+        lc.f = 1 - χ * χ * c2 / _r0_norm;
+        lc.g = dt - χ * χ * χ * c3 / _sqrt_μ;
+        lc.fdot = _sqrt_μ / (r * _r0_norm) * χ * (ψ * c3 - 1);
+        lc.gdot = 1 - χ * χ * c2 / r;
+        return lc;
+    }
+
+    lagrange_coefficients get_coefficients(double t) const
+    {
+        return get_coefficients_from_anomaly(t - _t0, solve_anomaly(t - _t0));
+    }
+
+    void state_at(double t, V &r, V &v) const
+    {
+        lagrange_coefficients lc = get_coefficients(t);
+        r = lc.f * _r0 + lc.g * _v0;
+        v = lc.fdot * _r0 + lc.gdot * _v0;
+    }
+
+    /// Batched evaluation. Each solve starts from the previous anomaly advanced with the current
+    /// radial rate, so increasing times (a time grid) converge in one or two iterations.
+    void state_at(std::span<const double> t, std::span<V> r, std::span<V> v) const
+    {
+        sample(t.size(), [&](size_t i) { return t[i]; }, r, v);
+    }
+
+    /// r.size() states uniformly spaced in time from t_begin to t_end (both included)
+    void state_at(double t_begin, double t_end, std::span<V> r, std::span<V> v) const
+    {
+        double dt = r.size() > 1 ? (t_end - t_begin) / (r.size() - 1) : 0;
+        sample(r.size(), [&](size_t i) { return t_begin + i * dt; }, r, v);
+    }
+
+    void get_coefficients(std::span<const double> t, std::span<lagrange_coefficients> coefficients) const
+    {
+        for (size_t i = 0; i < t.size(); i++)
+            coefficients[i] = get_coefficients(t[i]);
+    }
+
+private:
+    template <typename Time>
+    void sample(size_t count, Time time, std::span<V> r, std::span<V> v) const
+    {
+        double χ = NAN;
+        double previous_dt = 0;
+        double previous_r = _r0_norm;
+        for (size_t i = 0; i < count; i++)
+        {
+            double dt = time(i) - _t0;
+            double guess = std::isnan(χ) ? NAN : χ + _sqrt_μ * (dt - previous_dt) / previous_r;
+            χ = solve_anomaly(dt, guess);
+            lagrange_coefficients lc = get_coefficients_from_anomaly(dt, χ);
+            r[i] = lc.f * _r0 + lc.g * _v0;
+            v[i] = lc.fdot * _r0 + lc.gdot * _v0;
+            previous_dt = dt;
+            previous_r = r[i].norm();
+        }
+    }
+
+    /// Starting values of Vallado, Fundamentals of Astrodynamics, algorithm 8
+    double initial_guess(double dt) const
+    {
+        if (_α > 1e-12 / _r0_norm)
+            return _sqrt_μ * dt * _α;
+        if (_α < -1e-12 / _r0_norm && dt != 0)
+        {
+            double a = 1 / _α;
+            double s = dt > 0 ? 1 : -1;
+            double χ = s * std::sqrt(-a) * std::log(-2 * _μ * _α * dt / (_r0.dot(_v0) + s * std::sqrt(-_μ * a) * (1 - _r0_norm * _α)));
+            if (std::isfinite(χ))
+                return χ;
+        }
+        return _sqrt_μ * dt / _r0_norm;
+    }
+
+    V _r0;
+    V _v0;
+    double _μ;
+    double _t0;
+    double _sqrt_μ;
+    double _r0_norm;
+    double _σ0; ///< r0 . v0 / √μ
+    double _α;
+};
@@ -0,0 +1,252 @@
+#pragma once
+#include <cmath>
+#include <span>
+#include <vector>
+#include <fmt/format.h>
+#include "math/double_pack.h"
+#include "math/vec3d.h"
+#include "math/vec_pack.h"
+#include "kepler_equation.h"
+#include "universal_kepler.h"
+
+/// Wisdom-Holman symplectic map in Jacobi coordinates (WHFast, Rein & Tamayo 2015), for systems
+/// dominated by one central mass (body 0). The Hamiltonian is split into Keplerian motions of the
+/// Jacobi coordinates, solved analytically (drift), and the planet-planet interactions (kick).
+/// A step is drift(dt/2) kick(dt) drift(dt/2); consecutive half drifts are merged, so a step
+/// costs one Kepler drift per body and one evaluation of the interactions.
+/// Symplectic correctors of order 3, 5 or 7 (Wisdom, Holman & Touma 1996) remove the O(ε dt²)
+/// oscillating error terms of the map: they are applied once when the integration starts and
+/// inverted on the copy returned by get_state, so their cost does not grow with the step count.
+class wisdom_holman
+{
+public:
+    wisdom_holman(std::vector<double> masses, double G = 6.67430e-11) : _masses(std::move(masses)), _G(G)
+    {
+        size_t N = _masses.size();
+        _interior.resize(N);
+        _μ.resize(N);
+        double M = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            M += _masses[i];
+            _interior[i] = M;
+            _μ[i] = G * M;
+        }
+        _x.resize(N);
+        _a.resize(N);
+    }
+
+    /// Inertial positions and velocities at t0
+    void set_initial_state(double t0, std::span<const vec3d> positions, std::span<const vec3d> velocities)
+    {
+        _t = t0;
+        _q.resize(_masses.size());
+        _u.resize(_masses.size());
+        to_jacobi(positions, _q);
+        to_jacobi(velocities, _u);
+        _synchronized = true;
+        _corrected = false;
+    }
+    void set_timestep(double dt) { _dt = dt; }
+    /// 0 (no corrector), 3, 5 or 7. Must be set before the first solve.
+    void set_corrector_order(size_t order)
+    {
+        if (order != 0 && order != 3 && order != 5 && order != 7)
+            fmt::println("ERROR: symplectic corrector order must be 0, 3, 5 or 7");
+        _corrector_order = order;
+    }
+
+    /// Advances the system to tf (continuing from the last solve)
+    void solve(double tf)
+    {
+        size_t N = (size_t)std::round((tf - _t) / _dt);
+        if (!_corrected)
+        {
+            apply_corrector(_q, _u, 1);
+            _corrected = true;
+        }
+        for (size_t i = 0; i < N; i++)
+        {
+            drift(_q, _u, _synchronized ? _dt / 2 : _dt);
+            kick(_q, _u, _dt);
+            _synchronized = false;
+            _t += _dt;
+        }
+    }
+
+    double get_time() const { return _t; }
+
+    /// Inertial positions and velocities at get_time()
+    void get_state(std::span<vec3d> positions, std::span<vec3d> velocities)
+    {
+        std::vector<vec3d> q = _q;
+        std::vector<vec3d> u = _u;
+        if (!_synchronized)
+            drift(q, u, _dt / 2);
+        if (_corrected)
+            apply_corrector(q, u, -1);
+        from_jacobi(q, positions);
+        from_jacobi(u, velocities);
+    }
+
+    /// Total energy (kinetic + potential) of the current state
+    double get_energy()
+    {
+        size_t N = _masses.size();
+        std::vector<vec3d> x(N), v(N);
+        get_state(x, v);
+        double energy = 0;
+        for (size_t i = 0; i < N; i++)
+        {
+            energy += 0.5 * _masses[i] * v[i].dot(v[i]);
+            for (size_t j = i + 1; j < N; j++)
+                energy -= _G * _masses[i] * _masses[j] / (x[i] - x[j]).norm();
+        }
+        return energy;
+    }
+
+private:
+    /// Jacobi coordinates: q_i is body i relative to the barycenter of bodies 0..i-1, q_0 is the
+    /// barycenter of the system. Velocities and accelerations transform the same way.
+    void to_jacobi(std::span<const vec3d> x, std::span<vec3d> q) const
+    {
+        vec3d barycenter = x[0];
+        for (size_t i = 1; i < x.size(); i++)
+        {
+            q[i] = x[i] - barycenter;
+            barycenter += _masses[i] / _interior[i] * q[i];
+        }
+        q[0] = barycenter;
+    }
+
+    void from_jacobi(std::span<const vec3d> q, std::span<vec3d> x) const
+    {
+        vec3d barycenter = q[0];
+        for (size_t i = q.size() - 1; i > 0; i--)
+        {
+            barycenter -= _masses[i] / _interior[i] * q[i];
+            x[i] = barycenter + q[i];
+        }
+        x[0] = barycenter;
+    }
+
+    /// Keplerian motion of every Jacobi coordinate around the interior mass. Bound orbits (the usual
+    /// case) are drifted native_lanes bodies at a time, unbound ones with the universal formulation.
+    void drift(std::vector<vec3d> &q, std::vector<vec3d> &u, double dt) const
+    {
+        q[0] += dt * u[0];
+        bool bound = true;
+        for (size_t i = 1; i < q.size(); i++)
+            bound = bound && u[i].dot(u[i]) * q[i].norm() < 2 * _μ[i];
+
+        size_t i = 1;
+        if (bound)
+        {
+            constexpr size_t W = native_lanes;
+            for (; i + W <= q.size(); i += W)
+            {
+                vec3d_pack<W> r = vec3d_pack<W>::gather(q, i);
+                vec3d_pack<W> v = vec3d_pack<W>::gather(u, i);
+                kepler_drift(r, v, double_pack<W>::load(&_μ[i]), dt);
+                r.scatter(q, i);
+                v.scatter(u, i);
+            }
+        }
+        for (; i < q.size(); i++)
+        {
+            if (u[i].dot(u[i]) * q[i].norm() < 2 * _μ[i])
+                kepler_drift(q[i], u[i], _μ[i], dt);
+            else
+                universal_kepler<vec3d>(q[i], u[i], _μ[i]).state_at(dt, q[i], u[i]);
+        }
+    }
+
+    /// Velocity change from the interaction Hamiltonian: the full mutual gravity in Jacobi
+    /// coordinates minus the Keplerian part already handled by the drift
+    void kick(const std::vector<vec3d> &q, std::vector<vec3d> &u, double dt)
+    {
+        size_t N = q.size();
+        from_jacobi(q, _x);
+        for (size_t i = 0; i < N; i++)
+            _a[i] = vec3d(0.);
+        for (size_t i = 0; i < N; i++)
+        {
+            for (size_t j = i + 1; j < N; j++)
+            {
+                vec3d d = _x[j] - _x[i];
+                vec3d k = _G * d.inv_norm_3() * d;
+                _a[i].axpy(_masses[j], k);
+                _a[j].axpy(-_masses[i], k);
+            }
+        }
+        to_jacobi(_a, _a);
+        for (size_t i = 1; i < N; i++)
+        {
+            _a[i].axpy(_μ[i] * q[i].inv_norm_3(), q[i]);
+            u[i].axpy(dt, _a[i]);
+        }
+    }
+
+    /// Z(a, b) = drift(a) kick(-b) drift(-2a) kick(b) drift(a)
+    void corrector_Z(std::vector<vec3d> &q, std::vector<vec3d> &u, double a, double b)
+    {
+        drift(q, u, a);
+        kick(q, u, -b);
+        drift(q, u, -2 * a);
+        kick(q, u, b);
+        drift(q, u, a);
+    }
+
+    /// direction = 1 maps real coordinates to the map's coordinates, -1 maps them back.
+    /// The a and b are the published constants of Wisdom, Holman & Touma (1996), with the 5th and
+    /// 7th order sets as used by WHFast (Rein & Tamayo 2015)
+    void apply_corrector(std::vector<vec3d> &q, std::vector<vec3d> &u, double direction)
+    {
+        const double a1 = 0.41833001326703777398908601289259374469640768464934; ///< √(7/40)
+        const double a2 = 2 * a1;
+        const double a3 = 3 * a1;
+        const double b31 = -0.024900596027799867499350357910273437184309981229548;
+        const double b51 = -0.0083001986759332891664501193034244790614366604098494;
+        const double b52 = 0.041500993379666445832250596517122395307183302049247;
+        const double b71 = 0.0024926811426922105779030593952776964450539008582219;
+        const double b72 = -0.018270923246702131478062356884535264841652263842596;
+        const double b73 = 0.053964399093127498721765893493510877532452806339655;
+        const double h = _dt;
+        const double s = direction;
+        switch (_corrector_order)
+        {
+        case 3:
+            corrector_Z(q, u, a1 * h, -s * b31 * h);
+            corrector_Z(q, u, -a1 * h, s * b31 * h);
+            break;
+        case 5:
+            corrector_Z(q, u, -a2 * h, -s * b51 * h);
+            corrector_Z(q, u, -a1 * h, -s * b52 * h);
+            corrector_Z(q, u, a1 * h, s * b52 * h);
+            corrector_Z(q, u, a2 * h, s * b51 * h);
+            break;
+        case 7:
+            corrector_Z(q, u, -a3 * h, -s * b71 * h);
+            corrector_Z(q, u, -a2 * h, -s * b72 * h);
+            corrector_Z(q, u, -a1 * h, -s * b73 * h);
+            corrector_Z(q, u, a1 * h, s * b73 * h);
+            corrector_Z(q, u, a2 * h, s * b72 * h);
+            corrector_Z(q, u, a3 * h, s * b71 * h);
+            break;
+        }
+    }
+
+    std::vector<double> _masses;
+    std::vector<double> _interior; ///< Mass of bodies 0..i
+    std::vector<double> _μ;        ///< G times the interior mass, for the Kepler drift of body i
+    double _G;
+    double _t = 0;
+    double _dt = 1;
+    size_t _corrector_order = 0;
+    bool _synchronized = true; ///< False when the state waits for the last half drift
+    bool _corrected = false;   ///< True once the corrector has been applied to the state
+    std::vector<vec3d> _q;     ///< Jacobi positions
+    std::vector<vec3d> _u;     ///< Jacobi velocities
+    std::vector<vec3d> _x;     ///< Inertial positions, kick buffer
+    std::vector<vec3d> _a;     ///< Accelerations, kick buffer
+};
@@ -0,0 +1,405 @@
+#pragma once
+#include <cmath>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <immintrin.h>
+#include "math/fast_math.h"
+
+/// Lane count matching the widest double vector register of the target. With AVX-512, GCC also
+/// needs -mprefer-vector-width=512 (set by CMakeLists.txt), or it splits 8-lane loops in two.
+#if defined(__AVX512F__)
+constexpr size_t native_lanes = 8;
+#elif defined(__AVX__)
+constexpr size_t native_lanes = 4;
+#else
+constexpr size_t native_lanes = 2;
+#endif
+
+template <size_t W>
+class mask_pack
+{
+public:
+	int64_t m[W]{}; ///< 0 or 1, as wide as a double lane so that masked loops vectorize with the data
+
+	mask_pack() = default;
+
+	mask_pack(bool b)
+	{
+		for (size_t i = 0; i < W; i++)
+			m[i] = b;
+	}
+
+	/// GCC vector type of the lanes, see double_pack
+	static constexpr size_t vector_bytes = std::bit_ceil(W) * sizeof(int64_t);
+	typedef int64_t vector_type __attribute__((vector_size(vector_bytes)));
+
+	/// Only for power of two W: the vector type has bit_ceil(W) lanes
+	vector_type get() const
+	{
+		static_assert(std::has_single_bit(W), "get() covers bit_ceil(W) lanes");
+		vector_type out;
+		std::memcpy(&out, m, sizeof(out));
+		return out;
+	}
+
+	void set(const vector_type &x)
+	{
+		static_assert(std::has_single_bit(W), "set() covers bit_ceil(W) lanes");
+		std::memcpy(m, &x, sizeof(x));
+	}
+
+	bool operator[](size_t i) const { return m[i]; }
+	int64_t &operator[](size_t i) { return m[i]; }
+
+	bool any() const
+	{
+		bool out = false;
+		for (size_t i = 0; i < W; i++)
+			out |= m[i];
+		return out;
+	}
+
+	bool all() const
+	{
+		bool out = true;
+		for (size_t i = 0; i < W; i++)
+			out &= m[i];
+		return out;
+	}
+
+	friend mask_pack operator&(const mask_pack &a, const mask_pack &b)
+	{
+		mask_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.m[i] = a.m[i] && b.m[i];
+		return out;
+	}
+
+	friend mask_pack operator|(const mask_pack &a, const mask_pack &b)
+	{
+		mask_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.m[i] = a.m[i] || b.m[i];
+		return out;
+	}
+
+	mask_pack operator!() const
+	{
+		mask_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.m[i] = !m[i];
+		return out;
+	}
+};
+
+/// W doubles processed together. Every operation is a plain loop over the lanes that the
+/// compiler turns into packed instructions; sqrt and rsqrt use intrinsics when available.
+template <size_t W>
+class double_pack
+{
+public:
+	alignas(std::bit_ceil(W) * sizeof(double) > 64 ? 64 : std::bit_ceil(W) * sizeof(double)) double v[W]{};
+
+	double_pack() = default;
+
+	double_pack(double a)
+	{
+		for (size_t i = 0; i < W; i++)
+			v[i] = a;
+	}
+
+	/// GCC vector type of the lanes: arithmetic through it stays packed at -O3, where the plain
+	/// loops are fully unrolled before vectorization and not always put back together
+	static constexpr size_t vector_bytes = std::bit_ceil(W) * sizeof(double);
+	typedef double vector_type __attribute__((vector_size(vector_bytes)));
+
+	/// Only for power of two W: the vector type has bit_ceil(W) lanes
+	vector_type get() const
+	{
+		static_assert(std::has_single_bit(W), "get() covers bit_ceil(W) lanes");
+		vector_type out;
+		std::memcpy(&out, v, sizeof(out));
+		return out;
+	}
+
+	void set(const vector_type &x)
+	{
+		static_assert(std::has_single_bit(W), "set() covers bit_ceil(W) lanes");
+		std::memcpy(v, &x, sizeof(x));
+	}
+
+	double operator[](size_t i) const { return v[i]; }
+	double &operator[](size_t i) { return v[i]; }
+
+	static double_pack load(const double *src)
+	{
+		double_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.v[i] = src[i];
+		return out;
+	}
+
+	void store(double *dst) const
+	{
+		for (size_t i = 0; i < W; i++)
+			dst[i] = v[i];
+	}
+
+	static double_pack gather(const double *src, const size_t *index)
+	{
+		double_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.v[i] = src[index[i]];
+		return out;
+	}
+
+	void scatter(double *dst, const size_t *index) const
+	{
+		for (size_t i = 0; i < W; i++)
+			dst[index[i]] = v[i];
+	}
+
+	double hsum() const
+	{
+		double out = 0;
+		for (size_t i = 0; i < W; i++)
+			out += v[i];
+		return out;
+	}
+
+	double hmin() const
+	{
+		double out = v[0];
+		for (size_t i = 1; i < W; i++)
+			out = std::fmin(out, v[i]);
+		return out;
+	}
+
+	double hmax() const
+	{
+		double out = v[0];
+		for (size_t i = 1; i < W; i++)
+			out = std::fmax(out, v[i]);
+		return out;
+	}
+
+	/// Assigns value to the lanes selected by mask, leaves the others untouched
+	void masked_assign(const mask_pack<W> &mask, const double_pack &value)
+	{
+		for (size_t i = 0; i < W; i++)
+			v[i] = mask.m[i] ? value.v[i] : v[i];
+	}
+
+#define DOUBLE_PACK_BINARY_OPERATOR(OP)                                        \
+	friend double_pack operator OP(const double_pack &a, const double_pack &b) \
+	{                                                                          \
+		double_pack out;                                                       \
+		if constexpr (std::has_single_bit(W))                                  \
+			out.set(a.get() OP b.get());                                       \
+		else                                                                   \
+			for (size_t i = 0; i < W; i++)                                     \
+				out.v[i] = a.v[i] OP b.v[i];                                   \
+		return out;                                                            \
+	}                                                                          \
+	friend double_pack operator OP(const double_pack &a, double b)             \
+	{                                                                          \
+		return a OP double_pack(b);                                            \
+	}                                                                          \
+	friend double_pack operator OP(double a, const double_pack &b)             \
+	{                                                                          \
+		return double_pack(a) OP b;                                            \
+	}                                                                          \
+	double_pack &operator OP##=(const double_pack &b)                          \
+	{                                                                          \
+		return *this = *this OP b;                                             \
+	}
+
+	DOUBLE_PACK_BINARY_OPERATOR(+)
+	DOUBLE_PACK_BINARY_OPERATOR(-)
+	DOUBLE_PACK_BINARY_OPERATOR(*)
+	DOUBLE_PACK_BINARY_OPERATOR(/)
+#undef DOUBLE_PACK_BINARY_OPERATOR
+
+	double_pack operator-() const
+	{
+		double_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.v[i] = -v[i];
+		return out;
+	}
+
+#define DOUBLE_PACK_COMPARISON(OP)                                             \
+	friend mask_pack<W> operator OP(const double_pack &a, const double_pack &b) \
+	{                                                                          \
+		mask_pack<W> out;                                                      \
+		if constexpr (std::has_single_bit(W))                                  \
+			out.set(-(a.get() OP b.get()));                                    \
+		else                                                                   \
+			for (size_t i = 0; i < W; i++)                                     \
+				out.m[i] = a.v[i] OP b.v[i];                                   \
+		return out;                                                            \
+	}
+
+	DOUBLE_PACK_COMPARISON(<)
+	DOUBLE_PACK_COMPARISON(<=)
+	DOUBLE_PACK_COMPARISON(>)
+	DOUBLE_PACK_COMPARISON(>=)
+	DOUBLE_PACK_COMPARISON(==)
+#undef DOUBLE_PACK_COMPARISON
+
+	friend double_pack sqrt(const double_pack &a)
+	{
+		double_pack out;
+		size_t i = 0;
+#if defined(__AVX512F__)
+		for (; i + 8 <= W; i += 8)
+			_mm512_storeu_pd(out.v + i, _mm512_sqrt_pd(_mm512_loadu_pd(a.v + i)));
+#endif
+#if defined(__AVX__)
+		for (; i + 4 <= W; i += 4)
+			_mm256_storeu_pd(out.v + i, _mm256_sqrt_pd(_mm256_loadu_pd(a.v + i)));
+#endif
+		for (; i < W; i++)
+			out.v[i] = std::sqrt(a.v[i]);
+		return out;
+	}
+
+	/// 1 / sqrt(a), see rsqrt(double) for the accuracy of the AVX-512 estimate (AVX2 is as accurate).
+	/// Every width returns ±inf for ±0 and 0 for inf, as rsqrt(double)
+	friend double_pack rsqrt(const double_pack &a)
+	{
+		double_pack out;
+		size_t i = 0;
+#if defined(__AVX512F__)
+		const __m512d half = _mm512_set1_pd(0.5);
+		const __m512d three_halves = _mm512_set1_pd(1.5);
+		const __m512d inf = _mm512_set1_pd(INFINITY);
+		for (; i + 8 <= W; i += 8)
+		{
+			__m512d x = _mm512_loadu_pd(a.v + i);
+			__m512d half_x = _mm512_mul_pd(x, half);
+			__m512d estimate = _mm512_rsqrt14_pd(x);
+			__m512d y = _mm512_mul_pd(estimate, _mm512_fnmadd_pd(half_x, _mm512_mul_pd(estimate, estimate), three_halves));
+			y = _mm512_mul_pd(y, _mm512_fnmadd_pd(half_x, _mm512_mul_pd(y, y), three_halves));
+			/// The estimate is exact for 0 and inf
+			__mmask8 special = _mm512_cmp_pd_mask(x, _mm512_setzero_pd(), _CMP_EQ_OQ) | _mm512_cmp_pd_mask(x, inf, _CMP_EQ_OQ);
+			y = _mm512_mask_mov_pd(y, special, estimate);
+			_mm512_storeu_pd(out.v + i, y);
+		}
+#endif
+#if defined(__AVX__) && defined(__FMA__)
+		/// AVX2 has no double precision estimate: the single precision one (12 bits) is refined by
+		/// three Newton steps. Chunks with a lane outside the float range fall back to the division.
+		const __m256d half_4 = _mm256_set1_pd(0.5);
+		const __m256d three_halves_4 = _mm256_set1_pd(1.5);
+		const __m256d low = _mm256_set1_pd(1e-36);
+		const __m256d high = _mm256_set1_pd(1e36);
+		for (; i + 4 <= W; i += 4)
+		{
+			__m256d x = _mm256_loadu_pd(a.v + i);
+			__m256d in_range = _mm256_and_pd(_mm256_cmp_pd(x, low, _CMP_GE_OQ), _mm256_cmp_pd(x, high, _CMP_LE_OQ));
+			if (_mm256_movemask_pd(in_range) != 0xF)
+			{
+				_mm256_storeu_pd(out.v + i, _mm256_div_pd(_mm256_set1_pd(1.), _mm256_sqrt_pd(x)));
+				continue;
+			}
+			__m256d half_x = _mm256_mul_pd(x, half_4);
+			__m256d y = _mm256_cvtps_pd(_mm_rsqrt_ps(_mm256_cvtpd_ps(x)));
+			y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half_x, _mm256_mul_pd(y, y), three_halves_4));
+			y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half_x, _mm256_mul_pd(y, y), three_halves_4));
+			y = _mm256_mul_pd(y, _mm256_fnmadd_pd(half_x, _mm256_mul_pd(y, y), three_halves_4));
+			_mm256_storeu_pd(out.v + i, y);
+		}
+#elif defined(__AVX__)
+		const __m256d one = _mm256_set1_pd(1.);
+		for (; i + 4 <= W; i += 4)
+			_mm256_storeu_pd(out.v + i, _mm256_div_pd(one, _mm256_sqrt_pd(_mm256_loadu_pd(a.v + i))));
+#endif
+		for (; i < W; i++)
+			out.v[i] = rsqrt(a.v[i]);
+		return out;
+	}
+
+	friend double_pack abs(const double_pack &a)
+	{
+		double_pack out;
+		for (size_t i = 0; i < W; i++)
+			out.v[i] = std::fabs(a.v[i]);
+		return out;
+	}
+
+	friend double_pack min(const double_pack &a, const double_pack &b)
+	{
+		double_pack out;
+		if constexpr (std::has_single_bit(W))
+			out.set(a.get() < b.get() ? a.get() : b.get());
+		else
+			for (size_t i = 0; i < W; i++)
+				out.v[i] = a.v[i] < b.v[i] ? a.v[i] : b.v[i];
+		return out;
+	}
+
+	friend double_pack max(const double_pack &a, const double_pack &b)
+	{
+		double_pack out;
+		if constexpr (std::has_single_bit(W))
+			out.set(a.get() > b.get() ? a.get() : b.get());
+		else
+			for (size_t i = 0; i < W; i++)
+				out.v[i] = a.v[i] > b.v[i] ? a.v[i] : b.v[i];
+		return out;
+	}
+
+	friend double_pack select(const mask_pack<W> &mask, const double_pack &a, const double_pack &b)
+	{
+		double_pack out;
+		if constexpr (std::has_single_bit(W))
+			out.set(mask.get() != 0 ? a.get() : b.get());
+		else
+			for (size_t i = 0; i < W; i++)
+				out.v[i] = mask.m[i] ? a.v[i] : b.v[i];
+		return out;
+	}
+};
+
+/// Scalar counterparts, so that kernels templated on the lane type also compile for double
+inline double select(bool mask, double a, double b)
+{
+	return mask ? a : b;
+}
+
+inline bool any(bool mask)
+{
+	return mask;
+}
+
+inline bool all(bool mask)
+{
+	return mask;
+}
+
+template <size_t W>
+bool any(const mask_pack<W> &mask)
+{
+	return mask.any();
+}
+
+template <size_t W>
+bool all(const mask_pack<W> &mask)
+{
+	return mask.all();
+}
+
+inline double hsum(double a)
+{
+	return a;
+}
+
+template <size_t W>
+double hsum(const double_pack<W> &a)
+{
+	return a.hsum();
+}
@@ -0,0 +1,24 @@
+#pragma once
+#include <cmath>
+#include <immintrin.h>
+
+/// 1 / sqrt(x). With AVX-512 the hardware 14-bit estimate is refined by two Newton steps,
+/// which is accurate to about one ulp and avoids the long-latency divide. As 1 / std::sqrt, it
+/// returns ±inf for ±0 and 0 for inf, where the Newton steps would give NaN.
+inline double rsqrt(double x)
+{
+#if defined(__AVX512F__)
+	__m128d v = _mm_set_sd(x);
+	__m128d estimate = _mm_rsqrt14_sd(v, v);
+	__m128d half_x = _mm_mul_sd(v, _mm_set_sd(0.5));
+	__m128d three_halves = _mm_set_sd(1.5);
+	__m128d y = _mm_mul_sd(estimate, _mm_fnmadd_sd(half_x, _mm_mul_sd(estimate, estimate), three_halves));
+	y = _mm_mul_sd(y, _mm_fnmadd_sd(half_x, _mm_mul_sd(y, y), three_halves));
+	/// The estimate is exact for 0 and inf
+	__mmask8 special = _mm_cmp_sd_mask(v, _mm_setzero_pd(), _CMP_EQ_OQ) | _mm_cmp_sd_mask(v, _mm_set_sd(INFINITY), _CMP_EQ_OQ);
+	y = _mm_mask_mov_pd(y, special, estimate);
+	return _mm_cvtsd_f64(y);
+#else
+	return 1. / std::sqrt(x);
+#endif
+}
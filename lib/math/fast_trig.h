@@ -0,0 +1,71 @@
+#pragma once
+#include <cmath>
+#include "math/double_pack.h"
+
+/// Branch-free trigonometry written once for double and double_pack<W>, so that loops over
+/// many angles vectorize (std::sin/std::cos are opaque library calls that do not).
+/// Accurate to about 1 ulp for |x| < 1e5, which covers the angles met in orbit propagation.
+
+/// Rounds to the nearest integer with the 1.5 * 2^52 trick, which only uses additions
+template <typename D>
+D round_nearest(const D &x)
+{
+	const double shift = 6755399441055744.0;
+	return (x + shift) - shift;
+}
+
+template <typename D>
+void fast_sincos(const D &x, D &s, D &c)
+{
+	const double two_over_π = 0.63661977236758134308;
+	const double π_over_2_hi = 1.57079632673412561417e+00; ///< π/2 split in two parts (Cody-Waite) so that
+	const double π_over_2_lo = 6.07710050650619224932e-11; ///< x - q π/2 is computed without cancellation
+
+	D q = round_nearest(x * two_over_π);
+	D r = (x - q * π_over_2_hi) - q * π_over_2_lo; ///< r in [-π/4, π/4]
+	D r2 = r * r;
+
+	/// Minimax polynomials on [-π/4, π/4] (Cephes)
+	D sin_r = r + r * r2 * (-1.66666666666666307295E-1 + r2 * (8.33333333332211858878E-3 + r2 * (-1.98412698295895385996E-4 + r2 * (2.75573136213857245213E-6 + r2 * (-2.50507477628578072866E-8 + r2 * 1.58962301576546568060E-10)))));
+	D cos_r = 1. - 0.5 * r2 + r2 * r2 * (4.16666666666665929218E-2 + r2 * (-1.38888888888730564116E-3 + r2 * (2.48015872888517045348E-5 + r2 * (-2.75573141792967388112E-7 + r2 * (2.08757008419747316778E-9 + r2 * -1.13585365213876817300E-11)))));
+
+	/// Quadrant m = q mod 4, then sin(r + m π/2) and cos(r + m π/2) by swapping and negating
+	D m = q - 4. * round_nearest(0.25 * q - 0.375);
+	auto odd = (m == 1.) | (m == 3.);
+	D sin_abs = select(odd, cos_r, sin_r);
+	D cos_abs = select(odd, sin_r, cos_r);
+	s = select(m >= 2., -sin_abs, sin_abs);
+	c = select((m == 1.) | (m == 2.), -cos_abs, cos_abs);
+}
+
+/// Four-quadrant arctangent, branch-free like fast_sincos (about 1 ulp)
+template <typename D>
+D fast_atan2(const D &y, const D &x)
+{
+	using std::abs;
+	using std::max;
+	using std::min;
+	const double π = 3.14159265358979323846;
+	const double tan_π_over_8 = 0.41421356237309504880;
+
+	D ax = abs(x);
+	D ay = abs(y);
+	D large = max(ax, ay);
+	D t = min(ax, ay) / select(large == 0., D(1.), large); ///< t in [0, 1]
+
+	/// atan(t) = π/4 + atan((t - 1) / (t + 1)) brings the argument into [-tan(π/8), tan(π/8)]
+	auto reduce = t > tan_π_over_8;
+	D z = select(reduce, (t - 1.) / (t + 1.), t);
+	D z2 = z * z;
+
+	/// Rational approximation on [-0.66, 0.66] (Cephes)
+	D P = (((-8.750608600031904122785E-1 * z2 - 1.615753718733365076637E1) * z2 - 7.500855792314704667340E1) * z2 - 1.228866684490136173410E2) * z2 - 6.485021904942025371773E1;
+	D Q = ((((z2 + 2.485846490142306297962E1) * z2 + 1.650270098316988542046E2) * z2 + 4.328810604912902668951E2) * z2 + 4.853903996359136964868E2) * z2 + 1.945506571482613964425E2;
+	D a = z + z * z2 * P / Q;
+	a = select(reduce, a + 0.25 * π, a);
+
+	/// Back to the octant, then the quadrant of (x, y)
+	a = select(ay > ax, 0.5 * π - a, a);
+	a = select(x < 0., π - a, a);
+	return select(y < 0., -a, a);
+}
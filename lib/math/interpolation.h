@@ -0,0 +1,341 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <span>
+#include <vector>
+#include <fmt/format.h>
+#include "math/double_pack.h"
+
+enum class interpolation_method
+{
+	linear,
+	monotone_cubic, ///< Fritsch-Butland slopes (as PCHIP): no overshoot, monotone data stay monotone
+	akima,          ///< Akima (1970): local, follows the data closely without the ringing of splines
+};
+
+/// Number of nodes ≤ x, the search starting from the previous result in hint (hunt of Numerical
+/// Recipes): O(1) when successive x are close, as along a trajectory, O(log of the distance) else.
+inline size_t hunt(std::span<const double> nodes, double x, size_t &hint)
+{
+	size_t n = nodes.size();
+	size_t e = std::min(hint, n);
+	if (e > 0 && !(x >= nodes[e - 1]))
+	{
+		/// Below: doubling steps down until a node ≤ x, then bisection
+		size_t hi = e - 1, lo = 0;
+		for (size_t step = 1;; step *= 2)
+		{
+			lo = hi >= step ? hi - step : 0;
+			if (lo == 0 || x >= nodes[lo])
+				break;
+			hi = lo;
+		}
+		e = std::upper_bound(nodes.begin() + lo, nodes.begin() + hi, x) - nodes.begin();
+	}
+	else if (e < n && !(x < nodes[e]))
+	{
+		size_t lo = e, hi = n;
+		for (size_t step = 1;; step *= 2)
+		{
+			hi = std::min(lo + step, n);
+			if (hi == n || x < nodes[hi])
+				break;
+			lo = hi;
+		}
+		e = std::upper_bound(nodes.begin() + lo + 1, nodes.begin() + hi, x) - nodes.begin();
+	}
+	hint = e;
+	return e;
+}
+
+/// Node slopes of a cubic Hermite interpolant of the method (secants for linear)
+inline std::vector<double> interpolation_slopes(std::span<const double> x, std::span<const double> y, interpolation_method method)
+{
+	size_t n = x.size();
+	std::vector<double> d(n, 0.);
+	if (n < 2)
+		return d;
+	std::vector<double> h(n - 1), Δ(n - 1);
+	for (size_t i = 0; i + 1 < n; i++)
+	{
+		h[i] = x[i + 1] - x[i];
+		Δ[i] = (y[i + 1] - y[i]) / h[i];
+	}
+	if (n == 2 || method == interpolation_method::linear)
+	{
+		d[0] = Δ[0];
+		d[n - 1] = Δ[n - 2];
+		for (size_t i = 1; i + 1 < n; i++)
+			d[i] = 0.5 * (Δ[i - 1] + Δ[i]);
+		return d;
+	}
+	if (method == interpolation_method::monotone_cubic)
+	{
+		for (size_t i = 1; i + 1 < n; i++)
+		{
+			if (Δ[i - 1] * Δ[i] <= 0)
+				continue;
+			double w1 = 2 * h[i] + h[i - 1], w2 = h[i] + 2 * h[i - 1];
+			d[i] = (w1 + w2) / (w1 / Δ[i - 1] + w2 / Δ[i]);
+		}
+		/// Shape-preserving three-point end slopes
+		auto end = [](double h0, double h1, double Δ0, double Δ1)
+		{
+			double s = ((2 * h0 + h1) * Δ0 - h0 * Δ1) / (h0 + h1);
+			if (s * Δ0 <= 0)
+				return 0.;
+			if (Δ0 * Δ1 <= 0 && std::abs(s) > 3 * std::abs(Δ0))
+				return 3 * Δ0;
+			return s;
+		};
+		d[0] = end(h[0], h[1], Δ[0], Δ[1]);
+		d[n - 1] = end(h[n - 2], h[n - 3], Δ[n - 2], Δ[n - 3]);
+		return d;
+	}
+	/// Akima: secants extended by two on each side by linear extrapolation
+	std::vector<double> m(n + 3);
+	for (size_t i = 0; i + 1 < n; i++)
+		m[i + 2] = Δ[i];
+	m[1] = 2 * m[2] - m[3];
+	m[0] = 2 * m[1] - m[2];
+	m[n + 1] = 2 * m[n] - m[n - 1];
+	m[n + 2] = 2 * m[n + 1] - m[n];
+	for (size_t i = 0; i < n; i++)
+	{
+		double w1 = std::abs(m[i + 3] - m[i + 2]), w2 = std::abs(m[i + 1] - m[i]);
+		d[i] = w1 + w2 > 0 ? (w1 * m[i + 1] + w2 * m[i + 2]) / (w1 + w2) : 0.5 * (m[i + 1] + m[i + 2]);
+	}
+	return d;
+}
+
+/// y(x) interpolated from nodes x_0 < ... < x_n-1: piecewise linear or cubic Hermite. Each segment
+/// is stored as a polynomial in (x - x_i), so an evaluation is a segment lookup and 3 FMAs; beyond
+/// the ends, y continues linearly with the end slope. Lookups with a hint use hunt; the batched
+/// evaluation hunts from one point to the next (sorted inputs are the fast case) and evaluates the
+/// polynomials native_lanes points at a time.
+class table_1d
+{
+public:
+	table_1d() = default;
+	table_1d(std::vector<double> x, std::vector<double> y, interpolation_method method = interpolation_method::linear)
+	{
+		set(std::move(x), std::move(y), method);
+	}
+
+	void set(std::vector<double> x, std::vector<double> y, interpolation_method method = interpolation_method::linear)
+	{
+		if (x.size() != y.size() || x.size() < 2)
+		{
+			fmt::println("ERROR: interpolation table needs at least 2 nodes and as many values, got {} and {}", x.size(), y.size());
+			return;
+		}
+		for (size_t i = 0; i + 1 < x.size(); i++)
+			if (!(x[i] < x[i + 1]))
+			{
+				fmt::println("ERROR: interpolation nodes must be strictly increasing (node {})", i + 1);
+				return;
+			}
+		_x = std::move(x);
+		_y = std::move(y);
+		_method = method;
+
+		size_t n = _x.size();
+		std::vector<double> d = interpolation_slopes(_x, _y, method);
+		for (std::vector<double> *c : {&_base, &_c0, &_c1, &_c2, &_c3})
+			c->assign(n + 1, 0.);
+		/// Segment e covers [x_e-1, x_e): 0 and n are the linear extensions
+		_base[0] = _x[0];
+		_c0[0] = _y[0];
+		_c1[0] = d[0];
+		_base[n] = _x[n - 1];
+		_c0[n] = _y[n - 1];
+		_c1[n] = d[n - 1];
+		for (size_t i = 0; i + 1 < n; i++)
+		{
+			double h = _x[i + 1] - _x[i], Δ = (_y[i + 1] - _y[i]) / h;
+			_base[i + 1] = _x[i];
+			_c0[i + 1] = _y[i];
+			if (method == interpolation_method::linear)
+				_c1[i + 1] = Δ;
+			else
+			{
+				_c1[i + 1] = d[i];
+				_c2[i + 1] = (3 * Δ - 2 * d[i] - d[i + 1]) / h;
+				_c3[i + 1] = (d[i] + d[i + 1] - 2 * Δ) / (h * h);
+			}
+		}
+	}
+
+	/// Value at x, by bisection
+	double operator()(double x) const
+	{
+		size_t e = std::upper_bound(_x.begin(), _x.end(), x) - _x.begin();
+		return evaluate(e, x);
+	}
+
+	/// Value at x, hint being the segment of the previous lookup (0 initially)
+	double operator()(double x, size_t &hint) const { return evaluate(hunt(_x, x, hint), x); }
+
+	double derivative(double x, size_t &hint) const
+	{
+		size_t e = hunt(_x, x, hint);
+		double s = x - _base[e];
+		return _c1[e] + s * (2 * _c2[e] + 3 * s * _c3[e]);
+	}
+
+	/// Values at every x
+	void operator()(std::span<const double> x, std::span<double> y) const
+	{
+		constexpr size_t W = native_lanes;
+		size_t hint = 0, segment[W];
+		size_t count = x.size(), packs = count / W;
+		for (size_t p = 0; p < packs; p++)
+		{
+			for (size_t l = 0; l < W; l++)
+				segment[l] = hunt(_x, x[p * W + l], hint);
+			double_pack<W> s = double_pack<W>::load(&x[p * W]) - double_pack<W>::gather(_base.data(), segment);
+			double_pack<W> c3 = double_pack<W>::gather(_c3.data(), segment), c2 = double_pack<W>::gather(_c2.data(), segment);
+			double_pack<W> c1 = double_pack<W>::gather(_c1.data(), segment), c0 = double_pack<W>::gather(_c0.data(), segment);
+			(c0 + s * (c1 + s * (c2 + s * c3))).store(&y[p * W]);
+		}
+		for (size_t i = packs * W; i < count; i++)
+			y[i] = (*this)(x[i], hint);
+	}
+
+	const std::vector<double> &nodes() const { return _x; }
+	const std::vector<double> &values() const { return _y; }
+	interpolation_method method() const { return _method; }
+
+private:
+	double evaluate(size_t e, double x) const
+	{
+		double s = x - _base[e];
+		return _c0[e] + s * (_c1[e] + s * (_c2[e] + s * _c3[e]));
+	}
+
+	std::vector<double> _x, _y;
+	interpolation_method _method = interpolation_method::linear;
+	std::vector<double> _base, _c0, _c1, _c2, _c3; ///< Segment polynomials, SoA for the batched gathers
+};
+
+/// Segments of the previous lookup along each axis of a table_2d
+struct table_hint
+{
+	size_t x = 0, y = 0;
+};
+
+/// z(x, y) on a rectangular grid, z[i * ny + j] at (x_i, y_j): bilinear, or bicubic Hermite with
+/// the partial derivatives (and the cross one) given by the 1D method along each axis, which keeps
+/// the surface C1. Each cell stores its 16 polynomial coefficients. Queries are clamped to the grid.
+class table_2d
+{
+public:
+	table_2d() = default;
+	table_2d(std::vector<double> x, std::vector<double> y, std::vector<double> z,
+			 interpolation_method method = interpolation_method::linear)
+	{
+		set(std::move(x), std::move(y), std::move(z), method);
+	}
+
+	void set(std::vector<double> x, std::vector<double> y, std::vector<double> z,
+			 interpolation_method method = interpolation_method::linear)
+	{
+		size_t nx = x.size(), ny = y.size();
+		if (nx < 2 || ny < 2 || z.size() != nx * ny)
+		{
+			fmt::println("ERROR: 2D interpolation table needs at least 2 x 2 nodes and nx * ny values, got {} x {} and {}", nx, ny, z.size());
+			return;
+		}
+		for (const std::vector<double> *axis : {&x, &y})
+			for (size_t i = 0; i + 1 < axis->size(); i++)
+				if (!((*axis)[i] < (*axis)[i + 1]))
+				{
+					fmt::println("ERROR: interpolation nodes must be strictly increasing (node {})", i + 1);
+					return;
+				}
+		_x = std::move(x);
+		_y = std::move(y);
+
+		/// Partial derivatives at the nodes: z_x along x, z_y along y, z_xy along x of z_y
+		std::vector<double> zx(nx * ny), zy(nx * ny), zxy(nx * ny), column(nx);
+		for (size_t i = 0; i < nx; i++)
+		{
+			std::vector<double> d = interpolation_slopes(_y, std::span(z).subspan(i * ny, ny), method);
+			std::copy(d.begin(), d.end(), zy.begin() + i * ny);
+		}
+		for (size_t j = 0; j < ny; j++)
+			for (const auto &[from, to] : {std::pair{&z, &zx}, std::pair{&zy, &zxy}})
+			{
+				for (size_t i = 0; i < nx; i++)
+					column[i] = (*from)[i * ny + j];
+				std::vector<double> d = interpolation_slopes(_x, column, method);
+				for (size_t i = 0; i < nx; i++)
+					(*to)[i * ny + j] = d[i];
+			}
+
+		_cells.assign((nx - 1) * (ny - 1), {});
+		for (size_t i = 0; i + 1 < nx; i++)
+			for (size_t j = 0; j + 1 < ny; j++)
+			{
+				std::array<double, 16> &a = _cells[i * (ny - 1) + j];
+				auto at = [&](const std::vector<double> &f, size_t di, size_t dj) { return f[(i + di) * ny + j + dj]; };
+				if (method == interpolation_method::linear)
+				{
+					a[0] = at(z, 0, 0);
+					a[1] = at(z, 0, 1) - at(z, 0, 0);
+					a[4] = at(z, 1, 0) - at(z, 0, 0);
+					a[5] = at(z, 0, 0) - at(z, 1, 0) - at(z, 0, 1) + at(z, 1, 1);
+					continue;
+				}
+				/// a = M F Mᵀ in the cell coordinates t, u ∈ [0, 1], a[4 p + q] multiplying t^p u^q
+				double hx = _x[i + 1] - _x[i], hy = _y[j + 1] - _y[j];
+				double F[4][4] = {{at(z, 0, 0), at(z, 0, 1), hy * at(zy, 0, 0), hy * at(zy, 0, 1)},
+								  {at(z, 1, 0), at(z, 1, 1), hy * at(zy, 1, 0), hy * at(zy, 1, 1)},
+								  {hx * at(zx, 0, 0), hx * at(zx, 0, 1), hx * hy * at(zxy, 0, 0), hx * hy * at(zxy, 0, 1)},
+								  {hx * at(zx, 1, 0), hx * at(zx, 1, 1), hx * hy * at(zxy, 1, 0), hx * hy * at(zxy, 1, 1)}};
+				constexpr double M[4][4] = {{1, 0, 0, 0}, {0, 0, 1, 0}, {-3, 3, -2, -1}, {2, -2, 1, 1}};
+				double MF[4][4] = {};
+				for (size_t p = 0; p < 4; p++)
+					for (size_t k = 0; k < 4; k++)
+						for (size_t q = 0; q < 4; q++)
+							MF[p][q] += M[p][k] * F[k][q];
+				for (size_t p = 0; p < 4; p++)
+					for (size_t q = 0; q < 4; q++)
+					{
+						double sum = 0;
+						for (size_t k = 0; k < 4; k++)
+							sum += MF[p][k] * M[q][k];
+						a[4 * p + q] = sum;
+					}
+			}
+	}
+
+	double operator()(double x, double y) const
+	{
+		table_hint hint;
+		return (*this)(x, y, hint);
+	}
+
+	double operator()(double x, double y, table_hint &hint) const
+	{
+		size_t nx = _x.size(), ny = _y.size();
+		size_t i = std::clamp<size_t>(hunt(_x, x, hint.x), 1, nx - 1) - 1;
+		size_t j = std::clamp<size_t>(hunt(_y, y, hint.y), 1, ny - 1) - 1;
+		double t = std::clamp((x - _x[i]) / (_x[i + 1] - _x[i]), 0., 1.);
+		double u = std::clamp((y - _y[j]) / (_y[j + 1] - _y[j]), 0., 1.);
+		const std::array<double, 16> &a = _cells[i * (ny - 1) + j];
+		double out = 0;
+		for (size_t p = 4; p-- > 0;)
+			out = out * t + (a[4 * p] + u * (a[4 * p + 1] + u * (a[4 * p + 2] + u * a[4 * p + 3])));
+		return out;
+	}
+
+	const std::vector<double> &nodes_x() const { return _x; }
+	const std::vector<double> &nodes_y() const { return _y; }
+
+private:
+	std::vector<double> _x, _y;
+	std::vector<std::array<double, 16>> _cells;
+};
@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <Eigen/Dense>
+#include <fmt/format.h>
+#include "math/parallel.h"
+
+enum class difference_scheme
+{
+	forward,      ///< (f(x + h) - f(x)) / h, error O(h)
+	central,      ///< (f(x + h) - f(x - h)) / 2h, error O(h²)
+	fourth_order, ///< Five-point stencil, error O(h⁴)
+	complex_step, ///< Im f(x + ih) / h, no cancellation: exact to rounding, needs f templated on the scalar
+};
+
+/// Sparsity of a Jacobian: the rows where each column can be nonzero
+struct jacobian_pattern
+{
+	size_t rows = 0;
+	std::vector<std::vector<size_t>> columns;
+
+	/// Banded pattern: J(i, j) nonzero for -lower ≤ j - i ≤ upper
+	static jacobian_pattern banded(size_t rows, size_t cols, size_t lower, size_t upper)
+	{
+		jacobian_pattern pattern{rows, std::vector<std::vector<size_t>>(cols)};
+		for (size_t j = 0; j < cols; j++)
+			for (size_t i = j > upper ? j - upper : 0; i < rows && i <= j + lower; i++)
+				pattern.columns[j].push_back(i);
+		return pattern;
+	}
+};
+
+/// Jacobian of a vector function y = f(x) by finite differences or complex step. The function is
+/// evaluated concurrently on parallel_for threads: f receives the index of the worker calling it, so
+/// a model with state (a propagator and its buffers) keeps one instance per worker. All the
+/// perturbed evaluations of a Jacobian are independent tasks, so with as many threads as tasks it
+/// costs the wall-clock time of one evaluation.
+///
+/// Steps are chosen per variable as h = ε_f^(1/(p+1)) max(|x|, typical), the optimum of truncation
+/// against rounding for a scheme of order p when f is known to relative precision ε_f (the noise,
+/// machine epsilon by default, larger for a function computed by an integrator with tolerances),
+/// and rounded so that x + h - x = h exactly.
+///
+/// With a sparsity pattern, the columns are greedily colored so that two columns of a color share no
+/// row (Curtis, Powell and Reid 1974): the variables of a color are perturbed together, and each
+/// nonzero is recovered from the only column of its color touching its row. A banded Jacobian then
+/// costs bandwidth evaluations per stencil point, whatever its size.
+class jacobian_engine
+{
+public:
+	/// y = f(x) for the worker of the given index, y sized by f
+	using function = std::function<void(const Eigen::VectorXd &x, Eigen::VectorXd &y, size_t worker)>;
+
+	jacobian_engine(difference_scheme scheme = difference_scheme::central, size_t threads = thread_count())
+		: _scheme(scheme), _threads(std::max<size_t>(threads, 1)) {}
+
+	void set_scheme(difference_scheme scheme) { _scheme = scheme; }
+	void set_threads(size_t threads) { _threads = std::max<size_t>(threads, 1); }
+	/// Relative precision of f
+	void set_noise(double noise) { _noise = noise; }
+	/// Typical magnitude of each variable, the scale of the step when x is near 0 (1 by default)
+	void set_typical(Eigen::VectorXd typical) { _typical = std::move(typical); }
+
+	/// Sparsity pattern of the next Jacobians, colored once here; an empty pattern for dense
+	void set_pattern(jacobian_pattern pattern)
+	{
+		_pattern = std::move(pattern);
+		_members.clear();
+		std::vector<std::vector<bool>> rows_of_color; ///< Rows touched by the columns of each color
+		for (size_t j = 0; j < _pattern.columns.size(); j++)
+		{
+			/// First color none of the rows of j is touched by
+			const std::vector<size_t> &rows = _pattern.columns[j];
+			if (std::any_of(rows.begin(), rows.end(), [&](size_t i) { return i >= _pattern.rows; }))
+			{
+				fmt::println("ERROR: column {} has rows outside the {} rows of the pattern", j, _pattern.rows);
+				_pattern = {};
+				_members.clear();
+				return;
+			}
+			size_t c = 0;
+			while (c < _members.size() && std::any_of(rows.begin(), rows.end(), [&](size_t i) { return rows_of_color[c][i]; }))
+				c++;
+			if (c == _members.size())
+			{
+				_members.emplace_back();
+				rows_of_color.emplace_back(_pattern.rows, false);
+			}
+			_members[c].push_back(j);
+			for (size_t i : rows)
+				rows_of_color[c][i] = true;
+		}
+	}
+
+	/// Number of groups of columns perturbed together (the number of columns when dense)
+	size_t colors() const { return _members.size(); }
+	/// Evaluations of f by the last Jacobian
+	size_t evaluations() const { return _evaluations; }
+
+	/// Jacobian of f at x into J. y0 receives f(x) when given (free with the forward scheme).
+	void compute(const function &f, const Eigen::VectorXd &x, Eigen::MatrixXd &J, Eigen::VectorXd *y0 = nullptr)
+	{
+		if (_scheme == difference_scheme::complex_step)
+		{
+			fmt::println("ERROR: the complex step needs a function of complex vectors, see compute_complex");
+			return;
+		}
+		prepare(x);
+		static constexpr double forward[] = {1.}, central[] = {-1., 1.}, fourth[] = {-2., -1., 1., 2.};
+		static constexpr double w_forward[] = {1.}, w_central[] = {-0.5, 0.5}, w_fourth[] = {1. / 12, -2. / 3, 2. / 3, -1. / 12};
+		const double *offsets = _scheme == difference_scheme::forward ? forward : _scheme == difference_scheme::central ? central : fourth;
+		const double *weights = _scheme == difference_scheme::forward ? w_forward : _scheme == difference_scheme::central ? w_central : w_fourth;
+		size_t points = _scheme == difference_scheme::forward ? 1 : _scheme == difference_scheme::central ? 2 : 4;
+		bool base = _scheme == difference_scheme::forward || y0;
+
+		/// Tasks: f(x) first when needed, then every stencil point of every color
+		size_t colors = this->colors(), tasks = colors * points + base;
+		_x.resize(std::min(_threads, tasks));
+		_y.resize(tasks);
+		parallel_for(_x.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t worker = begin; worker < end; worker++)
+				for (size_t task = worker; task < tasks; task += _x.size())
+				{
+					_x[worker] = x;
+					if (!base || task > 0)
+						perturb(_x[worker], (task - base) / points, offsets[(task - base) % points]);
+					f(_x[worker], _y[task], worker);
+				}
+		}, _x.size());
+		_evaluations = tasks;
+
+		size_t m = _y.back().size();
+		J.setZero(m, _n);
+		const Eigen::VectorXd *y_base = _scheme == difference_scheme::forward ? &_y[0] : nullptr;
+		for (size_t c = 0; c < colors; c++)
+		{
+			for (size_t j : columns_of(c))
+			{
+				double h = _h[j];
+				auto difference = [&](size_t i)
+				{
+					double d = y_base ? -(*y_base)[i] : 0.;
+					for (size_t p = 0; p < points; p++)
+						d += weights[p] * _y[base + c * points + p][i];
+					return d / h;
+				};
+				if (_pattern.columns.empty())
+					for (size_t i = 0; i < m; i++)
+						J(i, j) = difference(i);
+				else
+					for (size_t i : _pattern.columns[j])
+						J(i, j) = difference(i);
+			}
+		}
+		if (y0)
+			*y0 = _y[0];
+	}
+
+	/// Jacobian by complex step of f(const Eigen::VectorXcd &x, Eigen::VectorXcd &y, size_t worker),
+	/// one evaluation per color, accurate to rounding whatever the step
+	template <typename F>
+	void compute_complex(F &&f, const Eigen::VectorXd &x, Eigen::MatrixXd &J)
+	{
+		difference_scheme scheme = _scheme;
+		_scheme = difference_scheme::complex_step;
+		prepare(x);
+		_scheme = scheme;
+		size_t colors = this->colors();
+		_xc.resize(std::min(_threads, colors));
+		_yc.resize(colors);
+		parallel_for(_xc.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t worker = begin; worker < end; worker++)
+				for (size_t c = worker; c < colors; c += _xc.size())
+				{
+					_xc[worker] = x.cast<std::complex<double>>();
+					for (size_t j : columns_of(c))
+						_xc[worker][j] += std::complex<double>(0., _h[j]);
+					f(_xc[worker], _yc[c], worker);
+				}
+		}, _xc.size());
+		_evaluations = colors;
+
+		size_t m = _yc.back().size();
+		J.setZero(m, _n);
+		for (size_t c = 0; c < colors; c++)
+			for (size_t j : columns_of(c))
+			{
+				if (_pattern.columns.empty())
+					J.col(j) = _yc[c].imag() / _h[j];
+				else
+					for (size_t i : _pattern.columns[j])
+						J(i, j) = _yc[c][i].imag() / _h[j];
+			}
+	}
+
+	/// Steps of the last Jacobian
+	const Eigen::VectorXd &steps() const { return _h; }
+
+private:
+	void prepare(const Eigen::VectorXd &x)
+	{
+		_n = x.size();
+		if (!_pattern.columns.empty() && _pattern.columns.size() != _n)
+		{
+			fmt::println("ERROR: pattern of {} columns for {} variables, computing a dense Jacobian", _pattern.columns.size(), _n);
+			_pattern = {};
+			_members.clear();
+		}
+		/// Dense: one color per column
+		if (_pattern.columns.empty() && _members.size() != _n)
+		{
+			_members.resize(_n);
+			for (size_t j = 0; j < _n; j++)
+				_members[j] = {j};
+		}
+
+		double order = _scheme == difference_scheme::forward ? 1 : _scheme == difference_scheme::central ? 2 : 4;
+		double relative = _scheme == difference_scheme::complex_step ? 1e-20 : std::pow(_noise, 1 / (order + 1));
+		_h.resize(_n);
+		for (size_t j = 0; j < _n; j++)
+		{
+			double typical = (size_t)_typical.size() == _n ? std::abs(_typical[j]) : 1.;
+			double h = relative * std::max(std::abs(x[j]), typical);
+			if (_scheme != difference_scheme::complex_step)
+				h = (x[j] + h) - x[j];
+			_h[j] = h;
+		}
+	}
+
+	/// Columns perturbed by a color
+	const std::vector<size_t> &columns_of(size_t c) const { return _members[c]; }
+
+	void perturb(Eigen::VectorXd &x, size_t c, double offset) const
+	{
+		for (size_t j : columns_of(c))
+			x[j] += offset * _h[j];
+	}
+
+	difference_scheme _scheme;
+	size_t _threads;
+	double _noise = std::numeric_limits<double>::epsilon();
+	Eigen::VectorXd _typical;
+
+	jacobian_pattern _pattern;
+	std::vector<std::vector<size_t>> _members; ///< Columns of each color
+
+	size_t _n = 0, _evaluations = 0;
+	Eigen::VectorXd _h;
+	std::vector<Eigen::VectorXd> _x, _y;
+	std::vector<Eigen::VectorXcd> _xc, _yc;
+};
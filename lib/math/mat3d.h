@@ -0,0 +1,321 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <Eigen/Dense>
+#include "math/vec3d.h"
+#include "math/vec_pack.h"
+
+/// 3x3 matrix stored as three vec3d columns, so that a product with a vector is
+/// three fused multiply-adds on whole columns: M * v = c0 * v.x + c1 * v.y + c2 * v.z
+class mat3d
+{
+public:
+	vec3d c0{};
+	vec3d c1{};
+	vec3d c2{};
+
+	mat3d() = default;
+
+	mat3d(const vec3d &c0, const vec3d &c1, const vec3d &c2) : c0(c0), c1(c1), c2(c2) {}
+
+	mat3d(const Eigen::Matrix3d &m)
+		: c0(m(0, 0), m(1, 0), m(2, 0)), c1(m(0, 1), m(1, 1), m(2, 1)), c2(m(0, 2), m(1, 2), m(2, 2)) {}
+
+	static mat3d identity()
+	{
+		return mat3d(vec3d::unitX(), vec3d::unitY(), vec3d::unitZ());
+	}
+
+	static mat3d from_rows(const vec3d &r0, const vec3d &r1, const vec3d &r2)
+	{
+		return mat3d(vec3d(r0.x, r1.x, r2.x), vec3d(r0.y, r1.y, r2.y), vec3d(r0.z, r1.z, r2.z));
+	}
+
+	static mat3d diagonal(const vec3d &d)
+	{
+		return mat3d(vec3d(d.x, 0., 0.), vec3d(0., d.y, 0.), vec3d(0., 0., d.z));
+	}
+
+	/// Rotations of the vectors by an angle θ around the coordinate axes
+	static mat3d rotation_x(double θ)
+	{
+		double c = std::cos(θ), s = std::sin(θ);
+		return mat3d(vec3d(1., 0., 0.), vec3d(0., c, s), vec3d(0., -s, c));
+	}
+
+	static mat3d rotation_y(double θ)
+	{
+		double c = std::cos(θ), s = std::sin(θ);
+		return mat3d(vec3d(c, 0., -s), vec3d(0., 1., 0.), vec3d(s, 0., c));
+	}
+
+	static mat3d rotation_z(double θ)
+	{
+		double c = std::cos(θ), s = std::sin(θ);
+		return mat3d(vec3d(c, s, 0.), vec3d(-s, c, 0.), vec3d(0., 0., 1.));
+	}
+
+	const vec3d &col(size_t j) const
+	{
+		return j == 0 ? c0 : (j == 1 ? c1 : c2);
+	}
+
+	vec3d &col(size_t j)
+	{
+		return j == 0 ? c0 : (j == 1 ? c1 : c2);
+	}
+
+	vec3d row(size_t i) const
+	{
+		return vec3d((*this)(i, 0), (*this)(i, 1), (*this)(i, 2));
+	}
+
+	double operator()(size_t i, size_t j) const
+	{
+		const vec3d &c = col(j);
+		return i == 0 ? c.x : (i == 1 ? c.y : c.z);
+	}
+
+	double &operator()(size_t i, size_t j)
+	{
+		vec3d &c = col(j);
+		return i == 0 ? c.x : (i == 1 ? c.y : c.z);
+	}
+
+	Eigen::Matrix3d to_eigen() const
+	{
+		Eigen::Matrix3d m;
+		m << c0.x, c1.x, c2.x,
+			c0.y, c1.y, c2.y,
+			c0.z, c1.z, c2.z;
+		return m;
+	}
+
+	mat3d transpose() const
+	{
+		return from_rows(c0, c1, c2);
+	}
+
+	double trace() const
+	{
+		return c0.x + c1.y + c2.z;
+	}
+
+	double determinant() const
+	{
+		return c0.dot(c1.cross(c2));
+	}
+
+	/// Inverse through the adjugate; the rows of the inverse are the cross products of the columns
+	mat3d inverse() const
+	{
+		vec3d r0 = c1.cross(c2);
+		vec3d r1 = c2.cross(c0);
+		vec3d r2 = c0.cross(c1);
+		double detInv = 1. / c0.dot(r0);
+		return from_rows(r0 * detInv, r1 * detInv, r2 * detInv);
+	}
+
+	/// Transpose(M) * v, i.e. the inverse rotation for an orthonormal matrix
+	vec3d transpose_multiply(const vec3d &v) const
+	{
+		return vec3d(c0.dot(v), c1.dot(v), c2.dot(v));
+	}
+
+	void print() const
+	{
+		for (size_t i = 0; i < 3; i++)
+			std::printf("%10.4f %10.4f %10.4f\n", (*this)(i, 0), (*this)(i, 1), (*this)(i, 2));
+	}
+
+	friend vec3d operator*(const mat3d &m, const vec3d &v)
+	{
+		vec3d out = m.c0 * v.x;
+		out.axpy(v.y, m.c1);
+		out.axpy(v.z, m.c2);
+		return out;
+	}
+
+	friend Eigen::Vector3d operator*(const mat3d &m, const Eigen::Vector3d &v)
+	{
+		vec3d out = m * vec3d(v[0], v[1], v[2]);
+		return {out.x, out.y, out.z};
+	}
+
+	template <size_t W>
+	friend vec3d_pack<W> operator*(const mat3d &m, const vec3d_pack<W> &v)
+	{
+		return vec3d_pack<W>(
+			m.c0.x * v.x + m.c1.x * v.y + m.c2.x * v.z,
+			m.c0.y * v.x + m.c1.y * v.y + m.c2.y * v.z,
+			m.c0.z * v.x + m.c1.z * v.y + m.c2.z * v.z);
+	}
+
+	friend mat3d operator*(const mat3d &a, const mat3d &b)
+	{
+		return mat3d(a * b.c0, a * b.c1, a * b.c2);
+	}
+
+	mat3d &operator*=(const mat3d &m)
+	{
+		*this = *this * m;
+		return *this;
+	}
+
+	friend mat3d operator*(double a, const mat3d &m)
+	{
+		return mat3d(a * m.c0, a * m.c1, a * m.c2);
+	}
+
+	friend mat3d operator*(const mat3d &m, double a)
+	{
+		return mat3d(a * m.c0, a * m.c1, a * m.c2);
+	}
+
+	friend mat3d operator+(const mat3d &a, const mat3d &b)
+	{
+		return mat3d(a.c0 + b.c0, a.c1 + b.c1, a.c2 + b.c2);
+	}
+
+	mat3d &operator+=(const mat3d &m)
+	{
+		c0 += m.c0;
+		c1 += m.c1;
+		c2 += m.c2;
+		return *this;
+	}
+
+	friend mat3d operator-(const mat3d &a, const mat3d &b)
+	{
+		return mat3d(a.c0 - b.c0, a.c1 - b.c1, a.c2 - b.c2);
+	}
+
+	mat3d &operator-=(const mat3d &m)
+	{
+		c0 -= m.c0;
+		c1 -= m.c1;
+		c2 -= m.c2;
+		return *this;
+	}
+
+	mat3d operator-() const
+	{
+		return mat3d(-c0, -c1, -c2);
+	}
+
+	/// out[i] = M * in[i]
+	void apply(std::span<const vec3d> in, std::span<vec3d> out) const
+	{
+		for (size_t i = 0; i < in.size(); i++)
+			out[i] = *this * in[i];
+	}
+
+	void apply(std::span<const Eigen::Vector3d> in, std::span<Eigen::Vector3d> out) const
+	{
+		for (size_t i = 0; i < in.size(); i++)
+			out[i] = *this * in[i];
+	}
+};
+
+/// 6x6 matrix made of four mat3d blocks, laid out for state-transition matrices of
+/// (position, velocity) states: [[A, B], [C, D]] maps (r, v) to (A r + B v, C r + D v)
+class mat6d
+{
+public:
+	mat3d A{};
+	mat3d B{};
+	mat3d C{};
+	mat3d D{};
+
+	mat6d() = default;
+
+	mat6d(const mat3d &A, const mat3d &B, const mat3d &C, const mat3d &D) : A(A), B(B), C(C), D(D) {}
+
+	mat6d(const Eigen::Matrix<double, 6, 6> &m)
+		: A(Eigen::Matrix3d(m.block<3, 3>(0, 0))), B(Eigen::Matrix3d(m.block<3, 3>(0, 3))),
+		  C(Eigen::Matrix3d(m.block<3, 3>(3, 0))), D(Eigen::Matrix3d(m.block<3, 3>(3, 3))) {}
+
+	static mat6d identity()
+	{
+		return mat6d(mat3d::identity(), mat3d(), mat3d(), mat3d::identity());
+	}
+
+	double operator()(size_t i, size_t j) const
+	{
+		const mat3d &block = i < 3 ? (j < 3 ? A : B) : (j < 3 ? C : D);
+		return block(i % 3, j % 3);
+	}
+
+	double &operator()(size_t i, size_t j)
+	{
+		mat3d &block = i < 3 ? (j < 3 ? A : B) : (j < 3 ? C : D);
+		return block(i % 3, j % 3);
+	}
+
+	Eigen::Matrix<double, 6, 6> to_eigen() const
+	{
+		Eigen::Matrix<double, 6, 6> m;
+		m.block<3, 3>(0, 0) = A.to_eigen();
+		m.block<3, 3>(0, 3) = B.to_eigen();
+		m.block<3, 3>(3, 0) = C.to_eigen();
+		m.block<3, 3>(3, 3) = D.to_eigen();
+		return m;
+	}
+
+	mat6d transpose() const
+	{
+		return mat6d(A.transpose(), C.transpose(), B.transpose(), D.transpose());
+	}
+
+	/// Inverse of a symplectic matrix (e.g. the STM of a Hamiltonian flow): [[D^T, -B^T], [-C^T, A^T]]
+	mat6d symplectic_inverse() const
+	{
+		return mat6d(D.transpose(), -B.transpose(), -C.transpose(), A.transpose());
+	}
+
+	/// Applies the matrix to the state (r, v) in place
+	void apply(vec3d &r, vec3d &v) const
+	{
+		vec3d r_out = A * r + B * v;
+		v = C * r + D * v;
+		r = r_out;
+	}
+
+	friend Eigen::Vector<double, 6> operator*(const mat6d &m, const Eigen::Vector<double, 6> &s)
+	{
+		vec3d r(s[0], s[1], s[2]);
+		vec3d v(s[3], s[4], s[5]);
+		m.apply(r, v);
+		Eigen::Vector<double, 6> out;
+		out << r.x, r.y, r.z, v.x, v.y, v.z;
+		return out;
+	}
+
+	friend mat6d operator*(const mat6d &a, const mat6d &b)
+	{
+		return mat6d(a.A * b.A + a.B * b.C, a.A * b.B + a.B * b.D,
+					 a.C * b.A + a.D * b.C, a.C * b.B + a.D * b.D);
+	}
+
+	mat6d &operator*=(const mat6d &m)
+	{
+		*this = *this * m;
+		return *this;
+	}
+
+	friend mat6d operator+(const mat6d &a, const mat6d &b)
+	{
+		return mat6d(a.A + b.A, a.B + b.B, a.C + b.C, a.D + b.D);
+	}
+
+	friend mat6d operator-(const mat6d &a, const mat6d &b)
+	{
+		return mat6d(a.A - b.A, a.B - b.B, a.C - b.C, a.D - b.D);
+	}
+
+	friend mat6d operator*(double a, const mat6d &m)
+	{
+		return mat6d(a * m.A, a * m.B, a * m.C, a * m.D);
+	}
+};
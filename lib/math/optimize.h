@@ -0,0 +1,655 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <Eigen/Dense>
+#include <fmt/format.h>
+
+/// Objective of the minimizers: returns f(x) and fills its gradient
+using objective_function = std::function<double(const Eigen::VectorXd &x, Eigen::VectorXd &gradient)>;
+/// Residuals r(x) of a least-squares problem, min ½ |r|², and their Jacobian when J is not null
+using residual_function = std::function<void(const Eigen::VectorXd &x, Eigen::VectorXd &r, Eigen::MatrixXd *J)>;
+/// Product Hv of the Hessian of the objective at x with v
+using hessian_vector_function = std::function<void(const Eigen::VectorXd &x, const Eigen::VectorXd &v, Eigen::VectorXd &Hv)>;
+
+struct optimize_options
+{
+	size_t max_iterations = 100;
+	double gradient_tolerance = 1e-8;  ///< On the largest component of the (projected) gradient
+	double step_tolerance = 1e-12;     ///< On the largest component of the step, relative to x
+	double function_tolerance = 1e-14; ///< On the relative decrease of f over an iteration
+	size_t memory = 8;                 ///< Correction pairs kept by L-BFGS
+	/// Line search: sufficient decrease and curvature constants of the strong Wolfe conditions, and
+	/// the maximum number of evaluations
+	double sufficient_decrease = 1e-4;
+	double curvature = 0.9;
+	size_t max_line_search = 20;
+	double damping = 1e-3; ///< Initial Levenberg-Marquardt λ, multiplying the diagonal of JᵀJ component by component
+};
+
+enum class optimize_status
+{
+	gradient,       ///< Converged: gradient below tolerance
+	step,           ///< Converged: step below tolerance
+	function,       ///< Converged: f stopped decreasing
+	max_iterations,
+	line_search, ///< The line search found no decrease (often the gradient is inaccurate)
+};
+
+struct optimize_result
+{
+	Eigen::VectorXd x;
+	double f = 0;
+	size_t iterations = 0;
+	size_t evaluations = 0; ///< Calls of the objective or of the residuals
+	optimize_status status = optimize_status::max_iterations;
+
+	bool converged() const { return status == optimize_status::gradient || status == optimize_status::step || status == optimize_status::function; }
+};
+
+namespace optimize_detail
+{
+	/// Safeguarded step of Moré and Thuente (dcstep of MINPACK-2): updates the interval of
+	/// uncertainty [stx, sty] with the trial stp, and returns in stp the next trial, from the cubic
+	/// and quadratic interpolants of the function values and derivatives.
+	inline void more_thuente_step(double &stx, double &fx, double &dx, double &sty, double &fy, double &dy, double &stp,
+								  double fp, double dp, bool &bracketed, double stpmin, double stpmax)
+	{
+		double sgnd = dp * (dx / std::abs(dx));
+		double stpf;
+		if (fp > fx)
+		{
+			/// Higher value: the minimum is bracketed, cubic step or halfway to the quadratic one
+			double θ = 3 * (fx - fp) / (stp - stx) + dx + dp;
+			double s = std::max({std::abs(θ), std::abs(dx), std::abs(dp)});
+			double γ = s * std::sqrt((θ / s) * (θ / s) - (dx / s) * (dp / s));
+			if (stp < stx)
+				γ = -γ;
+			double p = (γ - dx) + θ, q = ((γ - dx) + γ) + dp;
+			double stpc = stx + p / q * (stp - stx);
+			double stpq = stx + dx / ((fx - fp) / (stp - stx) + dx) / 2 * (stp - stx);
+			stpf = std::abs(stpc - stx) < std::abs(stpq - stx) ? stpc : stpc + (stpq - stpc) / 2;
+			bracketed = true;
+		}
+		else if (sgnd < 0)
+		{
+			/// Derivatives of opposite signs: bracketed, the step farther from stp
+			double θ = 3 * (fx - fp) / (stp - stx) + dx + dp;
+			double s = std::max({std::abs(θ), std::abs(dx), std::abs(dp)});
+			double γ = s * std::sqrt((θ / s) * (θ / s) - (dx / s) * (dp / s));
+			if (stp > stx)
+				γ = -γ;
+			double p = (γ - dp) + θ, q = ((γ - dp) + γ) + dx;
+			double stpc = stp + p / q * (stx - stp);
+			double stpq = stp + dp / (dp - dx) * (stx - stp);
+			stpf = std::abs(stpc - stp) > std::abs(stpq - stp) ? stpc : stpq;
+			bracketed = true;
+		}
+		else if (std::abs(dp) < std::abs(dx))
+		{
+			/// Same sign, decreasing magnitude: the cubic step only if it goes in the right direction
+			double θ = 3 * (fx - fp) / (stp - stx) + dx + dp;
+			double s = std::max({std::abs(θ), std::abs(dx), std::abs(dp)});
+			double γ = s * std::sqrt(std::max(0., (θ / s) * (θ / s) - (dx / s) * (dp / s)));
+			if (stp > stx)
+				γ = -γ;
+			double p = (γ - dp) + θ, q = (γ + (dx - dp)) + γ;
+			double r = p / q;
+			double stpc = r < 0 && γ != 0 ? stp + r * (stx - stp) : stp > stx ? stpmax : stpmin;
+			double stpq = stp + dp / (dp - dx) * (stx - stp);
+			if (bracketed)
+			{
+				stpf = std::abs(stpc - stp) < std::abs(stpq - stp) ? stpc : stpq;
+				stpf = stp > stx ? std::min(stp + 0.66 * (sty - stp), stpf) : std::max(stp + 0.66 * (sty - stp), stpf);
+			}
+			else
+			{
+				stpf = std::abs(stpc - stp) > std::abs(stpq - stp) ? stpc : stpq;
+				stpf = std::clamp(stpf, stpmin, stpmax);
+			}
+		}
+		else
+		{
+			/// Same sign, no decrease of the magnitude: cubic on the other end, or extrapolation
+			if (bracketed)
+			{
+				double θ = 3 * (fp - fy) / (sty - stp) + dy + dp;
+				double s = std::max({std::abs(θ), std::abs(dy), std::abs(dp)});
+				double γ = s * std::sqrt((θ / s) * (θ / s) - (dy / s) * (dp / s));
+				if (stp > sty)
+					γ = -γ;
+				double p = (γ - dp) + θ, q = ((γ - dp) + γ) + dy;
+				stpf = stp + p / q * (sty - stp);
+			}
+			else
+				stpf = stp > stx ? stpmax : stpmin;
+		}
+
+		if (fp > fx)
+		{
+			sty = stp;
+			fy = fp;
+			dy = dp;
+		}
+		else
+		{
+			if (sgnd < 0)
+			{
+				sty = stx;
+				fy = fx;
+				dy = dx;
+			}
+			stx = stp;
+			fx = fp;
+			dx = dp;
+		}
+		stp = stpf;
+	}
+}
+
+/// Line search of Moré and Thuente (1994) along the descent direction d from (x, f, g): finds a
+/// step satisfying the strong Wolfe conditions
+///     f(x + α d) ≤ f + c1 α gᵀd,    |g(x + α d)ᵀd| ≤ c2 |gᵀd|
+/// from the initial α, keeping an interval of uncertainty refined by safeguarded cubic
+/// interpolation. On return x_new, f_new and g_new hold the last point evaluated, α its step.
+/// Returns false when no point of sufficient decrease was found.
+inline bool line_search_more_thuente(const objective_function &f, const Eigen::VectorXd &x, double f0, const Eigen::VectorXd &g0,
+									 const Eigen::VectorXd &d, double &α, Eigen::VectorXd &x_new, double &f_new,
+									 Eigen::VectorXd &g_new, const optimize_options &options, size_t &evaluations,
+									 double α_max = 1e20)
+{
+	constexpr double x_tolerance = 1e-14, extrapolation_low = 1.1, extrapolation_high = 4.;
+	double dg0 = g0.dot(d);
+	if (!(dg0 < 0))
+		return false;
+	double dg_test = options.sufficient_decrease * dg0;
+	double α_min = 0;
+	α = std::min(α, α_max);
+
+	bool bracketed = false, first_stage = true;
+	double width = α_max - α_min, width_previous = 2 * width;
+	double αx = 0, fx = f0, dgx = dg0, αy = 0, fy = f0, dgy = dg0;
+	double stmin = 0, stmax = α + extrapolation_high * α;
+	for (size_t i = 0; i < options.max_line_search; i++)
+	{
+		x_new = x + α * d;
+		f_new = f(x_new, g_new);
+		evaluations++;
+		double dg = g_new.dot(d);
+		double f_test = f0 + α * dg_test;
+		if (std::isnan(f_new))
+		{
+			/// Outside the domain of f: back towards the best point
+			α = αx + 0.5 * (α - αx);
+			continue;
+		}
+
+		if (first_stage && f_new <= f_test && dg >= 0)
+			first_stage = false;
+		if (f_new <= f_test && std::abs(dg) <= -options.curvature * dg0)
+			return true;
+		if ((bracketed && (α <= stmin || α >= stmax)) || (bracketed && stmax - stmin <= x_tolerance * stmax) ||
+			(α == α_max && f_new <= f_test && dg <= dg_test) || (α == α_min && (f_new > f_test || dg >= dg_test)))
+			return f_new <= f_test;
+
+		/// First stage on the modified function ψ(α) = f(α) - f0 - c1 α gᵀd, as long as it is not known
+		/// to have a minimizer with f below the test line
+		if (first_stage && f_new <= fx && f_new > f_test)
+		{
+			double fm = f_new - α * dg_test, fxm = fx - αx * dg_test, fym = fy - αy * dg_test;
+			double dgm = dg - dg_test, dgxm = dgx - dg_test, dgym = dgy - dg_test;
+			optimize_detail::more_thuente_step(αx, fxm, dgxm, αy, fym, dgym, α, fm, dgm, bracketed, stmin, stmax);
+			fx = fxm + αx * dg_test;
+			fy = fym + αy * dg_test;
+			dgx = dgxm + dg_test;
+			dgy = dgym + dg_test;
+		}
+		else
+			optimize_detail::more_thuente_step(αx, fx, dgx, αy, fy, dgy, α, f_new, dg, bracketed, stmin, stmax);
+
+		/// Bisection when the interval does not shrink fast enough
+		if (bracketed)
+		{
+			if (std::abs(αy - αx) >= 0.66 * width_previous)
+				α = αx + 0.5 * (αy - αx);
+			width_previous = width;
+			width = std::abs(αy - αx);
+			stmin = std::min(αx, αy);
+			stmax = std::max(αx, αy);
+		}
+		else
+		{
+			stmin = α + extrapolation_low * (α - αx);
+			stmax = α + extrapolation_high * (α - αx);
+		}
+		α = std::clamp(α, α_min, α_max);
+		if (bracketed && (α <= stmin || α >= stmax || stmax - stmin <= x_tolerance * stmax))
+			α = αx;
+	}
+	return f_new <= f0 + α * dg_test;
+}
+
+namespace optimize_detail
+{
+	/// Correction pairs of L-BFGS in a ring buffer
+	struct lbfgs_memory
+	{
+		Eigen::MatrixXd S, Y;
+		Eigen::VectorXd ρ, a;
+		size_t size = 0, next = 0;
+
+		lbfgs_memory(size_t n, size_t m) : S(n, m), Y(n, m), ρ(m), a(m) {}
+
+		/// Skips the pair when the curvature sᵀy is not safely positive
+		void push(const Eigen::VectorXd &s, const Eigen::VectorXd &y)
+		{
+			double sy = s.dot(y);
+			if (!(sy > 1e-12 * y.squaredNorm()))
+				return;
+			size_t m = S.cols();
+			S.col(next) = s;
+			Y.col(next) = y;
+			ρ[next] = 1 / sy;
+			next = (next + 1) % m;
+			size = std::min(size + 1, m);
+		}
+
+		/// d = -H g by the two-loop recursion, restricted to the free components when given
+		void direction(const Eigen::VectorXd &g, Eigen::VectorXd &d, const Eigen::VectorXd *free = nullptr)
+		{
+			size_t m = S.cols();
+			d = -g;
+			if (free)
+				d = d.cwiseProduct(*free);
+			for (size_t j = 0; j < size; j++)
+			{
+				size_t i = (next + m - 1 - j) % m;
+				a[i] = ρ[i] * S.col(i).dot(d);
+				d -= a[i] * Y.col(i);
+			}
+			if (size > 0)
+			{
+				size_t newest = (next + m - 1) % m;
+				d *= 1 / (ρ[newest] * Y.col(newest).squaredNorm());
+			}
+			for (size_t j = size; j-- > 0;)
+			{
+				size_t i = (next + m - 1 - j) % m;
+				double β = ρ[i] * Y.col(i).dot(d);
+				d += (a[i] - β) * S.col(i);
+			}
+			if (free)
+				d = d.cwiseProduct(*free);
+		}
+
+		void clear() { size = next = 0; }
+	};
+
+	/// Relative decrease and step tests shared by the minimizers
+	inline bool stalled(double f, double f_new, const Eigen::VectorXd &x, const Eigen::VectorXd &s,
+						const optimize_options &options, optimize_status &status)
+	{
+		if (s.lpNorm<Eigen::Infinity>() <= options.step_tolerance * std::max(1., x.lpNorm<Eigen::Infinity>()))
+		{
+			status = optimize_status::step;
+			return true;
+		}
+		if (f - f_new <= options.function_tolerance * std::max({std::abs(f), std::abs(f_new), 1.}))
+		{
+			status = optimize_status::function;
+			return true;
+		}
+		return false;
+	}
+}
+
+/// Unconstrained minimization by limited-memory BFGS (Nocedal 1980) with the Moré-Thuente line
+/// search: the inverse Hessian is approximated from the last options.memory steps and gradient
+/// changes, scaled by sᵀy / yᵀy, so each iteration costs O(n m) besides one or two evaluations.
+/// The initial matrix is rescaled at every iteration, so even a memory covering every iteration does
+/// not reproduce BFGS.
+inline optimize_result lbfgs(const objective_function &f, const Eigen::VectorXd &x0, const optimize_options &options = {})
+{
+	size_t n = x0.size();
+	optimize_result result;
+	result.x = x0;
+	Eigen::VectorXd g(n), d(n), x_new(n), g_new(n);
+	result.f = f(result.x, g);
+	result.evaluations = 1;
+	optimize_detail::lbfgs_memory memory(n, std::max<size_t>(options.memory, 1));
+
+	for (result.iterations = 0; result.iterations < options.max_iterations; result.iterations++)
+	{
+		if (g.lpNorm<Eigen::Infinity>() <= options.gradient_tolerance)
+		{
+			result.status = optimize_status::gradient;
+			return result;
+		}
+		memory.direction(g, d);
+		if (!(d.dot(g) < 0))
+		{
+			memory.clear();
+			d = -g;
+		}
+		/// Unit step once the Hessian is approximated, a step of the size of x or 1 else
+		double α = memory.size > 0 ? 1. : std::max(1., result.x.lpNorm<Eigen::Infinity>()) / d.lpNorm<Eigen::Infinity>();
+		double f_new;
+		if (!line_search_more_thuente(f, result.x, result.f, g, d, α, x_new, f_new, g_new, options, result.evaluations))
+		{
+			result.status = optimize_status::line_search;
+			return result;
+		}
+		Eigen::VectorXd s = x_new - result.x;
+		memory.push(s, g_new - g);
+		bool stop = optimize_detail::stalled(result.f, f_new, result.x, s, options, result.status);
+		result.x = x_new;
+		result.f = f_new;
+		g = g_new;
+		if (stop)
+		{
+			result.iterations++;
+			return result;
+		}
+	}
+	result.status = optimize_status::max_iterations;
+	return result;
+}
+
+/// Unconstrained minimization by truncated Newton (line search Newton-CG, Nocedal & Wright
+/// algorithm 7.1): the Newton system H d = -g is solved by conjugate gradients up to the forcing
+/// tolerance min(0.01, √|g|) |g|, which gives superlinear convergence, and the inner iterations stop
+/// at the first direction of negative curvature. The cap is 0.01 rather than the book's ½, with which
+/// a single CG iteration often meets the tolerance and the step degenerates to steepest descent in
+/// curved valleys (84 iterations instead of 24 on Rosenbrock). Only Hessian-vector products are
+/// needed: from hessian_vector when given, else by a forward difference of the gradient (one
+/// evaluation each).
+inline optimize_result newton_cg(const objective_function &f, const Eigen::VectorXd &x0, const optimize_options &options = {},
+								 const hessian_vector_function &hessian_vector = nullptr)
+{
+	size_t n = x0.size();
+	optimize_result result;
+	result.x = x0;
+	Eigen::VectorXd g(n), d(n), x_new(n), g_new(n), z(n), r(n), p(n), Hp(n), g_h(n);
+	result.f = f(result.x, g);
+	result.evaluations = 1;
+	auto product = [&](const Eigen::VectorXd &v, Eigen::VectorXd &Hv)
+	{
+		if (hessian_vector)
+			return hessian_vector(result.x, v, Hv);
+		double h = std::sqrt(std::numeric_limits<double>::epsilon()) * std::max(1., result.x.norm()) / v.norm();
+		x_new = result.x + h * v;
+		f(x_new, g_h);
+		result.evaluations++;
+		Hv = (g_h - g) / h;
+	};
+
+	for (result.iterations = 0; result.iterations < options.max_iterations; result.iterations++)
+	{
+		double g_norm = g.norm();
+		if (g.lpNorm<Eigen::Infinity>() <= options.gradient_tolerance)
+		{
+			result.status = optimize_status::gradient;
+			return result;
+		}
+
+		/// Conjugate gradients on H z = -g from z = 0
+		double tolerance = std::min(0.01, std::sqrt(g_norm)) * g_norm;
+		z.setZero();
+		r = g;
+		p = -g;
+		d = -g;
+		for (size_t j = 0; j < n; j++)
+		{
+			product(p, Hp);
+			double curvature = p.dot(Hp), rr = r.squaredNorm();
+			if (curvature <= 0)
+			{
+				/// Negative curvature: the last iterate, or on the first iteration steepest descent
+				/// scaled by |g|² / |gᵀHg|
+				if (j > 0)
+					d = z;
+				else if (curvature < 0)
+					d = rr / -curvature * p;
+				break;
+			}
+			double α = rr / curvature;
+			z += α * p;
+			r += α * Hp;
+			d = z;
+			if (r.norm() <= tolerance)
+				break;
+			p = -r + r.squaredNorm() / rr * p;
+		}
+
+		double α = 1, f_new;
+		if (!line_search_more_thuente(f, result.x, result.f, g, d, α, x_new, f_new, g_new, options, result.evaluations))
+		{
+			result.status = optimize_status::line_search;
+			return result;
+		}
+		Eigen::VectorXd s = x_new - result.x;
+		bool stop = optimize_detail::stalled(result.f, f_new, result.x, s, options, result.status);
+		result.x = x_new;
+		result.f = f_new;
+		g = g_new;
+		if (stop)
+		{
+			result.iterations++;
+			return result;
+		}
+	}
+	result.status = optimize_status::max_iterations;
+	return result;
+}
+
+/// Minimization within the box lower ≤ x ≤ upper (infinite bounds allowed), in the spirit of
+/// L-BFGS-B: the variables at a bound with the gradient pushing outwards are held fixed, the L-BFGS
+/// direction is computed on the free ones, and a backtracking line search on the projected path
+/// P(x + α d) lets several bounds become active in one iteration. The convergence test is on the
+/// projected gradient. The Cauchy point and subspace minimization of Byrd et al. are replaced by
+/// this active-set projection, which needs no bound-specific matrix algebra.
+inline optimize_result lbfgsb(const objective_function &f, const Eigen::VectorXd &x0, const Eigen::VectorXd &lower,
+							  const Eigen::VectorXd &upper, const optimize_options &options = {})
+{
+	size_t n = x0.size();
+	optimize_result result;
+	if ((size_t)lower.size() != n || (size_t)upper.size() != n)
+	{
+		fmt::println("ERROR: lbfgsb needs one lower and one upper bound per variable");
+		result.x = x0;
+		result.status = optimize_status::line_search;
+		return result;
+	}
+	auto project = [&](Eigen::VectorXd &x)
+	{ x = x.cwiseMax(lower).cwiseMin(upper); };
+	result.x = x0;
+	project(result.x);
+	Eigen::VectorXd g(n), d(n), x_new(n), g_new(n), free(n), projected(n);
+	result.f = f(result.x, g);
+	result.evaluations = 1;
+	optimize_detail::lbfgs_memory memory(n, std::max<size_t>(options.memory, 1));
+
+	for (result.iterations = 0; result.iterations < options.max_iterations; result.iterations++)
+	{
+		/// Projected gradient x - P(x - g), and the ε-active set of Bertsekas around it
+		projected = result.x - g;
+		project(projected);
+		projected = result.x - projected;
+		double pg = projected.lpNorm<Eigen::Infinity>();
+		if (pg <= options.gradient_tolerance)
+		{
+			result.status = optimize_status::gradient;
+			return result;
+		}
+		double ε = std::min(1e-3, pg);
+		for (size_t i = 0; i < n; i++)
+		{
+			bool at_lower = result.x[i] <= lower[i] + ε && g[i] > 0, at_upper = result.x[i] >= upper[i] - ε && g[i] < 0;
+			free[i] = at_lower || at_upper ? 0. : 1.;
+		}
+		memory.direction(g, d, &free);
+		if (!(d.dot(g) < 0))
+		{
+			memory.clear();
+			d = -projected;
+		}
+
+		/// Armijo backtracking on the projected path, with a quadratic interpolation of the step
+		double α = memory.size > 0 ? 1. : std::max(1., result.x.lpNorm<Eigen::Infinity>()) / d.lpNorm<Eigen::Infinity>();
+		double f_new = NAN;
+		bool decrease = false;
+		for (size_t i = 0; i < options.max_line_search && !decrease; i++)
+		{
+			x_new = result.x + α * d;
+			project(x_new);
+			f_new = f(x_new, g_new);
+			result.evaluations++;
+			double slope = g.dot(x_new - result.x);
+			decrease = f_new <= result.f + options.sufficient_decrease * slope;
+			if (!decrease)
+			{
+				double quadratic = -slope * α / (2 * (f_new - result.f - slope));
+				α = std::isfinite(quadratic) ? std::clamp(quadratic, 0.1 * α, 0.5 * α) : 0.5 * α;
+			}
+		}
+		if (!decrease)
+		{
+			result.status = optimize_status::line_search;
+			return result;
+		}
+		Eigen::VectorXd s = x_new - result.x;
+		memory.push(s, g_new - g);
+		bool stop = optimize_detail::stalled(result.f, f_new, result.x, s, options, result.status);
+		result.x = x_new;
+		result.f = f_new;
+		g = g_new;
+		if (stop)
+		{
+			result.iterations++;
+			return result;
+		}
+	}
+	result.status = optimize_status::max_iterations;
+	return result;
+}
+
+/// Nonlinear least squares min ½ |r(x)|² by Gauss-Newton: the step solves the linearized problem
+/// J δ = -r (column-pivoting QR, so rank-deficient Jacobians give a basic solution) and is halved
+/// until the cost decreases. Quadratic convergence for zero-residual problems such as targeting.
+inline optimize_result gauss_newton(const residual_function &residuals, const Eigen::VectorXd &x0, const optimize_options &options = {})
+{
+	optimize_result result;
+	result.x = x0;
+	Eigen::VectorXd r, r_new, δ, x_new;
+	Eigen::MatrixXd J;
+	residuals(result.x, r, &J);
+	result.evaluations = 1;
+	result.f = 0.5 * r.squaredNorm();
+
+	for (result.iterations = 0; result.iterations < options.max_iterations; result.iterations++)
+	{
+		if ((J.transpose() * r).lpNorm<Eigen::Infinity>() <= options.gradient_tolerance)
+		{
+			result.status = optimize_status::gradient;
+			return result;
+		}
+		δ = J.colPivHouseholderQr().solve(-r);
+		double f_new = INFINITY;
+		for (size_t i = 0; i < options.max_line_search; i++, δ /= 2)
+		{
+			x_new = result.x + δ;
+			residuals(x_new, r_new, nullptr);
+			result.evaluations++;
+			f_new = 0.5 * r_new.squaredNorm();
+			if (f_new < result.f)
+				break;
+		}
+		if (!(f_new < result.f))
+		{
+			result.status = result.f == 0 ? optimize_status::function : optimize_status::line_search;
+			return result;
+		}
+		bool stop = optimize_detail::stalled(result.f, f_new, result.x, δ, options, result.status);
+		result.x = x_new;
+		result.f = f_new;
+		if (stop)
+		{
+			r = r_new;
+			result.iterations++;
+			return result;
+		}
+		residuals(result.x, r, &J);
+		result.evaluations++;
+	}
+	result.status = optimize_status::max_iterations;
+	return result;
+}
+
+/// Nonlinear least squares by Levenberg-Marquardt: the step solves (JᵀJ + λ D) δ = -Jᵀr, D the
+/// diagonal of JᵀJ (Marquardt scaling, invariant to the units of x), and λ follows the ratio of
+/// actual to predicted reduction (Nielsen 1999): decreased smoothly on good steps, multiplied by a
+/// growing factor on rejected ones. The Jacobian is only evaluated at accepted points.
+inline optimize_result levenberg_marquardt(const residual_function &residuals, const Eigen::VectorXd &x0,
+										   const optimize_options &options = {})
+{
+	optimize_result result;
+	result.x = x0;
+	Eigen::VectorXd r, r_new, g, δ, x_new, D;
+	Eigen::MatrixXd J, A;
+	residuals(result.x, r, &J);
+	result.evaluations = 1;
+	result.f = 0.5 * r.squaredNorm();
+	A = J.transpose() * J;
+	g = J.transpose() * r;
+	D = A.diagonal().cwiseMax(1e-12 * std::max(1., A.diagonal().maxCoeff()));
+	double λ = options.damping, ν = 2;
+
+	for (result.iterations = 0; result.iterations < options.max_iterations; result.iterations++)
+	{
+		if (g.lpNorm<Eigen::Infinity>() <= options.gradient_tolerance)
+		{
+			result.status = optimize_status::gradient;
+			return result;
+		}
+		Eigen::MatrixXd M = A;
+		M.diagonal() += λ * D;
+		δ = M.ldlt().solve(-g);
+		if (δ.lpNorm<Eigen::Infinity>() <= options.step_tolerance * std::max(1., result.x.lpNorm<Eigen::Infinity>()))
+		{
+			result.status = optimize_status::step;
+			return result;
+		}
+		x_new = result.x + δ;
+		residuals(x_new, r_new, nullptr);
+		result.evaluations++;
+		double f_new = 0.5 * r_new.squaredNorm();
+		double predicted = 0.5 * δ.dot(λ * D.cwiseProduct(δ) - g);
+		double ρ = (result.f - f_new) / predicted;
+		if (ρ > 0 && std::isfinite(f_new))
+		{
+			bool stop = optimize_detail::stalled(result.f, f_new, result.x, δ, options, result.status);
+			result.x = x_new;
+			result.f = f_new;
+			if (stop)
+			{
+				result.iterations++;
+				return result;
+			}
+			residuals(result.x, r, &J);
+			result.evaluations++;
+			A = J.transpose() * J;
+			g = J.transpose() * r;
+			D = D.cwiseMax(A.diagonal());
+			λ *= std::max(1. / 3, 1 - std::pow(2 * ρ - 1, 3));
+			ν = 2;
+		}
+		else
+		{
+			λ *= ν;
+			ν *= 2;
+		}
+	}
+	result.status = optimize_status::max_iterations;
+	return result;
+}
@@ -0,0 +1,178 @@
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/// Number of worker threads used by parallel_for, at least 1
+inline size_t thread_count()
+{
+	return std::max<size_t>(1, std::thread::hardware_concurrency());
+}
+
+namespace parallel_detail
+{
+	/// Set on the pool workers and on a thread while it dispatches to the pool: a parallel_for
+	/// called from there cannot wait on the pool
+	inline thread_local bool in_pool = false;
+
+	/// Workers started once and woken for every parallel_for, so that the repeated calls of a
+	/// solver (one per Jacobian, per force evaluation, per FMM level) do not pay thread creation,
+	/// and thread_local scratch buffers survive between them. One dispatch at a time.
+	class thread_pool
+	{
+	public:
+		static thread_pool &instance()
+		{
+			static thread_pool pool;
+			return pool;
+		}
+
+		~thread_pool()
+		{
+			{
+				std::lock_guard lock(_mutex);
+				_stop = true;
+			}
+			_start.notify_all();
+			for (std::thread &worker : _workers)
+				worker.join();
+		}
+
+		std::mutex &busy() { return _busy; }
+
+		/// Runs task(i) for i in [0, tasks) on the workers and local() on the calling thread, and
+		/// returns when all are done. The caller holds busy().
+		template <typename T, typename L>
+		void run(size_t tasks, const T &task, L &&local)
+		{
+			{
+				std::lock_guard lock(_mutex);
+				while (_workers.size() < tasks)
+					_workers.emplace_back([this, index = _workers.size()]() { work(index); });
+				_context = &task;
+				_call = [](const void *context, size_t i) { (*static_cast<const T *>(context))(i); };
+				_tasks = tasks;
+				_pending = tasks;
+				_generation++;
+			}
+			_start.notify_all();
+			in_pool = true;
+			local();
+			in_pool = false;
+			std::unique_lock lock(_mutex);
+			_done.wait(lock, [this]() { return _pending == 0; });
+		}
+
+	private:
+		void work(size_t index)
+		{
+			in_pool = true;
+			size_t seen = 0;
+			std::unique_lock lock(_mutex);
+			for (;;)
+			{
+				_start.wait(lock, [&]() { return _stop || _generation != seen; });
+				if (_stop)
+					return;
+				seen = _generation;
+				if (index >= _tasks)
+					continue;
+				const void *context = _context;
+				void (*call)(const void *, size_t) = _call;
+				lock.unlock();
+				call(context, index);
+				lock.lock();
+				if (--_pending == 0)
+					_done.notify_one();
+			}
+		}
+
+		std::mutex _busy, _mutex;
+		std::condition_variable _start, _done;
+		std::vector<std::thread> _workers;
+		const void *_context = nullptr;
+		void (*_call)(const void *, size_t) = nullptr;
+		size_t _tasks = 0, _pending = 0, _generation = 0;
+		bool _stop = false;
+	};
+}
+
+/// Splits [0, count) in contiguous chunks, one per thread, and calls f(begin, end) on each.
+/// The calling thread processes the last chunk, the others run on a persistent thread pool. A call
+/// nested in another one (or concurrent with it) runs on fresh threads instead. f must only write to
+/// data owned by its range.
+template <typename F>
+void parallel_for(size_t count, F &&f, size_t threads = thread_count())
+{
+	threads = std::min(threads, count);
+	if (threads <= 1)
+	{
+		if (count > 0)
+			f(size_t(0), count);
+		return;
+	}
+	size_t chunk = count / threads;
+	size_t remainder = count % threads;
+	auto task = [&](size_t i)
+	{
+		size_t begin = i * chunk + std::min(i, remainder);
+		f(begin, begin + chunk + (i < remainder ? 1 : 0));
+	};
+
+	parallel_detail::thread_pool &pool = parallel_detail::thread_pool::instance();
+	if (!parallel_detail::in_pool)
+	{
+		std::unique_lock busy(pool.busy(), std::try_to_lock);
+		if (busy.owns_lock())
+		{
+			pool.run(threads - 1, task, [&]() { task(threads - 1); });
+			return;
+		}
+	}
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (size_t i = 0; i + 1 < threads; i++)
+		workers.emplace_back([&task, i]() { task(i); });
+	task(threads - 1);
+	for (std::thread &worker : workers)
+		worker.join();
+}
+
+/// Sorts [first, last): one std::sort per thread on contiguous chunks, then pairwise merges of the
+/// sorted chunks, the merges of a level running in parallel.
+template <typename It, typename Compare>
+void parallel_sort(It first, It last, Compare comp, size_t threads = thread_count())
+{
+	size_t count = last - first;
+	threads = std::min(threads, count / 1024);
+	if (threads <= 1)
+	{
+		std::sort(first, last, comp);
+		return;
+	}
+	std::vector<size_t> bounds(threads + 1);
+	for (size_t i = 0; i <= threads; i++)
+		bounds[i] = count * i / threads;
+	parallel_for(threads, [&](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; i++)
+			std::sort(first + bounds[i], first + bounds[i + 1], comp);
+	}, threads);
+	for (size_t width = 1; width < threads; width *= 2)
+	{
+		size_t pairs = (threads + 2 * width - 1) / (2 * width);
+		parallel_for(pairs, [&](size_t begin, size_t end)
+		{
+			for (size_t p = begin; p < end; p++)
+			{
+				size_t lo = 2 * width * p;
+				size_t mid = std::min(lo + width, threads);
+				size_t hi = std::min(lo + 2 * width, threads);
+				std::inplace_merge(first + bounds[lo], first + bounds[mid], first + bounds[hi], comp);
+			}
+		}, threads);
+	}
+}
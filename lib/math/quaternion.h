@@ -0,0 +1,243 @@
+#pragma once
+#include <cmath>
+#include <cstdio>
+#include <span>
+#include <Eigen/Dense>
+#include "math/fast_math.h"
+#include "math/vec3d.h"
+#include "math/vec_pack.h"
+#include "math/mat3d.h"
+
+/// Quaternion w + x i + y j + z k. Unit quaternions represent rotations, composed with
+/// operator* in the same order as matrices: (p * q).rotate(v) == p.rotate(q.rotate(v)).
+class quaternion
+{
+public:
+	double w = 1;
+	double x{};
+	double y{};
+	double z{};
+
+	quaternion() = default;
+
+	quaternion(double w, double x, double y, double z) : w(w), x(x), y(y), z(z) {}
+
+	quaternion(double w, const vec3d &v) : w(w), x(v.x), y(v.y), z(v.z) {}
+
+	static quaternion identity()
+	{
+		return quaternion();
+	}
+
+	/// Rotation of angle θ around axis (which does not need to be normalized)
+	static quaternion from_axis_angle(vec3d axis, double θ)
+	{
+		axis.normalize();
+		return quaternion(std::cos(θ / 2), std::sin(θ / 2) * axis);
+	}
+
+	/// Shepperd's method: picks the largest of w, x, y, z to divide by, so it is stable for every rotation
+	static quaternion from_matrix(const mat3d &m)
+	{
+		double tr = m.trace();
+		quaternion q;
+		if (tr > m(0, 0) && tr > m(1, 1) && tr > m(2, 2))
+		{
+			double s = 2 * std::sqrt(1 + tr);
+			q = quaternion(s / 4, (m(2, 1) - m(1, 2)) / s, (m(0, 2) - m(2, 0)) / s, (m(1, 0) - m(0, 1)) / s);
+		}
+		else if (m(0, 0) > m(1, 1) && m(0, 0) > m(2, 2))
+		{
+			double s = 2 * std::sqrt(1 + m(0, 0) - m(1, 1) - m(2, 2));
+			q = quaternion((m(2, 1) - m(1, 2)) / s, s / 4, (m(0, 1) + m(1, 0)) / s, (m(0, 2) + m(2, 0)) / s);
+		}
+		else if (m(1, 1) > m(2, 2))
+		{
+			double s = 2 * std::sqrt(1 + m(1, 1) - m(0, 0) - m(2, 2));
+			q = quaternion((m(0, 2) - m(2, 0)) / s, (m(0, 1) + m(1, 0)) / s, s / 4, (m(1, 2) + m(2, 1)) / s);
+		}
+		else
+		{
+			double s = 2 * std::sqrt(1 + m(2, 2) - m(0, 0) - m(1, 1));
+			q = quaternion((m(1, 0) - m(0, 1)) / s, (m(0, 2) + m(2, 0)) / s, (m(1, 2) + m(2, 1)) / s, s / 4);
+		}
+		q.normalize();
+		return q;
+	}
+
+	vec3d vec() const
+	{
+		return vec3d(x, y, z);
+	}
+
+	double norm() const
+	{
+		return std::sqrt(w * w + x * x + y * y + z * z);
+	}
+
+	double norm_2() const
+	{
+		return w * w + x * x + y * y + z * z;
+	}
+
+	void normalize()
+	{
+		double r = w * w + x * x + y * y + z * z;
+		if (r == 0)
+			return;
+		r = rsqrt(r);
+		w *= r;
+		x *= r;
+		y *= r;
+		z *= r;
+	}
+
+	quaternion conjugate() const
+	{
+		return quaternion(w, -x, -y, -z);
+	}
+
+	quaternion inverse() const
+	{
+		double r = 1. / norm_2();
+		return quaternion(w * r, -x * r, -y * r, -z * r);
+	}
+
+	double dot(const quaternion &q) const
+	{
+		return w * q.w + x * q.x + y * q.y + z * q.z;
+	}
+
+	/// Rotation matrix of a unit quaternion
+	mat3d to_matrix() const
+	{
+		double xx = x * x, yy = y * y, zz = z * z;
+		double xy = x * y, xz = x * z, yz = y * z;
+		double wx = w * x, wy = w * y, wz = w * z;
+		return mat3d(
+			vec3d(1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy)),
+			vec3d(2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx)),
+			vec3d(2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy)));
+	}
+
+	/// Rotates v by a unit quaternion: v + w t + q x t with t = 2 q x v (15 multiplications)
+	vec3d rotate(const vec3d &v) const
+	{
+		vec3d q(x, y, z);
+		vec3d t = 2 * q.cross(v);
+		return v + w * t + q.cross(t);
+	}
+
+	Eigen::Vector3d rotate(const Eigen::Vector3d &v) const
+	{
+		vec3d out = rotate(vec3d(v[0], v[1], v[2]));
+		return {out.x, out.y, out.z};
+	}
+
+	template <size_t W>
+	vec3d_pack<W> rotate(const vec3d_pack<W> &v) const
+	{
+		vec3d_pack<W> q(vec3d(x, y, z));
+		vec3d_pack<W> t = 2. * q.cross(v);
+		return v + w * t + q.cross(t);
+	}
+
+	/// Inverse rotation of v by a unit quaternion
+	vec3d unrotate(const vec3d &v) const
+	{
+		return conjugate().rotate(v);
+	}
+
+	/// Rotates a batch of vectors. The quaternion is converted once to a matrix, which is
+	/// cheaper per vector (9 multiplications) than the quaternion formula.
+	void rotate(std::span<const vec3d> in, std::span<vec3d> out) const
+	{
+		to_matrix().apply(in, out);
+	}
+
+	void rotate(std::span<const Eigen::Vector3d> in, std::span<Eigen::Vector3d> out) const
+	{
+		to_matrix().apply(in, out);
+	}
+
+	/// Spherical linear interpolation between two unit quaternions, along the shortest arc
+	static quaternion slerp(const quaternion &a, quaternion b, double s)
+	{
+		double cosθ = a.dot(b);
+		if (cosθ < 0)
+		{
+			b = -b;
+			cosθ = -cosθ;
+		}
+		if (cosθ > 0.9995)
+		{
+			quaternion q = (1 - s) * a + s * b;
+			q.normalize();
+			return q;
+		}
+		double θ = std::acos(cosθ);
+		double sinθInv = 1. / std::sin(θ);
+		return (std::sin((1 - s) * θ) * sinθInv) * a + (std::sin(s * θ) * sinθInv) * b;
+	}
+
+	void print() const
+	{
+		std::printf("w: %.4f, x: %.4f, y: %.4f, z: %.4f\n", w, x, y, z);
+	}
+
+	friend quaternion operator*(const quaternion &p, const quaternion &q)
+	{
+		return quaternion(
+			p.w * q.w - p.x * q.x - p.y * q.y - p.z * q.z,
+			p.w * q.x + p.x * q.w + p.y * q.z - p.z * q.y,
+			p.w * q.y - p.x * q.z + p.y * q.w + p.z * q.x,
+			p.w * q.z + p.x * q.y - p.y * q.x + p.z * q.w);
+	}
+
+	quaternion &operator*=(const quaternion &q)
+	{
+		*this = *this * q;
+		return *this;
+	}
+
+	friend quaternion operator*(double a, const quaternion &q)
+	{
+		return quaternion(a * q.w, a * q.x, a * q.y, a * q.z);
+	}
+
+	friend quaternion operator+(const quaternion &p, const quaternion &q)
+	{
+		return quaternion(p.w + q.w, p.x + q.x, p.y + q.y, p.z + q.z);
+	}
+
+	friend quaternion operator-(const quaternion &p, const quaternion &q)
+	{
+		return quaternion(p.w - q.w, p.x - q.x, p.y - q.y, p.z - q.z);
+	}
+
+	quaternion operator-() const
+	{
+		return quaternion(-w, -x, -y, -z);
+	}
+};
+
+/// Batched compose: out[i] = p[i] * q[i]
+inline void compose(std::span<const quaternion> p, std::span<const quaternion> q, std::span<quaternion> out)
+{
+	for (size_t i = 0; i < p.size(); i++)
+		out[i] = p[i] * q[i];
+}
+
+/// Batched normalize, typically after many compositions have accumulated rounding errors
+inline void normalize(std::span<quaternion> q)
+{
+	for (size_t i = 0; i < q.size(); i++)
+		q[i].normalize();
+}
+
+/// Batched rotate with one quaternion per vector: out[i] = q[i].rotate(in[i])
+inline void rotate(std::span<const quaternion> q, std::span<const vec3d> in, std::span<vec3d> out)
+{
+	for (size_t i = 0; i < q.size(); i++)
+		out[i] = q[i].rotate(in[i]);
+}
@@ -3,8 +3,16 @@
 #include <cmath>
 #include <functional>
 #include <span>
+#include <type_traits>
+#include "math/fast_math.h"
 
-class vec2d
+#ifdef OPTITOOLS_ALIGNED_VECTORS
+#define VEC2D_ALIGN alignas(16) ///< Aligned so that a vec2d fills one SSE register
+#else
+#define VEC2D_ALIGN
+#endif
+
+class VEC2D_ALIGN vec2d
 {
 public:
 	double x{};
@@ -17,15 +25,6 @@ public:
 	template <typename T>
 	vec2d(T x, T y) : x((double)x), y((double)y) {}
 
-	vec2d(const vec2d &ref) : x(ref.x), y(ref.y) {}
-
-	vec2d &operator=(const vec2d &v)
-	{
-		x = v.x;
-		y = v.y;
-		return *this;
-	}
-
 	void zero()
 	{
 		x = {};
@@ -42,12 +41,25 @@ public:
 		return x * x + y * y;
 	}
 
+	/// 1 / |v|^3, the factor of every inverse-square force. One sqrt and one division: on a single
+	/// vector the chain is latency bound, and the rsqrt estimate with its Newton steps is longer
+	double inv_norm_3() const
+	{
+		double r2 = x * x + y * y;
+		return 1. / (r2 * std::sqrt(r2));
+	}
+
+	double dot(const vec2d &v) const
+	{
+		return x * v.x + y * v.y;
+	}
+
 	void normalize()
 	{
 		double r = x * x + y * y;
 		if (r == 0)
 			return;
-		r = 1. / sqrt(r);
+		r = rsqrt(r);
 		x *= r;
 		y *= r;
 	}
@@ -163,8 +175,9 @@ public:
 	template <typename U>
 	vec2d &operator/=(U a)
 	{
-		x /= a;
-		y /= a;
+		double aInv = 1. / a;
+		x *= aInv;
+		y *= aInv;
 		return *this;
 	}
 
@@ -205,4 +218,41 @@ public:
 		out.y = -y;
 		return out;
 	}
+
+	/// this += a * u, in a single pass
+	vec2d &axpy(double a, const vec2d &u)
+	{
+		x += a * u.x;
+		y += a * u.y;
+		return *this;
+	}
+
+	/// a * u + b * v without intermediate vectors
+	static vec2d lincomb(double a, const vec2d &u, double b, const vec2d &v)
+	{
+		return vec2d(a * u.x + b * v.x, a * u.y + b * v.y);
+	}
+
+	/// Fused overloads of the solver stage helpers (see solver/inplace.h), picked up by argument
+	/// dependent lookup so the RK4 and Verlet inner loops do not build chains of temporaries.
+	friend void set_stage(vec2d &out, const vec2d &x, double h, const vec2d &k)
+	{
+		out.x = x.x + h * k.x;
+		out.y = x.y + h * k.y;
+	}
+
+	friend void accumulate(vec2d &x, double h, const vec2d &k)
+	{
+		x.axpy(h, k);
+	}
+
+	friend void rk4_update(vec2d &x, double h, const vec2d &k1, const vec2d &k2, const vec2d &k3, const vec2d &k4)
+	{
+		double h6 = h / 6;
+		double h3 = h / 3;
+		x.x += h6 * (k1.x + k4.x) + h3 * (k2.x + k3.x);
+		x.y += h6 * (k1.y + k4.y) + h3 * (k2.y + k3.y);
+	}
 };
+
+static_assert(std::is_trivially_copyable_v<vec2d>, "vec2d must stay trivially copyable");
\ No newline at end of file
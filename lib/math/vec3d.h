@@ -3,8 +3,16 @@
 #include <cmath>
 #include <functional>
 #include <span>
+#include <type_traits>
+#include "math/fast_math.h"
 
-class vec3d
+#ifdef OPTITOOLS_ALIGNED_VECTORS
+#define VEC3D_ALIGN alignas(32) ///< Padded to 4 doubles so that a vec3d fills one AVX register
+#else
+#define VEC3D_ALIGN
+#endif
+
+class VEC3D_ALIGN vec3d
 {
 public:
 	double x{};
@@ -18,16 +26,6 @@ public:
 	template <typename T>
 	vec3d(T x, T y, T z) : x((double)x), y((double)y), z((double)z) {}
 
-	vec3d(const vec3d &ref) : x(ref.x), y(ref.y), z(ref.z) {}
-
-	vec3d &operator=(const vec3d &v)
-	{
-		x = v.x;
-		y = v.y;
-		z = v.z;
-		return *this;
-	}
-
 	void zero()
 	{
 		x = {};
@@ -45,12 +43,30 @@ public:
 		return x * x + y * y + z * z;
 	}
 
+	/// 1 / |v|^3, the factor of every inverse-square force. One sqrt and one division: on a single
+	/// vector the chain is latency bound, and the rsqrt estimate with its Newton steps is longer
+	double inv_norm_3() const
+	{
+		double r2 = x * x + y * y + z * z;
+		return 1. / (r2 * std::sqrt(r2));
+	}
+
+	double dot(const vec3d &v) const
+	{
+		return x * v.x + y * v.y + z * v.z;
+	}
+
+	vec3d cross(const vec3d &v) const
+	{
+		return vec3d(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+	}
+
 	void normalize()
 	{
 		double r = x * x + y * y + z * z;
 		if (r == 0)
 			return;
-		r = 1. / sqrt(r);
+		r = rsqrt(r);
 		x *= r;
 		y *= r;
 		z *= r;
@@ -187,9 +203,10 @@ public:
 	template <typename U>
 	vec3d &operator/=(U a)
 	{
-		x /= a;
-		y /= a;
-		z /= a;
+		double aInv = 1. / a;
+		x *= aInv;
+		y *= aInv;
+		z *= aInv;
 		return *this;
 	}
 
@@ -235,4 +252,44 @@ public:
 		out.z = -z;
 		return out;
 	}
+
+	/// this += a * u, in a single pass
+	vec3d &axpy(double a, const vec3d &u)
+	{
+		x += a * u.x;
+		y += a * u.y;
+		z += a * u.z;
+		return *this;
+	}
+
+	/// a * u + b * v without intermediate vectors
+	static vec3d lincomb(double a, const vec3d &u, double b, const vec3d &v)
+	{
+		return vec3d(a * u.x + b * v.x, a * u.y + b * v.y, a * u.z + b * v.z);
+	}
+
+	/// Fused overloads of the solver stage helpers (see solver/inplace.h), picked up by argument
+	/// dependent lookup so the RK4 and Verlet inner loops do not build chains of temporaries.
+	friend void set_stage(vec3d &out, const vec3d &x, double h, const vec3d &k)
+	{
+		out.x = x.x + h * k.x;
+		out.y = x.y + h * k.y;
+		out.z = x.z + h * k.z;
+	}
+
+	friend void accumulate(vec3d &x, double h, const vec3d &k)
+	{
+		x.axpy(h, k);
+	}
+
+	friend void rk4_update(vec3d &x, double h, const vec3d &k1, const vec3d &k2, const vec3d &k3, const vec3d &k4)
+	{
+		double h6 = h / 6;
+		double h3 = h / 3;
+		x.x += h6 * (k1.x + k4.x) + h3 * (k2.x + k3.x);
+		x.y += h6 * (k1.y + k4.y) + h3 * (k2.y + k3.y);
+		x.z += h6 * (k1.z + k4.z) + h3 * (k2.z + k3.z);
+	}
 };
+
+static_assert(std::is_trivially_copyable_v<vec3d>, "vec3d must stay trivially copyable");
\ No newline at end of file
@@ -0,0 +1,586 @@
+#pragma once
+#include <cstddef>
+#include <span>
+#include "math/double_pack.h"
+#include "math/vec2d.h"
+#include "math/vec3d.h"
+
+/// Structure-of-arrays packs of W vectors: each component is a double_pack<W>, so the same
+/// expression evaluates W vectors at once. The operator surface mirrors vec2d/vec3d, with
+/// double_pack<W> taking the place of double, so kernels templated on the vector type run
+/// unchanged on scalars (lanes = 1) and on packs.
+
+template <size_t W>
+class vec2d_pack
+{
+public:
+	double_pack<W> x{};
+	double_pack<W> y{};
+
+	vec2d_pack() = default;
+
+	vec2d_pack(double a) : x(a), y(a) {}
+
+	vec2d_pack(const double_pack<W> &x, const double_pack<W> &y) : x(x), y(y) {}
+
+	/// Broadcasts the same vector to every lane
+	vec2d_pack(const vec2d &u) : x(u.x), y(u.y) {}
+
+	vec2d get(size_t lane) const
+	{
+		return vec2d(x[lane], y[lane]);
+	}
+
+	void set(size_t lane, const vec2d &u)
+	{
+		x[lane] = u.x;
+		y[lane] = u.y;
+	}
+
+	/// Loads W consecutive vectors of an array of vec2d starting at offset
+	static vec2d_pack gather(std::span<const vec2d> src, size_t offset)
+	{
+		vec2d_pack out;
+		for (size_t i = 0; i < W; i++)
+		{
+			out.x[i] = src[offset + i].x;
+			out.y[i] = src[offset + i].y;
+		}
+		return out;
+	}
+
+	/// Loads the vectors src[index[0]], ..., src[index[W - 1]]
+	static vec2d_pack gather(std::span<const vec2d> src, const size_t *index)
+	{
+		vec2d_pack out;
+		for (size_t i = 0; i < W; i++)
+		{
+			out.x[i] = src[index[i]].x;
+			out.y[i] = src[index[i]].y;
+		}
+		return out;
+	}
+
+	void scatter(std::span<vec2d> dst, size_t offset) const
+	{
+		for (size_t i = 0; i < W; i++)
+		{
+			dst[offset + i].x = x[i];
+			dst[offset + i].y = y[i];
+		}
+	}
+
+	void scatter(std::span<vec2d> dst, const size_t *index) const
+	{
+		for (size_t i = 0; i < W; i++)
+		{
+			dst[index[i]].x = x[i];
+			dst[index[i]].y = y[i];
+		}
+	}
+
+	void zero()
+	{
+		x = 0.;
+		y = 0.;
+	}
+
+	double_pack<W> norm() const
+	{
+		return sqrt(x * x + y * y);
+	}
+
+	double_pack<W> norm_2() const
+	{
+		return x * x + y * y;
+	}
+
+	double_pack<W> inv_norm_3() const
+	{
+		double_pack<W> r = rsqrt(x * x + y * y);
+		return r * r * r;
+	}
+
+	double_pack<W> dot(const vec2d_pack &v) const
+	{
+		return x * v.x + y * v.y;
+	}
+
+	void normalize()
+	{
+		double_pack<W> n2 = x * x + y * y;
+		double_pack<W> r = rsqrt(n2);
+		r.masked_assign(n2 == 0., 1.); ///< Zero vectors are left untouched, as in vec2d
+		x *= r;
+		y *= r;
+	}
+
+	double_pack<W> sum() const
+	{
+		return x + y;
+	}
+
+	/// Sum over the lanes
+	vec2d hsum() const
+	{
+		return vec2d(x.hsum(), y.hsum());
+	}
+
+	/// Assigns u to the lanes selected by mask, leaves the others untouched
+	void masked_assign(const mask_pack<W> &mask, const vec2d_pack &u)
+	{
+		x.masked_assign(mask, u.x);
+		y.masked_assign(mask, u.y);
+	}
+
+	friend vec2d_pack select(const mask_pack<W> &mask, const vec2d_pack &u, const vec2d_pack &v)
+	{
+		return vec2d_pack(select(mask, u.x, v.x), select(mask, u.y, v.y));
+	}
+
+	friend vec2d_pack operator*(const double_pack<W> &a, const vec2d_pack &v)
+	{
+		return vec2d_pack(a * v.x, a * v.y);
+	}
+
+	friend vec2d_pack operator*(const vec2d_pack &v, const double_pack<W> &a)
+	{
+		return vec2d_pack(v.x * a, v.y * a);
+	}
+
+	friend vec2d_pack operator*(double a, const vec2d_pack &v)
+	{
+		return vec2d_pack(a * v.x, a * v.y);
+	}
+
+	friend vec2d_pack operator*(const vec2d_pack &v, double a)
+	{
+		return vec2d_pack(v.x * a, v.y * a);
+	}
+
+	friend vec2d_pack operator*(const vec2d_pack &u, const vec2d_pack &v)
+	{
+		return vec2d_pack(u.x * v.x, u.y * v.y);
+	}
+
+	vec2d_pack &operator*=(const double_pack<W> &a)
+	{
+		x *= a;
+		y *= a;
+		return *this;
+	}
+
+	vec2d_pack &operator*=(const vec2d_pack &u)
+	{
+		x *= u.x;
+		y *= u.y;
+		return *this;
+	}
+
+	friend vec2d_pack operator/(const vec2d_pack &u, const vec2d_pack &v)
+	{
+		return vec2d_pack(u.x / v.x, u.y / v.y);
+	}
+
+	friend vec2d_pack operator/(const vec2d_pack &u, const double_pack<W> &a)
+	{
+		double_pack<W> aInv = 1. / a;
+		return vec2d_pack(u.x * aInv, u.y * aInv);
+	}
+
+	friend vec2d_pack operator/(const vec2d_pack &u, double a)
+	{
+		double aInv = 1. / a;
+		return vec2d_pack(u.x * aInv, u.y * aInv);
+	}
+
+	vec2d_pack &operator/=(const double_pack<W> &a)
+	{
+		double_pack<W> aInv = 1. / a;
+		x *= aInv;
+		y *= aInv;
+		return *this;
+	}
+
+	friend vec2d_pack operator+(const vec2d_pack &u, const vec2d_pack &v)
+	{
+		return vec2d_pack(u.x + v.x, u.y + v.y);
+	}
+
+	vec2d_pack &operator+=(const vec2d_pack &v)
+	{
+		x += v.x;
+		y += v.y;
+		return *this;
+	}
+
+	friend vec2d_pack operator-(const vec2d_pack &u, const vec2d_pack &v)
+	{
+		return vec2d_pack(u.x - v.x, u.y - v.y);
+	}
+
+	vec2d_pack &operator-=(const vec2d_pack &v)
+	{
+		x -= v.x;
+		y -= v.y;
+		return *this;
+	}
+
+	vec2d_pack operator-() const
+	{
+		return vec2d_pack(-x, -y);
+	}
+
+	vec2d_pack &axpy(const double_pack<W> &a, const vec2d_pack &u)
+	{
+		x += a * u.x;
+		y += a * u.y;
+		return *this;
+	}
+
+	static vec2d_pack lincomb(const double_pack<W> &a, const vec2d_pack &u, const double_pack<W> &b, const vec2d_pack &v)
+	{
+		return vec2d_pack(a * u.x + b * v.x, a * u.y + b * v.y);
+	}
+
+	friend void set_stage(vec2d_pack &out, const vec2d_pack &x, double h, const vec2d_pack &k)
+	{
+		out.x = x.x + h * k.x;
+		out.y = x.y + h * k.y;
+	}
+
+	friend void accumulate(vec2d_pack &x, double h, const vec2d_pack &k)
+	{
+		x.x += h * k.x;
+		x.y += h * k.y;
+	}
+
+	friend void rk4_update(vec2d_pack &x, double h, const vec2d_pack &k1, const vec2d_pack &k2, const vec2d_pack &k3, const vec2d_pack &k4)
+	{
+		double h6 = h / 6;
+		double h3 = h / 3;
+		x.x += h6 * (k1.x + k4.x) + h3 * (k2.x + k3.x);
+		x.y += h6 * (k1.y + k4.y) + h3 * (k2.y + k3.y);
+	}
+};
+
+template <size_t W>
+class vec3d_pack
+{
+public:
+	double_pack<W> x{};
+	double_pack<W> y{};
+	double_pack<W> z{};
+
+	vec3d_pack() = default;
+
+	vec3d_pack(double a) : x(a), y(a), z(a) {}
+
+	vec3d_pack(const double_pack<W> &x, const double_pack<W> &y, const double_pack<W> &z) : x(x), y(y), z(z) {}
+
+	/// Broadcasts the same vector to every lane
+	vec3d_pack(const vec3d &u) : x(u.x), y(u.y), z(u.z) {}
+
+	vec3d get(size_t lane) const
+	{
+		return vec3d(x[lane], y[lane], z[lane]);
+	}
+
+	void set(size_t lane, const vec3d &u)
+	{
+		x[lane] = u.x;
+		y[lane] = u.y;
+		z[lane] = u.z;
+	}
+
+	/// Loads W consecutive vectors of an array of vec3d starting at offset
+	static vec3d_pack gather(std::span<const vec3d> src, size_t offset)
+	{
+		vec3d_pack out;
+		for (size_t i = 0; i < W; i++)
+		{
+			out.x[i] = src[offset + i].x;
+			out.y[i] = src[offset + i].y;
+			out.z[i] = src[offset + i].z;
+		}
+		return out;
+	}
+
+	/// Loads the vectors src[index[0]], ..., src[index[W - 1]]
+	static vec3d_pack gather(std::span<const vec3d> src, const size_t *index)
+	{
+		vec3d_pack out;
+		for (size_t i = 0; i < W; i++)
+		{
+			out.x[i] = src[index[i]].x;
+			out.y[i] = src[index[i]].y;
+			out.z[i] = src[index[i]].z;
+		}
+		return out;
+	}
+
+	void scatter(std::span<vec3d> dst, size_t offset) const
+	{
+		for (size_t i = 0; i < W; i++)
+		{
+			dst[offset + i].x = x[i];
+			dst[offset + i].y = y[i];
+			dst[offset + i].z = z[i];
+		}
+	}
+
+	void scatter(std::span<vec3d> dst, const size_t *index) const
+	{
+		for (size_t i = 0; i < W; i++)
+		{
+			dst[index[i]].x = x[i];
+			dst[index[i]].y = y[i];
+			dst[index[i]].z = z[i];
+		}
+	}
+
+	void zero()
+	{
+		x = 0.;
+		y = 0.;
+		z = 0.;
+	}
+
+	double_pack<W> norm() const
+	{
+		return sqrt(x * x + y * y + z * z);
+	}
+
+	double_pack<W> norm_2() const
+	{
+		return x * x + y * y + z * z;
+	}
+
+	double_pack<W> inv_norm_3() const
+	{
+		double_pack<W> r = rsqrt(x * x + y * y + z * z);
+		return r * r * r;
+	}
+
+	double_pack<W> dot(const vec3d_pack &v) const
+	{
+		return x * v.x + y * v.y + z * v.z;
+	}
+
+	vec3d_pack cross(const vec3d_pack &v) const
+	{
+		return vec3d_pack(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+	}
+
+	void normalize()
+	{
+		double_pack<W> n2 = x * x + y * y + z * z;
+		double_pack<W> r = rsqrt(n2);
+		r.masked_assign(n2 == 0., 1.); ///< Zero vectors are left untouched, as in vec3d
+		x *= r;
+		y *= r;
+		z *= r;
+	}
+
+	double_pack<W> sum() const
+	{
+		return x + y + z;
+	}
+
+	/// Sum over the lanes
+	vec3d hsum() const
+	{
+		return vec3d(x.hsum(), y.hsum(), z.hsum());
+	}
+
+	/// Assigns u to the lanes selected by mask, leaves the others untouched
+	void masked_assign(const mask_pack<W> &mask, const vec3d_pack &u)
+	{
+		x.masked_assign(mask, u.x);
+		y.masked_assign(mask, u.y);
+		z.masked_assign(mask, u.z);
+	}
+
+	friend vec3d_pack select(const mask_pack<W> &mask, const vec3d_pack &u, const vec3d_pack &v)
+	{
+		return vec3d_pack(select(mask, u.x, v.x), select(mask, u.y, v.y), select(mask, u.z, v.z));
+	}
+
+	friend vec3d_pack operator*(const double_pack<W> &a, const vec3d_pack &v)
+	{
+		return vec3d_pack(a * v.x, a * v.y, a * v.z);
+	}
+
+	friend vec3d_pack operator*(const vec3d_pack &v, const double_pack<W> &a)
+	{
+		return vec3d_pack(v.x * a, v.y * a, v.z * a);
+	}
+
+	friend vec3d_pack operator*(double a, const vec3d_pack &v)
+	{
+		return vec3d_pack(a * v.x, a * v.y, a * v.z);
+	}
+
+	friend vec3d_pack operator*(const vec3d_pack &v, double a)
+	{
+		return vec3d_pack(v.x * a, v.y * a, v.z * a);
+	}
+
+	friend vec3d_pack operator*(const vec3d_pack &u, const vec3d_pack &v)
+	{
+		return vec3d_pack(u.x * v.x, u.y * v.y, u.z * v.z);
+	}
+
+	vec3d_pack &operator*=(const double_pack<W> &a)
+	{
+		x *= a;
+		y *= a;
+		z *= a;
+		return *this;
+	}
+
+	vec3d_pack &operator*=(const vec3d_pack &u)
+	{
+		x *= u.x;
+		y *= u.y;
+		z *= u.z;
+		return *this;
+	}
+
+	friend vec3d_pack operator/(const vec3d_pack &u, const vec3d_pack &v)
+	{
+		return vec3d_pack(u.x / v.x, u.y / v.y, u.z / v.z);
+	}
+
+	friend vec3d_pack operator/(const vec3d_pack &u, const double_pack<W> &a)
+	{
+		double_pack<W> aInv = 1. / a;
+		return vec3d_pack(u.x * aInv, u.y * aInv, u.z * aInv);
+	}
+
+	friend vec3d_pack operator/(const vec3d_pack &u, double a)
+	{
+		double aInv = 1. / a;
+		return vec3d_pack(u.x * aInv, u.y * aInv, u.z * aInv);
+	}
+
+	vec3d_pack &operator/=(const double_pack<W> &a)
+	{
+		double_pack<W> aInv = 1. / a;
+		x *= aInv;
+		y *= aInv;
+		z *= aInv;
+		return *this;
+	}
+
+	friend vec3d_pack operator+(const vec3d_pack &u, const vec3d_pack &v)
+	{
+		return vec3d_pack(u.x + v.x, u.y + v.y, u.z + v.z);
+	}
+
+	vec3d_pack &operator+=(const vec3d_pack &v)
+	{
+		x += v.x;
+		y += v.y;
+		z += v.z;
+		return *this;
+	}
+
+	friend vec3d_pack operator-(const vec3d_pack &u, const vec3d_pack &v)
+	{
+		return vec3d_pack(u.x - v.x, u.y - v.y, u.z - v.z);
+	}
+
+	vec3d_pack &operator-=(const vec3d_pack &v)
+	{
+		x -= v.x;
+		y -= v.y;
+		z -= v.z;
+		return *this;
+	}
+
+	vec3d_pack operator-() const
+	{
+		return vec3d_pack(-x, -y, -z);
+	}
+
+	vec3d_pack &axpy(const double_pack<W> &a, const vec3d_pack &u)
+	{
+		x += a * u.x;
+		y += a * u.y;
+		z += a * u.z;
+		return *this;
+	}
+
+	static vec3d_pack lincomb(const double_pack<W> &a, const vec3d_pack &u, const double_pack<W> &b, const vec3d_pack &v)
+	{
+		return vec3d_pack(a * u.x + b * v.x, a * u.y + b * v.y, a * u.z + b * v.z);
+	}
+
+	friend void set_stage(vec3d_pack &out, const vec3d_pack &x, double h, const vec3d_pack &k)
+	{
+		out.x = x.x + h * k.x;
+		out.y = x.y + h * k.y;
+		out.z = x.z + h * k.z;
+	}
+
+	friend void accumulate(vec3d_pack &x, double h, const vec3d_pack &k)
+	{
+		x.x += h * k.x;
+		x.y += h * k.y;
+		x.z += h * k.z;
+	}
+
+	friend void rk4_update(vec3d_pack &x, double h, const vec3d_pack &k1, const vec3d_pack &k2, const vec3d_pack &k3, const vec3d_pack &k4)
+	{
+		double h6 = h / 6;
+		double h3 = h / 3;
+		x.x += h6 * (k1.x + k4.x) + h3 * (k2.x + k3.x);
+		x.y += h6 * (k1.y + k4.y) + h3 * (k2.y + k3.y);
+		x.z += h6 * (k1.z + k4.z) + h3 * (k2.z + k3.z);
+	}
+};
+
+inline vec2d hsum(const vec2d &u)
+{
+	return u;
+}
+
+inline vec3d hsum(const vec3d &u)
+{
+	return u;
+}
+
+template <size_t W>
+vec2d hsum(const vec2d_pack<W> &u)
+{
+	return u.hsum();
+}
+
+template <size_t W>
+vec3d hsum(const vec3d_pack<W> &u)
+{
+	return u.hsum();
+}
+
+/// Lane count and per-lane scalar type of a vector type, to write kernels once for vec3d and vec3d_pack<W>
+template <typename V>
+struct pack_traits
+{
+	static constexpr size_t lanes = 1;
+	using scalar = double;
+};
+
+template <size_t W>
+struct pack_traits<vec2d_pack<W>>
+{
+	static constexpr size_t lanes = W;
+	using scalar = double_pack<W>;
+};
+
+template <size_t W>
+struct pack_traits<vec3d_pack<W>>
+{
+	static constexpr size_t lanes = W;
+	using scalar = double_pack<W>;
+};
@@ -0,0 +1,345 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+#include <Eigen/Core>
+#include "math/double_pack.h"
+#include "math/parallel.h"
+#include "math/vec3d.h"
+#include "direct.h"
+#include "morton.h"
+
+/// Barnes-Hut tree code: O(N log N) gravitational accelerations with Plummer softening, for the
+/// SoA states of direct_summation. The bodies are sorted along the Morton curve and the octree is
+/// a contiguous array in depth-first order, each cell holding a contiguous range of sorted bodies
+/// and the index of the cell after its subtree, so the traversal needs no stack.
+/// Cells carry their mass, center of mass and traceless quadrupole. The bodies of a group (cell of
+/// at most group_size bodies, or leaf of more bodies sharing one Morton key) share one walk: a cell is accepted for the whole group when its
+/// distance to the group's bounding box is larger than s / θ + δ (s the cell size, δ the offset
+/// of its center of mass from the center of its box), then every target of the group sums the
+/// accepted cells and the bodies of the opened leaves with double_pack.
+/// The tree is rebuilt at every evaluation: keys, sort and moments run in parallel, the serial split
+/// of the key ranges takes ~0.1% of an evaluation, and the whole build ~3%.
+class barnes_hut
+{
+public:
+    static constexpr size_t leaf_size = 16;  ///< Maximum bodies per leaf
+    static constexpr size_t group_size = 64; ///< Maximum bodies sharing a tree walk
+
+    barnes_hut(std::vector<double> masses, double G = 6.67430e-11, double softening = 0)
+        : _N(masses.size()), _masses(std::move(masses)), _G(G), _ε2(softening * softening)
+    {
+        _order.resize(_N);
+        _keys.resize(_N);
+        size_t padded = _N + 4 * native_lanes; ///< The last target packs of a group load up to 4 W lanes
+        _x.assign(padded, 0.);
+        _y.assign(padded, 0.);
+        _z.assign(padded, 0.);
+        _Gm.assign(padded, 0.);
+        _ax.assign(padded, 0.);
+        _ay.assign(padded, 0.);
+        _az.assign(padded, 0.);
+    }
+
+    /// θ = 0 degenerates into direct summation, 0.5 to 0.7 are the usual values
+    void set_opening_angle(double θ) { _θ = θ; }
+    void set_softening(double softening) { _ε2 = softening * softening; }
+    void set_thread_count(size_t threads) { _threads = threads; }
+    size_t size() const { return _N; }
+    size_t get_node_count() const { return _nodes.size(); }
+
+    /// a = accelerations of the bodies at positions x, both in SoA layout
+    void operator()(double, const Eigen::VectorXd &x, Eigen::VectorXd &a)
+    {
+        build(x);
+        compute_moments();
+
+        parallel_for(_groups.size(), [this](size_t begin, size_t end)
+        {
+            interaction_list list;
+            for (size_t g = begin; g < end; g++)
+                accumulate_group(_nodes[_groups[g]], list);
+        }, _threads);
+
+        a.resize(3 * _N);
+        for (size_t k = 0; k < _N; k++)
+        {
+            size_t i = _order[k];
+            a[i] = _ax[k];
+            a[_N + i] = _ay[k];
+            a[2 * _N + i] = _az[k];
+        }
+    }
+
+private:
+    struct node
+    {
+        uint32_t begin, end; ///< Range of sorted bodies
+        uint32_t next;       ///< First cell after the subtree
+        bool leaf;
+        double Gm{};
+        vec3d com{};    ///< Center of mass
+        double Q[6]{};  ///< G Σ m (3 d dᵀ - |d|² I) about the center of mass: xx, xy, xz, yy, yz, zz
+        vec3d center{}; ///< Bounding box of the bodies
+        vec3d half_size{};
+        double open_radius{}; ///< s / θ + δ
+    };
+
+    /// Accepted cells and leaf bodies for one group, SoA
+    struct interaction_list
+    {
+        std::vector<double> x, y, z, Gm;
+        std::vector<double> cx, cy, cz, cGm, Q[6];
+
+        void clear()
+        {
+            x.clear(), y.clear(), z.clear(), Gm.clear();
+            cx.clear(), cy.clear(), cz.clear(), cGm.clear();
+            for (std::vector<double> &q : Q)
+                q.clear();
+        }
+    };
+
+    /// Morton sort of the bodies in their bounding cube, then top-down split of the key ranges
+    void build(const Eigen::VectorXd &x)
+    {
+        Eigen::Vector3d low(x.segment(0, _N).minCoeff(), x.segment(_N, _N).minCoeff(), x.segment(2 * _N, _N).minCoeff());
+        Eigen::Vector3d high(x.segment(0, _N).maxCoeff(), x.segment(_N, _N).maxCoeff(), x.segment(2 * _N, _N).maxCoeff());
+        double size = std::max((high - low).maxCoeff(), 1e-300);
+        double scale = ((1u << morton_bits) - 1) / size;
+
+        parallel_for(_N, [&](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; i++)
+            {
+                uint32_t ix = (uint32_t)((x[i] - low[0]) * scale);
+                uint32_t iy = (uint32_t)((x[_N + i] - low[1]) * scale);
+                uint32_t iz = (uint32_t)((x[2 * _N + i] - low[2]) * scale);
+                _keys[i] = {morton_encode(ix, iy, iz), (uint32_t)i};
+            }
+        }, _threads);
+        parallel_sort(_keys.begin(), _keys.end(), [](const keyed &a, const keyed &b)
+        { return a.key < b.key; }, _threads);
+        for (size_t k = 0; k < _N; k++)
+        {
+            _order[k] = _keys[k].index;
+            _Gm[k] = _G * _masses[_order[k]];
+        }
+
+        _nodes.clear();
+        _groups.clear();
+        if (_N > 0)
+            split(0, _N, 0, _N + group_size);
+        gather(x);
+    }
+
+    void split(size_t begin, size_t end, unsigned level, size_t parent_count)
+    {
+        /// Levels where every body falls in the same octant add no cell
+        while (level < morton_bits && morton_octant(_keys[begin].key, level) == morton_octant(_keys[end - 1].key, level))
+            level++;
+
+        size_t index = _nodes.size();
+        bool leaf = end - begin <= leaf_size || level == morton_bits;
+        _nodes.push_back({(uint32_t)begin, (uint32_t)end, 0, leaf});
+        /// A leaf of more than group_size bodies sharing one key is a group of its own
+        if ((end - begin <= group_size && parent_count > group_size) || (leaf && end - begin > group_size))
+            _groups.push_back(index);
+        if (!_nodes[index].leaf)
+        {
+            size_t child = begin;
+            while (child < end)
+            {
+                unsigned octant = morton_octant(_keys[child].key, level);
+                size_t child_end = std::partition_point(_keys.begin() + child, _keys.begin() + end, [&](const keyed &k)
+                { return morton_octant(k.key, level) == octant; }) - _keys.begin();
+                split(child, child_end, level + 1, end - begin);
+                child = child_end;
+            }
+        }
+        _nodes[index].next = _nodes.size();
+    }
+
+    /// Positions in Morton order
+    void gather(const Eigen::VectorXd &x)
+    {
+        for (size_t k = 0; k < _N; k++)
+        {
+            size_t i = _order[k];
+            _x[k] = x[i];
+            _y[k] = x[_N + i];
+            _z[k] = x[2 * _N + i];
+        }
+    }
+
+    /// Moments and boxes of every cell from its own range of bodies: each cell is independent, so
+    /// they are computed in parallel, and the ranges are contiguous in memory
+    void compute_moments()
+    {
+        parallel_for(_nodes.size(), [this](size_t begin, size_t end)
+        {
+            for (size_t n = begin; n < end; n++)
+            {
+                node &c = _nodes[n];
+                double Gm = 0;
+                vec3d com(0.), low(_x[c.begin], _y[c.begin], _z[c.begin]), high = low;
+                for (size_t k = c.begin; k < c.end; k++)
+                {
+                    vec3d p(_x[k], _y[k], _z[k]);
+                    Gm += _Gm[k];
+                    com.axpy(_Gm[k], p);
+                    low = vec3d(std::min(low.x, p.x), std::min(low.y, p.y), std::min(low.z, p.z));
+                    high = vec3d(std::max(high.x, p.x), std::max(high.y, p.y), std::max(high.z, p.z));
+                }
+                com = Gm > 0 ? com / Gm : 0.5 * (low + high);
+
+                std::fill_n(c.Q, 6, 0.);
+                for (size_t k = c.begin; k < c.end; k++)
+                {
+                    vec3d d = vec3d(_x[k], _y[k], _z[k]) - com;
+                    double d2 = d.dot(d);
+                    c.Q[0] += _Gm[k] * (3 * d.x * d.x - d2);
+                    c.Q[1] += _Gm[k] * 3 * d.x * d.y;
+                    c.Q[2] += _Gm[k] * 3 * d.x * d.z;
+                    c.Q[3] += _Gm[k] * (3 * d.y * d.y - d2);
+                    c.Q[4] += _Gm[k] * 3 * d.y * d.z;
+                    c.Q[5] += _Gm[k] * (3 * d.z * d.z - d2);
+                }
+
+                c.Gm = Gm;
+                c.com = com;
+                c.center = 0.5 * (low + high);
+                c.half_size = 0.5 * (high - low);
+                double s = 2 * std::max({c.half_size.x, c.half_size.y, c.half_size.z});
+                c.open_radius = _θ > 0 ? s / _θ + (com - c.center).norm() : INFINITY;
+            }
+        }, _threads);
+    }
+
+    /// Walk of the tree for the bodies of one group, then summation of the interaction list
+    void accumulate_group(const node &target, interaction_list &list)
+    {
+        list.clear();
+        size_t n = 0;
+        while (n < _nodes.size())
+        {
+            const node &c = _nodes[n];
+            vec3d d = c.com - target.center;
+            vec3d outside(std::max(std::abs(d.x) - target.half_size.x, 0.),
+                          std::max(std::abs(d.y) - target.half_size.y, 0.),
+                          std::max(std::abs(d.z) - target.half_size.z, 0.));
+            if (outside.dot(outside) > c.open_radius * c.open_radius && c.end - c.begin > 1)
+            {
+                list.cx.push_back(c.com.x);
+                list.cy.push_back(c.com.y);
+                list.cz.push_back(c.com.z);
+                list.cGm.push_back(c.Gm);
+                for (size_t q = 0; q < 6; q++)
+                    list.Q[q].push_back(c.Q[q]);
+                n = c.next;
+            }
+            else if (c.leaf || c.end - c.begin == 1)
+            {
+                list.x.insert(list.x.end(), &_x[c.begin], &_x[c.end]);
+                list.y.insert(list.y.end(), &_y[c.begin], &_y[c.end]);
+                list.z.insert(list.z.end(), &_z[c.begin], &_z[c.end]);
+                list.Gm.insert(list.Gm.end(), &_Gm[c.begin], &_Gm[c.end]);
+                n = c.next;
+            }
+            else
+                n++;
+        }
+
+        /// Target packs by 4, 2 and 1, for the rsqrt latency as in direct_summation
+        constexpr size_t W = native_lanes;
+        size_t i = target.begin;
+        for (; i + 2 * W < target.end; i += 4 * W)
+            sum_list<4>(i, target.end, list);
+        for (; i + W < target.end; i += 2 * W)
+            sum_list<2>(i, target.end, list);
+        for (; i < target.end; i += W)
+            sum_list<1>(i, target.end, list);
+    }
+
+    /// Accelerations of the U packs of targets from i, stored up to end. Bodies: direct_summation
+    /// kernel. Cells: monopole and quadrupole, with d = com - target,
+    ///     a = G M d / r³ + 5/2 (dᵀQd) d / r⁷ - Q d / r⁵
+    template <size_t U>
+    void sum_list(size_t i, size_t end, const interaction_list &list)
+    {
+        using D = double_pack<native_lanes>;
+        constexpr size_t W = native_lanes;
+        const double ε2 = _ε2 + 1e-120;
+        D xi[U], yi[U], zi[U], ax[U], ay[U], az[U];
+        for (size_t b = 0; b < U; b++)
+        {
+            xi[b] = D::load(&_x[i + b * W]);
+            yi[b] = D::load(&_y[i + b * W]);
+            zi[b] = D::load(&_z[i + b * W]);
+            ax[b] = ay[b] = az[b] = D(0.);
+        }
+        for (size_t j = 0; j < list.x.size(); j++)
+        {
+            for (size_t b = 0; b < U; b++)
+            {
+                D dx = list.x[j] - xi[b];
+                D dy = list.y[j] - yi[b];
+                D dz = list.z[j] - zi[b];
+                D inv_r = rsqrt(dx * dx + dy * dy + dz * dz + ε2);
+                D k = list.Gm[j] * inv_r * inv_r * inv_r;
+                ax[b] += k * dx;
+                ay[b] += k * dy;
+                az[b] += k * dz;
+            }
+        }
+        for (size_t j = 0; j < list.cx.size(); j++)
+        {
+            for (size_t b = 0; b < U; b++)
+            {
+                D dx = list.cx[j] - xi[b];
+                D dy = list.cy[j] - yi[b];
+                D dz = list.cz[j] - zi[b];
+                D inv_r = rsqrt(dx * dx + dy * dy + dz * dz + ε2);
+                D inv_r2 = inv_r * inv_r;
+                D inv_r3 = inv_r2 * inv_r;
+                D inv_r5 = inv_r3 * inv_r2;
+                D Qx = list.Q[0][j] * dx + list.Q[1][j] * dy + list.Q[2][j] * dz;
+                D Qy = list.Q[1][j] * dx + list.Q[3][j] * dy + list.Q[4][j] * dz;
+                D Qz = list.Q[2][j] * dx + list.Q[4][j] * dy + list.Q[5][j] * dz;
+                D dQd = dx * Qx + dy * Qy + dz * Qz;
+                D k = list.cGm[j] * inv_r3 + 2.5 * dQd * inv_r5 * inv_r2;
+                ax[b] += k * dx - inv_r5 * Qx;
+                ay[b] += k * dy - inv_r5 * Qy;
+                az[b] += k * dz - inv_r5 * Qz;
+            }
+        }
+        /// The lanes past end belong to the next group, possibly on another thread
+        size_t count = std::min(U * W, end - i);
+        for (size_t l = 0; l < count; l++)
+        {
+            _ax[i + l] = ax[l / W][l % W];
+            _ay[i + l] = ay[l / W][l % W];
+            _az[i + l] = az[l / W][l % W];
+        }
+    }
+
+    struct keyed
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    size_t _N;
+    std::vector<double> _masses;
+    double _G;
+    double _ε2;
+    double _θ = 0.5;
+    size_t _threads = thread_count();
+    std::vector<keyed> _keys;     ///< Sorted Morton keys of the last build
+    std::vector<uint32_t> _order; ///< Original index of the k-th body in Morton order
+    std::vector<node> _nodes;     ///< Depth first, the children of a cell follow it
+    std::vector<size_t> _groups;  ///< Largest cells with at most group_size bodies, and larger leaves
+    std::vector<double> _x, _y, _z, _Gm; ///< Morton order, padded by 4 native_lanes
+    std::vector<double> _ax, _ay, _az;
+};
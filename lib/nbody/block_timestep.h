@@ -0,0 +1,195 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+#include <Eigen/Core>
+#include <fmt/format.h>
+
+/// Accelerations of the active bodies of an SoA N-body state (see direct_summation): a is written
+/// for the listed bodies only, the other entries keep their values
+using active_acceleration_inplace =
+    std::function<void(double t, const Eigen::VectorXd &x, std::span<const uint32_t> active, Eigen::VectorXd &a)>;
+
+/// Kick-drift-kick leapfrog with individual block time steps (Quinn et al. 1997, as in GADGET): each
+/// body has its own step dt_max / 2^k, k being its bin, and is kicked only at the multiples of that
+/// step. All bodies are drifted to every sub-step time, and a single call evaluates the forces of the
+/// bodies that are due there (the active bins), so one close pair no longer forces the whole system
+/// onto its step. The bin of a body follows the criterion
+///     dt = η |a| / |da/dt|
+/// (the first-order form of Aarseth's), with da/dt from the accelerations at the two ends of its
+/// last step, and is reconsidered at each of its kicks: moving to a smaller step is always possible,
+/// to the next larger one only when that step is synchronized. Every body is synchronized at the
+/// multiples of dt_max.
+class block_timestep
+{
+public:
+    static constexpr size_t max_bin = 30; ///< Steps down to dt_max / 2^30
+
+    block_timestep(size_t bins = 16) { set_bin_count(bins); }
+
+    /// Positions and velocities at t0, SoA layout
+    void set_initial_state(double t0, const Eigen::VectorXd &x0, const Eigen::VectorXd &v0)
+    {
+        _t = t0;
+        _x = x0;
+        _v = v0;
+        _started = false;
+    }
+    /// Largest step, at which every body is synchronized
+    void set_timestep(double dt_max) { _dt = dt_max; }
+    /// Number of bins, the smallest step being dt_max / 2^(bins - 1)
+    void set_bin_count(size_t bins)
+    {
+        if (bins < 1 || bins > max_bin + 1)
+            fmt::println("ERROR: block time steps need 1 to {} bins, got {}", max_bin + 1, bins);
+        _bins = std::clamp<size_t>(bins, 1, max_bin + 1);
+    }
+    /// η of the time step criterion
+    void set_accuracy(double η) { _η = η; }
+
+    /// Advances the system to tf, a multiple of dt_max after the current time (continuing from the
+    /// last solve)
+    const Eigen::VectorXd &solve(double tf, active_acceleration_inplace a)
+    {
+        size_t N = _x.size() / 3;
+        size_t steps = (size_t)std::round((tf - _t) / _dt);
+        if (tf <= _t)
+            fmt::println("ERROR: end time must be greater than initial time");
+        if (!_started)
+            start(a);
+
+        const uint64_t ticks = uint64_t(1) << (_bins - 1); ///< Smallest steps per dt_max
+        const double dt_min = _dt / ticks;
+        for (size_t step = 0; step < steps; step++)
+        {
+            double t0 = _t;
+            /// Opening half kicks of every body, all synchronized
+            for (size_t i = 0; i < N; i++)
+                kick(i, 0.5 * step_of(i));
+
+            uint64_t tick = 0;
+            while (tick < ticks)
+            {
+                /// Next time some body is due: the end of the smallest occupied step
+                uint64_t next = ticks;
+                for (size_t i = 0; i < N; i++)
+                    next = std::min(next, (tick / period(i) + 1) * period(i));
+                _x.noalias() += (next - tick) * dt_min * _v;
+                tick = next;
+                _t = t0 + tick * dt_min;
+
+                _active.clear();
+                for (size_t i = 0; i < N; i++)
+                    if (tick % period(i) == 0)
+                        _active.push_back(i);
+                for (uint32_t i : _active)
+                    for (size_t d = 0; d < 3; d++)
+                        _a_last[d * N + i] = _a[d * N + i];
+                a(_t, _x, _active, _a);
+                _evaluations += _active.size();
+
+                /// Closing half kick, new bin, and opening half kick of the next step
+                for (uint32_t i : _active)
+                {
+                    double dt_old = step_of(i);
+                    kick(i, 0.5 * dt_old);
+                    update_bin(i, dt_old, tick);
+                    if (tick < ticks)
+                        kick(i, 0.5 * step_of(i));
+                }
+            }
+            _t = t0 + _dt;
+        }
+        _t = tf;
+        return _x;
+    }
+
+    double get_time() const { return _t; }
+    const Eigen::VectorXd &get_positions() const { return _x; }
+    const Eigen::VectorXd &get_velocities() const { return _v; }
+    /// Bodies per bin, bin k having the step dt_max / 2^k
+    std::vector<size_t> get_bin_histogram() const
+    {
+        std::vector<size_t> histogram(_bins, 0);
+        for (uint8_t k : _bin)
+            histogram[k]++;
+        return histogram;
+    }
+    /// Accelerations of single bodies computed so far: N per step for a global time step
+    size_t get_force_evaluations() const { return _evaluations; }
+
+private:
+    uint64_t period(size_t i) const { return uint64_t(1) << (_bins - 1 - _bin[i]); }
+    double step_of(size_t i) const { return std::ldexp(_dt, -int(_bin[i])); }
+
+    void kick(size_t i, double h)
+    {
+        size_t N = _x.size() / 3;
+        for (size_t d = 0; d < 3; d++)
+            _v[d * N + i] += h * _a[d * N + i];
+    }
+
+    /// Bin of the step η |a| / |da/dt|, rounded down to a power of two
+    size_t required_bin(size_t i, const Eigen::VectorXd &jerk_a, const Eigen::VectorXd &jerk_b, double h) const
+    {
+        size_t N = _x.size() / 3;
+        double a2 = 0, j2 = 0;
+        for (size_t d = 0; d < 3; d++)
+        {
+            double j = (jerk_b[d * N + i] - jerk_a[d * N + i]) / h;
+            a2 += _a[d * N + i] * _a[d * N + i];
+            j2 += j * j;
+        }
+        if (j2 == 0)
+            return 0;
+        double dt = _η * std::sqrt(a2 / j2);
+        if (!(dt < _dt)) ///< Also catches a = 0 and NaN
+            return 0;
+        return std::min<size_t>(_bins - 1, (size_t)std::ceil(std::log2(_dt / dt)));
+    }
+
+    void update_bin(size_t i, double h, uint64_t tick)
+    {
+        size_t k = required_bin(i, _a_last, _a, h);
+        if (k > _bin[i])
+            _bin[i] = k;
+        else if (k < _bin[i] && tick % (2 * period(i)) == 0)
+            _bin[i]--;
+    }
+
+    /// Accelerations of all bodies, and the initial bins from da/dt along the initial velocities over
+    /// the smallest step
+    void start(active_acceleration_inplace &a)
+    {
+        size_t N = _x.size() / 3;
+        _all.resize(N);
+        for (size_t i = 0; i < N; i++)
+            _all[i] = i;
+        _bin.assign(N, 0);
+        _a.setZero(3 * N);
+        _a_last.setZero(3 * N);
+        double h = std::ldexp(_dt, 1 - int(_bins));
+        Eigen::VectorXd x_h = _x + h * _v;
+        a(_t, x_h, _all, _a_last);
+        a(_t, _x, _all, _a);
+        _evaluations += 2 * N;
+        for (size_t i = 0; i < N; i++)
+            _bin[i] = required_bin(i, _a, _a_last, h);
+        _started = true;
+    }
+
+    double _t = 0;
+    double _dt = 1;
+    size_t _bins;
+    double _η = 0.02;
+    bool _started = false;
+    size_t _evaluations = 0;
+    Eigen::VectorXd _x, _v;
+    Eigen::VectorXd _a;      ///< Accelerations at the last kick of each body
+    Eigen::VectorXd _a_last; ///< Accelerations at the kick before
+    std::vector<uint8_t> _bin;
+    std::vector<uint32_t> _active, _all;
+};
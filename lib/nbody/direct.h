@@ -0,0 +1,404 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <Eigen/Core>
+#include "math/double_pack.h"
+#include "math/parallel.h"
+#include "math/vec3d.h"
+
+/// N-body states are Eigen::VectorXd in structure-of-arrays layout (x_0..x_N-1, y_0..y_N-1, z_0..z_N-1):
+/// the integrators' arithmetic works on them unchanged and the kernels read contiguous lanes.
+inline Eigen::VectorXd nbody_state(std::span<const vec3d> bodies)
+{
+    size_t N = bodies.size();
+    Eigen::VectorXd x(3 * N);
+    for (size_t i = 0; i < N; i++)
+    {
+        x[i] = bodies[i].x;
+        x[N + i] = bodies[i].y;
+        x[2 * N + i] = bodies[i].z;
+    }
+    return x;
+}
+
+inline vec3d nbody_body(const Eigen::VectorXd &x, size_t i)
+{
+    size_t N = x.size() / 3;
+    return vec3d(x[i], x[N + i], x[2 * N + i]);
+}
+
+/// O(N²) direct summation of the gravitational accelerations with Plummer softening ε:
+///     a_i = Σ_j G m_j (x_j - x_i) / (|x_j - x_i|² + ε²)^(3/2)
+/// Targets are processed in blocks of double_pack (rsqrt refined by Newton steps), sources
+/// in tiles that stay in L1 while every target block of a thread sweeps them, and the target blocks
+/// are split between threads. Usable as the acceleration_inplace<Eigen::VectorXd> of verlet_velocity
+/// and yoshida_4th, and with the velocities as the acceleration_jerk_inplace / acceleration_snap_inplace
+/// of the Hermite integrators; pass it with std::ref to share the buffers instead of copying them.
+class direct_summation
+{
+public:
+    static constexpr size_t tile_size = 512; ///< Sources per tile: 4 arrays of 4 kB
+
+    direct_summation(std::vector<double> masses, double G = 6.67430e-11, double softening = 0)
+        : _N(masses.size()), _masses(std::move(masses)), _G(G), _ε2(softening * softening)
+    {
+        size_t padded = (_N + block - 1) / block * block;
+        _Gm.assign(padded, 0.); ///< Padding bodies have no mass, so they can be summed over
+        for (size_t i = 0; i < _N; i++)
+            _Gm[i] = _G * _masses[i];
+        _x.assign(padded, 0.);
+        _y.assign(padded, 0.);
+        _z.assign(padded, 0.);
+        _ax.assign(padded, 0.);
+        _ay.assign(padded, 0.);
+        _az.assign(padded, 0.);
+    }
+
+    void set_softening(double softening) { _ε2 = softening * softening; }
+    void set_thread_count(size_t threads) { _threads = threads; }
+    size_t size() const { return _N; }
+
+    /// a = accelerations of the bodies at positions x, both in SoA layout
+    void operator()(double, const Eigen::VectorXd &x, Eigen::VectorXd &a)
+    {
+        std::copy_n(x.data(), _N, _x.data());
+        std::copy_n(x.data() + _N, _N, _y.data());
+        std::copy_n(x.data() + 2 * _N, _N, _z.data());
+
+        parallel_for(_x.size() / block, [this](size_t begin, size_t end)
+        { accumulate_blocks(_x.data(), _y.data(), _z.data(), begin * block, end * block); }, _threads);
+
+        a.resize(3 * _N);
+        std::copy_n(_ax.data(), _N, a.data());
+        std::copy_n(_ay.data(), _N, a.data() + _N);
+        std::copy_n(_az.data(), _N, a.data() + 2 * _N);
+    }
+
+    /// Accelerations of the active bodies only, from all the bodies: the other entries of a are left
+    /// unchanged. The active targets are gathered into packed blocks, for block_timestep.
+    void operator()(double, const Eigen::VectorXd &x, std::span<const uint32_t> active, Eigen::VectorXd &a)
+    {
+        std::copy_n(x.data(), _N, _x.data());
+        std::copy_n(x.data() + _N, _N, _y.data());
+        std::copy_n(x.data() + 2 * _N, _N, _z.data());
+        size_t padded = (active.size() + block - 1) / block * block;
+        _tx.assign(padded, 0.);
+        _ty.assign(padded, 0.);
+        _tz.assign(padded, 0.);
+        for (size_t k = 0; k < active.size(); k++)
+        {
+            _tx[k] = _x[active[k]];
+            _ty[k] = _y[active[k]];
+            _tz[k] = _z[active[k]];
+        }
+
+        parallel_for(padded / block, [this](size_t begin, size_t end)
+        { accumulate_blocks(_tx.data(), _ty.data(), _tz.data(), begin * block, end * block); }, _threads);
+
+        a.resize(3 * _N);
+        for (size_t k = 0; k < active.size(); k++)
+        {
+            a[active[k]] = _ax[k];
+            a[_N + active[k]] = _ay[k];
+            a[2 * _N + active[k]] = _az[k];
+        }
+    }
+
+    /// Accelerations and jerks (time derivatives of the accelerations) of the bodies at positions x
+    /// and velocities v, in one pass over the pairs, for hermite_4th
+    void operator()(double, const Eigen::VectorXd &x, const Eigen::VectorXd &v, Eigen::VectorXd &a, Eigen::VectorXd &j)
+    {
+        derivatives<false>(x, v, nullptr, all_bodies(), a, j, nullptr);
+    }
+
+    /// Accelerations and jerks of the active bodies only, for hermite_block_timestep
+    void operator()(double, const Eigen::VectorXd &x, const Eigen::VectorXd &v, std::span<const uint32_t> active,
+                    Eigen::VectorXd &a, Eigen::VectorXd &j)
+    {
+        derivatives<false>(x, v, nullptr, active, a, j, nullptr);
+    }
+
+    /// Accelerations, jerks and snaps, for hermite_6th. The snaps depend on the accelerations of the
+    /// bodies, given as a_in (predicted by the integrator).
+    void operator()(double, const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &a_in,
+                    Eigen::VectorXd &a, Eigen::VectorXd &j, Eigen::VectorXd &s)
+    {
+        derivatives<true>(x, v, &a_in, all_bodies(), a, j, &s);
+    }
+
+    void operator()(double, const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd &a_in,
+                    std::span<const uint32_t> active, Eigen::VectorXd &a, Eigen::VectorXd &j, Eigen::VectorXd &s)
+    {
+        derivatives<true>(x, v, &a_in, active, a, j, &s);
+    }
+
+    /// Total potential energy -Σ_{i<j} G m_i m_j / sqrt(r_ij² + ε²), scalar O(N²)
+    double potential_energy(const Eigen::VectorXd &x) const
+    {
+        double energy = 0;
+        for (size_t i = 0; i < _N; i++)
+        {
+            vec3d xi = nbody_body(x, i);
+            for (size_t j = i + 1; j < _N; j++)
+            {
+                vec3d d = nbody_body(x, j) - xi;
+                energy -= _G * _masses[i] * _masses[j] / std::sqrt(d.dot(d) + _ε2);
+            }
+        }
+        return energy;
+    }
+
+    double kinetic_energy(const Eigen::VectorXd &v) const
+    {
+        double energy = 0;
+        for (size_t i = 0; i < _N; i++)
+        {
+            vec3d vi = nbody_body(v, i);
+            energy += 0.5 * _masses[i] * vi.dot(vi);
+        }
+        return energy;
+    }
+
+    double total_energy(const Eigen::VectorXd &x, const Eigen::VectorXd &v) const
+    {
+        return kinetic_energy(v) + potential_energy(x);
+    }
+
+private:
+    using D = double_pack<native_lanes>;
+
+    /// Target packs sharing each source load: enough independent rsqrt chains to hide their latency,
+    /// few enough for the accumulators to stay in registers
+    static constexpr size_t unroll = native_lanes == 8 ? 4 : 2;
+    static constexpr size_t block = unroll * native_lanes;
+    /// Added to ε², so that the target itself (r = 0 when ε = 0) gives a finite k and k dx = 0
+    /// without a select in the inner loop. Below the rounding of any physical r², and k stays
+    /// finite for G m up to 1e120.
+    static constexpr double min_r2 = 1e-120;
+
+    /// Accelerations of the targets [begin, end) of tx, ty, tz into _ax, _ay, _az, begin and end
+    /// multiples of block
+    void accumulate_blocks(const double *tx, const double *ty, const double *tz, size_t begin, size_t end)
+    {
+        constexpr size_t W = native_lanes;
+        const double ε2 = _ε2 + min_r2;
+        for (size_t tile = 0; tile < _N; tile += tile_size)
+        {
+            size_t tile_end = std::min(tile + tile_size, _N);
+            for (size_t i = begin; i < end; i += block)
+            {
+                D xi[unroll], yi[unroll], zi[unroll], ax[unroll], ay[unroll], az[unroll];
+                for (size_t b = 0; b < unroll; b++)
+                {
+                    xi[b] = D::load(&tx[i + b * W]);
+                    yi[b] = D::load(&ty[i + b * W]);
+                    zi[b] = D::load(&tz[i + b * W]);
+                    ax[b] = tile > 0 ? D::load(&_ax[i + b * W]) : D(0.);
+                    ay[b] = tile > 0 ? D::load(&_ay[i + b * W]) : D(0.);
+                    az[b] = tile > 0 ? D::load(&_az[i + b * W]) : D(0.);
+                }
+                for (size_t j = tile; j < tile_end; j++)
+                {
+                    for (size_t b = 0; b < unroll; b++)
+                    {
+                        D dx = _x[j] - xi[b];
+                        D dy = _y[j] - yi[b];
+                        D dz = _z[j] - zi[b];
+                        D inv_r = rsqrt(dx * dx + dy * dy + dz * dz + ε2);
+                        D k = _Gm[j] * inv_r * inv_r * inv_r;
+                        ax[b] += k * dx;
+                        ay[b] += k * dy;
+                        az[b] += k * dz;
+                    }
+                }
+                for (size_t b = 0; b < unroll; b++)
+                {
+                    ax[b].store(&_ax[i + b * W]);
+                    ay[b].store(&_ay[i + b * W]);
+                    az[b].store(&_az[i + b * W]);
+                }
+            }
+        }
+    }
+
+    std::span<const uint32_t> all_bodies()
+    {
+        if (_all.size() != _N)
+        {
+            _all.resize(_N);
+            for (size_t i = 0; i < _N; i++)
+                _all[i] = i;
+        }
+        return _all;
+    }
+
+    /// Gathers the sources and the active targets, runs accumulate_derivatives and scatters the results.
+    /// With snap, a_in are the accelerations of all the bodies.
+    template <bool snap>
+    void derivatives(const Eigen::VectorXd &x, const Eigen::VectorXd &v, const Eigen::VectorXd *a_in,
+                     std::span<const uint32_t> active, Eigen::VectorXd &a, Eigen::VectorXd &j, Eigen::VectorXd *s)
+    {
+        size_t padded = (active.size() + block - 1) / block * block;
+        double *source[3] = {_x.data(), _y.data(), _z.data()};
+        double *target[3] = {nullptr, nullptr, nullptr};
+        std::vector<double> *target_x[3] = {&_tx, &_ty, &_tz};
+        for (size_t d = 0; d < 3; d++)
+        {
+            std::copy_n(x.data() + d * _N, _N, source[d]);
+            _v[d].resize(_x.size());
+            std::copy_n(v.data() + d * _N, _N, _v[d].data());
+            if constexpr (snap)
+            {
+                _a_in[d].resize(_x.size());
+                std::copy_n(a_in->data() + d * _N, _N, _a_in[d].data());
+            }
+            target_x[d]->assign(padded, 0.);
+            target[d] = target_x[d]->data();
+            _tv[d].assign(padded, 0.);
+            _ta[d].assign(padded, 0.);
+            _j[d].resize(_x.size());
+            _s[d].resize(_x.size());
+            for (size_t k = 0; k < active.size(); k++)
+            {
+                target[d][k] = source[d][active[k]];
+                _tv[d][k] = _v[d][active[k]];
+                if constexpr (snap)
+                    _ta[d][k] = _a_in[d][active[k]];
+            }
+        }
+
+        parallel_for(padded / block, [this](size_t begin, size_t end)
+        { accumulate_derivatives<snap>(begin * block, end * block); }, _threads);
+
+        a.resize(3 * _N);
+        j.resize(3 * _N);
+        if constexpr (snap)
+            s->resize(3 * _N);
+        double *out[3] = {_ax.data(), _ay.data(), _az.data()};
+        for (size_t d = 0; d < 3; d++)
+            for (size_t k = 0; k < active.size(); k++)
+            {
+                a[d * _N + active[k]] = out[d][k];
+                j[d * _N + active[k]] = _j[d][k];
+                if constexpr (snap)
+                    (*s)[d * _N + active[k]] = _s[d][k];
+            }
+    }
+
+    /// Accelerations, jerks and with snap the snaps of the gathered targets [begin, end). For a pair at
+    /// separation r, relative velocity u and relative acceleration w (source minus target):
+    ///     A = G m r / r³,    J = G m u / r³ - 3 α A,    S = G m w / r³ - 6 α J - 3 β A
+    /// with α = r·u / r² and β = (u·u + r·w) / r² + α²
+    template <bool snap>
+    void accumulate_derivatives(size_t begin, size_t end)
+    {
+        constexpr size_t W = native_lanes;
+        constexpr size_t U = snap ? 1 : unroll / 2; ///< Twice (or four times) the registers of accumulate_blocks
+        const double ε2 = _ε2 + min_r2;
+        const double *vx = _v[0].data(), *vy = _v[1].data(), *vz = _v[2].data();
+        const double *wx = _a_in[0].data(), *wy = _a_in[1].data(), *wz = _a_in[2].data();
+        for (size_t tile = 0; tile < _N; tile += tile_size)
+        {
+            size_t tile_end = std::min(tile + tile_size, _N);
+            for (size_t i = begin; i < end; i += U * W)
+            {
+                D xi[U], yi[U], zi[U], uxi[U], uyi[U], uzi[U], wxi[U], wyi[U], wzi[U];
+                D ax[U], ay[U], az[U], jx[U], jy[U], jz[U], sx[U], sy[U], sz[U];
+                for (size_t b = 0; b < U; b++)
+                {
+                    size_t k = i + b * W;
+                    xi[b] = D::load(&_tx[k]);
+                    yi[b] = D::load(&_ty[k]);
+                    zi[b] = D::load(&_tz[k]);
+                    uxi[b] = D::load(&_tv[0][k]);
+                    uyi[b] = D::load(&_tv[1][k]);
+                    uzi[b] = D::load(&_tv[2][k]);
+                    ax[b] = tile > 0 ? D::load(&_ax[k]) : D(0.);
+                    ay[b] = tile > 0 ? D::load(&_ay[k]) : D(0.);
+                    az[b] = tile > 0 ? D::load(&_az[k]) : D(0.);
+                    jx[b] = tile > 0 ? D::load(&_j[0][k]) : D(0.);
+                    jy[b] = tile > 0 ? D::load(&_j[1][k]) : D(0.);
+                    jz[b] = tile > 0 ? D::load(&_j[2][k]) : D(0.);
+                    if constexpr (snap)
+                    {
+                        wxi[b] = D::load(&_ta[0][k]);
+                        wyi[b] = D::load(&_ta[1][k]);
+                        wzi[b] = D::load(&_ta[2][k]);
+                        sx[b] = tile > 0 ? D::load(&_s[0][k]) : D(0.);
+                        sy[b] = tile > 0 ? D::load(&_s[1][k]) : D(0.);
+                        sz[b] = tile > 0 ? D::load(&_s[2][k]) : D(0.);
+                    }
+                }
+                for (size_t j = tile; j < tile_end; j++)
+                {
+                    for (size_t b = 0; b < U; b++)
+                    {
+                        D dx = _x[j] - xi[b];
+                        D dy = _y[j] - yi[b];
+                        D dz = _z[j] - zi[b];
+                        D ux = vx[j] - uxi[b];
+                        D uy = vy[j] - uyi[b];
+                        D uz = vz[j] - uzi[b];
+                        D inv_r = rsqrt(dx * dx + dy * dy + dz * dz + ε2);
+                        D inv_r2 = inv_r * inv_r;
+                        D k = _Gm[j] * inv_r * inv_r2;
+                        D α = (dx * ux + dy * uy + dz * uz) * inv_r2;
+                        D Ax = k * dx, Ay = k * dy, Az = k * dz;
+                        D Jx = k * ux - 3. * α * Ax;
+                        D Jy = k * uy - 3. * α * Ay;
+                        D Jz = k * uz - 3. * α * Az;
+                        ax[b] += Ax;
+                        ay[b] += Ay;
+                        az[b] += Az;
+                        jx[b] += Jx;
+                        jy[b] += Jy;
+                        jz[b] += Jz;
+                        if constexpr (snap)
+                        {
+                            D wx_ = wx[j] - wxi[b];
+                            D wy_ = wy[j] - wyi[b];
+                            D wz_ = wz[j] - wzi[b];
+                            D β = (ux * ux + uy * uy + uz * uz + dx * wx_ + dy * wy_ + dz * wz_) * inv_r2 + α * α;
+                            sx[b] += k * wx_ - 6. * α * Jx - 3. * β * Ax;
+                            sy[b] += k * wy_ - 6. * α * Jy - 3. * β * Ay;
+                            sz[b] += k * wz_ - 6. * α * Jz - 3. * β * Az;
+                        }
+                    }
+                }
+                for (size_t b = 0; b < U; b++)
+                {
+                    size_t k = i + b * W;
+                    ax[b].store(&_ax[k]);
+                    ay[b].store(&_ay[k]);
+                    az[b].store(&_az[k]);
+                    jx[b].store(&_j[0][k]);
+                    jy[b].store(&_j[1][k]);
+                    jz[b].store(&_j[2][k]);
+                    if constexpr (snap)
+                    {
+                        sx[b].store(&_s[0][k]);
+                        sy[b].store(&_s[1][k]);
+                        sz[b].store(&_s[2][k]);
+                    }
+                }
+            }
+        }
+    }
+
+    size_t _N;
+    std::vector<double> _masses;
+    double _G;
+    double _ε2;
+    size_t _threads = thread_count();
+    std::vector<double> _Gm; ///< Padded to a multiple of block, like the arrays below
+    std::vector<double> _x, _y, _z;
+    std::vector<double> _tx, _ty, _tz; ///< Gathered active targets, padded to a multiple of block
+    std::vector<double> _ax, _ay, _az;
+    std::vector<double> _v[3], _a_in[3]; ///< Velocities and accelerations of the sources, by axis
+    std::vector<double> _tv[3], _ta[3];  ///< Gathered for the active targets
+    std::vector<double> _j[3], _s[3];    ///< Jerks and snaps of the targets
+    std::vector<uint32_t> _all;
+};
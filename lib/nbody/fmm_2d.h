@@ -0,0 +1,412 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <complex>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <fmt/format.h>
+#include "math/double_pack.h"
+#include "math/parallel.h"
+#include "math/vec2d.h"
+#include "morton.h"
+
+/// Fast multipole method for the 2D Laplace kernel, with the complex expansions of Greengard and
+/// Rokhlin truncated at order p:
+///     φ(x) = -Σ_j q_j log|x - y_j|,    E(x) = -∇φ(x) = Σ_j q_j (x - y_j) / |x - y_j|²
+/// (line charges with q / 2πε0, or gravity of a 2D system with q = 2 G m and a = -E). With z = x + iy,
+/// φ = -Re Φ and E_x + i E_y = conj(Φ'(z)) for Φ(z) = Σ q_j log(z - z_j). Multipoles
+///     Φ(z) = a_0 log(z - c) + Σ_{k=1..p} a_k / (z - c)^k,    a_0 = Σ q,    a_k = -Σ q (z_j - c)^k / k
+/// are built in the leaves of a uniform quadtree over the unit square (cells indexed by Morton key,
+/// children of c are 4c..4c+3), shifted up, converted to local Taylor series between the well
+/// separated cells of each level (at most 27), shifted down and evaluated; the 9 neighboring leaves are
+/// summed directly. Each pass runs in parallel over the cells of a level. The error decreases about
+/// tenfold every two orders down to rounding at p = 30, the cost of the translations grows as p².
+class fmm_2d
+{
+public:
+    static constexpr unsigned max_level = 10; ///< 1048576 leaves
+    static constexpr size_t max_order = 40;
+
+    fmm_2d(size_t order = 20, size_t leaf_size = 32) : _leaf_size(leaf_size) { set_order(order); }
+
+    /// Expansion order, at most 40 (the terms then reach the rounding of double)
+    void set_order(size_t order)
+    {
+        if (order < 1 || order > max_order)
+            fmt::println("ERROR: FMM order must be in [1, {}], got {}", max_order, order);
+        _p = std::clamp<size_t>(order, 1, max_order);
+        _binomial.assign((2 * _p + 1) * (2 * _p + 1), 0.);
+        for (size_t n = 0; n <= 2 * _p; n++)
+        {
+            _binomial[n * (2 * _p + 1)] = 1;
+            for (size_t k = 1; k <= n; k++)
+                _binomial[n * (2 * _p + 1) + k] = _binomial[(n - 1) * (2 * _p + 1) + k - 1] +
+                                                  (k < n ? _binomial[(n - 1) * (2 * _p + 1) + k] : 0.);
+        }
+    }
+    /// Average bodies per leaf the depth of the tree is chosen for
+    void set_leaf_size(size_t leaf_size) { _leaf_size = std::max<size_t>(1, leaf_size); }
+    /// Plummer softening of the direct (near field) interactions
+    void set_softening(double softening) { _ε = softening; }
+    void set_thread_count(size_t threads) { _threads = threads; }
+    size_t get_order() const { return _p; }
+    unsigned get_depth() const { return _depth; }
+
+    /// Potential and field of the sources at the targets. potential or field can be empty to skip
+    /// them. A target on a source ignores it.
+    void evaluate(std::span<const vec2d> sources, std::span<const double> charges, std::span<const vec2d> targets,
+                  std::span<double> potential, std::span<vec2d> field)
+    {
+        if (targets.empty())
+            return;
+        bool with_potential = !potential.empty();
+        bool with_field = !field.empty();
+
+        /// Bounding square, then sorting of sources and targets by leaf
+        vec2d low = targets[0], high = targets[0];
+        for (std::span<const vec2d> points : {sources, targets})
+            for (const vec2d &x : points)
+            {
+                low = vec2d(std::min(low.x, x.x), std::min(low.y, x.y));
+                high = vec2d(std::max(high.x, x.x), std::max(high.y, x.y));
+            }
+        double size = std::max(high.x - low.x, high.y - low.y);
+        size = size > 0 ? size * (1 + 1e-12) : 1.;
+        _log_size = std::log(size);
+        _depth = 2;
+        while (_depth < max_level && (size_t(1) << 2 * _depth) * _leaf_size < std::max(sources.size(), targets.size()))
+            _depth++;
+        bin(sources, low, size, _source_start, _source_order, _sx, _sy);
+        bin(targets, low, size, _target_start, _target_order, _tx, _ty);
+        _sq.resize(sources.size());
+        for (size_t k = 0; k < sources.size(); k++)
+            _sq[k] = charges[_source_order[k]];
+
+        upward_pass();
+        downward_pass();
+
+        size_t leaves = size_t(1) << 2 * _depth;
+        _tφ.assign(_tx.size(), 0.);
+        _tEx.assign(_tx.size(), 0.);
+        _tEy.assign(_tx.size(), 0.);
+        const double ε2 = _ε * _ε / (size * size);
+        parallel_for(leaves, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                if (_target_start[c] == _target_start[c + 1])
+                    continue;
+                evaluate_local(c);
+                if (with_potential)
+                    near_field<true>(c, ε2);
+                else
+                    near_field<false>(c, ε2);
+            }
+        }, _threads);
+
+        /// Back to the original order and units: the logarithms already include log(size)
+        for (size_t k = 0; k < targets.size(); k++)
+        {
+            size_t i = _target_order[k];
+            if (with_potential)
+                potential[i] = _tφ[k];
+            if (with_field)
+                field[i] = vec2d(_tEx[k], _tEy[k]) / size;
+        }
+    }
+
+private:
+    using complex = std::complex<double>;
+
+    double binomial(size_t n, size_t k) const { return _binomial[n * (2 * _p + 1) + k]; }
+
+    /// Counting sort of points by leaf, coordinates scaled to the unit square. The coordinate arrays
+    /// are padded by native_lanes for the packed loops.
+    void bin(std::span<const vec2d> points, const vec2d &low, double size, std::vector<uint32_t> &start,
+             std::vector<uint32_t> &order, std::vector<double> &x, std::vector<double> &y)
+    {
+        size_t leaves = size_t(1) << 2 * _depth;
+        double scale = (1u << _depth) / size;
+        uint32_t max_cell = (1u << _depth) - 1;
+        std::vector<uint32_t> leaf(points.size());
+        start.assign(leaves + 1, 0);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            vec2d u = (points[i] - low) * scale;
+            leaf[i] = morton_encode(std::min((uint32_t)u.x, max_cell), std::min((uint32_t)u.y, max_cell));
+            start[leaf[i] + 1]++;
+        }
+        for (size_t c = 0; c < leaves; c++)
+            start[c + 1] += start[c];
+        order.resize(points.size());
+        std::vector<uint32_t> next(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < points.size(); i++)
+            order[next[leaf[i]]++] = i;
+        x.assign(points.size() + native_lanes, 0.);
+        y.assign(points.size() + native_lanes, 0.);
+        for (size_t k = 0; k < points.size(); k++)
+        {
+            vec2d u = (points[order[k]] - low) / size;
+            x[k] = u.x;
+            y[k] = u.y;
+        }
+    }
+
+    /// Bodies of cell c of level l, from the leaf ranges
+    static size_t count(const std::vector<uint32_t> &start, unsigned depth, unsigned level, size_t c)
+    {
+        unsigned shift = 2 * (depth - level);
+        return start[(c + 1) << shift] - start[c << shift];
+    }
+
+    complex center(unsigned level, size_t c) const
+    {
+        uint32_t x, y;
+        morton_decode(c, x, y);
+        return complex(x + 0.5, y + 0.5) / double(1u << level);
+    }
+
+    /// Displacement from the center of a cell of level l - 1 to the center of its child k
+    static complex child_shift(unsigned level, size_t k)
+    {
+        double h = 1. / (1u << level);
+        return complex(((k >> 1 & 1) - 0.5) * h, ((k & 1) - 0.5) * h);
+    }
+
+    /// P2M in the leaves, M2M up to level 2
+    void upward_pass()
+    {
+        size_t n = _p + 1;
+        _M.resize(_depth + 1);
+        _L.resize(_depth + 1);
+        for (unsigned l = 2; l <= _depth; l++)
+        {
+            _M[l].assign((size_t(1) << 2 * l) * n, 0.);
+            _L[l].assign((size_t(1) << 2 * l) * n, 0.);
+        }
+
+        parallel_for(size_t(1) << 2 * _depth, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                if (_source_start[c] == _source_start[c + 1])
+                    continue;
+                complex z = center(_depth, c);
+                complex *M = &_M[_depth][c * n];
+                for (size_t j = _source_start[c]; j < _source_start[c + 1]; j++)
+                {
+                    complex d = complex(_sx[j], _sy[j]) - z;
+                    complex power = _sq[j];
+                    M[0] += _sq[j];
+                    for (size_t k = 1; k <= _p; k++)
+                    {
+                        power *= d;
+                        M[k] -= power / double(k);
+                    }
+                }
+            }
+        }, _threads);
+
+        /// b_l = -a_0 z0^l / l + Σ_{k=1..l} a_k z0^(l-k) C(l-1, k-1), z0 = child - parent
+        for (unsigned l = _depth - 1; l >= 2; l--)
+        {
+            parallel_for(size_t(1) << 2 * l, [&](size_t begin, size_t end)
+            {
+                complex power[max_order + 1];
+                for (size_t c = begin; c < end; c++)
+                {
+                    if (count(_source_start, _depth, l, c) == 0)
+                        continue;
+                    complex *M = &_M[l][c * n];
+                    for (size_t k = 0; k < 4; k++)
+                    {
+                        if (count(_source_start, _depth, l + 1, 4 * c + k) == 0)
+                            continue;
+                        const complex *a = &_M[l + 1][(4 * c + k) * n];
+                        complex z0 = child_shift(l + 1, k);
+                        power[0] = 1;
+                        for (size_t m = 1; m <= _p; m++)
+                            power[m] = power[m - 1] * z0;
+                        M[0] += a[0];
+                        for (size_t m = 1; m <= _p; m++)
+                        {
+                            complex b = -a[0] * power[m] / double(m);
+                            for (size_t j = 1; j <= m; j++)
+                                b += a[j] * power[m - j] * binomial(m - 1, j - 1);
+                            M[m] += b;
+                        }
+                    }
+                }
+            }, _threads);
+        }
+    }
+
+    /// L2L from the parent and M2L from the interaction list, level by level
+    void downward_pass()
+    {
+        size_t n = _p + 1;
+        for (unsigned l = 2; l <= _depth; l++)
+        {
+            size_t cells = size_t(1) << 2 * l;
+            int side = 1 << l;
+            parallel_for(cells, [&](size_t begin, size_t end)
+            {
+                complex power[max_order + 1], scaled[max_order + 1];
+                for (size_t c = begin; c < end; c++)
+                {
+                    if (count(_target_start, _depth, l, c) == 0)
+                        continue;
+                    complex *L = &_L[l][c * n];
+
+                    /// c_m = Σ_{j>=m} b_j C(j, m) d^(j-m), d = child - parent
+                    if (l > 2)
+                    {
+                        const complex *b = &_L[l - 1][(c >> 2) * n];
+                        complex d = child_shift(l, c & 3);
+                        power[0] = 1;
+                        for (size_t m = 1; m <= _p; m++)
+                            power[m] = power[m - 1] * d;
+                        for (size_t m = 0; m <= _p; m++)
+                        {
+                            complex sum = 0;
+                            for (size_t j = m; j <= _p; j++)
+                                sum += b[j] * power[j - m] * binomial(j, m);
+                            L[m] += sum;
+                        }
+                    }
+
+                    /// b_0 = a_0 log(-z0) + Σ a'_k,    b_l = z0^-l (-a_0 / l + Σ a'_k C(l+k-1, k-1)),
+                    /// a'_k = a_k (-1/z0)^k, z0 = source - target
+                    uint32_t x, y;
+                    morton_decode(c, x, y);
+                    int px = x >> 1, py = y >> 1;
+                    complex zt = center(l, c);
+                    for (int sx = 2 * px - 2; sx < 2 * px + 4; sx++)
+                        for (int sy = 2 * py - 2; sy < 2 * py + 4; sy++)
+                        {
+                            if (sx < 0 || sy < 0 || sx >= side || sy >= side ||
+                                std::max(std::abs((int)x - sx), std::abs((int)y - sy)) <= 1)
+                                continue;
+                            size_t s = morton_encode(sx, sy);
+                            if (count(_source_start, _depth, l, s) == 0)
+                                continue;
+                            const complex *a = &_M[l][s * n];
+                            complex z0 = center(l, s) - zt;
+                            complex inv_z0 = 1. / z0;
+                            complex factor = -inv_z0;
+                            scaled[0] = a[0];
+                            for (size_t k = 1; k <= _p; k++)
+                            {
+                                scaled[k] = a[k] * factor;
+                                factor *= -inv_z0;
+                            }
+                            complex b0 = a[0] * (std::log(-z0) + _log_size);
+                            for (size_t k = 1; k <= _p; k++)
+                                b0 += scaled[k];
+                            L[0] += b0;
+                            complex inv_power = 1;
+                            for (size_t m = 1; m <= _p; m++)
+                            {
+                                inv_power *= inv_z0;
+                                complex sum = -a[0] / double(m);
+                                for (size_t k = 1; k <= _p; k++)
+                                    sum += scaled[k] * binomial(m + k - 1, k - 1);
+                                L[m] += sum * inv_power;
+                            }
+                        }
+                }
+            }, _threads);
+        }
+    }
+
+    /// L2P for the targets of leaf c: φ = -Re Σ b_l w^l, E = conj(Σ l b_l w^(l-1))
+    void evaluate_local(size_t c)
+    {
+        size_t n = _p + 1;
+        complex z = center(_depth, c);
+        const complex *b = &_L[_depth][c * n];
+        for (size_t k = _target_start[c]; k < _target_start[c + 1]; k++)
+        {
+            complex w = complex(_tx[k], _ty[k]) - z;
+            complex Φ = b[_p], dΦ = 0;
+            for (size_t m = _p; m-- > 0;)
+            {
+                dΦ = dΦ * w + Φ;
+                Φ = Φ * w + b[m];
+            }
+            _tφ[k] = -Φ.real();
+            _tEx[k] = dΦ.real();
+            _tEy[k] = -dΦ.imag();
+        }
+    }
+
+    /// P2P from the 9 leaves around leaf c, target packs against broadcast sources. The logarithms
+    /// of the potential are taken per lane.
+    template <bool potential>
+    void near_field(size_t c, double ε2)
+    {
+        using D = double_pack<native_lanes>;
+        constexpr size_t W = native_lanes;
+        ε2 += 1e-240; ///< Finite 1/r² on the target itself, as in direct_summation
+        uint32_t x, y;
+        morton_decode(c, x, y);
+        int side = 1 << _depth;
+        size_t end = _target_start[c + 1];
+        for (size_t i = _target_start[c]; i < end; i += W)
+        {
+            D xi = D::load(&_tx[i]), yi = D::load(&_ty[i]);
+            D Ex(0.), Ey(0.);
+            double φ[W] = {};
+            for (int sx = (int)x - 1; sx <= (int)x + 1; sx++)
+                for (int sy = (int)y - 1; sy <= (int)y + 1; sy++)
+                {
+                    if (sx < 0 || sy < 0 || sx >= side || sy >= side)
+                        continue;
+                    size_t s = morton_encode(sx, sy);
+                    for (size_t j = _source_start[s]; j < _source_start[s + 1]; j++)
+                    {
+                        D dx = _sx[j] - xi;
+                        D dy = _sy[j] - yi;
+                        D d2 = dx * dx + dy * dy;
+                        D k = _sq[j] / (d2 + ε2);
+                        Ex -= k * dx;
+                        Ey -= k * dy;
+                        if constexpr (potential)
+                        {
+                            double r2[W];
+                            (d2 + ε2).store(r2);
+                            for (size_t l = 0; l < W; l++)
+                                if (d2[l] > 0) ///< 0 on the target itself
+                                    φ[l] -= _sq[j] * (0.5 * std::log(r2[l]) + _log_size);
+                        }
+                    }
+                }
+            double out[2][W];
+            Ex.store(out[0]);
+            Ey.store(out[1]);
+            size_t count = std::min(W, end - i);
+            for (size_t l = 0; l < count; l++)
+            {
+                _tφ[i + l] += φ[l];
+                _tEx[i + l] += out[0][l];
+                _tEy[i + l] += out[1][l];
+            }
+        }
+    }
+
+    size_t _p;
+    size_t _leaf_size;
+    double _ε = 0;
+    size_t _threads = thread_count();
+    unsigned _depth = 2;
+    double _log_size = 0;
+    std::vector<double> _binomial; ///< C(n, k) for n <= 2p
+
+    std::vector<uint32_t> _source_start, _source_order, _target_start, _target_order; ///< Leaf ranges, Morton order
+    std::vector<double> _sx, _sy, _sq;
+    std::vector<double> _tx, _ty;
+    std::vector<double> _tφ, _tEx, _tEy;
+    std::vector<std::vector<complex>> _M; ///< Expansions of the cells, per level
+    std::vector<std::vector<complex>> _L;
+};
@@ -0,0 +1,591 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <Eigen/Core>
+#include <fmt/format.h>
+#include "math/double_pack.h"
+#include "math/parallel.h"
+#include "math/vec3d.h"
+#include "morton.h"
+
+/// Fast multipole method for the 3D Laplace kernel, with Cartesian Taylor expansions of order p:
+///     φ(x) = Σ_j q_j / |x - y_j|,    E(x) = -∇φ(x) = Σ_j q_j (x - y_j) / |x - y_j|³
+/// (Coulomb's law with q / 4πε0, gravity with q = G m and a = -E). Sources and targets are
+/// independent sets, so the fields can be sampled anywhere.
+/// The tree is a uniform octree over the bounding cube of sources and targets, scaled to the unit
+/// cube so that the expansions are well conditioned, with cells indexed by Morton key at each level
+/// (children of c are 8c..8c+7, the bodies of a cell are a contiguous range). Multipoles
+///     M_α = Σ q (y - c)^α / α!
+/// are built in the leaves and shifted up, converted to local expansions L_β (derivatives of φ at
+/// the cell center) between well separated cells of each level, shifted down and evaluated; the
+/// 27 neighboring leaves are summed directly. M2L is the contraction
+///     L_β += Σ_{|α| + |β| <= p} (-1)^|α| M_α D_{α+β}(c_L - c_M),    D_γ = ∂^γ (1 / r)
+/// and the D of the 316 possible cell offsets are computed once, then scaled to each level. Each
+/// pass runs in parallel over the cells of a level. The error decreases about as 0.6^p.
+class fmm_3d
+{
+public:
+    static constexpr unsigned max_level = 6; ///< 262144 leaves
+
+    fmm_3d(size_t order = 6, size_t leaf_size = 64) : _leaf_size(leaf_size) { set_order(order); }
+
+    /// Expansion order, at most 12 (the M2L tables take 47 MB)
+    void set_order(size_t order)
+    {
+        if (order > 12)
+            fmt::println("ERROR: FMM order limited to 12, got {}", order);
+        _p = std::min<size_t>(order, 12);
+        build_tables();
+    }
+    /// Average bodies per leaf the depth of the tree is chosen for
+    void set_leaf_size(size_t leaf_size) { _leaf_size = std::max<size_t>(1, leaf_size); }
+    /// Plummer softening of the direct (near field) interactions only, the expansions are of 1 / r
+    void set_softening(double softening) { _ε = softening; }
+    void set_thread_count(size_t threads) { _threads = threads; }
+    /// Bound on the expansion storage, the depth of the tree is reduced to stay below it
+    void set_memory_limit(size_t bytes) { _memory_limit = bytes; }
+    /// Bytes of the M and L expansions of every level down to depth, and of the scaled M of a level
+    size_t expansion_bytes(unsigned depth) const
+    {
+        size_t cells = 0;
+        for (unsigned l = 2; l <= depth; l++)
+            cells += 2 * (size_t(1) << 3 * l);
+        return (cells + (size_t(1) << 3 * depth)) * _terms.size() * sizeof(double);
+    }
+    size_t get_order() const { return _p; }
+    unsigned get_depth() const { return _depth; }
+
+    /// Potential and field of the sources at the targets. potential or field can be empty to skip
+    /// them. A target on a source ignores it.
+    void evaluate(std::span<const vec3d> sources, std::span<const double> charges, std::span<const vec3d> targets,
+                  std::span<double> potential, std::span<vec3d> field)
+    {
+        if (targets.empty())
+            return;
+        bool with_potential = !potential.empty();
+        bool with_field = !field.empty();
+
+        /// Bounding cube, then sorting of sources and targets by leaf
+        vec3d low = targets[0], high = targets[0];
+        for (std::span<const vec3d> points : {sources, targets})
+            for (const vec3d &x : points)
+            {
+                low = vec3d(std::min(low.x, x.x), std::min(low.y, x.y), std::min(low.z, x.z));
+                high = vec3d(std::max(high.x, x.x), std::max(high.y, x.y), std::max(high.z, x.z));
+            }
+        double size = std::max({high.x - low.x, high.y - low.y, high.z - low.z});
+        size = size > 0 ? size * (1 + 1e-12) : 1.;
+        _depth = 2;
+        while (_depth < max_level && (size_t(1) << 3 * _depth) * _leaf_size < std::max(sources.size(), targets.size()))
+            _depth++;
+        /// Depth 6 at p = 12 would take 3.1 GB
+        if (expansion_bytes(_depth) > _memory_limit)
+        {
+            unsigned depth = _depth;
+            while (_depth > 2 && expansion_bytes(_depth) > _memory_limit)
+                _depth--;
+            if (!_memory_reported)
+                fmt::println("ERROR: FMM expansions of depth {} at p = {} take {} MB, above the limit of {} MB; depth {} used",
+                             depth, _p, expansion_bytes(depth) >> 20, _memory_limit >> 20, _depth);
+            _memory_reported = true;
+        }
+        bin(sources, low, size, _source_start, _source_order, _sx, _sy, _sz);
+        bin(targets, low, size, _target_start, _target_order, _tx, _ty, _tz);
+        _sq.resize(sources.size());
+        for (size_t k = 0; k < sources.size(); k++)
+            _sq[k] = charges[_source_order[k]];
+
+        upward_pass();
+        downward_pass();
+
+        size_t leaves = size_t(1) << 3 * _depth;
+        _tφ.assign(_tx.size(), 0.);
+        _tEx.assign(_tx.size(), 0.);
+        _tEy.assign(_tx.size(), 0.);
+        _tEz.assign(_tx.size(), 0.);
+        const double ε2 = _ε * _ε / (size * size);
+        parallel_for(leaves, [&](size_t begin, size_t end)
+        {
+            for (size_t c = begin; c < end; c++)
+            {
+                if (_target_start[c] == _target_start[c + 1])
+                    continue;
+                evaluate_local(c);
+                if (with_potential)
+                    near_field<true>(c, ε2);
+                else
+                    near_field<false>(c, ε2);
+            }
+        }, _threads);
+
+        /// Back to the original order and units
+        for (size_t k = 0; k < targets.size(); k++)
+        {
+            size_t i = _target_order[k];
+            if (with_potential)
+                potential[i] = _tφ[k] / size;
+            if (with_field)
+                field[i] = vec3d(_tEx[k], _tEy[k], _tEz[k]) / (size * size);
+        }
+    }
+
+private:
+    size_t term_count(size_t order) const { return (order + 1) * (order + 2) * (order + 3) / 6; }
+    int index(int a, int b, int c) const { return _index[(a * (_p + 1) + b) * (_p + 1) + c]; }
+
+    /// Multi-indices sorted by degree, and the index lists of the translations
+    void build_tables()
+    {
+        int p = _p;
+        _terms.clear();
+        _index.assign((p + 1) * (p + 1) * (p + 1), -1);
+        for (int degree = 0; degree <= p; degree++)
+            for (int a = degree; a >= 0; a--)
+                for (int b = degree - a; b >= 0; b--)
+                {
+                    int c = degree - a - b;
+                    _index[(a * (p + 1) + b) * (p + 1) + c] = _terms.size();
+                    _terms.push_back({a, b, c});
+                }
+        size_t n = _terms.size();
+        _degree.resize(n);
+        _inv_factorial.resize(n);
+        std::vector<double> factorial(p + 1, 1.);
+        for (int k = 1; k <= p; k++)
+            factorial[k] = factorial[k - 1] * k;
+        for (size_t t = 0; t < n; t++)
+        {
+            auto [a, b, c] = _terms[t];
+            _degree[t] = a + b + c;
+            _inv_factorial[t] = 1 / (factorial[a] * factorial[b] * factorial[c]);
+        }
+
+        /// M2M and L2L: (γ, α, γ - α) for α <= γ
+        _shift.clear();
+        for (size_t g = 0; g < n; g++)
+            for (size_t t = 0; t < n; t++)
+            {
+                auto [a, b, c] = _terms[g];
+                auto [d, e, f] = _terms[t];
+                if (d <= a && e <= b && f <= c)
+                    _shift.push_back({(uint32_t)g, (uint32_t)t, (uint32_t)index(a - d, b - e, c - f)});
+            }
+        /// M2L: for each β, the α with |α| + |β| <= p are the first terms
+        _m2l_count.resize(n);
+        for (size_t β = 0; β < n; β++)
+            _m2l_count[β] = term_count(p - _degree[β]);
+        /// Gradient of the local expansion: β and β + e_x, β + e_y, β + e_z for |β| < p
+        _gradient.clear();
+        for (size_t β = 0; β < n && _degree[β] < p; β++)
+        {
+            auto [a, b, c] = _terms[β];
+            _gradient.push_back({(uint32_t)β, (uint32_t)index(a + 1, b, c), (uint32_t)index(a, b + 1, c), (uint32_t)index(a, b, c + 1)});
+        }
+        /// Derivatives of 1/r at the offsets in cell units, [-3, 3]³, expanded as D_{α+β} in the order
+        /// of the M2L loops so that they are contiguous dot products
+        size_t expanded = 0;
+        for (size_t β = 0; β < n; β++)
+            expanded += _m2l_count[β];
+        _D_unit.assign(343 * expanded, 0.);
+        _D_size = expanded;
+        std::vector<double> D(n);
+        for (int x = -3; x <= 3; x++)
+            for (int y = -3; y <= 3; y++)
+                for (int z = -3; z <= 3; z++)
+                {
+                    if (std::max({std::abs(x), std::abs(y), std::abs(z)}) <= 1)
+                        continue;
+                    derivatives(vec3d(x, y, z), D.data());
+                    double *out = &_D_unit[offset_index(x, y, z) * expanded];
+                    for (size_t β = 0; β < n; β++)
+                        for (size_t α = 0; α < _m2l_count[β]; α++)
+                        {
+                            auto [a, b, c] = _terms[α];
+                            auto [d, e, f] = _terms[β];
+                            *out++ = D[index(a + d, b + e, c + f)];
+                        }
+                }
+    }
+
+    static size_t offset_index(int x, int y, int z) { return ((x + 3) * 7 + (y + 3)) * 7 + (z + 3); }
+
+    /// D_γ(r) = ∂^γ (1 / r) for |γ| <= p, by the McMurchie-Davidson recurrence
+    ///     R^n_{0,0,0} = (-1)^n (2n - 1)!! / r^(2n+1),    R^n_{a+1,b,c} = a R^{n+1}_{a-1,b,c} + x R^{n+1}_{a,b,c}
+    /// (same in y and z), D_γ = R^0_γ
+    void derivatives(const vec3d &r, double *D) const
+    {
+        size_t n = _terms.size();
+        std::vector<double> R((_p + 1) * n, 0.);
+        double inv_r = 1 / r.norm();
+        double inv_r2 = inv_r * inv_r;
+        double value = inv_r;
+        for (size_t m = 0; m <= _p; m++)
+        {
+            R[m * n] = value;
+            value *= -(2. * m + 1) * inv_r2;
+        }
+        for (size_t t = 1; t < n; t++)
+        {
+            auto [a, b, c] = _terms[t];
+            for (size_t m = 0; m + _degree[t] <= _p; m++)
+            {
+                const double *next = &R[(m + 1) * n];
+                if (a > 0)
+                    R[m * n + t] = (a > 1 ? (a - 1) * next[index(a - 2, b, c)] : 0.) + r.x * next[index(a - 1, b, c)];
+                else if (b > 0)
+                    R[m * n + t] = (b > 1 ? (b - 1) * next[index(a, b - 2, c)] : 0.) + r.y * next[index(a, b - 1, c)];
+                else
+                    R[m * n + t] = (c > 1 ? (c - 1) * next[index(a, b, c - 2)] : 0.) + r.z * next[index(a, b, c - 1)];
+            }
+        }
+        std::copy_n(R.data(), n, D);
+    }
+
+    /// d^α / α! for every term
+    void monomials(double dx, double dy, double dz, double *out) const
+    {
+        double px[32], py[32], pz[32];
+        px[0] = py[0] = pz[0] = 1;
+        for (size_t k = 1; k <= _p; k++)
+        {
+            px[k] = px[k - 1] * dx;
+            py[k] = py[k - 1] * dy;
+            pz[k] = pz[k - 1] * dz;
+        }
+        for (size_t t = 0; t < _terms.size(); t++)
+            out[t] = px[_terms[t][0]] * py[_terms[t][1]] * pz[_terms[t][2]] * _inv_factorial[t];
+    }
+
+    /// Counting sort of points by leaf, coordinates scaled to the unit cube. The coordinate arrays
+    /// are padded by native_lanes for the packed loops.
+    void bin(std::span<const vec3d> points, const vec3d &low, double size, std::vector<uint32_t> &start,
+             std::vector<uint32_t> &order, std::vector<double> &x, std::vector<double> &y, std::vector<double> &z)
+    {
+        size_t leaves = size_t(1) << 3 * _depth;
+        double scale = (1u << _depth) / size;
+        uint32_t max_cell = (1u << _depth) - 1;
+        std::vector<uint32_t> leaf(points.size());
+        start.assign(leaves + 1, 0);
+        for (size_t i = 0; i < points.size(); i++)
+        {
+            vec3d u = (points[i] - low) * scale;
+            leaf[i] = morton_encode(std::min((uint32_t)u.x, max_cell), std::min((uint32_t)u.y, max_cell), std::min((uint32_t)u.z, max_cell));
+            start[leaf[i] + 1]++;
+        }
+        for (size_t c = 0; c < leaves; c++)
+            start[c + 1] += start[c];
+        order.resize(points.size());
+        std::vector<uint32_t> next(start.begin(), start.end() - 1);
+        for (size_t i = 0; i < points.size(); i++)
+            order[next[leaf[i]]++] = i;
+        x.assign(points.size() + native_lanes, 0.);
+        y.assign(points.size() + native_lanes, 0.);
+        z.assign(points.size() + native_lanes, 0.);
+        for (size_t k = 0; k < points.size(); k++)
+        {
+            vec3d u = (points[order[k]] - low) / size;
+            x[k] = u.x;
+            y[k] = u.y;
+            z[k] = u.z;
+        }
+    }
+
+    /// Bodies of cell c of level l, from the leaf ranges
+    static size_t count(const std::vector<uint32_t> &start, unsigned depth, unsigned level, size_t c)
+    {
+        unsigned shift = 3 * (depth - level);
+        return start[(c + 1) << shift] - start[c << shift];
+    }
+
+    /// Displacements from the center of a cell of level l - 1 to the centers of its 8 children,
+    /// as monomials for M2M and L2L
+    std::vector<double> child_shifts(unsigned level) const
+    {
+        size_t n = _terms.size();
+        std::vector<double> shifts(8 * n);
+        double h = 1. / (1u << level);
+        for (size_t k = 0; k < 8; k++)
+            monomials(((k >> 2 & 1) - 0.5) * h, ((k >> 1 & 1) - 0.5) * h, ((k & 1) - 0.5) * h, &shifts[k * n]);
+        return shifts;
+    }
+
+    vec3d center(unsigned level, size_t c) const
+    {
+        uint32_t x, y, z;
+        morton_decode(c, x, y, z);
+        return (vec3d(x, y, z) + vec3d(0.5)) / double(1u << level);
+    }
+
+    /// P2M in the leaves, M2M up to level 2
+    void upward_pass()
+    {
+        size_t n = _terms.size();
+        _M.resize(_depth + 1);
+        _L.resize(_depth + 1);
+        for (unsigned l = 2; l <= _depth; l++)
+        {
+            _M[l].assign((size_t(1) << 3 * l) * n, 0.);
+            _L[l].assign((size_t(1) << 3 * l) * n, 0.);
+        }
+
+        parallel_for(size_t(1) << 3 * _depth, [&](size_t begin, size_t end)
+        {
+            std::vector<double> mono(n);
+            for (size_t c = begin; c < end; c++)
+            {
+                if (_source_start[c] == _source_start[c + 1])
+                    continue;
+                vec3d z = center(_depth, c);
+                double *M = &_M[_depth][c * n];
+                for (size_t k = _source_start[c]; k < _source_start[c + 1]; k++)
+                {
+                    monomials(_sx[k] - z.x, _sy[k] - z.y, _sz[k] - z.z, mono.data());
+                    for (size_t t = 0; t < n; t++)
+                        M[t] += _sq[k] * mono[t];
+                }
+            }
+        }, _threads);
+
+        for (unsigned l = _depth - 1; l >= 2; l--)
+        {
+            std::vector<double> shifts = child_shifts(l + 1);
+            parallel_for(size_t(1) << 3 * l, [&](size_t begin, size_t end)
+            {
+                for (size_t c = begin; c < end; c++)
+                {
+                    if (count(_source_start, _depth, l, c) == 0)
+                        continue;
+                    double *M = &_M[l][c * n];
+                    for (size_t k = 0; k < 8; k++)
+                    {
+                        const double *child = &_M[l + 1][(8 * c + k) * n];
+                        const double *s = &shifts[k * n];
+                        for (const std::array<uint32_t, 3> &g : _shift)
+                            M[g[0]] += child[g[1]] * s[g[2]];
+                    }
+                }
+            }, _threads);
+        }
+    }
+
+    /// L2L from the parent and M2L from the interaction list, level by level
+    void downward_pass()
+    {
+        size_t n = _terms.size();
+        std::vector<double> Ms;
+        for (unsigned l = 2; l <= _depth; l++)
+        {
+            size_t cells = size_t(1) << 3 * l;
+            int side = 1 << l;
+            double h = 1. / side;
+
+            /// (-1)^|α| M_α / h^|α|, so that the unit D apply
+            Ms.resize(cells * n);
+            std::vector<double> scale(n), local_scale(n);
+            for (size_t t = 0; t < n; t++)
+            {
+                scale[t] = (_degree[t] % 2 ? -1 : 1) * std::pow(h, -double(_degree[t]));
+                local_scale[t] = std::pow(h, -double(_degree[t] + 1));
+            }
+            for (size_t c = 0; c < cells; c++)
+                for (size_t t = 0; t < n; t++)
+                    Ms[c * n + t] = _M[l][c * n + t] * scale[t];
+
+            std::vector<double> shifts = child_shifts(l);
+            parallel_for(cells, [&](size_t begin, size_t end)
+            {
+                std::vector<double> local(n);
+                for (size_t c = begin; c < end; c++)
+                {
+                    if (count(_target_start, _depth, l, c) == 0)
+                        continue;
+                    double *L = &_L[l][c * n];
+                    if (l > 2)
+                    {
+                        const double *parent = &_L[l - 1][(c >> 3) * n];
+                        const double *s = &shifts[(c & 7) * n];
+                        for (const std::array<uint32_t, 3> &g : _shift)
+                            L[g[1]] += parent[g[0]] * s[g[2]];
+                    }
+
+                    std::fill(local.begin(), local.end(), 0.);
+                    uint32_t x, y, z;
+                    morton_decode(c, x, y, z);
+                    int px = x >> 1, py = y >> 1, pz = z >> 1;
+                    for (int sx = 2 * px - 2; sx < 2 * px + 4; sx++)
+                        for (int sy = 2 * py - 2; sy < 2 * py + 4; sy++)
+                            for (int sz = 2 * pz - 2; sz < 2 * pz + 4; sz++)
+                            {
+                                int ox = (int)x - sx, oy = (int)y - sy, oz = (int)z - sz;
+                                if (sx < 0 || sy < 0 || sz < 0 || sx >= side || sy >= side || sz >= side ||
+                                    std::max({std::abs(ox), std::abs(oy), std::abs(oz)}) <= 1)
+                                    continue;
+                                size_t s = morton_encode(sx, sy, sz);
+                                if (count(_source_start, _depth, l, s) == 0)
+                                    continue;
+                                const double *M = &Ms[s * n];
+                                const double *D = &_D_unit[offset_index(ox, oy, oz) * _D_size];
+                                for (size_t β = 0; β < n; β++)
+                                {
+                                    double sum = 0;
+                                    for (size_t α = 0; α < _m2l_count[β]; α++)
+                                        sum += M[α] * D[α];
+                                    local[β] += sum;
+                                    D += _m2l_count[β];
+                                }
+                            }
+                    for (size_t t = 0; t < n; t++)
+                        L[t] += local[t] * local_scale[t];
+                }
+            }, _threads);
+        }
+    }
+
+    /// L2P for the targets of leaf c
+    void evaluate_local(size_t c)
+    {
+        size_t n = _terms.size();
+        vec3d z = center(_depth, c);
+        const double *L = &_L[_depth][c * n];
+        double mono[1024];
+        for (size_t k = _target_start[c]; k < _target_start[c + 1]; k++)
+        {
+            monomials(_tx[k] - z.x, _ty[k] - z.y, _tz[k] - z.z, mono);
+            double φ = 0;
+            for (size_t t = 0; t < n; t++)
+                φ += L[t] * mono[t];
+            double gx = 0, gy = 0, gz = 0;
+            for (const std::array<uint32_t, 4> &g : _gradient)
+            {
+                gx += L[g[1]] * mono[g[0]];
+                gy += L[g[2]] * mono[g[0]];
+                gz += L[g[3]] * mono[g[0]];
+            }
+            _tφ[k] = φ;
+            _tEx[k] = -gx;
+            _tEy[k] = -gy;
+            _tEz[k] = -gz;
+        }
+    }
+
+    /// P2P from the 27 leaves around leaf c, target packs against broadcast sources
+    template <bool potential>
+    void near_field(size_t c, double ε2)
+    {
+        using D = double_pack<native_lanes>;
+        constexpr size_t W = native_lanes;
+        ε2 += 1e-120; ///< Finite k on the target itself, as in direct_summation
+        uint32_t x, y, z;
+        morton_decode(c, x, y, z);
+        int side = 1 << _depth;
+        size_t end = _target_start[c + 1];
+        for (size_t i = _target_start[c]; i < end; i += W)
+        {
+            D xi = D::load(&_tx[i]), yi = D::load(&_ty[i]), zi = D::load(&_tz[i]);
+            D φ(0.), Ex(0.), Ey(0.), Ez(0.);
+            for (int sx = (int)x - 1; sx <= (int)x + 1; sx++)
+                for (int sy = (int)y - 1; sy <= (int)y + 1; sy++)
+                    for (int sz = (int)z - 1; sz <= (int)z + 1; sz++)
+                    {
+                        if (sx < 0 || sy < 0 || sz < 0 || sx >= side || sy >= side || sz >= side)
+                            continue;
+                        size_t s = morton_encode(sx, sy, sz);
+                        for (size_t j = _source_start[s]; j < _source_start[s + 1]; j++)
+                        {
+                            D dx = _sx[j] - xi;
+                            D dy = _sy[j] - yi;
+                            D dz = _sz[j] - zi;
+                            D d2 = dx * dx + dy * dy + dz * dz;
+                            D inv_r = rsqrt(d2 + ε2);
+                            D k = _sq[j] * inv_r * inv_r * inv_r;
+                            Ex -= k * dx;
+                            Ey -= k * dy;
+                            Ez -= k * dz;
+                            if constexpr (potential)
+                                φ += _sq[j] * inv_r * min(d2 * 1e300, D(1.)); ///< 0 on the target itself
+                        }
+                    }
+            double out[4][W];
+            φ.store(out[0]);
+            Ex.store(out[1]);
+            Ey.store(out[2]);
+            Ez.store(out[3]);
+            size_t count = std::min(W, end - i);
+            for (size_t l = 0; l < count; l++)
+            {
+                _tφ[i + l] += out[0][l];
+                _tEx[i + l] += out[1][l];
+                _tEy[i + l] += out[2][l];
+                _tEz[i + l] += out[3][l];
+            }
+        }
+    }
+
+    size_t _p;
+    size_t _leaf_size;
+    double _ε = 0;
+    size_t _threads = thread_count();
+    unsigned _depth = 2;
+    size_t _memory_limit = size_t(1) << 30;
+    bool _memory_reported = false;
+
+    std::vector<std::array<int, 3>> _terms; ///< Multi-indices α, by degree
+    std::vector<int> _index;                ///< Term of (a, b, c)
+    std::vector<int> _degree;
+    std::vector<double> _inv_factorial;
+    std::vector<std::array<uint32_t, 3>> _shift;
+    std::vector<size_t> _m2l_count;         ///< Number of α for each β
+    std::vector<std::array<uint32_t, 4>> _gradient;
+    std::vector<double> _D_unit; ///< Expanded D of the cell offsets, offset_index order
+    size_t _D_size;              ///< Expanded D per offset
+
+    std::vector<uint32_t> _source_start, _source_order, _target_start, _target_order; ///< Leaf ranges, Morton order
+    std::vector<double> _sx, _sy, _sz, _sq;
+    std::vector<double> _tx, _ty, _tz;
+    std::vector<double> _tφ, _tEx, _tEy, _tEz;
+    std::vector<std::vector<double>> _M; ///< Expansions of the cells, per level
+    std::vector<std::vector<double>> _L;
+};
+
+/// Gravitational accelerations from fmm_3d, as an acceleration_inplace<Eigen::VectorXd> on the SoA
+/// states of direct_summation. Unsoftened: the far field expansions are of 1 / r, and softening
+/// only the near field would make the force depend on the cell boundaries.
+class fmm_gravity
+{
+public:
+    fmm_gravity(std::vector<double> masses, double G = 6.67430e-11, double softening = 0, size_t order = 6)
+        : _Gm(masses.size()), _positions(masses.size()), _field(masses.size()), _fmm(order)
+    {
+        for (size_t i = 0; i < masses.size(); i++)
+            _Gm[i] = G * masses[i];
+        if (softening != 0)
+            fmt::println("ERROR: fmm_gravity is unsoftened, softening {} ignored", softening);
+    }
+
+    fmm_3d &get_fmm() { return _fmm; }
+
+    void operator()(double, const Eigen::VectorXd &x, Eigen::VectorXd &a)
+    {
+        size_t N = _Gm.size();
+        for (size_t i = 0; i < N; i++)
+            _positions[i] = vec3d(x[i], x[N + i], x[2 * N + i]);
+        _fmm.evaluate(_positions, _Gm, _positions, {}, _field);
+        a.resize(3 * N);
+        for (size_t i = 0; i < N; i++)
+        {
+            a[i] = -_field[i].x;
+            a[N + i] = -_field[i].y;
+            a[2 * N + i] = -_field[i].z;
+        }
+    }
+
+private:
+    std::vector<double> _Gm;
+    std::vector<vec3d> _positions;
+    std::vector<vec3d> _field;
+    fmm_3d _fmm;
+};
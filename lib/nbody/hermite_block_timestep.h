@@ -0,0 +1,277 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+#include <Eigen/Core>
+#include <fmt/format.h>
+
+/// Accelerations and jerks of the active bodies of an SoA N-body state, for hermite_block_timestep
+/// (see direct_summation): the entries of the other bodies keep their values
+using active_jerk_inplace = std::function<void(double t, const Eigen::VectorXd &x, const Eigen::VectorXd &v,
+                                               std::span<const uint32_t> active, Eigen::VectorXd &a, Eigen::VectorXd &j)>;
+
+/// Same with the snaps, a_in being the predicted accelerations of all the bodies
+using active_snap_inplace = std::function<void(double t, const Eigen::VectorXd &x, const Eigen::VectorXd &v,
+                                               const Eigen::VectorXd &a_in, std::span<const uint32_t> active,
+                                               Eigen::VectorXd &a, Eigen::VectorXd &j, Eigen::VectorXd &s)>;
+
+/// Hermite integration of collisional N-body systems with individual block time steps (Makino 1991):
+/// each body has its own step dt_max / 2^k and its own time. At each block time, every body is
+/// predicted there by its Taylor series, the bodies due are evaluated in one call and corrected with
+/// the fourth order (hermite_4th) or sixth order (hermite_6th) corrector of their own step. Steps
+/// follow the generalized Aarseth criterion of Nitadori & Makino (2008),
+///     dt = η ((sqrt(|a| |a⁽²⁾|) + |a⁽¹⁾|) / (sqrt(|a⁽ᵖ⁻³⁾| |a⁽ᵖ⁻¹⁾|) + |a⁽ᵖ⁻²⁾|))^(1/(p-3))
+/// with the higher derivatives interpolated over the last step (p = 4 is Aarseth's criterion), and
+/// η |a| / |j| for the first step. A body moves to a smaller step at any of its corrections, to the
+/// next larger one only when that step is synchronized; all bodies are synchronized at the multiples
+/// of dt_max.
+class hermite_block_timestep
+{
+public:
+    static constexpr size_t max_bin = 30; ///< Steps down to dt_max / 2^30
+
+    hermite_block_timestep(size_t bins = 20) { set_bin_count(bins); }
+
+    /// Positions and velocities at t0, SoA layout
+    void set_initial_state(double t0, const Eigen::VectorXd &x0, const Eigen::VectorXd &v0)
+    {
+        _t = t0;
+        _x = x0;
+        _v = v0;
+        _order = 0;
+    }
+    /// Largest step, at which every body is synchronized
+    void set_timestep(double dt_max) { _dt = dt_max; }
+    /// Number of bins, the smallest step being dt_max / 2^(bins - 1)
+    void set_bin_count(size_t bins)
+    {
+        if (bins < 1 || bins > max_bin + 1)
+            fmt::println("ERROR: block time steps need 1 to {} bins, got {}", max_bin + 1, bins);
+        _bins = std::clamp<size_t>(bins, 1, max_bin + 1);
+    }
+    /// η of the time step criterion (about 0.1 for the fourth order, 0.2 for the sixth)
+    void set_accuracy(double η) { _η = η; }
+    /// η of the first steps, η |a| / |j|
+    void set_initial_accuracy(double η) { _η_start = η; }
+
+    /// Advances the system to tf, a multiple of dt_max after the current time (continuing from the
+    /// last solve)
+    const Eigen::VectorXd &solve_4th(double tf, active_jerk_inplace a) { return solve<4>(tf, &a, nullptr); }
+    const Eigen::VectorXd &solve_6th(double tf, active_snap_inplace a) { return solve<6>(tf, nullptr, &a); }
+
+    double get_time() const { return _t; }
+    const Eigen::VectorXd &get_positions() const { return _x; }
+    const Eigen::VectorXd &get_velocities() const { return _v; }
+    /// Bodies per bin, bin k having the step dt_max / 2^k
+    std::vector<size_t> get_bin_histogram() const
+    {
+        std::vector<size_t> histogram(_bins, 0);
+        for (uint8_t k : _bin)
+            histogram[k]++;
+        return histogram;
+    }
+    /// Accelerations of single bodies computed so far
+    size_t get_force_evaluations() const { return _evaluations; }
+    /// Block times at which some bodies were corrected
+    size_t get_block_steps() const { return _block_steps; }
+
+    /// |E - E0| / |E0| for the total energy of the state (direct_summation::total_energy for
+    /// instance), E0 being its value at the initial state
+    double get_energy_error(std::function<double(const Eigen::VectorXd &x, const Eigen::VectorXd &v)> energy)
+    {
+        if (_x0.size() != _x.size())
+            return 0;
+        double E0 = energy(_x0, _v0);
+        return std::abs((energy(_x, _v) - E0) / E0);
+    }
+
+private:
+    uint64_t period(size_t i) const { return uint64_t(1) << (_bins - 1 - _bin[i]); }
+
+    /// Bin of the step dt, rounded down to a power of two
+    size_t bin_of(double dt) const
+    {
+        if (!(dt < _dt)) ///< Also catches infinite and NaN steps
+            return 0;
+        return std::min<size_t>(_bins - 1, (size_t)std::ceil(std::log2(_dt / dt)));
+    }
+
+    double norm(const Eigen::VectorXd &u, size_t i) const
+    {
+        size_t N = _x.size() / 3;
+        return std::sqrt(u[i] * u[i] + u[N + i] * u[N + i] + u[2 * N + i] * u[2 * N + i]);
+    }
+
+    void set_bin(size_t i, size_t k, uint64_t tick)
+    {
+        if (k > _bin[i])
+            _bin[i] = k;
+        else if (k < _bin[i] && tick % (2 * period(i)) == 0)
+            _bin[i]--;
+    }
+
+    /// Derivatives of all bodies at the synchronized state, and the first steps
+    template <int order>
+    void start(active_jerk_inplace *a4, active_snap_inplace *a6)
+    {
+        size_t N = _x.size() / 3;
+        _x0 = _x;
+        _v0 = _v;
+        _all.resize(N);
+        for (size_t i = 0; i < N; i++)
+            _all[i] = i;
+        _bin.assign(N, 0);
+        _last.assign(N, 0);
+        for (Eigen::VectorXd *u : {&_a, &_j, &_s, &_c, &_xp, &_vp, &_ap, &_a1, &_j1, &_s1})
+            u->setZero(3 * N);
+        if constexpr (order == 4)
+            (*a4)(_t, _x, _v, _all, _a, _j);
+        else
+        {
+            /// The accelerations are not known yet for the first snaps: a second evaluation corrects them
+            (*a6)(_t, _x, _v, _ap, _all, _a, _j, _s);
+            (*a6)(_t, _x, _v, _a, _all, _a, _j, _s);
+            _evaluations += N;
+        }
+        _evaluations += N;
+        for (size_t i = 0; i < N; i++)
+            _bin[i] = bin_of(_η_start * norm(_a, i) / norm(_j, i));
+        _order = order;
+    }
+
+    template <int order>
+    const Eigen::VectorXd &solve(double tf, active_jerk_inplace *a4, active_snap_inplace *a6)
+    {
+        size_t N = _x.size() / 3;
+        size_t steps = (size_t)std::round((tf - _t) / _dt);
+        if (tf <= _t)
+            fmt::println("ERROR: end time must be greater than initial time");
+        if (_order != order)
+            start<order>(a4, a6);
+
+        const uint64_t ticks = uint64_t(1) << (_bins - 1); ///< Smallest steps per dt_max
+        const double dt_min = _dt / ticks;
+        for (size_t step = 0; step < steps; step++)
+        {
+            double t0 = _t;
+            std::fill(_last.begin(), _last.end(), 0);
+            uint64_t tick = 0;
+            while (tick < ticks)
+            {
+                /// Next block time, prediction of every body there and the bodies due
+                uint64_t next = ticks;
+                for (size_t i = 0; i < N; i++)
+                    next = std::min(next, _last[i] + period(i));
+                tick = next;
+                _active.clear();
+                for (size_t i = 0; i < N; i++)
+                {
+                    if (_last[i] + period(i) == tick)
+                        _active.push_back(i);
+                    double h = (tick - _last[i]) * dt_min;
+                    for (size_t d = 0; d < 3; d++)
+                    {
+                        size_t k = d * N + i;
+                        if constexpr (order == 4)
+                        {
+                            _xp[k] = _x[k] + h * (_v[k] + h / 2 * (_a[k] + h / 3 * _j[k]));
+                            _vp[k] = _v[k] + h * (_a[k] + h / 2 * _j[k]);
+                        }
+                        else
+                        {
+                            _xp[k] = _x[k] + h * (_v[k] + h / 2 * (_a[k] + h / 3 * (_j[k] + h / 4 * (_s[k] + h / 5 * _c[k]))));
+                            _vp[k] = _v[k] + h * (_a[k] + h / 2 * (_j[k] + h / 3 * (_s[k] + h / 4 * _c[k])));
+                            _ap[k] = _a[k] + h * (_j[k] + h / 2 * (_s[k] + h / 3 * _c[k]));
+                        }
+                    }
+                }
+                _t = t0 + tick * dt_min;
+                if constexpr (order == 4)
+                    (*a4)(_t, _xp, _vp, _active, _a1, _j1);
+                else
+                    (*a6)(_t, _xp, _vp, _ap, _active, _a1, _j1, _s1);
+                _evaluations += _active.size();
+                _block_steps++;
+
+                for (uint32_t i : _active)
+                {
+                    correct<order>(i, period(i) * dt_min, tick);
+                    _last[i] = tick;
+                }
+            }
+            _t = t0 + _dt;
+        }
+        _t = tf;
+        return _x;
+    }
+
+    /// Corrector of body i over its step h, then its derivatives at the end of the step and its new bin
+    template <int order>
+    void correct(size_t i, double h, uint64_t tick)
+    {
+        size_t N = _x.size() / 3;
+        double h2 = h * h, h3 = h2 * h;
+        double snap[3], crackle[3], pop[3], a5[3];
+        for (size_t d = 0; d < 3; d++)
+        {
+            size_t k = d * N + i;
+            double a0 = _a[k], j0 = _j[k], a1 = _a1[k], j1 = _j1[k];
+            double v1;
+            if constexpr (order == 4)
+            {
+                v1 = _v[k] + h / 2 * (a0 + a1) + h2 / 12 * (j0 - j1);
+                _x[k] += h / 2 * (_v[k] + v1) + h2 / 12 * (a0 - a1);
+                /// Cubic through a and j at both ends
+                crackle[d] = (12 * (a0 - a1) + 6 * h * (j0 + j1)) / h3;
+                snap[d] = (-6 * (a0 - a1) - h * (4 * j0 + 2 * j1)) / h2 + h * crackle[d];
+            }
+            else
+            {
+                double s0 = _s[k], s1 = _s1[k];
+                v1 = _v[k] + h / 2 * (a0 + a1) - h2 / 10 * (j1 - j0) + h3 / 120 * (s0 + s1);
+                _x[k] += h / 2 * (_v[k] + v1) - h2 / 10 * (a1 - a0) + h3 / 120 * (j0 + j1);
+                /// Quintic through a, j and s at both ends, see hermite_6th
+                double R1 = a1 - a0 - h * j0 - h2 / 2 * s0, R2 = h * (j1 - j0 - h * s0), R3 = h2 * (s1 - s0);
+                double Y = 7 * R2 - 15 * R1 - R3, Z = (R3 - 6 * R2 + 12 * R1) / 2;
+                snap[d] = s1;
+                crackle[d] = (60 * R1 - 36 * R2 + 9 * R3) / h3;
+                pop[d] = (24 * Y + 120 * Z) / (h3 * h);
+                a5[d] = 120 * Z / (h3 * h2);
+                _s[k] = s1;
+                _c[k] = crackle[d];
+            }
+            _v[k] = v1;
+            _a[k] = a1;
+            _j[k] = j1;
+        }
+
+        auto length = [](const double *u)
+        { return std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]); };
+        double a = norm(_a, i), j = norm(_j, i), s = length(snap);
+        double dt;
+        if constexpr (order == 4)
+            dt = _η * (std::sqrt(a * s) + j) / (std::sqrt(j * length(crackle)) + s);
+        else
+            dt = _η * std::cbrt((std::sqrt(a * s) + j) / (std::sqrt(length(crackle) * length(a5)) + length(pop)));
+        set_bin(i, bin_of(dt), tick);
+    }
+
+    double _t = 0;
+    double _dt = 1;
+    size_t _bins;
+    double _η = 0.1;
+    double _η_start = 0.01;
+    int _order = 0; ///< Order the derivatives were started for, 0 before the first solve
+    size_t _evaluations = 0;
+    size_t _block_steps = 0;
+    Eigen::VectorXd _x, _v, _x0, _v0;
+    Eigen::VectorXd _a, _j, _s, _c; ///< Derivatives at the last correction of each body
+    Eigen::VectorXd _xp, _vp, _ap;  ///< Predicted at the current block time
+    Eigen::VectorXd _a1, _j1, _s1;  ///< Evaluated for the active bodies
+    std::vector<uint8_t> _bin;
+    std::vector<uint64_t> _last; ///< Tick of the last correction of each body
+    std::vector<uint32_t> _active, _all;
+};
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstdint>
+
+/// Morton (Z-order) keys: the bits of the integer coordinates interleaved, so that sorting by key
+/// sorts bodies along a space-filling curve and every octree cell is a contiguous key range.
+/// 3D keys take 21 bits per axis, the cell of a key at depth l is given by its top 3 l bits.
+constexpr unsigned morton_bits = 21;
+
+/// Spreads the low 21 bits of x to every third bit
+inline uint64_t morton_spread(uint64_t x)
+{
+    x &= 0x1fffff;
+    x = (x | x << 32) & 0x1f00000000ffff;
+    x = (x | x << 16) & 0x1f0000ff0000ff;
+    x = (x | x << 8) & 0x100f00f00f00f00f;
+    x = (x | x << 4) & 0x10c30c30c30c30c3;
+    x = (x | x << 2) & 0x1249249249249249;
+    return x;
+}
+
+inline uint64_t morton_encode(uint32_t x, uint32_t y, uint32_t z)
+{
+    return morton_spread(x) << 2 | morton_spread(y) << 1 | morton_spread(z);
+}
+
+/// Octant (0 to 7) of a key at depth level, level 0 being the children of the root
+inline unsigned morton_octant(uint64_t key, unsigned level)
+{
+    return key >> 3 * (morton_bits - 1 - level) & 7;
+}
+
+/// Inverse of morton_spread
+inline uint32_t morton_compact(uint64_t x)
+{
+    x &= 0x1249249249249249;
+    x = (x | x >> 2) & 0x10c30c30c30c30c3;
+    x = (x | x >> 4) & 0x100f00f00f00f00f;
+    x = (x | x >> 8) & 0x1f0000ff0000ff;
+    x = (x | x >> 16) & 0x1f00000000ffff;
+    x = (x | x >> 32) & 0x1fffff;
+    return (uint32_t)x;
+}
+
+inline void morton_decode(uint64_t key, uint32_t &x, uint32_t &y, uint32_t &z)
+{
+    x = morton_compact(key >> 2);
+    y = morton_compact(key >> 1);
+    z = morton_compact(key);
+}
+
+/// 2D keys, 32 bits per axis: quadtree cells are contiguous key ranges
+inline uint64_t morton_spread_2d(uint64_t x)
+{
+    x &= 0xffffffff;
+    x = (x | x << 16) & 0x0000ffff0000ffff;
+    x = (x | x << 8) & 0x00ff00ff00ff00ff;
+    x = (x | x << 4) & 0x0f0f0f0f0f0f0f0f;
+    x = (x | x << 2) & 0x3333333333333333;
+    x = (x | x << 1) & 0x5555555555555555;
+    return x;
+}
+
+inline uint32_t morton_compact_2d(uint64_t x)
+{
+    x &= 0x5555555555555555;
+    x = (x | x >> 1) & 0x3333333333333333;
+    x = (x | x >> 2) & 0x0f0f0f0f0f0f0f0f;
+    x = (x | x >> 4) & 0x00ff00ff00ff00ff;
+    x = (x | x >> 8) & 0x0000ffff0000ffff;
+    x = (x | x >> 16) & 0xffffffff;
+    return (uint32_t)x;
+}
+
+inline uint64_t morton_encode(uint32_t x, uint32_t y)
+{
+    return morton_spread_2d(x) << 1 | morton_spread_2d(y);
+}
+
+inline void morton_decode(uint64_t key, uint32_t &x, uint32_t &y)
+{
+    x = morton_compact_2d(key >> 1);
+    y = morton_compact_2d(key);
+}
@@ -2,15 +2,18 @@
 #include <vector>
 #include <functional>
 #include "solver/coordinates.h"
+#include "solver/buffer.h"
+#include "solver/inplace.h"
 
 template <typename T>
-std::vector<T> RK4_explicit(
-    double t0, double tf, size_t N, T x0, std::function<T(double t, T x)> dxdt)
+void RK4_explicit(
+    double t0, double tf, size_t N, T x0, std::function<T(double t, T x)> dxdt,
+    std::vector<T> &positions)
 {
     double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
     T x = x0;
 
-    std::vector<T> positions(N + 1);
+    resize_buffer(positions, N + 1);
     positions[0] = x0;
 
     double t = dt;
@@ -20,54 +23,136 @@ std::vector<T> RK4_explicit(
         auto k2 = dxdt(t + dt / 2, x + k1 * dt / 2);
         auto k3 = dxdt(t + dt / 2, x + k2 * dt / 2);
         auto k4 = dxdt(t + dt, x + k3 * dt);
-        x += dt / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+        rk4_update(x, dt, k1, k2, k3, k4);
 
         positions[i] = x;
 
         t += dt;
     }
-    return positions;
 }
 
 template <typename T>
-std::tuple<std::vector<T>, std::vector<T>> RK4_explicit(
-    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x, T v)> a)
+void RK4_explicit(
+    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x, T v)> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
 {
     double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
     T x = x0;
     T v = v0;
 
-    std::vector<T> positions(N + 1);
+    resize_buffer(positions, N + 1);
     positions[0] = x0;
-    std::vector<T> velocities(N + 1);
+    resize_buffer(velocities, N + 1);
     velocities[0] = v0;
 
     double t = dt;
     for (size_t i = 1; i <= N; i++)
     {
-        auto v1 = v;
-        auto x1 = x;
+        T v1 = v;
+        T x1 = x;
         auto k1 = a(t, x, v);
 
-        auto v2 = v1 + dt / 2 * k1;
-        auto x2 = x1 + dt / 2 * v1;
+        T v2 = v1 + dt / 2 * k1;
+        T x2 = x1 + dt / 2 * v1;
         auto k2 = a(t + dt / 2, x2, v2);
 
-        auto v3 = v1 + dt / 2 * k2;
-        auto x3 = x1 + dt / 2 * v2;
+        T v3 = v1 + dt / 2 * k2;
+        T x3 = x1 + dt / 2 * v2;
         auto k3 = a(t + dt / 2, x3, v3);
 
-        auto v4 = v1 + dt * k3;
-        auto x4 = x1 + dt * v3;
+        T v4 = v1 + dt * k3;
+        T x4 = x1 + dt * v3;
         auto k4 = a(t + dt, x4, v4);
 
-        v += dt / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
-        x += dt / 6 * (v1 + 2 * v2 + 2 * v3 + v4);
+        rk4_update(v, dt, k1, k2, k3, k4);
+        rk4_update(x, dt, v1, v2, v3, v4);
+
+        positions[i] = x;
+        velocities[i] = v;
+
+        t += dt;
+    }
+}
+
+template <typename T>
+void RK4_explicit(
+    double t0, double tf, size_t N, const T &x0, rhs_inplace<T> dxdt,
+    std::vector<T> &positions)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T k1 = x0; ///< Stage buffers, allocated once for the whole propagation
+    T k2 = x0;
+    T k3 = x0;
+    T k4 = x0;
+    T x_i = x0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+
+    double t = dt;
+    for (size_t i = 1; i <= N; i++)
+    {
+        dxdt(t, x, k1);
+        set_stage(x_i, x, dt / 2, k1);
+        dxdt(t + dt / 2, x_i, k2);
+        set_stage(x_i, x, dt / 2, k2);
+        dxdt(t + dt / 2, x_i, k3);
+        set_stage(x_i, x, dt, k3);
+        dxdt(t + dt, x_i, k4);
+        rk4_update(x, dt, k1, k2, k3, k4);
+
+        positions[i] = x;
+
+        t += dt;
+    }
+}
+
+template <typename T>
+void RK4_explicit(
+    double t0, double tf, size_t N, const T &x0, const T &v0, acceleration_xv_inplace<T> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T v = v0;
+    T k1 = v0; ///< Stage buffers, allocated once for the whole propagation
+    T k2 = v0;
+    T k3 = v0;
+    T k4 = v0;
+    T v2 = v0;
+    T v3 = v0;
+    T v4 = v0;
+    T x_i = x0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+    resize_buffer(velocities, N + 1);
+    velocities[0] = v0;
+
+    double t = dt;
+    for (size_t i = 1; i <= N; i++)
+    {
+        a(t, x, v, k1);
+
+        set_stage(v2, v, dt / 2, k1);
+        set_stage(x_i, x, dt / 2, v);
+        a(t + dt / 2, x_i, v2, k2);
+
+        set_stage(v3, v, dt / 2, k2);
+        set_stage(x_i, x, dt / 2, v2);
+        a(t + dt / 2, x_i, v3, k3);
+
+        set_stage(v4, v, dt, k3);
+        set_stage(x_i, x, dt, v3);
+        a(t + dt, x_i, v4, k4);
+
+        rk4_update(x, dt, v, v2, v3, v4);
+        rk4_update(v, dt, k1, k2, k3, k4);
 
         positions[i] = x;
         velocities[i] = v;
 
         t += dt;
     }
-    return std::make_tuple(positions, velocities);
 }
\ No newline at end of file
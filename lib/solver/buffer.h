@@ -0,0 +1,31 @@
+#pragma once
+#include <vector>
+#include <cstddef>
+
+namespace debug
+{
+#ifndef NDEBUG
+    inline size_t allocations = 0; ///< Number of times a solver buffer had to grow its storage
+#endif
+
+    inline size_t allocation_count()
+    {
+#ifndef NDEBUG
+        return allocations;
+#else
+        return 0;
+#endif
+    }
+}
+
+/// Resizes a solver buffer while keeping its capacity, so that repeated propagations
+/// of the same length reuse the storage of the previous one instead of allocating.
+template <typename T>
+void resize_buffer(std::vector<T> &buffer, size_t size)
+{
+#ifndef NDEBUG
+    if (size > buffer.capacity())
+        debug::allocations++;
+#endif
+    buffer.resize(size);
+}
@@ -28,13 +28,20 @@ vec2 cross_2D(vec2 v, vec3 outside)
 }
 
 template <typename T>
-std::vector<double> parse(std::vector<T> data, size_t index)
+void parse(const std::vector<T> &data, size_t index, std::vector<double> &result)
 {
-    std::vector<double> result(data.size());
+    result.resize(data.size());
     for (size_t i = 0; i < data.size(); i++)
     {
         result[i] = data[i][index];
     }
+}
+
+template <typename T>
+std::vector<double> parse(const std::vector<T> &data, size_t index)
+{
+    std::vector<double> result;
+    parse(data, index, result);
     return result;
 }
 
@@ -105,7 +112,7 @@ std::vector<xy> polar_to_cart(std::vector<polar> pol)
     return XY;
 }
 
-size_t get_maximum_index(std::vector<double> data)
+size_t get_maximum_index(const std::vector<double> &data)
 {
     size_t index = data.size() - 1;
     double value = 0;
@@ -120,8 +127,25 @@ size_t get_maximum_index(std::vector<double> data)
     return index;
 }
 
+/// Same as get_maximum_index(parse(data, index)) without building the intermediate vector
+template <typename T>
+size_t get_maximum_index(const std::vector<T> &data, size_t index)
+{
+    size_t max_index = data.size() - 1;
+    double value = 0;
+    for (size_t i = 0; i < data.size() - 1; i++)
+    {
+        if (data[i + 1][index] < data[i][index] && data[i][index] > value)
+        {
+            value = data[i][index];
+            max_index = i;
+        }
+    }
+    return max_index;
+}
+
 template <typename T>
-std::vector<T> truncate_vector(std::vector<T> data, size_t max_index)
+std::vector<T> truncate_vector(const std::vector<T> &data, size_t max_index)
 {
     std::vector<T> result(max_index + 1);
     for (size_t i = 0; i < result.size(); i++)
@@ -0,0 +1,175 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+#include <fmt/format.h>
+#include "solver/buffer.h"
+#include "solver/inplace.h"
+
+/// Event function g(t, x): the event occurs where g crosses zero in the direction of the event
+template <typename T>
+using event_function = std::function<double(double t, const T &x)>;
+
+enum class event_direction
+{
+    any,
+    rising,  ///< g goes from negative to non-negative
+    falling, ///< g goes from positive to non-positive
+};
+
+/// Terminal event: the integration stops at its first occurrence
+template <typename T>
+struct event
+{
+    event_function<T> g;
+    event_direction direction = event_direction::any;
+};
+
+/// Where an integration stopped: the index of the event (no_event when tf was reached) and the time
+struct event_hit
+{
+    static constexpr size_t no_event = SIZE_MAX;
+
+    size_t index = no_event;
+    double t = 0;
+
+    bool triggered() const { return index != no_event; }
+};
+
+/// Appends to a solver buffer, counting the growth of its storage like resize_buffer
+template <typename T>
+void append_buffer(std::vector<T> &buffer, const T &value)
+{
+#ifndef NDEBUG
+    if (buffer.size() == buffer.capacity())
+        debug::allocations++;
+#endif
+    buffer.push_back(value);
+}
+
+/// One RK4 step of size h from (t, x) into out
+template <typename T>
+void RK4_step(double t, double h, const T &x, rhs_inplace<T> &dxdt, T &k1, T &k2, T &k3, T &k4, T &x_i, T &out)
+{
+    dxdt(t, x, k1);
+    set_stage(x_i, x, h / 2, k1);
+    dxdt(t + h / 2, x_i, k2);
+    set_stage(x_i, x, h / 2, k2);
+    dxdt(t + h / 2, x_i, k3);
+    set_stage(x_i, x, h, k3);
+    dxdt(t + h, x_i, k4);
+    out = x;
+    rk4_update(out, h, k1, k2, k3, k4);
+}
+
+/// RK4 with fixed steps dt from t0 towards tf, stopping exactly at the first terminal event. After
+/// each step, the events whose g changed sign in their direction are located on the cubic Hermite
+/// interpolant of the step (from x and dx/dt at both ends) by the Illinois method, and the earliest
+/// one is reached by a last RK4 step from the start of the step, so the state at the event keeps
+/// the order of the method. x is advanced in place; the time and state after every step (the
+/// initial state excluded) are appended to times and positions when given. An event whose g is
+/// zero at t0, typically the one the integration was restarted from, does not trigger again.
+template <typename T>
+event_hit RK4_events(double t0, double tf, double dt, T &x, rhs_inplace<T> dxdt, std::span<const event<T>> events,
+                     std::vector<double> *times = nullptr, std::vector<T> *positions = nullptr)
+{
+    constexpr size_t max_events = 16;
+    double g_start[max_events], g_end[max_events];
+    if (events.size() > max_events)
+        fmt::println("ERROR: at most {} events are checked, got {}", max_events, events.size());
+    size_t count = std::min(events.size(), max_events);
+    for (size_t e = 0; e < count; e++)
+        g_start[e] = events[e].g(t0, x);
+
+    T k1 = x, k2 = x, k3 = x, k4 = x, x_i = x, x_end = x, f_end = x; ///< Stage buffers
+    double t = t0;
+    while (t < tf)
+    {
+        double h = std::min(dt, tf - t);
+        RK4_step(t, h, x, dxdt, k1, k2, k3, k4, x_i, x_end);
+
+        /// Earliest crossing among the events
+        size_t hit = event_hit::no_event;
+        double s_hit = 1;
+        bool interpolant = false;
+        for (size_t e = 0; e < count; e++)
+        {
+            g_end[e] = events[e].g(t + h, x_end);
+            double a = g_start[e], b = g_end[e];
+            bool rising = a < 0 && b >= 0, falling = a > 0 && b <= 0;
+            event_direction direction = events[e].direction;
+            if (!(direction == event_direction::rising ? rising : direction == event_direction::falling ? falling : rising || falling))
+                continue;
+            if (!interpolant)
+            {
+                dxdt(t + h, x_end, f_end);
+                interpolant = true;
+            }
+            /// Illinois method on s ∈ [0, 1], x(s) = Hermite(x, k1, x_end, f_end)
+            auto g_at = [&](double s)
+            {
+                double h00 = (1 + 2 * s) * (1 - s) * (1 - s), h10 = s * (1 - s) * (1 - s);
+                double h01 = s * s * (3 - 2 * s), h11 = s * s * (s - 1);
+                x_i = h00 * x + h01 * x_end;
+                accumulate(x_i, h10 * h, k1);
+                accumulate(x_i, h11 * h, f_end);
+                return events[e].g(t + s * h, x_i);
+            };
+            double s0 = 0, s1 = 1, g0 = a, g1 = b;
+            int side = 0;
+            for (size_t iteration = 0; iteration < 100 && (s1 - s0) * h > 1e-12 * std::max(1., std::abs(t)); iteration++)
+            {
+                double s = (s0 * g1 - s1 * g0) / (g1 - g0);
+                double g = g_at(s);
+                if ((g < 0) == (g1 < 0))
+                {
+                    s1 = s;
+                    g1 = g;
+                    if (side == -1)
+                        g0 /= 2;
+                    side = -1;
+                }
+                else
+                {
+                    s0 = s;
+                    g0 = g;
+                    if (side == 1)
+                        g1 /= 2;
+                    side = 1;
+                }
+                if (g == 0)
+                    s0 = s1 = s;
+            }
+            if (s1 < s_hit || hit == event_hit::no_event)
+            {
+                s_hit = s1;
+                hit = e;
+            }
+        }
+
+        if (hit != event_hit::no_event)
+        {
+            /// Last step onto the event, ending just past the root so that g has changed sign
+            double h_event = s_hit * h;
+            RK4_step(t, h_event, x, dxdt, k1, k2, k3, k4, x_i, x_end);
+            x = x_end;
+            t += h_event;
+            if (times)
+                append_buffer(*times, t);
+            if (positions)
+                append_buffer(*positions, x);
+            return {hit, t};
+        }
+        x = x_end;
+        t += h;
+        std::copy(g_end, g_end + count, g_start);
+        if (times)
+            append_buffer(*times, t);
+        if (positions)
+            append_buffer(*positions, x);
+    }
+    return {event_hit::no_event, t};
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <vector>
+#include <functional>
+#include "solver/buffer.h"
+#include "solver/inplace.h"
+
+/// Hermite predictor-corrector (Makino & Aarseth 1992), fourth order from the acceleration and the
+/// jerk at both ends of the step. Each step predicts x and v by Taylor series, evaluates a and j once
+/// at the prediction and applies the time-symmetric corrector
+///     v1 = v0 + h/2 (a0 + a1) + h²/12 (j0 - j1),    x1 = x0 + h/2 (v0 + v1) + h²/12 (a0 - a1)
+template <typename T>
+void hermite_4th(
+    double t0, double tf, size_t N, const T &x0, const T &v0, acceleration_jerk_inplace<T> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T v = v0;
+    T xp = x0, vp = v0, v1 = v0; ///< Stage buffers, allocated once for the whole propagation
+    T a0 = v0, j0 = v0, a1 = v0, j1 = v0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+    resize_buffer(velocities, N + 1);
+    velocities[0] = v0;
+
+    const double h = dt, h2 = dt * dt, h3 = h2 * dt;
+    double t = t0;
+    a(t, x, v, a0, j0);
+    for (size_t i = 1; i <= N; i++)
+    {
+        xp = x + h * v + h2 / 2 * a0 + h3 / 6 * j0;
+        vp = v + h * a0 + h2 / 2 * j0;
+        a(t + dt, xp, vp, a1, j1);
+        v1 = v + h / 2 * (a0 + a1) + h2 / 12 * (j0 - j1);
+        x = x + h / 2 * (v + v1) + h2 / 12 * (a0 - a1);
+        std::swap(v, v1);
+        std::swap(a0, a1);
+        std::swap(j0, j1);
+
+        positions[i] = x;
+        velocities[i] = v;
+
+        t += dt;
+    }
+}
+
+/// Sixth order Hermite scheme of Nitadori & Makino (2008), from the acceleration, jerk and snap at
+/// both ends of the step:
+///     v1 = v0 + h/2 (a0 + a1) - h²/10 (j1 - j0) + h³/120 (s0 + s1)
+///     x1 = x0 + h/2 (v0 + v1) - h²/10 (a1 - a0) + h³/120 (j0 + j1)
+/// The predictor goes to the crackle, interpolated from the end values of the previous step (0 on
+/// the first step), and also predicts the acceleration the snap depends on.
+template <typename T>
+void hermite_6th(
+    double t0, double tf, size_t N, const T &x0, const T &v0, acceleration_snap_inplace<T> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T v = v0;
+    T xp = x0, vp = v0, ap = v0, v1 = v0; ///< Stage buffers, allocated once for the whole propagation
+    T a0 = v0, j0 = v0, s0 = v0, c0 = v0, a1 = v0, j1 = v0, s1 = v0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+    resize_buffer(velocities, N + 1);
+    velocities[0] = v0;
+
+    const double h = dt, h2 = dt * dt, h3 = h2 * dt, h4 = h3 * dt, h5 = h4 * dt;
+    double t = t0;
+    /// The acceleration is not known yet for the first snap: a second evaluation corrects it, from a
+    /// copy since the output may be written before the input is read
+    ap = 0 * v0;
+    a(t, x, v, ap, a0, j0, s0);
+    ap = a0;
+    a(t, x, v, ap, a0, j0, s0);
+    c0 = 0 * v0;
+    for (size_t i = 1; i <= N; i++)
+    {
+        xp = x + h * v + h2 / 2 * a0 + h3 / 6 * j0 + h4 / 24 * s0 + h5 / 120 * c0;
+        vp = v + h * a0 + h2 / 2 * j0 + h3 / 6 * s0 + h4 / 24 * c0;
+        ap = a0 + h * j0 + h2 / 2 * s0 + h3 / 6 * c0;
+        a(t + dt, xp, vp, ap, a1, j1, s1);
+        v1 = v + h / 2 * (a0 + a1) - h2 / 10 * (j1 - j0) + h3 / 120 * (s0 + s1);
+        x = x + h / 2 * (v + v1) - h2 / 10 * (a1 - a0) + h3 / 120 * (j0 + j1);
+        std::swap(v, v1);
+
+        /// Crackle at the end of the step, from the quintic through a, j and s at both ends:
+        ///     c1 = (60 R1 - 36 R2 + 9 R3) / h³
+        /// with R1 = a1 - a0 - h j0 - h²/2 s0, R2 = h (j1 - j0 - h s0), R3 = h² (s1 - s0)
+        c0 = (60 * (a1 - a0) - 24 * h * j0 - 36 * h * j1 - 3 * h2 * s0 + 9 * h2 * s1) / h3;
+        std::swap(a0, a1);
+        std::swap(j0, j1);
+        std::swap(s0, s1);
+
+        positions[i] = x;
+        velocities[i] = v;
+
+        t += dt;
+    }
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <fmt/format.h>
+#include "solver/events.h"
+
+/// Reset map applied to the state when a transition is taken (impact restitution, dropped mass...)
+template <typename T>
+using reset_map = std::function<void(double t, T &x)>;
+
+/// Mode switch taken during a solve
+struct hybrid_switch
+{
+    double t;
+    size_t from, to;
+};
+
+/// Hybrid system: modes with their own RHS, and transitions guarded by events. The solve integrates
+/// the current mode with RK4_events, stops exactly where the first guard fires, applies its reset
+/// map and restarts the integration in the target mode from that state. A restart evaluates the
+/// new RHS afresh at the switch (no stage of the previous mode is reused), so the discontinuities
+/// of the RHS or of the state never fall inside a step and RK4 keeps its order with steps much
+/// larger than the distance between switches would allow if they were smeared.
+///
+/// A guard whose g is zero right after the switch does not fire again, but a reset should leave the
+/// state on the side of the guards of the target mode that does not trigger them (a directional
+/// guard is the simplest way). Chattering (Zeno) systems are cut at max_switches.
+template <typename T>
+class hybrid_system
+{
+public:
+    static constexpr size_t stop = SIZE_MAX; ///< Target of a terminal transition
+
+    /// Returns the index of the mode
+    size_t add_mode(rhs_inplace<T> dxdt)
+    {
+        _modes.push_back({std::move(dxdt), {}, {}, {}});
+        return _modes.size() - 1;
+    }
+
+    /// Transition from one mode to another (or stop) when guard fires, after the reset if any
+    void add_transition(size_t from, size_t to, event<T> guard, reset_map<T> reset = {})
+    {
+        if (from >= _modes.size() || (to >= _modes.size() && to != stop))
+        {
+            fmt::println("ERROR: transition between unknown modes {} -> {}", from, to);
+            return;
+        }
+        _modes[from].guards.push_back(std::move(guard));
+        _modes[from].targets.push_back(to);
+        _modes[from].resets.push_back(std::move(reset));
+    }
+
+    void set_initial_state(double t0, T x0, size_t mode)
+    {
+        _t0 = t0;
+        _x0 = x0;
+        _mode0 = mode;
+    }
+
+    void set_timestep(double dt) { _dt = dt; }
+    void set_max_switches(size_t max_switches) { _max_switches = max_switches; }
+
+    /// Integrates until tf or a terminal transition, returns the final state
+    T solve(double tf)
+    {
+        T x = _x0;
+        double t = _t0;
+        _mode = _mode0;
+        _times.clear();
+        _positions.clear();
+        _switches.clear();
+        append_buffer(_times, t);
+        append_buffer(_positions, x);
+
+        while (t < tf)
+        {
+            const mode &current = _modes[_mode];
+            event_hit hit = RK4_events<T>(t, tf, _dt, x, current.dxdt, current.guards, &_times, &_positions);
+            t = hit.t;
+            if (!hit.triggered())
+                break;
+
+            size_t to = current.targets[hit.index];
+            append_buffer(_switches, hybrid_switch{t, _mode, to});
+            if (to == stop)
+                break;
+            if (current.resets[hit.index])
+            {
+                current.resets[hit.index](t, x);
+                /// The state after the reset starts the next mode at the same time
+                append_buffer(_times, t);
+                append_buffer(_positions, x);
+            }
+            _mode = to;
+            if (_switches.size() >= _max_switches)
+            {
+                fmt::println("ERROR: {} mode switches before t = {}, the hybrid solve stops", _switches.size(), t);
+                break;
+            }
+        }
+        return x;
+    }
+
+    /// Mode at the end of the last solve
+    size_t get_mode() const { return _mode; }
+    /// Times of the states, two equal times around a reset
+    const std::vector<double> &get_times() const { return _times; }
+    const std::vector<T> &get_positions() const { return _positions; }
+    const std::vector<hybrid_switch> &get_switches() const { return _switches; }
+
+private:
+    struct mode
+    {
+        rhs_inplace<T> dxdt;
+        std::vector<event<T>> guards;
+        std::vector<size_t> targets;
+        std::vector<reset_map<T>> resets;
+    };
+
+    std::vector<mode> _modes;
+    double _t0 = 0;
+    double _dt = 0.01;
+    T _x0;
+    size_t _mode0 = 0, _mode = 0;
+    size_t _max_switches = 10000;
+
+    std::vector<double> _times;
+    std::vector<T> _positions;
+    std::vector<hybrid_switch> _switches;
+};
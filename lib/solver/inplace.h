@@ -0,0 +1,52 @@
+#pragma once
+#include <functional>
+
+/// In-place right-hand sides: the derivative is written into a caller-owned buffer instead of
+/// being returned, so dynamic-size states (Eigen::VectorXd, ...) are not reallocated at every call.
+template <typename T>
+using rhs_inplace = std::function<void(double t, const T &x, T &dxdt)>;
+
+template <typename T>
+using acceleration_inplace = std::function<void(double t, const T &x, T &a)>;
+
+template <typename T>
+using acceleration_xv_inplace = std::function<void(double t, const T &x, const T &v, T &a)>;
+
+/// out = x + h * k, evaluated without temporaries
+template <typename T>
+void set_stage(T &out, const T &x, double h, const T &k)
+{
+    if constexpr (requires { out.noalias(); })
+        out.noalias() = x + h * k;
+    else
+        out = x + h * k;
+}
+
+/// x += h * k
+template <typename T>
+void accumulate(T &x, double h, const T &k)
+{
+    if constexpr (requires { x.noalias(); })
+        x.noalias() += h * k;
+    else
+        x += h * k;
+}
+
+/// x += h / 6 * (k1 + 2 * k2 + 2 * k3 + k4)
+template <typename T>
+void rk4_update(T &x, double h, const T &k1, const T &k2, const T &k3, const T &k4)
+{
+    if constexpr (requires { x.noalias(); })
+        x.noalias() += h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+    else
+        x += h / 6 * (k1 + 2 * k2 + 2 * k3 + k4);
+}
+
+/// Acceleration and jerk (its time derivative along the trajectory), for the Hermite integrators
+template <typename T>
+using acceleration_jerk_inplace = std::function<void(double t, const T &x, const T &v, T &a, T &j)>;
+
+/// Acceleration, jerk and snap. The snap depends on the acceleration itself: a_in is its value
+/// predicted by the integrator at (t, x, v).
+template <typename T>
+using acceleration_snap_inplace = std::function<void(double t, const T &x, const T &v, const T &a_in, T &a, T &j, T &s)>;
@@ -2,15 +2,18 @@
 #include <vector>
 #include <functional>
 #include "solver/coordinates.h"
+#include "solver/buffer.h"
+#include "solver/inplace.h"
 
 template <typename T>
-std::vector<T> midpoint(
-    double t0, double tf, size_t N, T x0, std::function<T(double t, T x)> dxdt)
+void midpoint(
+    double t0, double tf, size_t N, T x0, std::function<T(double t, T x)> dxdt,
+    std::vector<T> &positions)
 {
     double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
     T x = x0;
 
-    std::vector<T> positions(N + 1);
+    resize_buffer(positions, N + 1);
     positions[0] = x0;
 
     double t = dt;
@@ -23,20 +26,20 @@ std::vector<T> midpoint(
 
         t += dt;
     }
-    return positions;
 }
 
 template <typename T>
-std::tuple<std::vector<T>, std::vector<T>> midpoint(
-    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x, T v)> a)
+void midpoint(
+    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x, T v)> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
 {
     double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
     T x = x0;
     T v = v0;
 
-    std::vector<T> positions(N + 1);
+    resize_buffer(positions, N + 1);
     positions[0] = x0;
-    std::vector<T> velocities(N + 1);
+    resize_buffer(velocities, N + 1);
     velocities[0] = v0;
 
     double t = dt;
@@ -52,5 +55,66 @@ std::tuple<std::vector<T>, std::vector<T>> midpoint(
 
         t += dt;
     }
-    return std::make_tuple(positions, velocities);
+}
+
+template <typename T>
+void midpoint(
+    double t0, double tf, size_t N, const T &x0, rhs_inplace<T> dxdt,
+    std::vector<T> &positions)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T k1 = x0; ///< Stage buffers, allocated once for the whole propagation
+    T k2 = x0;
+    T x_i = x0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+
+    double t = dt;
+    for (size_t i = 1; i <= N; i++)
+    {
+        dxdt(t, x, k1);
+        set_stage(x_i, x, dt / 2, k1);
+        dxdt(t + dt / 2, x_i, k2);
+        accumulate(x, dt, k2);
+
+        positions[i] = x;
+
+        t += dt;
+    }
+}
+
+template <typename T>
+void midpoint(
+    double t0, double tf, size_t N, const T &x0, const T &v0, acceleration_xv_inplace<T> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T v = v0;
+    T a_n = v0; ///< Stage buffers, allocated once for the whole propagation
+    T x_i = x0;
+    T v_i = v0;
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+    resize_buffer(velocities, N + 1);
+    velocities[0] = v0;
+
+    double t = dt;
+    for (size_t i = 1; i <= N; i++)
+    {
+        a(t, x, v, a_n);
+        set_stage(x_i, x, dt / 2, v);
+        set_stage(v_i, v, dt / 2, a_n);
+        accumulate(x, dt, v_i);
+        a(t + dt / 2, x_i, v_i, a_n);
+        accumulate(v, dt, a_n);
+
+        positions[i] = x;
+        velocities[i] = v;
+
+        t += dt;
+    }
 }
\ No newline at end of file
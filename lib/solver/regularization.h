@@ -0,0 +1,339 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include <fmt/format.h>
+#include "solver/buffer.h"
+#include "solver/coordinates.h"
+#include "solver/solver.h"
+
+/// Regularized formulations of the perturbed two-body problem r'' = -μ r / |r|³ + P(t, r, v).
+/// Each one maps a physical state (t, r, v) to a state y integrated in a fictitious time s, gives
+/// dy/ds for solver_degree_I, and maps y back. Steps of constant Δs shrink in physical time close
+/// to periapsis, so high eccentricity orbits no longer need the periapsis step for the whole orbit.
+/// regularized_solver hides the transformations and integrates up to a physical end time.
+
+template <size_t N>
+using perturbation = std::function<coordinates<N>(double t, const coordinates<N> &r, const coordinates<N> &v)>;
+
+/// Generalized Sundman transformation dt = r^α ds on Cartesian coordinates, y = (r, v, t).
+/// α = 1 makes s proportional to the eccentric anomaly, α = 2 to the true anomaly, α = 3/2
+/// distributes the steps close to the optimum for Kepler orbits.
+/// For α < 3/2 the periapsis passage spans a fictitious time shrinking like r_p^(3/2 - α): with
+/// α = 1, RK4 at 100 steps per orbit diverges from e = 0.99, and reaching 1e-3 a over a few orbits
+/// takes ~1000 steps per orbit at e = 0.99 and ~10000 at e = 0.999 (src/bench_regularization.cpp).
+/// regularized_solver refuses steps above max_step. Use α = 3/2 or kustaanheimo_stiefel there.
+template <size_t N>
+class sundman
+{
+public:
+    using vector = coordinates<N>;
+    using state = coordinates<2 * N + 1>;
+
+    sundman(double μ, double α = 1.5, perturbation<N> P = nullptr) : _μ(μ), _α(α), _P(std::move(P)) {}
+
+    state to_regularized(double t, const vector &r, const vector &v) const
+    {
+        state y;
+        y << r, v, t;
+        return y;
+    }
+
+    void to_physical(const state &y, double &t, vector &r, vector &v) const
+    {
+        r = y.template head<N>();
+        v = y.template segment<N>(N);
+        t = y[2 * N];
+    }
+
+    /// dt/ds
+    double time_derivative(const state &y) const
+    {
+        return std::pow(y.template head<N>().norm(), _α);
+    }
+
+    /// Largest Δs resolving the periapsis passage of the osculating Kepler orbit of y: a quarter of
+    /// the local timescale √(r³/μ) / r^α at periapsis. The bench orbits diverge above, for α ≥ 3/2
+    /// the timescale does not shrink at periapsis and there is no limit.
+    double max_step(const state &y) const
+    {
+        if (_α >= 1.5)
+            return INFINITY;
+        vector r = y.template head<N>();
+        vector v = y.template segment<N>(N);
+        double r_norm = r.norm(), v2 = v.squaredNorm(), rv = r.dot(v);
+        double h2 = std::max(0., r_norm * r_norm * v2 - rv * rv);
+        double E = v2 / 2 - _μ / r_norm;
+        double e = std::sqrt(std::max(0., 1 + 2 * E * h2 / (_μ * _μ)));
+        double r_p = h2 / (_μ * (1 + e));
+        return 0.25 * std::pow(r_p, 1.5 - _α) / std::sqrt(_μ);
+    }
+
+    state rhs(double, const state &y) const
+    {
+        vector r = y.template head<N>();
+        vector v = y.template segment<N>(N);
+        double r_norm = r.norm();
+        double dtds = std::pow(r_norm, _α);
+        vector a = -_μ / (r_norm * r_norm * r_norm) * r;
+        if (_P)
+            a += _P(y[2 * N], r, v);
+        state dyds;
+        dyds << dtds * v, dtds * a, dtds;
+        return dyds;
+    }
+
+private:
+    double _μ;
+    double _α;
+    perturbation<N> _P;
+};
+
+/// Levi-Civita (N = 2) and Kustaanheimo-Stiefel (N = 3) regularization with dt = r ds. The position
+/// is the square x = L(u) u of a 2 (resp. 4) dimensional vector u, and the Kepler problem becomes
+/// the harmonic oscillator u'' = E/2 u, E being the two-body energy. With perturbations:
+///     u'' = E/2 u + r/2 L(u)ᵀ P,    E' = 2 u'·L(u)ᵀ P,    t' = r = |u|²
+/// y = (u, u', E, t). The equations have no singularity at r = 0 and are linear for Kepler orbits,
+/// so a fixed Δs integrates every eccentricity with the same accuracy per orbit.
+template <size_t N>
+class ks_regularization
+{
+    static_assert(N == 2 || N == 3, "Levi-Civita is 2D and Kustaanheimo-Stiefel 3D");
+
+public:
+    static constexpr size_t M = N == 2 ? 2 : 4; ///< Dimension of u
+    using vector = coordinates<N>;
+    using spinor = coordinates<M>;
+    using state = coordinates<2 * M + 2>;
+
+    ks_regularization(double μ, perturbation<N> P = nullptr) : _μ(μ), _P(std::move(P)) {}
+
+    state to_regularized(double t, const vector &r, const vector &v) const
+    {
+        double r_norm = r.norm();
+        spinor u = spinor::Zero();
+        /// Of the possible u, the one that avoids dividing by a small component
+        if (r[0] >= 0)
+        {
+            u[0] = std::sqrt((r_norm + r[0]) / 2);
+            u[1] = r[1] / (2 * u[0]);
+            if constexpr (N == 3)
+                u[2] = r[2] / (2 * u[0]);
+        }
+        else
+        {
+            u[1] = std::sqrt((r_norm - r[0]) / 2);
+            u[0] = r[1] / (2 * u[1]);
+            if constexpr (N == 3)
+                u[3] = r[2] / (2 * u[1]);
+        }
+        spinor du = 0.5 * L(u).transpose() * extend(v);
+        state y;
+        y << u, du, 0.5 * v.squaredNorm() - _μ / r_norm, t;
+        return y;
+    }
+
+    void to_physical(const state &y, double &t, vector &r, vector &v) const
+    {
+        spinor u = y.template head<M>();
+        spinor du = y.template segment<M>(M);
+        spinor x = L(u) * u;
+        spinor dx = 2 / u.squaredNorm() * L(u) * du;
+        r = x.template head<N>();
+        v = dx.template head<N>();
+        t = y[2 * M + 1];
+    }
+
+    double time_derivative(const state &y) const
+    {
+        return y.template head<M>().squaredNorm();
+    }
+
+    state rhs(double, const state &y) const
+    {
+        spinor u = y.template head<M>();
+        spinor du = y.template segment<M>(M);
+        double E = y[2 * M];
+        double r = u.squaredNorm();
+        spinor d2u = 0.5 * E * u;
+        double dE = 0;
+        if (_P)
+        {
+            double t;
+            vector x, v;
+            to_physical(y, t, x, v);
+            spinor LtP = L(u).transpose() * extend(_P(t, x, v));
+            d2u += 0.5 * r * LtP;
+            dE = 2 * du.dot(LtP);
+        }
+        state dyds;
+        dyds << du, d2u, dE, r;
+        return dyds;
+    }
+
+private:
+    static Eigen::Matrix<double, M, M> L(const spinor &u)
+    {
+        Eigen::Matrix<double, M, M> L;
+        if constexpr (N == 2)
+            L << u[0], -u[1],
+                u[1], u[0];
+        else
+            L << u[0], -u[1], -u[2], u[3],
+                u[1], u[0], -u[3], -u[2],
+                u[2], u[3], u[0], u[1],
+                u[3], -u[2], u[1], -u[0];
+        return L;
+    }
+
+    /// Physical vector padded with zeros to the dimension of u
+    static spinor extend(const vector &x)
+    {
+        spinor out = spinor::Zero();
+        out.template head<N>() = x;
+        return out;
+    }
+
+    double _μ;
+    perturbation<N> _P;
+};
+
+using levi_civita = ks_regularization<2>;
+using kustaanheimo_stiefel = ks_regularization<3>;
+
+/// Integrates a regularized formulation R with the solver_degree_I integrators in fictitious time,
+/// up to a physical end time, and returns the physical trajectory.
+template <typename R>
+class regularized_solver
+{
+public:
+    using vector = typename R::vector;
+    using state = typename R::state;
+
+    regularized_solver(R regularization) : _R(std::move(regularization)) {}
+
+    void set_initial_state(double t0, const vector &r0, const vector &v0) { _y0 = _R.to_regularized(t0, r0, v0); }
+    /// Constant step in fictitious time
+    void set_timestep(double ds) { _ds = ds; }
+
+    /// Steps of Δs with the solver_degree_I method of the same name until the physical time reaches
+    /// tf. The last step is shortened (Newton iterations on its length) so that the trajectory ends
+    /// at tf. A non-finite physical time or dt/ds, or a Δs above the max_step of the formulation,
+    /// stops the solve with an error, the trajectory ending at the last finite state.
+    vector solve_euler(double tf)
+    {
+        return solve(tf, [this](double s, std::function<state(double, state)> &f)
+                     { return _solver.solve_euler(s, f); });
+    }
+
+    vector solve_midpoint(double tf)
+    {
+        return solve(tf, [this](double s, std::function<state(double, state)> &f)
+                     { return _solver.solve_midpoint(s, f); });
+    }
+
+    vector solve_RK4(double tf)
+    {
+        return solve(tf, [this](double s, std::function<state(double, state)> &f)
+                     { return _solver.solve_RK4(s, f); });
+    }
+
+    const std::vector<double> &get_times() const { return _times; }
+    const std::vector<vector> &get_positions() const { return _positions; }
+    const std::vector<vector> &get_velocities() const { return _velocities; }
+    /// Regularized states, one per step
+    const std::vector<state> &get_states() const { return _states; }
+
+private:
+    /// Every formulation stores the physical time last
+    static double time(const state &y) { return y[y.size() - 1]; }
+
+    /// step(Δs, f) integrates Δs of fictitious time from the initial state of _solver
+    template <typename Step>
+    vector solve(double tf, Step step)
+    {
+        std::function<state(double, state)> f = [this](double s, state y)
+        { return _R.rhs(s, y); };
+        _states.assign(1, _y0);
+        state y = _y0;
+        bool failed = !std::isfinite(time(y));
+        if (failed)
+            fmt::println("ERROR: initial time {} is not finite", time(y));
+        while (!failed && time(y) < tf)
+        {
+            if constexpr (requires { _R.max_step(y); })
+            {
+                double max_step = _R.max_step(y);
+                if (!(_ds <= max_step))
+                {
+                    fmt::println("ERROR: Δs = {} above {} for the periapsis of the orbit at t = {}, the regularized solve stops",
+                                 _ds, max_step, time(y));
+                    failed = true;
+                    break;
+                }
+            }
+            /// Chunks sized from the current dt/ds, capped: near periapsis dt/ds is small and an
+            /// uncapped chunk would integrate far past tf only to be discarded
+            double remaining = (tf - time(y)) / (_R.time_derivative(y) * _ds);
+            if (!std::isfinite(remaining))
+            {
+                fmt::println("ERROR: dt/ds = {} at t = {}, the regularized solve stops", _R.time_derivative(y), time(y));
+                failed = true;
+                break;
+            }
+            size_t steps = std::clamp<size_t>((size_t)remaining, 1, 1000);
+            _solver.set_initial_state(0, y);
+            _solver.set_timestep(_ds);
+            step(steps * _ds, f);
+            const std::vector<state> &chunk = _solver.get_positions();
+            size_t i = 1;
+            for (; i < chunk.size() && time(chunk[i]) < tf; i++)
+                _states.push_back(chunk[i]);
+            y = chunk[i - 1];
+            if (i < chunk.size())
+            {
+                failed = !std::isfinite(time(chunk[i]));
+                if (failed)
+                    fmt::println("ERROR: physical time {} after t = {}, the regularized solve stops", time(chunk[i]), time(y));
+                break;
+            }
+        }
+
+        /// Last step from the last state before tf
+        if (!failed)
+        {
+            double σ = (tf - time(y)) / _R.time_derivative(y);
+            state y_end = y;
+            for (size_t k = 0; k < 10 && σ > 0; k++)
+            {
+                _solver.set_initial_state(0, y);
+                _solver.set_timestep(σ);
+                y_end = step(σ, f);
+                double error = time(y_end) - tf;
+                σ -= error / _R.time_derivative(y_end);
+                if (std::abs(error) <= 1e-15 * std::abs(tf))
+                    break;
+            }
+            if (!(std::abs(time(y_end) - tf) <= 1e-12 * std::max(1., std::abs(tf))))
+                fmt::println("ERROR: the last step ends at t = {} instead of {}", time(y_end), tf);
+            _states.push_back(y_end);
+        }
+
+        resize_buffer(_times, _states.size());
+        resize_buffer(_positions, _states.size());
+        resize_buffer(_velocities, _states.size());
+        for (size_t i = 0; i < _states.size(); i++)
+            _R.to_physical(_states[i], _times[i], _positions[i], _velocities[i]);
+        return _positions.back();
+    }
+
+    R _R;
+    solver_degree_I<state> _solver;
+    state _y0;
+    double _ds = 1;
+    std::vector<state> _states;
+    std::vector<double> _times;
+    std::vector<vector> _positions;
+    std::vector<vector> _velocities;
+};
@@ -1,3 +1,4 @@
+#pragma once
 #include <Eigen/Core>
 #include <fmt/format.h>
 #include "euler.h"
@@ -7,6 +8,7 @@
 #include <iostream>
 #include "solver/verlet.h"
 #include "solver/yoshida.h"
+#include "solver/hermite.h"
 
 size_t get_number_of_steps(double t0, double tf, double dt)
 {
@@ -32,25 +34,49 @@ public:
   T solve_euler(double tf, std::function<T(double t, T x)> dxdt)
   {
     size_t N = get_number_of_steps(_t0, tf, _dt);
-    _positions = euler_explicit(_t0, tf, N, _x0, dxdt);
+    euler_explicit(_t0, tf, N, _x0, dxdt, _positions);
     return _positions[N];
   }
 
   T solve_midpoint(double tf, std::function<T(double t, T x)> dxdt)
   {
     size_t N = get_number_of_steps(_t0, tf, _dt);
-    _positions = midpoint(_t0, tf, N, _x0, dxdt);
+    midpoint(_t0, tf, N, _x0, dxdt, _positions);
     return _positions[N];
   }
 
   T solve_RK4(double tf, std::function<T(double t, T x)> dxdt)
   {
     size_t N = get_number_of_steps(_t0, tf, _dt);
-    _positions = RK4_explicit(_t0, tf, N, _x0, dxdt);
+    RK4_explicit(_t0, tf, N, _x0, dxdt, _positions);
     return _positions[N];
   }
 
-  std::vector<T> get_positions() { return _positions; }
+  T solve_euler(double tf, rhs_inplace<T> dxdt)
+  {
+    size_t N = get_number_of_steps(_t0, tf, _dt);
+    euler_explicit(_t0, tf, N, _x0, dxdt, _positions);
+    return _positions[N];
+  }
+
+  T solve_midpoint(double tf, rhs_inplace<T> dxdt)
+  {
+    size_t N = get_number_of_steps(_t0, tf, _dt);
+    midpoint(_t0, tf, N, _x0, dxdt, _positions);
+    return _positions[N];
+  }
+
+  T solve_RK4(double tf, rhs_inplace<T> dxdt)
+  {
+    size_t N = get_number_of_steps(_t0, tf, _dt);
+    RK4_explicit(_t0, tf, N, _x0, dxdt, _positions);
+    return _positions[N];
+  }
+
+  const std::vector<T> &get_positions() const { return _positions; }
+
+  /// Drops the stored states after max_index, keeping the buffer capacity for the next solve
+  void truncate(size_t max_index) { _positions.resize(max_index + 1); }
 
   std::vector<double> get_timeline(double tf)
   {
@@ -87,68 +113,125 @@ public:
 
   T solve_euler(double tf, std::function<T(double t, T x, T v)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::tie(_positions, _velocities) = euler_explicit(_t0, tf, N, _x0, _v0, a);
+    size_t N = steps(tf);
+    euler_explicit(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_euler(double tf, std::function<T(double t, T x)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::function<T(double, T, T)> b = [a](double t, T x, T v)
+    size_t N = steps(tf);
+    std::function<T(double, T, T)> b = [a](double t, T x, T)
     { return a(t, x); };
-    std::tie(_positions, _velocities) = euler_explicit(_t0, tf, N, _x0, _v0, b);
+    euler_explicit(_t0, tf, N, _x0, _v0, b, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_midpoint(double tf, std::function<T(double t, T x, T v)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::tie(_positions, _velocities) = midpoint(_t0, tf, N, _x0, _v0, a);
+    size_t N = steps(tf);
+    midpoint(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_midpoint(double tf, std::function<T(double t, T x)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::function<T(double, T, T)> b = [a](double t, T x, T v)
+    size_t N = steps(tf);
+    std::function<T(double, T, T)> b = [a](double t, T x, T)
     { return a(t, x); };
-    std::tie(_positions, _velocities) = midpoint(_t0, tf, N, _x0, _v0, b);
+    midpoint(_t0, tf, N, _x0, _v0, b, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_verlet(double tf, std::function<T(double t, T x)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::tie(_positions, _velocities) = verlet_velocity(_t0, tf, N, _x0, _v0, a);
+    size_t N = steps(tf);
+    verlet_velocity(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_yoshida_4th(double tf, std::function<T(double t, T x)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::tie(_positions, _velocities) = yoshida_4th(_t0, tf, N, _x0, _v0, a);
+    size_t N = steps(tf);
+    yoshida_4th(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_RK4(double tf, std::function<T(double t, T x)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::function<T(double, T, T)> b = [a](double t, T x, T v)
+    size_t N = steps(tf);
+    std::function<T(double, T, T)> b = [a](double t, T x, T)
     { return a(t, x); };
-    std::tie(_positions, _velocities) = RK4_explicit(_t0, tf, N, _x0, _v0, b);
+    RK4_explicit(_t0, tf, N, _x0, _v0, b, _positions, _velocities);
     return _positions[N];
   }
 
   T solve_RK4(double tf, std::function<T(double t, T x, T v)> a)
   {
-    size_t N = get_number_of_steps(_t0, tf, _dt);
-    std::tie(_positions, _velocities) = RK4_explicit(_t0, tf, N, _x0, _v0, a);
+    size_t N = steps(tf);
+    RK4_explicit(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_euler(double tf, acceleration_xv_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    euler_explicit(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_midpoint(double tf, acceleration_xv_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    midpoint(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
     return _positions[N];
   }
 
-  std::vector<T> get_positions() { return _positions; }
-  std::vector<T> get_velocities() { return _velocities; }
+  T solve_verlet(double tf, acceleration_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    verlet_velocity(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_yoshida_4th(double tf, acceleration_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    yoshida_4th(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_RK4(double tf, acceleration_xv_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    RK4_explicit(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_hermite_4th(double tf, acceleration_jerk_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    hermite_4th(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  T solve_hermite_6th(double tf, acceleration_snap_inplace<T> a)
+  {
+    size_t N = steps(tf);
+    hermite_6th(_t0, tf, N, _x0, _v0, a, _positions, _velocities);
+    return _positions[N];
+  }
+
+  const std::vector<T> &get_positions() const { return _positions; }
+  const std::vector<T> &get_velocities() const { return _velocities; }
+
+  /// Drops the stored states after max_index, keeping the buffer capacity for the next solve
+  void truncate(size_t max_index)
+  {
+    _positions.resize(max_index + 1);
+    _velocities.resize(max_index + 1);
+  }
+
   std::vector<double> get_timeline(double tf)
   {
     size_t N = get_number_of_steps(_t0, tf, _dt);
@@ -183,8 +266,29 @@ public:
     return Em;
   }
 
+  /// |E - E0| / |E0| along the last solve, for the total energy E(t, x, v) of the system. The states
+  /// are (tf - t0) / N apart, which differs from the timestep when it does not divide tf - t0.
+  std::vector<double> get_energy_error(std::function<double(double t, const T &x, const T &v)> energy)
+  {
+    std::vector<double> error(_positions.size());
+    size_t N = _positions.size() - 1;
+    double step = N ? (_tf - _t0) / N : 0.;
+    double E0 = energy(_t0, _positions[0], _velocities[0]);
+    for (size_t i = 0; i < _positions.size(); i++)
+      error[i] = std::abs((energy(_t0 + i * step, _positions[i], _velocities[i]) - E0) / E0);
+    return error;
+  }
+
 private:
+  /// Number of steps to tf, which is kept for the times of the stored states
+  size_t steps(double tf)
+  {
+    _tf = tf;
+    return get_number_of_steps(_t0, tf, _dt);
+  }
+
   double _t0;
+  double _tf;
   double _dt;
   T _x0;
   T _v0;
@@ -2,19 +2,22 @@
 #include <vector>
 #include <functional>
 #include "solver/coordinates.h"
+#include "solver/buffer.h"
+#include "solver/inplace.h"
 #include <iostream>
 
 template <typename T>
-std::tuple<std::vector<T>, std::vector<T>> yoshida_4th(
-    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x)> a)
+void yoshida_4th(
+    double t0, double tf, size_t N, T x0, T v0, std::function<T(double t, T x)> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
 {
     double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
     T x = x0;
     T v = v0;
 
-    std::vector<T> positions(N + 1);
+    resize_buffer(positions, N + 1);
     positions[0] = x0;
-    std::vector<T> velocities(N + 1);
+    resize_buffer(velocities, N + 1);
     velocities[0] = v0;
 
     double ω0 = -cbrt(2) / (2 - cbrt(2));
@@ -47,6 +50,50 @@ std::tuple<std::vector<T>, std::vector<T>> yoshida_4th(
 
         t += dt;
     }
+}
 
-    return std::make_tuple(positions, velocities);
+template <typename T>
+void yoshida_4th(
+    double t0, double tf, size_t N, const T &x0, const T &v0, acceleration_inplace<T> a,
+    std::vector<T> &positions, std::vector<T> &velocities)
+{
+    double dt = (tf - t0) / N; ///< We consider N+1 steps from t0 to tf included so dt = T/N
+    T x = x0;
+    T v = v0;
+    T a_n = v0; ///< Stage buffer, allocated once for the whole propagation
+
+    resize_buffer(positions, N + 1);
+    positions[0] = x0;
+    resize_buffer(velocities, N + 1);
+    velocities[0] = v0;
+
+    double ω0 = -cbrt(2) / (2 - cbrt(2));
+    double ω1 = 1 / (2 - cbrt(2));
+    double c1 = ω1 / 2;
+    double c2 = (ω0 + ω1) / 2;
+    double c3 = (ω0 + ω1) / 2;
+    double c4 = ω1 / 2;
+    double d1 = ω1;
+    double d2 = ω0;
+    double d3 = ω1;
+
+    double t = dt;
+    for (size_t i = 1; i <= N; i++)
+    {
+        accumulate(x, c1 * dt, v);
+        a(t + c1 * dt, x, a_n);
+        accumulate(v, d1 * dt, a_n);
+        accumulate(x, c2 * dt, v);
+        a(t + (c1 + c2) * dt, x, a_n);
+        accumulate(v, d2 * dt, a_n);
+        accumulate(x, c3 * dt, v);
+        a(t + (c1 + c2 + c3) * dt, x, a_n);
+        accumulate(v, d3 * dt, a_n);
+        accumulate(x, c4 * dt, v);
+
+        positions[i] = x;
+        velocities[i] = v;
+
+        t += dt;
+    }
 }
\ No newline at end of file
@@ -0,0 +1,322 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <functional>
+#include <vector>
+#include <fmt/format.h>
+#include "celest/atmosphere.h"
+#include "math/interpolation.h"
+#include "solver/coordinates.h"
+#include "solver/events.h"
+#include "propulsion.h"
+
+/// Planar ascent state in the inertial frame of the central body, the launch site on the x axis at
+/// t = 0 and the body rotating counterclockwise
+using launch_state = coordinates<5>;
+
+namespace launch
+{
+    enum
+    {
+        x,
+        y,
+        vx,
+        vy,
+        mass,
+    };
+}
+
+/// One stage: it burns its propellant_mass, then its dry_mass is dropped and the next stage ignites
+/// after coast_time
+struct launch_stage
+{
+    double dry_mass = 0;
+    double propellant_mass = 0;
+    engine propulsion;
+    double reference_area = 0;
+    double drag_coefficient = 0.3; ///< Used when drag_table is empty
+    table_1d drag_table;           ///< Cd against Mach
+    double coast_time = 0;
+};
+
+/// Steering of the thrust, as a pitch from the local vertical: vertical rise, linear pitch-over to
+/// kick_angle, then gravity turn (thrust along the air-relative velocity) for the first stage. The
+/// upper stages follow the linear tangent law of their elevation above the local horizontal,
+/// tan φ = tan upper_elevation - upper_rate τ, τ from the ignition of the second stage.
+struct pitch_program
+{
+    double vertical_time = 10;
+    double kick_time = 10;
+    double kick_angle = 0.15;
+    double upper_elevation = 0.4;
+    double upper_rate = 0.002;
+};
+
+/// Why an ascent stopped
+enum class ascent_end
+{
+    time,    ///< tf reached
+    burnout, ///< Propellant of the last stage exhausted
+    cutoff,  ///< Target orbital energy reached
+    impact,
+};
+
+struct ascent_result
+{
+    ascent_end end = ascent_end::time;
+    double t = 0;
+    launch_state state;
+    size_t stage = 0; ///< Stage burning (or about to ignite) at the end
+    double altitude = 0;
+    double apoapsis = 0, periapsis = 0; ///< Altitudes of the osculating orbit
+};
+
+/// Multi-stage launch vehicle with the mass in the state: gravity of the central body, thrust and
+/// mass flow of the stage engine with its ambient pressure loss, drag in an atmosphere rotating with
+/// the body. The flight is a sequence of phases integrated by RK4_events with a fixed step: each
+/// burn ends on the burnout event (mass down to the stage dry mass), on the end of the engine
+/// profile, or on the energy cutoff of the last stage; separation drops the dry mass and the next
+/// phase restarts from that exact state with the RHS of the next stage. The phase RHS and events are
+/// small captures held in place by std::function, and the history buffers keep their capacity, so
+/// repeated simulations (an optimizer evaluating pitch programs) do not allocate.
+class launch_vehicle
+{
+public:
+    launch_vehicle(std::vector<launch_stage> stages, double payload_mass)
+        : _stages(std::move(stages)), _payload(payload_mass) {}
+
+    /// Central body: gravitational parameter, radius, rotation rate
+    void set_body(double μ, double R, double ω)
+    {
+        _μ = μ;
+        _R = R;
+        _ω = ω;
+    }
+    /// The atmosphere is not copied; none for vacuum
+    void set_atmosphere(const atmosphere *air) { _air = air; }
+    void set_pitch_program(const pitch_program &program) { _pitch = program; }
+    pitch_program &get_pitch_program() { return _pitch; }
+    /// Cutoff of the last stage when the orbital energy reaches the one of circular orbits at altitude
+    /// (semi-major axis R + altitude), 0 to burn it out
+    void set_cutoff_altitude(double altitude) { _cutoff = altitude; }
+    void set_timestep(double dt) { _dt = dt; }
+    /// Keeps the state after every step for get_times and get_states
+    void set_history(bool history) { _history = history; }
+
+    double liftoff_mass() const
+    {
+        double m = _payload;
+        for (const launch_stage &stage : _stages)
+            m += stage.dry_mass + stage.propellant_mass;
+        return m;
+    }
+
+    /// Flies from liftoff until tf, impact, or the end of the last burn
+    ascent_result simulate(double tf)
+    {
+        launch_state s;
+        s << _R, 0., 0., _ω * _R, liftoff_mass();
+        double t = 0;
+        _hint_air = 0;
+        _times.clear();
+        _states.clear();
+        if (_history)
+        {
+            append_buffer(_times, t);
+            append_buffer(_states, s);
+        }
+        std::vector<double> *times = _history ? &_times : nullptr;
+        std::vector<launch_state> *states = _history ? &_states : nullptr;
+
+        rhs_inplace<launch_state> burn = [this](double t, const launch_state &s, launch_state &dsdt)
+        { derivative(t, s, dsdt, true); };
+        rhs_inplace<launch_state> coast = [this](double t, const launch_state &s, launch_state &dsdt)
+        { derivative(t, s, dsdt, false); };
+        /// Impact, burnout, end of the engine profile, energy cutoff
+        std::array<event<launch_state>, 4> events = {
+            event<launch_state>{[this](double, const launch_state &s)
+                                { return std::hypot(s[launch::x], s[launch::y]) - _R; }, event_direction::falling},
+            event<launch_state>{[this](double, const launch_state &s)
+                                { return s[launch::mass] - _burnout_mass; }, event_direction::falling},
+            event<launch_state>{[this](double t, const launch_state &)
+                                { return t - _ignition - _stages[_stage].propulsion.get_burn_time(); }, event_direction::rising},
+            event<launch_state>{[this](double, const launch_state &s)
+                                { return _cutoff > 0 && _stage + 1 == _stages.size() ? energy(s) + _μ / (2 * (_R + _cutoff)) : -1.; },
+                                event_direction::rising}};
+
+        ascent_result result;
+        for (_stage = 0; _stage < _stages.size(); _stage++)
+        {
+            const launch_stage &stage = _stages[_stage];
+            if (stage.coast_time > 0 && _stage > 0)
+            {
+                event_hit hit = RK4_events<launch_state>(t, std::min(tf, t + stage.coast_time), _dt, s, coast,
+                                                         std::span(events).first(1), times, states);
+                t = hit.triggered() ? hit.t : std::min(tf, t + stage.coast_time);
+                if (hit.triggered() || t >= tf)
+                    return finish(hit.triggered() ? ascent_end::impact : ascent_end::time, t, s, result);
+            }
+            _ignition = t;
+            _hint_engine = table_hint();
+            _burnout_mass = s[launch::mass] - stage.propellant_mass;
+            if (_stage == 1)
+                _upper_ignition = t;
+            /// The pitch segments of the first stage are integrated separately, their switches being
+            /// discontinuities of the thrust direction that a step must not straddle
+            event_hit hit;
+            double segment_end[2] = {_pitch.vertical_time, _pitch.vertical_time + _pitch.kick_time};
+            for (_segment = _stage == 0 ? 0 : 2;; _segment++)
+            {
+                double end = _segment < 2 ? std::min(tf, segment_end[_segment]) : tf;
+                hit = RK4_events<launch_state>(t, end, _dt, s, burn, events, times, states);
+                t = hit.t;
+                if (hit.triggered() || t >= tf || _segment == 2)
+                    break;
+            }
+            if (!hit.triggered())
+                return finish(ascent_end::time, t, s, result);
+            if (hit.index == 0)
+                return finish(ascent_end::impact, t, s, result);
+            if (hit.index == 3)
+                return finish(ascent_end::cutoff, t, s, result);
+            /// Separation: the propellant left (none at burnout) goes with the stage
+            double propellant_left = std::max(0., s[launch::mass] - _burnout_mass);
+            if (_stage + 1 < _stages.size())
+                s[launch::mass] -= stage.dry_mass + propellant_left;
+        }
+        _stage = _stages.size() - 1;
+        return finish(ascent_end::burnout, t, s, result);
+    }
+
+    const std::vector<double> &get_times() const { return _times; }
+    const std::vector<launch_state> &get_states() const { return _states; }
+
+    double altitude(const launch_state &s) const { return std::hypot(s[launch::x], s[launch::y]) - _R; }
+
+    /// Radius of the apoapsis of the osculating orbit (infinite when unbound)
+    double apoapsis(const launch_state &s) const
+    {
+        double a, e;
+        elements(s, a, e);
+        return a > 0 ? a * (1 + e) - _R : INFINITY;
+    }
+
+    double periapsis(const launch_state &s) const
+    {
+        double a, e;
+        elements(s, a, e);
+        return a * (1 - e) - _R;
+    }
+
+    /// Downrange distance over the rotating surface
+    double downrange(double t, const launch_state &s) const { return _R * (std::atan2(s[launch::y], s[launch::x]) - _ω * t); }
+
+private:
+    /// Specific orbital energy
+    double energy(const launch_state &s) const
+    {
+        double v2 = s[launch::vx] * s[launch::vx] + s[launch::vy] * s[launch::vy];
+        return v2 / 2 - _μ / std::hypot(s[launch::x], s[launch::y]);
+    }
+
+    void elements(const launch_state &s, double &a, double &e) const
+    {
+        double h = s[launch::x] * s[launch::vy] - s[launch::y] * s[launch::vx], ε = energy(s);
+        a = -_μ / (2 * ε);
+        e = std::sqrt(std::max(0., 1 + 2 * ε * h * h / (_μ * _μ)));
+    }
+
+    /// Thrust direction from the local vertical (ux, uy) and horizontal (-uy, ux)
+    void steering(double t, double ux, double uy, double ax, double ay, double &dx, double &dy) const
+    {
+        double θ; ///< Pitch from the vertical
+        if (_stage == 0)
+        {
+            if (_segment == 0)
+                θ = 0;
+            else if (_segment == 1 || ax * ax + ay * ay == 0)
+                θ = _pitch.kick_angle * std::clamp((t - _pitch.vertical_time) / _pitch.kick_time, 0., 1.);
+            else
+            {
+                double norm = std::hypot(ax, ay);
+                dx = ax / norm;
+                dy = ay / norm;
+                return;
+            }
+        }
+        else
+            θ = M_PI / 2 - std::atan(std::tan(_pitch.upper_elevation) - _pitch.upper_rate * (t - _upper_ignition));
+        dx = std::cos(θ) * ux - std::sin(θ) * uy;
+        dy = std::cos(θ) * uy + std::sin(θ) * ux;
+    }
+
+    void derivative(double t, const launch_state &s, launch_state &dsdt, bool powered) const
+    {
+        const launch_stage &stage = _stages[_stage];
+        double x = s[launch::x], y = s[launch::y], vx = s[launch::vx], vy = s[launch::vy], m = s[launch::mass];
+        double r2 = x * x + y * y, r = std::sqrt(r2);
+        double g = -_μ / (r2 * r);
+        double ax = g * x, ay = g * y;
+
+        /// Air-relative velocity, and the atmosphere state shared by drag and thrust
+        double wx = vx + _ω * y, wy = vy - _ω * x;
+        double w = std::hypot(wx, wy);
+        double ρ = 0, p = 0, h = r - _R;
+        if (_air)
+        {
+            ρ = _air->density(h, _hint_air);
+            if (powered)
+                p = _air->pressure(h, _hint_air);
+            double Cd = stage.drag_coefficient;
+            if (!stage.drag_table.nodes().empty())
+                Cd = stage.drag_table(w / _air->speed_of_sound(h, _hint_air), _hint_mach);
+            double k = -0.5 * ρ * Cd * stage.reference_area * w / m;
+            ax += k * wx;
+            ay += k * wy;
+        }
+
+        double ṁ = 0;
+        if (powered)
+        {
+            double F = stage.propulsion.thrust(t - _ignition, p, _hint_engine);
+            ṁ = -stage.propulsion.mass_flow(t - _ignition, _hint_engine);
+            double dx, dy;
+            steering(t, x / r, y / r, wx, wy, dx, dy);
+            ax += F / m * dx;
+            ay += F / m * dy;
+        }
+        dsdt << vx, vy, ax, ay, ṁ;
+    }
+
+    ascent_result &finish(ascent_end end, double t, const launch_state &s, ascent_result &result) const
+    {
+        result.end = end;
+        result.t = t;
+        result.state = s;
+        result.stage = std::min(_stage, _stages.size() - 1);
+        result.altitude = altitude(s);
+        result.apoapsis = apoapsis(s);
+        result.periapsis = periapsis(s);
+        return result;
+    }
+
+    std::vector<launch_stage> _stages;
+    double _payload;
+    double _μ = 3.986004418e14, _R = 6378137., _ω = 7.2921159e-5;
+    const atmosphere *_air = nullptr;
+    pitch_program _pitch;
+    double _cutoff = 0;
+    double _dt = 0.5;
+    bool _history = false;
+
+    /// Current phase
+    size_t _stage = 0;
+    size_t _segment = 0; ///< Pitch segment of the first stage: vertical, kick, gravity turn
+    double _ignition = 0, _upper_ignition = 0, _burnout_mass = 0;
+    mutable size_t _hint_air = 0, _hint_mach = 0;
+    mutable table_hint _hint_engine;
+
+    std::vector<double> _times;
+    std::vector<launch_state> _states;
+};
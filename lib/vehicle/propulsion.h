@@ -0,0 +1,122 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+#include <fmt/format.h>
+#include "math/interpolation.h"
+
+/// Rocket engine (or cluster of identical engines). The vacuum thrust is constant or follows a
+/// tabulated profile of the time since ignition (throttling, solid motor grain), the mass flow
+/// follows it through the vacuum specific impulse, and the ambient pressure p costs p A_e:
+///     F = F_vac(t) - p A_e,    ṁ = F_vac(t) / (Isp_vac g0)
+/// Engine decks giving the thrust directly against time and ambient pressure replace the pressure
+/// term through set_thrust_table; without a profile, the vacuum column of the deck serves as one for
+/// the mass flow and the burn time. Lookups take a table_hint (x for the time, y for the pressure)
+/// kept by the caller between evaluations along a trajectory.
+class engine
+{
+public:
+    static constexpr double g0 = 9.80665;
+
+    engine() = default;
+    engine(double thrust_vacuum, double isp_vacuum, double exit_area = 0, double burn_time = INFINITY)
+        : _thrust(thrust_vacuum), _isp(isp_vacuum), _exit_area(exit_area), _burn_time(burn_time) {}
+
+    /// Vacuum thrust against the time since ignition, which ends with the profile
+    void set_thrust_profile(std::vector<double> t, std::vector<double> thrust_vacuum,
+                            interpolation_method method = interpolation_method::linear)
+    {
+        if (t.size() < 2 || t.size() != thrust_vacuum.size())
+        {
+            fmt::println("ERROR: thrust profile needs at least 2 times and as many thrusts, got {} and {}", t.size(), thrust_vacuum.size());
+            return;
+        }
+        if (std::adjacent_find(t.begin(), t.end(), std::greater_equal<>()) != t.end())
+        {
+            fmt::println("ERROR: thrust profile times must be strictly increasing");
+            return;
+        }
+        _burn_time = t.back();
+        _profile.set(std::move(t), std::move(thrust_vacuum), method);
+        _profiled = true;
+        _deck_profile = false;
+    }
+
+    /// Thrust against the time since ignition and the ambient pressure, thrust[i * n_p + j] at
+    /// (t_i, p_j), clamped to the table. Unless a profile was set, the thrust at the lowest pressure
+    /// (normally 0) becomes the vacuum profile, so the mass flow follows the deck and the burn ends
+    /// with it.
+    void set_thrust_table(std::vector<double> t, std::vector<double> p, std::vector<double> thrust,
+                          interpolation_method method = interpolation_method::linear)
+    {
+        if (t.size() < 2 || p.size() < 2 || thrust.size() != t.size() * p.size())
+        {
+            fmt::println("ERROR: thrust table needs at least 2 x 2 nodes and n_t * n_p values, got {} x {} and {}", t.size(), p.size(), thrust.size());
+            return;
+        }
+        if (!_profiled || _deck_profile)
+        {
+            std::vector<double> vacuum(t.size());
+            for (size_t i = 0; i < t.size(); i++)
+                vacuum[i] = thrust[i * p.size()];
+            set_thrust_profile(t, std::move(vacuum), method);
+            _deck_profile = _profiled;
+        }
+        _deck.set(std::move(t), std::move(p), std::move(thrust), method);
+        _tabulated = true;
+    }
+
+    void set_isp(double isp_vacuum) { _isp = isp_vacuum; }
+    void set_exit_area(double area) { _exit_area = area; }
+    void set_burn_time(double burn_time) { _burn_time = burn_time; }
+
+    double get_burn_time() const { return _burn_time; }
+    double get_isp() const { return _isp; }
+
+    double vacuum_thrust(double t, table_hint &hint) const
+    {
+        if (t < 0 || t >= _burn_time)
+            return 0;
+        return _profiled ? std::max(0., _profile(t, hint.x)) : _thrust;
+    }
+
+    /// Thrust at time t since ignition and ambient pressure p
+    double thrust(double t, double p, table_hint &hint) const
+    {
+        if (t < 0 || t >= _burn_time)
+            return 0;
+        if (_tabulated)
+            return std::max(0., _deck(t, p, hint));
+        return std::max(0., vacuum_thrust(t, hint) - p * _exit_area);
+    }
+
+    /// Propellant mass flow (positive)
+    double mass_flow(double t, table_hint &hint) const { return vacuum_thrust(t, hint) / (_isp * g0); }
+
+    /// Propellant burnt between ignition and t
+    double propellant_used(double t) const
+    {
+        t = std::clamp(t, 0., _burn_time);
+        if (!_profiled)
+            return _thrust * t / (_isp * g0);
+        /// Simpson on the profile segments, exact for the linear and cubic interpolants
+        const std::vector<double> &nodes = _profile.nodes();
+        double sum = 0;
+        size_t hint = 0;
+        auto F = [&](double τ) { return std::max(0., _profile(τ, hint)); };
+        for (size_t i = 0; i + 1 < nodes.size() && nodes[i] < t; i++)
+        {
+            double a = nodes[i], b = std::min(nodes[i + 1], t);
+            sum += (b - a) / 6 * (F(a) + 4 * F(0.5 * (a + b)) + F(b));
+        }
+        return sum / (_isp * g0);
+    }
+
+private:
+    double _thrust = 0, _isp = 300, _exit_area = 0, _burn_time = INFINITY;
+    bool _profiled = false, _tabulated = false, _deck_profile = false; ///< _deck_profile: the profile comes from the deck
+    table_1d _profile;
+    table_2d _deck;
+};
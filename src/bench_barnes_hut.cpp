@@ -0,0 +1,100 @@
+#include "nbody/barnes_hut.h"
+#include "nbody/direct.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+#include <random>
+
+int main()
+{
+    std::mt19937 rng(7);
+    constexpr double ε = 1e-2;
+
+    {
+        size_t N = 20000;
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd x = nbody_state(plummer_sphere(N, rng));
+        Eigen::VectorXd a_ref, a;
+        direct_summation direct(m, 1., ε);
+        double direct_ms = time_ms([&]
+                                   { direct(0, x, a_ref); });
+        fmt::println("Accuracy vs θ, N = {} (direct summation {:.1f}ms)", N, direct_ms);
+        fmt::println("{:>5} {:>12} {:>12} {:>10}", "θ", "rms error", "max error", "ms");
+        barnes_hut tree(m, 1., ε);
+        for (double θ : {0.2, 0.3, 0.4, 0.5, 0.6, 0.7, 0.8, 1.0})
+        {
+            tree.set_opening_angle(θ);
+            double runtime = time_ms([&]
+                                     { tree(0, x, a); });
+            double rms = 0, max = 0;
+            for (size_t i = 0; i < N; i++)
+            {
+                double error = (nbody_body(a, i) - nbody_body(a_ref, i)).norm() / nbody_body(a_ref, i).norm();
+                rms += error * error;
+                max = std::max(max, error);
+            }
+            fmt::println("{:>5} {:>12.2e} {:>12.2e} {:>10.1f}", θ, std::sqrt(rms / N), max, runtime);
+        }
+    }
+
+    fmt::println("\nTime vs N, θ = 0.5, {} threads (direct summation up to 64000)", thread_count());
+    fmt::println("{:>8} {:>12} {:>12} {:>10}", "N", "tree ms", "direct ms", "speedup");
+    for (size_t N = 1000; N <= 512000; N *= 2)
+    {
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd x = nbody_state(plummer_sphere(N, rng));
+        Eigen::VectorXd a;
+        barnes_hut tree(m, 1., ε);
+        double tree_ms = time_ms([&]
+                                 { tree(0, x, a); });
+        if (N <= 64000)
+        {
+            direct_summation direct(m, 1., ε);
+            double direct_ms = time_ms([&]
+                                       { direct(0, x, a); });
+            fmt::println("{:>8} {:>12.1f} {:>12.1f} {:>10.1f}", N, tree_ms, direct_ms, direct_ms / tree_ms);
+        }
+        else
+            fmt::println("{:>8} {:>12.1f}", N, tree_ms);
+    }
+
+    /// More than group_size bodies on one point share a Morton key and form a single leaf
+    {
+        size_t N = 2000, coincident = 200;
+        std::vector<vec3d> bodies = plummer_sphere(N, rng);
+        for (size_t i = 0; i < coincident; i++)
+            bodies[i] = vec3d(0.3, -0.2, 0.1);
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd x = nbody_state(bodies);
+        Eigen::VectorXd a_ref, a;
+        direct_summation(m, 1., ε)(0, x, a_ref);
+        barnes_hut tree(m, 1., ε);
+        tree(0, x, a);
+        double max = 0;
+        for (size_t i = 0; i < N; i++)
+            max = std::max(max, (nbody_body(a, i) - nbody_body(a_ref, i)).norm() / nbody_body(a_ref, i).norm());
+        fmt::println("\n{} coincident bodies in N = {}, θ = 0.5: max error {:.2e}", coincident, N, max);
+        if (!(max < 1e-2))
+            fmt::println("ERROR: bodies of an oversized leaf are not summed");
+    }
+
+    /// Cold collapse integrated with the tree as the Verlet acceleration
+    fmt::println("\nVerlet, N = 20000, 50 steps, θ = 0.5");
+    size_t N = 20000;
+    std::vector<double> m(N, 1. / N);
+    Eigen::VectorXd x0 = nbody_state(plummer_sphere(N, rng));
+    Eigen::VectorXd v0 = Eigen::VectorXd::Zero(3 * N);
+    direct_summation direct(m, 1., 0.05);
+    double E0 = direct.potential_energy(x0);
+    barnes_hut tree(m, 1., 0.05);
+    acceleration_inplace<Eigen::VectorXd> a = std::ref(tree);
+    solver_degree_II<Eigen::VectorXd> solver;
+    solver.set_initial_state(0, x0, v0);
+    solver.set_timestep(1e-2);
+    Eigen::VectorXd x;
+    double runtime = time_ms([&]
+                             { x = solver.solve_verlet(0.5, a); });
+    double E = direct.kinetic_energy(solver.get_velocities().back()) + direct.potential_energy(x);
+    fmt::println("{:.0f}ms, relative energy error {:.2e}", runtime, std::abs((E - E0) / E0));
+}
@@ -0,0 +1,73 @@
+#include "nbody/block_timestep.h"
+#include "nbody/direct.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <functional>
+#include <random>
+
+int main()
+{
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> u(0., 1.);
+
+    /// Cluster of N bodies, the first 2 B of them paired into hard circular binaries of separation s:
+    /// their periods are ~1e-3 of the crossing time
+    size_t N = 1000, B = 10;
+    double s = 1e-3, ε = 1e-5, tf = 0.25;
+    std::vector<vec3d> x, v;
+    plummer_model(N, rng, x, v);
+    std::vector<double> m(N, 1. / N);
+    for (size_t b = 0; b < B; b++)
+    {
+        vec3d axis = vec3d(u(rng) - 0.5, u(rng) - 0.5, u(rng) - 0.5);
+        axis.normalize();
+        vec3d normal = vec3d(0., 0., 1.).cross(axis);
+        normal.normalize();
+        double orbital = std::sqrt(2. / N / s) / 2;
+        x[2 * b + 1] = x[2 * b] - s / 2 * axis;
+        x[2 * b] += s / 2 * axis;
+        v[2 * b + 1] = v[2 * b] - orbital * normal;
+        v[2 * b] += orbital * normal;
+    }
+    Eigen::VectorXd x0 = nbody_state(x), v0 = nbody_state(v);
+    direct_summation direct(m, 1., ε);
+    double E0 = direct.kinetic_energy(v0) + direct.potential_energy(x0);
+    double period = 2 * M_PI * std::sqrt(s * s * s * N / 2);
+    fmt::println("Plummer cluster N = {} with {} binaries of period {:.2e}, t = {}", N, B, period, tf);
+
+    fmt::println("\nBlock time steps, dt_max = {}", 1. / 64);
+    fmt::println("{:>6} {:>10} {:>12} {:>14}  {}", "η", "ms", "energy err", "evaluations", "bodies per bin");
+    for (double η : {0.05, 0.02, 0.01})
+    {
+        block_timestep integrator(16);
+        integrator.set_initial_state(0, x0, v0);
+        integrator.set_timestep(1. / 64);
+        integrator.set_accuracy(η);
+        active_acceleration_inplace a = std::ref(direct);
+        double runtime = time_ms([&]
+                                 { integrator.solve(tf, a); });
+        double E = direct.kinetic_energy(integrator.get_velocities()) + direct.potential_energy(integrator.get_positions());
+        std::vector<size_t> histogram = integrator.get_bin_histogram();
+        while (histogram.size() > 1 && histogram.back() == 0)
+            histogram.pop_back();
+        fmt::println("{:>6} {:>10.0f} {:>12.2e} {:>14} {}", η, runtime, std::abs((E - E0) / E0),
+                     integrator.get_force_evaluations(), histogram);
+    }
+
+    /// A single bin is the global step leapfrog
+    fmt::println("\nGlobal time step");
+    fmt::println("{:>10} {:>10} {:>12} {:>14}", "dt", "ms", "energy err", "evaluations");
+    for (double dt : {1. / 4096, 1. / 16384, 1. / 65536})
+    {
+        block_timestep integrator(1);
+        integrator.set_initial_state(0, x0, v0);
+        integrator.set_timestep(dt);
+        active_acceleration_inplace a = std::ref(direct);
+        double runtime = time_ms([&]
+                                 { integrator.solve(tf, a); });
+        double E = direct.kinetic_energy(integrator.get_velocities()) + direct.potential_energy(integrator.get_positions());
+        fmt::println("{:>10.2e} {:>10.0f} {:>12.2e} {:>14}", dt, runtime, std::abs((E - E0) / E0),
+                     integrator.get_force_evaluations());
+    }
+}
@@ -0,0 +1,73 @@
+#pragma once
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <vector>
+#include "math/vec3d.h"
+
+/// Helpers shared by the benchmarks
+
+/// Wall time of f() in milliseconds
+template <typename F>
+double time_ms(F f)
+{
+    auto t1 = std::chrono::high_resolution_clock::now();
+    f();
+    auto t2 = std::chrono::high_resolution_clock::now();
+    return std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1).count() / 1000.;
+}
+
+/// Uniform ball of N equal masses (total mass 1, radius 1, G = 1), at rest
+inline std::vector<vec3d> random_ball(size_t N, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> u(-1., 1.);
+    std::vector<vec3d> bodies;
+    while (bodies.size() < N)
+    {
+        vec3d x(u(rng), u(rng), u(rng));
+        if (x.dot(x) < 1)
+            bodies.push_back(x);
+    }
+    return bodies;
+}
+
+/// Plummer sphere of N equal masses (total mass 1, scale radius 1, G = 1), positions only
+inline std::vector<vec3d> plummer_sphere(size_t N, std::mt19937 &rng)
+{
+    std::uniform_real_distribution<double> u(0., 1.);
+    std::vector<vec3d> bodies(N);
+    for (vec3d &x : bodies)
+    {
+        double r = 1 / std::sqrt(std::pow(u(rng), -2. / 3.) - 1);
+        double cos_θ = 2 * u(rng) - 1;
+        double φ = 2 * M_PI * u(rng);
+        double sin_θ = std::sqrt(1 - cos_θ * cos_θ);
+        x = r * vec3d(sin_θ * std::cos(φ), sin_θ * std::sin(φ), cos_θ);
+    }
+    return bodies;
+}
+
+/// Plummer sphere in equilibrium (total mass 1, scale radius 1, G = 1), velocities by the rejection
+/// sampling of Aarseth, Hénon & Wielen (1974)
+inline void plummer_model(size_t N, std::mt19937 &rng, std::vector<vec3d> &x, std::vector<vec3d> &v)
+{
+    std::uniform_real_distribution<double> u(0., 1.);
+    auto direction = [&]
+    {
+        double cos_θ = 2 * u(rng) - 1, φ = 2 * M_PI * u(rng);
+        double sin_θ = std::sqrt(1 - cos_θ * cos_θ);
+        return vec3d(sin_θ * std::cos(φ), sin_θ * std::sin(φ), cos_θ);
+    };
+    x.resize(N);
+    v.resize(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        double r = 1 / std::sqrt(std::pow(u(rng), -2. / 3.) - 1);
+        double q;
+        do
+            q = u(rng);
+        while (0.1 * u(rng) > q * q * std::pow(1 - q * q, 3.5));
+        x[i] = r * direction();
+        v[i] = q * std::sqrt(2.) * std::pow(1 + r * r, -0.25) * direction();
+    }
+}
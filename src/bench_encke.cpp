@@ -0,0 +1,70 @@
+#include "celest/encke.h"
+#include "math/vec3d.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+
+double μ = 3.986004418e14, R = 6378137., J2 = 1.08262668e-3;
+
+/// J2 acceleration alone, the perturbation of Encke
+vec3d j2(double, vec3d x, vec3d)
+{
+    double r2 = x.norm_2(), r = std::sqrt(r2);
+    double k = -1.5 * J2 * μ * R * R / (r2 * r2 * r), z2 = 5 * x.z * x.z / r2;
+    return vec3d(k * x.x * (1 - z2), k * x.y * (1 - z2), k * x.z * (3 - z2));
+}
+
+/// Full acceleration for Cowell
+vec3d gravity(double t, vec3d x, vec3d v)
+{
+    double r = x.norm();
+    return -μ / (r * r * r) * x + j2(t, x, v);
+}
+
+int main()
+{
+    /// Inclined LEO, slightly eccentric, two days
+    double a = 7000e3, e = 0.01, i = 0.9, tf = 2 * 86400.;
+    double rp = a * (1 - e), vp = std::sqrt(μ * (1 + e) / rp);
+    vec3d x0(rp, 0., 0.), v0(0., vp * std::cos(i), vp * std::sin(i));
+    std::function<vec3d(double, vec3d, vec3d)> full = gravity, perturbation = j2;
+
+    /// Reference: Cowell RK4 at 1 s
+    solver_degree_II<vec3d> cowell;
+    cowell.set_initial_state(0, x0, v0);
+    cowell.set_timestep(1.);
+    vec3d reference = cowell.solve_RK4(tf, full);
+
+    fmt::println("LEO a = 7000 km, e = 0.01, J2, 2 days: final position error against Cowell RK4 at 1 s");
+    fmt::println("{:>8} {:>14} {:>14} {:>10} {:>14} {:>10} {:>10}", "dt (s)", "Cowell (m)", "Encke (m)", "ratio",
+                 "rectifications", "Cowell ms", "Encke ms");
+    for (double dt : {30., 60., 120., 240.})
+    {
+        cowell.set_timestep(dt);
+        vec3d x_cowell, x_encke;
+        double t_cowell = time_ms([&]
+                                  { x_cowell = cowell.solve_RK4(tf, full); });
+        encke<vec3d> propagator(μ);
+        propagator.set_initial_state(0, x0, v0);
+        propagator.set_timestep(dt);
+        double t_encke = time_ms([&]
+                                 { x_encke = propagator.solve_RK4(tf, perturbation); });
+        double error_cowell = (x_cowell - reference).norm(), error_encke = (x_encke - reference).norm();
+        fmt::println("{:>8} {:>14.3e} {:>14.3e} {:>10.0f} {:>14} {:>10.2f} {:>10.2f}", dt, error_cowell, error_encke,
+                     error_cowell / error_encke, propagator.get_rectification_count(), t_cowell, t_encke);
+    }
+
+    /// Rectification threshold at a 60 s step
+    fmt::println("\nRectification threshold, dt = 60 s");
+    fmt::println("{:>10} {:>14} {:>14}", "threshold", "Encke (m)", "rectifications");
+    for (double threshold : {1e-4, 1e-3, 1e-2, 1e-1})
+    {
+        encke<vec3d> propagator(μ);
+        propagator.set_initial_state(0, x0, v0);
+        propagator.set_timestep(60.);
+        propagator.set_rectification_threshold(threshold);
+        vec3d x = propagator.solve_RK4(tf, perturbation);
+        fmt::println("{:>10} {:>14.3e} {:>14}", threshold, (x - reference).norm(), propagator.get_rectification_count());
+    }
+}
@@ -0,0 +1,208 @@
+#include "nbody/direct.h"
+#include "nbody/fmm_2d.h"
+#include "nbody/fmm_3d.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+#include <random>
+
+/// Direct 2D sums, the reference of fmm_2d
+void direct_2d(std::span<const vec2d> sources, std::span<const double> q, std::span<const vec2d> targets,
+               std::vector<double> &φ, std::vector<vec2d> &E)
+{
+    φ.assign(targets.size(), 0.);
+    E.assign(targets.size(), vec2d(0.));
+    parallel_for(targets.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; i++)
+            for (size_t j = 0; j < sources.size(); j++)
+            {
+                vec2d d = targets[i] - sources[j];
+                double r2 = d.norm_2();
+                if (r2 == 0)
+                    continue;
+                φ[i] -= 0.5 * q[j] * std::log(r2);
+                E[i] += q[j] / r2 * d;
+            }
+    });
+}
+
+template <typename T>
+double rms_error(std::span<const T> value, std::span<const T> reference)
+{
+    double error = 0, norm = 0;
+    for (size_t i = 0; i < value.size(); i++)
+    {
+        if constexpr (std::is_same_v<T, double>)
+        {
+            error += (value[i] - reference[i]) * (value[i] - reference[i]);
+            norm += reference[i] * reference[i];
+        }
+        else
+        {
+            error += (value[i] - reference[i]).norm_2();
+            norm += reference[i].norm_2();
+        }
+    }
+    return std::sqrt(error / norm);
+}
+
+int main()
+{
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<double> u(-1., 1.);
+
+    /// 3D: gravitational field of a uniform ball against direct_summation
+    {
+        size_t N = 20000;
+        std::vector<vec3d> bodies = random_ball(N, rng);
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd x = nbody_state(bodies), a_ref;
+        direct_summation direct(m, 1.);
+        double direct_ms = time_ms([&]
+                                   { direct(0, x, a_ref); });
+        fmt::println("3D accuracy vs order, N = {} (direct summation {:.1f}ms)", N, direct_ms);
+        fmt::println("{:>5} {:>12} {:>10}", "p", "rms error", "ms");
+        std::vector<vec3d> field(N);
+        fmm_3d fmm;
+        for (size_t p : {2, 4, 6, 8, 10, 12})
+        {
+            fmm.set_order(p);
+            double runtime = time_ms([&]
+                                     { fmm.evaluate(bodies, m, bodies, {}, field); });
+            std::vector<vec3d> reference(N);
+            for (size_t i = 0; i < N; i++)
+                reference[i] = -nbody_body(a_ref, i);
+            fmt::println("{:>5} {:>12.2e} {:>10.1f}", p, rms_error<vec3d>(field, reference), runtime);
+        }
+    }
+
+    /// Expansion storage at the deepest level, bounded by set_memory_limit (1 GB by default)
+    fmt::println("\nExpansion storage at depth {}", fmm_3d::max_level);
+    for (size_t p : {4, 6, 8, 12})
+        fmt::println("p = {:>2}: {:>5} MB", p, fmm_3d(p).expansion_bytes(fmm_3d::max_level) >> 20);
+
+    fmt::println("\n3D time vs N, p = 6, {} threads (direct summation up to 64000)", thread_count());
+    fmt::println("{:>8} {:>6} {:>12} {:>12} {:>10}", "N", "depth", "fmm ms", "direct ms", "speedup");
+    for (size_t N = 1000; N <= 1024000; N *= 4)
+    {
+        std::vector<vec3d> bodies = random_ball(N, rng);
+        std::vector<double> m(N, 1. / N);
+        std::vector<vec3d> field(N);
+        fmm_3d fmm;
+        double fmm_ms = time_ms([&]
+                                { fmm.evaluate(bodies, m, bodies, {}, field); });
+        if (N <= 64000)
+        {
+            direct_summation direct(m, 1.);
+            Eigen::VectorXd x = nbody_state(bodies), a;
+            double direct_ms = time_ms([&]
+                                       { direct(0, x, a); });
+            fmt::println("{:>8} {:>6} {:>12.1f} {:>12.1f} {:>10.1f}", N, fmm.get_depth(), fmm_ms, direct_ms, direct_ms / fmm_ms);
+        }
+        else
+            fmt::println("{:>8} {:>6} {:>12.1f}", N, fmm.get_depth(), fmm_ms);
+    }
+
+    /// 2D: random charges of both signs, potential and field against the direct sums
+    {
+        size_t N = 10000;
+        std::vector<vec2d> charges(N);
+        std::vector<double> q(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            charges[i] = vec2d(u(rng), u(rng));
+            q[i] = u(rng);
+        }
+        std::vector<double> φ_ref, φ(N);
+        std::vector<vec2d> E_ref, E(N);
+        double direct_ms = time_ms([&]
+                                   { direct_2d(charges, q, charges, φ_ref, E_ref); });
+        fmt::println("\n2D accuracy vs order, N = {} (direct sums {:.1f}ms)", N, direct_ms);
+        fmt::println("{:>5} {:>12} {:>12} {:>10}", "p", "φ error", "E error", "ms");
+        fmm_2d fmm;
+        for (size_t p : {4, 8, 12, 16, 20, 30})
+        {
+            fmm.set_order(p);
+            double runtime = time_ms([&]
+                                     { fmm.evaluate(charges, q, charges, φ, E); });
+            fmt::println("{:>5} {:>12.2e} {:>12.2e} {:>10.1f}", p, rms_error<double>(φ, φ_ref),
+                         rms_error<vec2d>(E, E_ref), runtime);
+        }
+    }
+
+    fmt::println("\n2D time vs N, p = 20");
+    fmt::println("{:>8} {:>6} {:>12}", "N", "depth", "fmm ms");
+    for (size_t N = 1000; N <= 1024000; N *= 4)
+    {
+        std::vector<vec2d> charges(N);
+        std::vector<double> q(N), φ(N);
+        std::vector<vec2d> E(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            charges[i] = vec2d(u(rng), u(rng));
+            q[i] = u(rng);
+        }
+        fmm_2d fmm;
+        double runtime = time_ms([&]
+                                 { fmm.evaluate(charges, q, charges, φ, E); });
+        fmt::println("{:>8} {:>6} {:>12.1f}", N, fmm.get_depth(), runtime);
+    }
+
+    /// Bulk sampling: field of 10000 line charges on a 1024 x 1024 grid, targets independent of the sources
+    {
+        size_t N = 10000, side = 1024;
+        std::vector<vec2d> charges(N);
+        std::vector<double> q(N);
+        for (size_t i = 0; i < N; i++)
+        {
+            charges[i] = vec2d(0.5 * u(rng), 0.5 * u(rng));
+            q[i] = i % 2 ? 1. : -1.;
+        }
+        std::vector<vec2d> grid;
+        for (size_t i = 0; i < side; i++)
+            for (size_t j = 0; j < side; j++)
+                grid.push_back(vec2d(-1 + 2. * i / (side - 1), -1 + 2. * j / (side - 1)));
+        std::vector<vec2d> E(grid.size());
+        fmm_2d fmm(12);
+        double runtime = time_ms([&]
+                                 { fmm.evaluate(charges, q, grid, {}, E); });
+        std::vector<double> φ_ref;
+        std::vector<vec2d> E_ref;
+        std::span<const vec2d> sample(grid.data(), 4096);
+        direct_2d(charges, q, sample, φ_ref, E_ref);
+        fmt::println("\nField of {} charges on {} x {} points, p = 12: {:.1f}ms, rms error {:.2e} on the first {} points",
+                     N, side, side, runtime, rms_error<vec2d>(std::span<const vec2d>(E.data(), sample.size()), E_ref), sample.size());
+    }
+
+    /// fmm_gravity as the Verlet acceleration against the direct one. Unsoftened, the close pairs of
+    /// a cold ball collapse within a few 1e-3, so the run is short and compares the displacements.
+    {
+        size_t N = 20000;
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd x0 = nbody_state(random_ball(N, rng));
+        Eigen::VectorXd v0 = Eigen::VectorXd::Zero(3 * N);
+        auto run = [&](acceleration_inplace<Eigen::VectorXd> a, double &runtime)
+        {
+            solver_degree_II<Eigen::VectorXd> solver;
+            solver.set_initial_state(0, x0, v0);
+            solver.set_timestep(1e-4);
+            Eigen::VectorXd x;
+            runtime = time_ms([&]
+                              { x = solver.solve_verlet(2e-3, a); });
+            return x;
+        };
+        direct_summation direct(m, 1.);
+        double direct_ms;
+        Eigen::VectorXd x_ref = run(std::ref(direct), direct_ms);
+        fmt::println("\nVerlet, N = {}, 20 steps (direct summation {:.0f}ms)", N, direct_ms);
+        for (size_t p : {4, 8})
+        {
+            fmm_gravity gravity(m, 1., 0., p);
+            double runtime;
+            Eigen::VectorXd x = run(std::ref(gravity), runtime);
+            fmt::println("p = {}: {:>8.0f}ms, displacement error {:.2e}", p, runtime, (x - x_ref).norm() / (x_ref - x0).norm());
+        }
+    }
+}
@@ -0,0 +1,120 @@
+#include "celest/encke.h"
+#include "celest/force_model.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+
+double μ = 3.986004418e14, R = 6378137., J2 = 1.08262668e-3, ω = 7.2921159e-5;
+double μ_sun = 1.32712440018e20, μ_moon = 4.9028e12;
+double ρ0 = 1.225, H = 8500., B = 2.2 * 10. / 1000., k_srp = 4.56e-6 * 1.3 * 10. / 1000.;
+
+/// Circular ephemerides, ecliptic inclined by 23.44° on the equator
+vec3d sun_position(double t)
+{
+    double θ = 2 * M_PI * t / 3.15581e7, ε = 0.40910518;
+    return 1.495978707e11 * vec3d(std::cos(θ), std::sin(θ) * std::cos(ε), std::sin(θ) * std::sin(ε));
+}
+vec3d moon_position(double t)
+{
+    double θ = 2 * M_PI * t / 2.36059e6 + 1., ε = 0.40910518 + 0.0898;
+    return 3.844e8 * vec3d(std::cos(θ), std::sin(θ) * std::cos(ε), std::sin(θ) * std::sin(ε));
+}
+
+/// The same forces written by hand in one function: |r| and the sun position computed once, cubes
+/// as products
+vec3d hand_written(double t, vec3d r, vec3d v)
+{
+    double r2 = r.norm_2(), r_norm = std::sqrt(r2), r3 = r2 * r_norm;
+    double z2 = r.z * r.z / r2;
+    double k = 1.5 * J2 * μ * R * R / (r3 * r2);
+    vec3d a = -μ / r3 * r + k * vec3d(r.x * (5 * z2 - 1), r.y * (5 * z2 - 1), r.z * (5 * z2 - 3));
+
+    vec3d v_rel = v - vec3d(0., 0., ω).cross(r);
+    double ρ = ρ0 * std::exp(-(r_norm - R) / H);
+    a += -0.5 * ρ * B * v_rel.norm() * v_rel;
+
+    auto attraction = [&](vec3d s, double μ_body)
+    {
+        vec3d d = s - r;
+        double d_norm = d.norm(), s_norm = s.norm();
+        return μ_body * (d / (d_norm * d_norm * d_norm) - s / (s_norm * s_norm * s_norm));
+    };
+    vec3d s = sun_position(t);
+    a += attraction(s, μ_sun) + attraction(moon_position(t), μ_moon);
+
+    double s_norm = s.norm(), along = r.dot(s) / s_norm;
+    if (along >= 0 || (r - along / s_norm * s).norm() >= R)
+    {
+        vec3d d = r - s;
+        double d2 = d.norm_2();
+        a += k_srp * 1.495978707e11 * 1.495978707e11 / (d2 * std::sqrt(d2)) * d;
+    }
+    return a;
+}
+
+int main()
+{
+    force_model model(point_mass{μ}, zonal_J2{μ, R, J2}, exponential_atmosphere{ρ0, H, R, ω}, drag{B},
+                      sun{μ_sun, sun_position}, third_body{μ_moon, moon_position}, radiation_pressure{k_srp, R});
+
+    /// 300 km circular orbit inclined by 51.6°, 1 day
+    double r0 = R + 300e3, v_c = std::sqrt(μ / r0), i = 0.9006;
+    vec3d x0(r0, 0., 0.), v0(0., v_c * std::cos(i), v_c * std::sin(i));
+    double tf = 86400, dt = 5;
+
+    vec3d a_model = model(1e5, x0, v0), a_hand = hand_written(1e5, x0, v0);
+    fmt::println("Composed vs hand-written acceleration: relative difference {:.2e}", (a_model - a_hand).norm() / a_hand.norm());
+
+    /// Cost of one evaluation, both through the std::function the integrators take
+    {
+        std::function<vec3d(double, vec3d, vec3d)> f_model = std::ref(model), f_hand = hand_written;
+        size_t count = 1000000;
+        vec3d sum(0.);
+        double t_model = time_ms([&]
+                                 {
+            for (size_t k = 0; k < count; k++)
+                sum += f_model(k, x0, v0); });
+        double t_hand = time_ms([&]
+                                {
+            for (size_t k = 0; k < count; k++)
+                sum += f_hand(k, x0, v0); });
+        if (std::isnan(sum.x))
+            fmt::println("ERROR: NaN accelerations");
+        fmt::println("One evaluation: composed {:.1f} ns, hand-written {:.1f} ns", t_model * 1e6 / count, t_hand * 1e6 / count);
+    }
+
+    /// RK4 over the day, returned and in-place forms
+    {
+        solver_degree_II<vec3d> solver;
+        solver.set_initial_state(0, x0, v0);
+        solver.set_timestep(dt);
+        vec3d x_hand, x_model, x_inplace;
+        double t_hand = time_ms([&]
+                                { x_hand = solver.solve_RK4(tf, std::function<vec3d(double, vec3d, vec3d)>(hand_written)); });
+        double t_model = time_ms([&]
+                                 { x_model = solver.solve_RK4(tf, std::function<vec3d(double, vec3d, vec3d)>(std::ref(model))); });
+        double t_inplace = time_ms([&]
+                                   { x_inplace = solver.solve_RK4(tf, acceleration_xv_inplace<vec3d>(std::ref(model))); });
+        fmt::println("RK4 {} s, 1 day: hand-written {:.1f}ms, composed {:.1f}ms, composed in-place {:.1f}ms, final positions "
+                     "within {:.1e} m",
+                     dt, t_hand, t_model, t_inplace, std::max((x_model - x_hand).norm(), (x_inplace - x_hand).norm()));
+        fmt::println("Altitude after 1 day: {:.1f} km", (x_model.norm() - R) / 1e3);
+    }
+
+    /// Conservative models also drive the position-only integrators, and Encke with the perturbations alone
+    {
+        force_model gravity(point_mass{μ}, zonal_J2{μ, R, J2});
+        solver_degree_II<vec3d> solver;
+        solver.set_initial_state(0, x0, v0);
+        solver.set_timestep(dt);
+        vec3d x_yoshida = solver.solve_yoshida_4th(tf, acceleration_inplace<vec3d>(std::ref(gravity)));
+
+        force_model perturbation(zonal_J2{μ, R, J2});
+        encke<vec3d> propagator(μ);
+        propagator.set_initial_state(0, x0, v0);
+        propagator.set_timestep(4 * dt);
+        vec3d x_encke = propagator.solve_RK4(tf, std::ref(perturbation));
+        fmt::println("J2 only: Yoshida 4th {} s vs Encke RK4 {} s differ by {:.2f} m", dt, 4 * dt, (x_yoshida - x_encke).norm());
+    }
+}
@@ -0,0 +1,147 @@
+#include "celest/geopotential.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <random>
+
+/// Earth-like field in ICGEM format: EGM2008 up to degree 4, random coefficients following
+/// Kaula's rule (RMS 1e-5 / n²) above
+void write_field(const std::string &path, size_t degree, std::mt19937 &rng)
+{
+    std::normal_distribution<double> g(0., 1.);
+    std::ofstream file(path);
+    file << "begin_of_head\nproduct_type gravity_field\nearth_gravity_constant 0.3986004415E+15\n";
+    file << fmt::format("radius 0.6378136300E+07\nmax_degree {}\nnorm fully_normalized\nend_of_head\n", degree);
+    double low[5][5][2] = {{{1, 0}},
+                           {{0, 0}, {0, 0}},
+                           {{-4.84165143790815e-4, 0}, {-2.06615509074176e-10, 1.38441389137979e-9}, {2.43938357328313e-6, -1.40027370385934e-6}},
+                           {{9.57161207093473e-7, 0}, {2.03046201047864e-6, 2.48200415856872e-7}, {9.04787894809528e-7, -6.19005475177618e-7}, {7.21321757121568e-7, 1.41434926192941e-6}},
+                           {{5.39965866638991e-7, 0}, {-5.36157389388867e-7, -4.73567346518086e-7}, {3.50501623962649e-7, 6.62480026275829e-7}, {9.90856766672321e-7, -2.00956723567452e-7}, {-1.88519633023033e-7, 3.08803882149194e-7}}};
+    for (size_t n = 0; n <= degree; n++)
+        for (size_t m = 0; m <= n; m++)
+        {
+            double C = n <= 4 ? low[n][m][0] : 1e-5 / (n * n) * g(rng);
+            double S = n <= 4 ? low[n][m][1] : m > 0 ? 1e-5 / (n * n) * g(rng) : 0.;
+            file << fmt::format("gfc {:4} {:4} {:24.16E} {:24.16E} 0 0\n", n, m, C, S);
+        }
+}
+
+int main()
+{
+    std::mt19937 rng(5);
+    std::string text = (std::filesystem::temp_directory_path() / "optitools_field.gfc").string();
+    std::string binary = (std::filesystem::temp_directory_path() / "optitools_field.bin").string();
+    write_field(text, 120, rng);
+
+    geopotential field;
+    double load_ms = time_ms([&]
+                             { field.load(text); });
+    field.save_binary(binary);
+    geopotential cached;
+    double binary_ms = time_ms([&]
+                               { cached.load_binary(binary); });
+    vec3d r_test(5e6, 4e6, -3e6);
+    fmt::println("Degree {} field: text {:.1f}ms, binary {:.1f}ms, J2 = {:.9e}, binary copy differs by {:.1e}", field.get_degree(),
+                 load_ms, binary_ms, field.get_J(2), (cached.acceleration(r_test) - field.acceleration(r_test)).norm());
+
+    /// Perturbing acceleration against the central differences of the perturbing potential, including
+    /// over the poles (with the central term, the rounding of U dominates the differences)
+    {
+        field.set_central_term(false);
+        double worst = 0;
+        std::uniform_real_distribution<double> u(-1., 1.);
+        std::vector<vec3d> points = {vec3d(0., 0., 7e6), vec3d(0., 0., -6.6e6), vec3d(7e6, 0., 0.)};
+        for (size_t k = 0; k < 20; k++)
+        {
+            vec3d r(u(rng), u(rng), u(rng));
+            points.push_back(7e6 / r.norm() * r);
+        }
+        for (const vec3d &r : points)
+        {
+            vec3d a = field.acceleration(r);
+            double h = 10.;
+            auto derivative = [&](const vec3d &e)
+            { return (field.potential(r + h * e) - field.potential(r - h * e)) / (2 * h); };
+            vec3d gradient(derivative(vec3d::unitX()), derivative(vec3d::unitY()), derivative(vec3d::unitZ()));
+            worst = std::max(worst, (a - gradient).norm() / a.norm());
+        }
+        fmt::println("Acceleration vs gradient of the potential: max relative difference {:.2e}", worst);
+        field.set_central_term(true);
+    }
+
+    /// J2 alone against its closed form
+    {
+        vec3d r(4e6, -3e6, 5e6);
+        double μ = field.get_μ(), R = field.get_radius(), j2 = field.get_J(2);
+        double r2 = r.norm_2(), k = 1.5 * j2 * μ * R * R / (r2 * r2 * std::sqrt(r2)), z2 = 5 * r.z * r.z / r2;
+        geopotential zonal(μ, R);
+        zonal.resize(2);
+        zonal.set_coefficient(2, 0, field.get_C(2, 0), 0.);
+        vec3d exact = -μ * r / (r2 * std::sqrt(r2)) + k * vec3d(r.x * (z2 - 1), r.y * (z2 - 1), r.z * (z2 - 3));
+        fmt::println("J2 closed form: relative difference {:.2e}", (zonal.acceleration(r) - exact).norm() / exact.norm());
+    }
+
+    /// Cost of one acceleration vs degree, scalar and batched
+    {
+        size_t count = 1 << 16;
+        std::vector<vec3d> positions(count), a(count);
+        std::uniform_real_distribution<double> u(-1., 1.);
+        for (vec3d &r : positions)
+        {
+            r = vec3d(u(rng), u(rng), u(rng));
+            r *= 6.8e6 / r.norm();
+        }
+        fmt::println("\n{} positions, {} lanes, {} threads", count, native_lanes, thread_count());
+        fmt::println("{:>7} {:>14} {:>14}", "degree", "scalar ns", "batched ns");
+        for (size_t degree : {2, 4, 8, 20, 40, 70, 120})
+        {
+            field.set_degree(degree);
+            double scalar = time_ms([&]
+                                    {
+                for (size_t i = 0; i < count; i++)
+                    a[i] = field.acceleration(positions[i]); });
+            double batched = time_ms([&]
+                                     { field.acceleration(positions, a); });
+            fmt::println("{:>7} {:>14.1f} {:>14.1f}", degree, scalar * 1e6 / count, batched * 1e6 / count);
+        }
+        field.set_degree(120);
+    }
+
+    /// Truncation by altitude: degree kept and acceleration error against the full field
+    field.set_truncation_tolerance(1e-12);
+    fmt::println("\nTruncation at 1e-12 of the central term");
+    for (double altitude : {400e3, 800e3, 2e6, 20e6, 36e6})
+    {
+        vec3d r = (field.get_radius() + altitude) * vec3d(0.6, 0.0, 0.8);
+        geopotential full = field;
+        full.set_truncation_tolerance(0);
+        vec3d a = full.acceleration(r);
+        fmt::println("{:>8.0f} km: degree {:>3}, error {:.2e}", altitude / 1e3, field.degree_at(r.norm()),
+                     (field.acceleration(r) - a).norm() / a.norm());
+    }
+
+    /// One day of a 500 km orbit with RK4, rotating Earth, point mass vs degree 70
+    {
+        field.set_truncation_tolerance(0);
+        field.set_degree(70);
+        field.set_rotation(7.2921159e-5);
+        double μ = field.get_μ(), r0 = field.get_radius() + 500e3;
+        vec3d x0(r0, 0., 0.), v0(0., std::sqrt(μ / r0) * std::cos(0.9), std::sqrt(μ / r0) * std::sin(0.9));
+        solver_degree_II<vec3d> solver;
+        solver.set_initial_state(0, x0, v0);
+        solver.set_timestep(10);
+        vec3d x70;
+        double runtime = time_ms([&]
+                                 { x70 = solver.solve_RK4(86400, std::function<vec3d(double, vec3d)>(std::ref(field))); });
+        std::function<vec3d(double, vec3d)> point = [μ](double, vec3d x)
+        { return -μ * x / (x.norm_2() * x.norm()); };
+        vec3d x_point = solver.solve_RK4(86400, point);
+        fmt::println("\n1 day at 500 km, RK4 10 s: degree 70 in {:.0f}ms, {:.1f} km from the point mass orbit",
+                     runtime, (x70 - x_point).norm() / 1e3);
+    }
+    std::filesystem::remove(text);
+    std::filesystem::remove(binary);
+}
@@ -0,0 +1,146 @@
+#include "nbody/block_timestep.h"
+#include "nbody/direct.h"
+#include "nbody/hermite_block_timestep.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <fmt/ranges.h>
+#include <functional>
+#include <random>
+
+int main()
+{
+    /// Kepler orbit, e = 0.5, μ = 1, a = 1, 10 periods: order of the shared step integrators
+    {
+        vec3d x0(0.5, 0., 0.), v0(0., std::sqrt(3.), 0.);
+        acceleration_inplace<vec3d> gravity = [](double, const vec3d &x, vec3d &a)
+        { a = -x / (x.norm_2() * x.norm()); };
+        acceleration_jerk_inplace<vec3d> jerk = [](double, const vec3d &x, const vec3d &v, vec3d &a, vec3d &j)
+        {
+            double inv_r2 = 1 / x.norm_2(), k = std::sqrt(inv_r2) * inv_r2, α = x.dot(v) * inv_r2;
+            a = -k * x;
+            j = -k * v - 3 * α * a;
+        };
+        acceleration_snap_inplace<vec3d> snap = [](double, const vec3d &x, const vec3d &v, const vec3d &a_in,
+                                                   vec3d &a, vec3d &j, vec3d &s)
+        {
+            double inv_r2 = 1 / x.norm_2(), k = std::sqrt(inv_r2) * inv_r2, α = x.dot(v) * inv_r2;
+            double β = (v.dot(v) + x.dot(a_in)) * inv_r2 + α * α;
+            a = -k * x;
+            j = -k * v - 3 * α * a;
+            s = -k * a_in - 6 * α * j - 3 * β * a;
+        };
+        auto energy = [](double, const vec3d &x, const vec3d &v)
+        { return v.norm_2() / 2 - 1 / x.norm(); };
+
+        fmt::println("Kepler orbit e = 0.5, 10 periods: max relative energy error");
+        fmt::println("{:>8} {:>12} {:>12} {:>12} {:>12}", "steps", "Verlet", "Yoshida 4th", "Hermite 4th", "Hermite 6th");
+        for (size_t steps : {200, 400, 800, 1600, 3200})
+        {
+            solver_degree_II<vec3d> solver;
+            solver.set_initial_state(0, x0, v0);
+            solver.set_timestep(2 * M_PI / steps);
+            double tf = 20 * M_PI;
+            double error[4];
+            for (size_t k = 0; k < 4; k++)
+            {
+                if (k == 0)
+                    solver.solve_verlet(tf, gravity);
+                else if (k == 1)
+                    solver.solve_yoshida_4th(tf, gravity);
+                else if (k == 2)
+                    solver.solve_hermite_4th(tf, jerk);
+                else
+                    solver.solve_hermite_6th(tf, snap);
+                std::vector<double> e = solver.get_energy_error(energy);
+                error[k] = *std::max_element(e.begin(), e.end());
+            }
+            fmt::println("{:>8} {:>12.2e} {:>12.2e} {:>12.2e} {:>12.2e}", steps, error[0], error[1], error[2], error[3]);
+        }
+    }
+
+    std::mt19937 rng(3);
+    std::uniform_real_distribution<double> u(0., 1.);
+
+    /// Fused kernels: pairs per second for the accelerations alone, with the jerks, with the snaps
+    {
+        size_t N = 16384;
+        std::vector<vec3d> x, v;
+        plummer_model(N, rng, x, v);
+        std::vector<double> m(N, 1. / N);
+        Eigen::VectorXd X = nbody_state(x), V = nbody_state(v), a, j, s;
+        direct_summation direct(m, 1., 1e-3);
+        direct(0, X, a);
+        double t_a = time_ms([&]
+                             { direct(0, X, a); });
+        double t_j = time_ms([&]
+                             { direct(0, X, V, a, j); });
+        Eigen::VectorXd a_in = a;
+        double t_s = time_ms([&]
+                             { direct(0, X, V, a_in, a, j, s); });
+        double pairs = double(N) * N * 1e-6;
+        fmt::println("\nDirect summation, N = {}, {} lanes: a {:.2f}, a + j {:.2f}, a + j + s {:.2f} Gpairs/s",
+                     N, native_lanes, pairs / t_a, pairs / t_j, pairs / t_s);
+    }
+
+    /// Plummer cluster with hard binaries (see bench_block_timestep)
+    size_t N = 1000, B = 10;
+    double s = 1e-3, ε = 1e-5, tf = 0.25;
+    std::vector<vec3d> x, v;
+    plummer_model(N, rng, x, v);
+    std::vector<double> m(N, 1. / N);
+    for (size_t b = 0; b < B; b++)
+    {
+        vec3d axis = vec3d(u(rng) - 0.5, u(rng) - 0.5, u(rng) - 0.5);
+        axis.normalize();
+        vec3d normal = vec3d(0., 0., 1.).cross(axis);
+        normal.normalize();
+        double orbital = std::sqrt(2. / N / s) / 2;
+        x[2 * b + 1] = x[2 * b] - s / 2 * axis;
+        x[2 * b] += s / 2 * axis;
+        v[2 * b + 1] = v[2 * b] - orbital * normal;
+        v[2 * b] += orbital * normal;
+    }
+    Eigen::VectorXd x0 = nbody_state(x), v0 = nbody_state(v);
+    direct_summation direct(m, 1., ε);
+    auto energy = [&](const Eigen::VectorXd &x, const Eigen::VectorXd &v)
+    { return direct.total_energy(x, v); };
+    fmt::println("\nPlummer cluster N = {} with {} binaries, t = {}, dt_max = {}", N, B, tf, 1. / 64);
+    fmt::println("{:<12} {:>6} {:>10} {:>12} {:>14} {:>8}  {}", "", "η", "ms", "energy err", "evaluations", "blocks", "bodies per bin");
+    auto report = [](const char *name, double η, double runtime, double error, size_t evaluations, size_t blocks,
+                     std::vector<size_t> histogram)
+    {
+        while (histogram.size() > 1 && histogram.back() == 0)
+            histogram.pop_back();
+        fmt::println("{:<12} {:>6} {:>10.0f} {:>12.2e} {:>14} {:>8}  {}", name, η, runtime, error, evaluations, blocks, histogram);
+    };
+    for (double η : {0.05, 0.02})
+    {
+        block_timestep integrator(20);
+        integrator.set_initial_state(0, x0, v0);
+        integrator.set_timestep(1. / 64);
+        integrator.set_accuracy(η);
+        active_acceleration_inplace a = std::ref(direct);
+        double runtime = time_ms([&]
+                                 { integrator.solve(tf, a); });
+        double E0 = energy(x0, v0);
+        report("leapfrog", η, runtime, std::abs((energy(integrator.get_positions(), integrator.get_velocities()) - E0) / E0),
+               integrator.get_force_evaluations(), 0, integrator.get_bin_histogram());
+    }
+    for (int order : {4, 6})
+        for (double η : order == 4 ? std::vector<double>{0.2, 0.1, 0.05} : std::vector<double>{0.4, 0.2, 0.1})
+        {
+            hermite_block_timestep integrator(20);
+            integrator.set_initial_state(0, x0, v0);
+            integrator.set_timestep(1. / 64);
+            integrator.set_accuracy(η);
+            double runtime = time_ms([&]
+                                     {
+                if (order == 4)
+                    integrator.solve_4th(tf, std::ref(direct));
+                else
+                    integrator.solve_6th(tf, std::ref(direct)); });
+            report(order == 4 ? "Hermite 4th" : "Hermite 6th", η, runtime, integrator.get_energy_error(energy),
+                   integrator.get_force_evaluations(), integrator.get_block_steps(), integrator.get_bin_histogram());
+        }
+}
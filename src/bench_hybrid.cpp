@@ -0,0 +1,100 @@
+#include "solver/hybrid.h"
+#include "solver/coordinates.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <cmath>
+
+using scalar = coordinates<1>;
+
+/// Thermostat with hysteresis: heating x' = 2 - x until x = 1, cooling x' = -x until x = 0.5
+void heating(double, const scalar &x, scalar &dxdt) { dxdt[0] = 2 - x[0]; }
+void cooling(double, const scalar &x, scalar &dxdt) { dxdt[0] = -x[0]; }
+
+/// Exact solution from x = 0.5 heating at t = 0, of period ln 3
+double thermostat_exact(double t)
+{
+    double τ = std::fmod(t, std::log(3.)), heat = std::log(1.5);
+    return τ < heat ? 2 - 1.5 * std::exp(-τ) : std::exp(-(τ - heat));
+}
+
+/// The same system with the switches checked at the end of each step only, as a fixed-step loop
+/// with the mode in the RHS would do: the switch is late by up to a step
+double thermostat_smeared(double tf, double dt)
+{
+    rhs_inplace<scalar> modes[2] = {heating, cooling};
+    scalar x{0.5}, k1, k2, k3, k4, x_i, x_next;
+    size_t mode = 0;
+    for (double t = 0; t < tf; t += dt)
+    {
+        double h = std::min(dt, tf - t);
+        RK4_step(t, h, x, modes[mode], k1, k2, k3, k4, x_i, x_next);
+        x = x_next;
+        if (mode == 0 && x[0] >= 1)
+            mode = 1;
+        else if (mode == 1 && x[0] <= 0.5)
+            mode = 0;
+    }
+    return x[0];
+}
+
+int main()
+{
+    hybrid_system<scalar> thermostat;
+    size_t heat = thermostat.add_mode(heating), cool = thermostat.add_mode(cooling);
+    thermostat.add_transition(heat, cool, {[](double, const scalar &x)
+                                           { return x[0] - 1; }, event_direction::rising});
+    thermostat.add_transition(cool, heat, {[](double, const scalar &x)
+                                           { return x[0] - 0.5; }, event_direction::falling});
+    thermostat.set_initial_state(0, scalar{0.5}, heat);
+
+    double tf = 20;
+    fmt::println("Thermostat, error at t = {} against the exact solution", tf);
+    fmt::println("{:>8} {:>14} {:>14} {:>10}", "dt", "hybrid", "smeared", "switches");
+    for (double dt : {0.4, 0.2, 0.1, 0.05, 0.025, 0.0125})
+    {
+        thermostat.set_timestep(dt);
+        double hybrid = thermostat.solve(tf)[0];
+        fmt::println("{:>8} {:>14.3e} {:>14.3e} {:>10}", dt, std::abs(hybrid - thermostat_exact(tf)),
+                     std::abs(thermostat_smeared(tf, dt) - thermostat_exact(tf)), thermostat.get_switches().size());
+    }
+
+    /// Bouncing ball: the guard is directional and the reset puts the ball exactly on the floor, so
+    /// the next flight does not start on the wrong side of the guard
+    using ball_state = coordinates<2>;
+    double g = 9.81, e = 0.8, h0 = 10;
+    hybrid_system<ball_state> ball;
+    size_t flight = ball.add_mode([g](double, const ball_state &x, ball_state &dxdt)
+                                  { dxdt << x[1], -g; });
+    ball.add_transition(flight, flight, {[](double, const ball_state &x)
+                                         { return x[0]; }, event_direction::falling},
+                        [e](double, ball_state &x)
+                        {
+                            x[0] = 0;
+                            x[1] = -e * x[1];
+                        });
+    ball.set_initial_state(0, ball_state(h0, 0), flight);
+    ball.set_timestep(0.01);
+
+    /// Bounce k at t1 + 2 v1 / g (e + ... + e^(k-1))
+    size_t bounces = 20;
+    double t1 = std::sqrt(2 * h0 / g), v1 = g * t1;
+    std::vector<double> exact(bounces);
+    for (size_t k = 0; k < bounces; k++)
+        exact[k] = t1 + 2 * v1 / g * e * (1 - std::pow(e, k)) / (1 - e);
+    ball.solve(exact.back() + 0.01);
+    double error = 0;
+    for (size_t k = 0; k < bounces; k++)
+        error = std::max(error, std::abs(ball.get_switches()[k].t - exact[k]));
+    fmt::println("\nBouncing ball, dt = 0.01: {} bounces, largest error on the bounce times {:.2e} s", ball.get_switches().size(), error);
+
+    /// Repeated solves reuse the buffers
+    thermostat.set_timestep(0.1);
+    thermostat.solve(tf);
+    size_t allocations = debug::allocation_count(), runs = 1000;
+    double runtime = time_ms([&]
+                             {
+        for (size_t i = 0; i < runs; i++)
+            thermostat.solve(tf); });
+    fmt::println("\n{} thermostat solves at dt = 0.1: {:.3f} ms each, {} buffer allocations", runs, runtime / runs,
+                 debug::allocation_count() - allocations);
+}
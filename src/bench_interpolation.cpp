@@ -0,0 +1,134 @@
+#include "celest/atmosphere.h"
+#include "celest/force_model.h"
+#include "math/interpolation.h"
+#include "vehicle/propulsion.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+#include <random>
+
+int main()
+{
+    /// Coarse tables of the standard atmosphere against a 50 m one, below 86 km
+    atmosphere reference = atmosphere::us76(50.);
+    fmt::println("US76 density from coarse tables, max relative error below 86 km");
+    fmt::println("{:>8} {:>12} {:>16} {:>12}", "step", "linear", "monotone cubic", "Akima");
+    for (double step : {1000., 2000., 5000.})
+    {
+        double error[3] = {};
+        for (size_t k = 0; k < 3; k++)
+        {
+            atmosphere coarse = atmosphere::us76(step, interpolation_method(k));
+            size_t hint = 0, hint_ref = 0;
+            for (double h = 0; h < 85000.; h += 10.)
+            {
+                double ρ = reference.density(h, hint_ref);
+                error[k] = std::max(error[k], std::abs(coarse.density(h, hint) / ρ - 1));
+            }
+        }
+        fmt::println("{:>8} {:>12.2e} {:>16.2e} {:>12.2e}", step, error[0], error[1], error[2]);
+    }
+
+    atmosphere air = atmosphere::us76();
+    size_t count = 1 << 20;
+    double sink = 0;
+
+    /// Altitudes along an ascent, sampled at RK4 stage times: each lookup is next to the previous one
+    {
+        std::vector<double> h(count), ρ(count);
+        for (size_t i = 0; i < count; i++)
+            h[i] = 150e3 * std::pow(double(i) / count, 1.5);
+        double H = 8500.;
+        double t_exp = time_ms([&]
+                               {
+            for (size_t i = 0; i < count; i++)
+                sink += 1.225 * std::exp(-h[i] / H); });
+        double t_bisection = time_ms([&]
+                                     {
+            for (size_t i = 0; i < count; i++)
+                sink += air.density(h[i]); });
+        size_t hint = 0;
+        double t_hunt = time_ms([&]
+                                {
+            for (size_t i = 0; i < count; i++)
+                sink += air.density(h[i], hint); });
+        double t_batched = time_ms([&]
+                                   { air.density(h, ρ); });
+        fmt::println("\nDensity along an ascent, ns per lookup ({} nodes)", air.altitudes().size());
+        fmt::println("exp(-h/H) {:.1f}, bisection {:.1f}, hunt {:.1f}, batched {:.1f}", t_exp * 1e6 / count,
+                     t_bisection * 1e6 / count, t_hunt * 1e6 / count, t_batched * 1e6 / count);
+    }
+
+    /// The hunt falls back to doubling steps when consecutive lookups are far apart
+    {
+        std::mt19937 rng(1);
+        std::uniform_real_distribution<double> u(0., 1000e3);
+        std::vector<double> h(count);
+        for (double &value : h)
+            value = u(rng);
+        double t_bisection = time_ms([&]
+                                     {
+            for (size_t i = 0; i < count; i++)
+                sink += air.density(h[i]); });
+        size_t hint = 0;
+        double t_hunt = time_ms([&]
+                                {
+            for (size_t i = 0; i < count; i++)
+                sink += air.density(h[i], hint); });
+        fmt::println("Random altitudes: bisection {:.1f}, hunt {:.1f} ns", t_bisection * 1e6 / count, t_hunt * 1e6 / count);
+    }
+
+    /// Drag of a 300 km orbit: exponential atmosphere against the tabulated one in a force model
+    {
+        double μ = 3.986004418e14, R = 6378137., r0 = R + 300e3;
+        vec3d x(r0, 0., 0.), v(0., std::sqrt(μ / r0), 0.);
+        force_model exponential(point_mass{μ}, exponential_atmosphere{1.225, 8500., R}, drag{0.022});
+        force_model tabulated(point_mass{μ}, tabulated_atmosphere{&air, R}, drag{0.022});
+        size_t evaluations = 1000000;
+        vec3d a;
+        double t_exponential = time_ms([&]
+                                       {
+            for (size_t i = 0; i < evaluations; i++)
+            {
+                exponential(0, x + double(i) * vec3d(1e-3, 0., 0.), v, a);
+                sink += a.x;
+            } });
+        double t_tabulated = time_ms([&]
+                                     {
+            for (size_t i = 0; i < evaluations; i++)
+            {
+                tabulated(0, x + double(i) * vec3d(1e-3, 0., 0.), v, a);
+                sink += a.x;
+            } });
+        fmt::println("\nPoint mass + drag: exponential {:.1f} ns, US76 table {:.1f} ns per evaluation; density at 300 km "
+                     "{:.2e} vs {:.2e}",
+                     t_exponential * 1e6 / evaluations, t_tabulated * 1e6 / evaluations, 1.225 * std::exp(-300e3 / 8500.),
+                     air.density(300e3));
+    }
+
+    /// Solid motor with a tabulated thrust profile, fired along an ascent
+    {
+        engine motor(0, 270., 1.2);
+        motor.set_thrust_profile({0., 5., 30., 80., 110., 120.}, {4.0e6, 4.6e6, 4.4e6, 3.6e6, 1.5e6, 0.}, interpolation_method::monotone_cubic);
+        table_hint hint;
+        size_t hint_air = 0;
+        fmt::println("\nSolid motor, burn time {} s, propellant {:.0f} kg", motor.get_burn_time(), motor.propellant_used(INFINITY));
+        for (double t : {0., 20., 40., 60., 80., 100., 119.})
+        {
+            double h = 0.5 * 20 * t * t; ///< 2 g climb
+            double p = air.pressure(h, hint_air);
+            fmt::println("{:>5} s  h {:>6.1f} km  F {:.3e} N  ṁ {:>6.1f} kg/s", t, h / 1e3, motor.thrust(t, p, hint), motor.mass_flow(t, hint));
+        }
+    }
+
+    /// Same motor from an engine deck only: the mass flow follows its vacuum column
+    {
+        engine deck(0, 270.);
+        deck.set_thrust_table({0., 60., 120.}, {0., 5e4, 1e5}, {4.4e6, 4.1e6, 3.8e6, 3.6e6, 3.3e6, 3.0e6, 0., 0., 0.});
+        table_hint hint;
+        fmt::println("\nEngine deck, burn time {} s, propellant {:.0f} kg, ṁ at 30 s {:.1f} kg/s", deck.get_burn_time(),
+                     deck.propellant_used(INFINITY), deck.mass_flow(30., hint));
+    }
+    if (std::isnan(sink))
+        fmt::println("ERROR: NaN densities");
+}
@@ -0,0 +1,108 @@
+#include "math/jacobian.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <cmath>
+#include <complex>
+
+/// Broyden tridiagonal function y_i = (3 - 2 x_i) x_i - x_(i-1) - 2 x_(i+1) + 1, with a cubic term
+/// so that the differences have a truncation error
+template <typename S>
+void broyden(const Eigen::Vector<S, Eigen::Dynamic> &x, Eigen::Vector<S, Eigen::Dynamic> &y)
+{
+    Eigen::Index n = x.size();
+    y.resize(n);
+    for (Eigen::Index i = 0; i < n; i++)
+    {
+        S left = i > 0 ? x[i - 1] : S(0), right = i + 1 < n ? x[i + 1] : S(0);
+        y[i] = (3. - 2. * x[i]) * x[i] - left - 2. * right + 1. + 0.1 * x[i] * x[i] * x[i];
+    }
+}
+
+Eigen::MatrixXd broyden_jacobian(const Eigen::VectorXd &x)
+{
+    Eigen::Index n = x.size();
+    Eigen::MatrixXd J = Eigen::MatrixXd::Zero(n, n);
+    for (Eigen::Index i = 0; i < n; i++)
+    {
+        J(i, i) = 3 - 4 * x[i] + 0.3 * x[i] * x[i];
+        if (i > 0)
+            J(i, i - 1) = -1;
+        if (i + 1 < n)
+            J(i, i + 1) = -2;
+    }
+    return J;
+}
+
+/// Range of a projectile with quadratic drag, RK4 over a fixed duration, against its launch speed,
+/// elevation and drag coefficient: a small propagation templated on the scalar
+template <typename S>
+void projectile(const Eigen::Vector<S, Eigen::Dynamic> &p, Eigen::Vector<S, Eigen::Dynamic> &y)
+{
+    using state = Eigen::Vector<S, 4>;
+    auto f = [&](const state &s)
+    {
+        S v = sqrt(s[2] * s[2] + s[3] * s[3]);
+        return state(s[2], s[3], -p[2] * v * s[2], -9.81 - p[2] * v * s[3]);
+    };
+    state s(S(0), S(0), p[0] * cos(p[1]), p[0] * sin(p[1]));
+    double dt = 1e-3;
+    for (size_t i = 0; i < 5000; i++)
+    {
+        state k1 = f(s), k2 = f(state(s + dt / 2 * k1)), k3 = f(state(s + dt / 2 * k2)), k4 = f(state(s + dt * k3));
+        s += dt / 6 * (k1 + 2. * k2 + 2. * k3 + k4);
+    }
+    y = s;
+}
+
+int main()
+{
+    const char *names[] = {"forward", "central", "fourth order", "complex step"};
+    Eigen::Index n = 400;
+    Eigen::VectorXd x = Eigen::VectorXd::LinSpaced(n, -1., 2.);
+    Eigen::MatrixXd exact = broyden_jacobian(x), J;
+    auto real = [](const Eigen::VectorXd &x, Eigen::VectorXd &y, size_t)
+    { broyden(x, y); };
+    auto complex = [](const Eigen::VectorXcd &x, Eigen::VectorXcd &y, size_t)
+    { broyden(x, y); };
+
+    fmt::println("Broyden tridiagonal, n = {}, {} threads", n, thread_count());
+    fmt::println("{:>14} {:>8} {:>8} {:>12} {:>10}", "scheme", "pattern", "evals", "max error", "ms");
+    jacobian_engine engine;
+    for (bool banded : {false, true})
+    {
+        engine.set_pattern(banded ? jacobian_pattern::banded(n, n, 1, 1) : jacobian_pattern{});
+        for (difference_scheme scheme : {difference_scheme::forward, difference_scheme::central, difference_scheme::fourth_order,
+                                         difference_scheme::complex_step})
+        {
+            engine.set_scheme(scheme);
+            double ms = time_ms([&]
+                                {
+                if (scheme == difference_scheme::complex_step)
+                    engine.compute_complex(complex, x, J);
+                else
+                    engine.compute(real, x, J); });
+            fmt::println("{:>14} {:>8} {:>8} {:>12.2e} {:>10.3f}", names[size_t(scheme)], banded ? "banded" : "dense",
+                         engine.evaluations(), (J - exact).cwiseAbs().maxCoeff(), ms);
+        }
+    }
+    engine.set_pattern({});
+
+    /// Propagation: the complex step as reference, the steps scaled on the parameters
+    Eigen::VectorXd p(3), reference;
+    p << 50., 0.7, 2e-3;
+    engine.set_typical(p);
+    Eigen::MatrixXd J_ref;
+    engine.compute_complex([](const Eigen::VectorXcd &p, Eigen::VectorXcd &y, size_t)
+                           { projectile(p, y); }, p, J_ref);
+    fmt::println("\nProjectile with drag, 4 outputs against 3 parameters, relative error against the complex step");
+    fmt::println("{:>14} {:>8} {:>12} {:>10}", "scheme", "evals", "error", "ms");
+    for (difference_scheme scheme : {difference_scheme::forward, difference_scheme::central, difference_scheme::fourth_order})
+    {
+        engine.set_scheme(scheme);
+        double ms = time_ms([&]
+                            { engine.compute([](const Eigen::VectorXd &p, Eigen::VectorXd &y, size_t)
+                                             { projectile(p, y); }, p, J); });
+        fmt::println("{:>14} {:>8} {:>12.2e} {:>10.3f}", names[size_t(scheme)], engine.evaluations(),
+                     (J - J_ref).norm() / J_ref.norm(), ms);
+    }
+}
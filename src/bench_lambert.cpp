@@ -0,0 +1,115 @@
+#include "celest/lambert.h"
+#include "celest/universal_kepler.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+constexpr double μ_sun = 1.32712440018e20, AU = 1.495978707e11, seconds_per_day = 86400.;
+
+/// Circular heliocentric orbit of radius a, at angle θ0 at t = 0
+orbit circular(double a, double θ0)
+{
+    orbit body(μ_sun, 0., 1.);
+    double v = std::sqrt(μ_sun / a);
+    body.set_from_current_state(xy(a * std::cos(θ0), a * std::sin(θ0)), xy(-v * std::sin(θ0), v * std::cos(θ0)));
+    return body;
+}
+
+int main()
+{
+    /// Random 3D geometries from 0.3 to 3 AU, times of flight from 5 days to 3 years, up to 3
+    /// revolutions: every arc is propagated from (r1, v1) with universal_kepler and must reach r2
+    /// with velocity v2
+    std::mt19937_64 rng(1);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::normal_distribution<double> normal;
+    size_t problems = 100000, max_revolutions = 3;
+    std::vector<vec3d> r1(problems), r2(problems);
+    std::vector<double> tof(problems);
+    for (size_t k = 0; k < problems; k++)
+    {
+        r1[k] = vec3d(normal(rng), normal(rng), 0.2 * normal(rng));
+        r2[k] = vec3d(normal(rng), normal(rng), 0.2 * normal(rng));
+        r1[k] *= (0.3 + 2.7 * uniform(rng)) * AU / r1[k].norm();
+        r2[k] *= (0.3 + 2.7 * uniform(rng)) * AU / r2[k].norm();
+        tof[k] = seconds_per_day * std::exp(std::log(5.) + (std::log(1100.) - std::log(5.)) * uniform(rng));
+    }
+
+    std::vector<lambert_arc> arcs(2 * max_revolutions + 1);
+    std::vector<size_t> counts(problems);
+    std::vector<std::vector<lambert_arc>> solutions(problems);
+    double ms = time_ms([&]
+                        {
+        for (size_t k = 0; k < problems; k++)
+        {
+            counts[k] = lambert_problem(r1[k], r2[k], tof[k], μ_sun).solve(arcs, max_revolutions);
+            solutions[k].assign(arcs.begin(), arcs.begin() + counts[k]);
+        } });
+
+    /// Short prograde times of flight for a transfer angle close to 2π give near radial hyperbolas
+    /// through the Sun, where the arc is ill-conditioned: they are counted in a row of their own
+    std::vector<double> position_error(max_revolutions + 2, 0.), velocity_error(max_revolutions + 2, 0.);
+    std::vector<size_t> found(max_revolutions + 2, 0);
+    for (size_t k = 0; k < problems; k++)
+        for (const lambert_arc &arc : solutions[k])
+        {
+            vec3d r, v;
+            universal_kepler<vec3d>(r1[k], arc.v1, μ_sun).state_at(tof[k], r, v);
+            vec3d h = r1[k].cross(arc.v1);
+            double e = ((arc.v1.norm_2() - μ_sun / r1[k].norm()) * r1[k] - r1[k].dot(arc.v1) * arc.v1).norm() / μ_sun;
+            double periapsis = h.norm_2() / (μ_sun * (1 + e));
+            size_t n = periapsis < 0.01 * AU ? max_revolutions + 1 : arc.revolutions;
+            found[n]++;
+            position_error[n] = std::max(position_error[n], (r - r2[k]).norm() / r2[k].norm());
+            velocity_error[n] = std::max(velocity_error[n], (v - arc.v2).norm() / arc.v2.norm());
+        }
+    fmt::println("{} random Lambert problems, up to {} revolutions: {:.2f} us per problem", problems, max_revolutions,
+                 ms * 1e3 / problems);
+    fmt::println("{:>13} {:>8} {:>16} {:>16}", "revolutions", "arcs", "|r - r2| / |r2|", "|v - v2| / |v2|");
+    for (size_t n = 0; n <= max_revolutions + 1; n++)
+        fmt::println("{:>13} {:>8} {:>16.2e} {:>16.2e}", n <= max_revolutions ? fmt::format("{}", n) : "r_p < 0.01 AU",
+                     found[n], position_error[n], velocity_error[n]);
+
+    /// Earth to Mars on circular coplanar orbits: the best cell of the grid must come close to the
+    /// Hohmann transfer from above, and every cell must match a direct solve
+    double a_earth = AU, a_mars = 1.523679 * AU;
+    double θ_mars = M_PI * (1 - std::pow((1 + a_earth / a_mars) / 2, 1.5)); ///< Hohmann phase at t = 0
+    orbit earth = circular(a_earth, 0.), mars = circular(a_mars, θ_mars);
+    double t_hohmann = M_PI * std::sqrt(std::pow((a_earth + a_mars) / 2, 3) / μ_sun);
+    double Δv_hohmann = std::sqrt(μ_sun / a_earth) * (std::sqrt(2 * a_mars / (a_earth + a_mars)) - 1) +
+                        std::sqrt(μ_sun / a_mars) * (1 - std::sqrt(2 * a_earth / (a_earth + a_mars)));
+
+    size_t n = 400;
+    std::vector<double> t_departure(n), t_arrival(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        t_departure[i] = (-60. + 120. * i / (n - 1)) * seconds_per_day;
+        t_arrival[i] = t_hohmann + (-80. + 160. * i / (n - 1)) * seconds_per_day;
+    }
+    Eigen::MatrixXd Δv;
+    double porkchop_ms = time_ms([&]
+                                 { porkchop(earth, t_departure, mars, t_arrival, Δv); });
+    Eigen::Index i_best, j_best;
+    Δv.minCoeff(&i_best, &j_best);
+
+    double mismatch = 0;
+    for (size_t i = 0; i < n; i += 37)
+        for (size_t j = 0; j < n; j += 41)
+        {
+            orbit_state departure = earth.state_at(t_departure[i]), arrival = mars.state_at(t_arrival[j]);
+            vec3d r_departure(departure.position[0], departure.position[1], 0.), v_departure(departure.velocity[0], departure.velocity[1], 0.);
+            vec3d r_arrival(arrival.position[0], arrival.position[1], 0.), v_arrival(arrival.velocity[0], arrival.velocity[1], 0.);
+            lambert_arc arc = solve_lambert(r_departure, r_arrival, t_arrival[j] - t_departure[i], μ_sun)[0];
+            double direct = (arc.v1 - v_departure).norm() + (v_arrival - arc.v2).norm();
+            mismatch = std::max(mismatch, std::abs(direct - Δv(i, j)) / direct);
+        }
+
+    fmt::println("\nEarth to Mars porkchop, {}x{} grid around the Hohmann window, {} threads: {:.1f} ms ({:.2f} us per cell)",
+                 n, n, thread_count(), porkchop_ms, porkchop_ms * 1e3 / (n * n));
+    fmt::println("best cell: Δv {:.2f} m/s, departure {:+.1f} d, flight {:.1f} d", Δv(i_best, j_best), t_departure[i_best] / seconds_per_day,
+                 (t_arrival[j_best] - t_departure[i_best]) / seconds_per_day);
+    fmt::println("Hohmann:   Δv {:.2f} m/s, departure {:+.1f} d, flight {:.1f} d", Δv_hohmann, 0., t_hohmann / seconds_per_day);
+    fmt::println("grid against direct solves: max relative difference {:.2e}", mismatch);
+}
@@ -0,0 +1,78 @@
+#include "celest/atmosphere.h"
+#include "vehicle/launch_vehicle.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+
+/// Two-stage medium launcher: first stage on sea-level-limited engines, vacuum upper stage
+launch_vehicle medium_launcher()
+{
+    launch_stage first, second;
+    first.dry_mass = 25600;
+    first.propellant_mass = 395700;
+    first.propulsion = engine(8.2e6, 311., 5.9);
+    first.reference_area = 10.5;
+    first.drag_table.set({0., 0.8, 1.0, 1.2, 2., 4., 10.}, {0.30, 0.32, 0.50, 0.52, 0.40, 0.28, 0.25}, interpolation_method::monotone_cubic);
+    second.dry_mass = 3900;
+    second.propellant_mass = 92670;
+    second.propulsion = engine(981e3, 348.);
+    second.reference_area = 10.5;
+    second.coast_time = 3;
+    return launch_vehicle({first, second}, 15000);
+}
+
+const char *name(ascent_end end)
+{
+    constexpr const char *names[] = {"time", "burnout", "cutoff", "impact"};
+    return names[size_t(end)];
+}
+
+int main()
+{
+    atmosphere air = atmosphere::us76();
+    launch_vehicle vehicle = medium_launcher();
+    vehicle.set_atmosphere(&air);
+    vehicle.set_cutoff_altitude(250e3);
+    fmt::println("Liftoff mass {:.0f} kg, cutoff at the energy of a 250 km circular orbit", vehicle.liftoff_mass());
+
+    fmt::println("\nKick angle against the final orbit (dt = 0.5 s)");
+    fmt::println("{:>8} {:>8} {:>8} {:>10} {:>10} {:>10} {:>10}", "kick", "end", "t", "altitude", "apoapsis", "periapsis", "mass");
+    for (double kick : {0.10, 0.12, 0.14, 0.15, 0.16, 0.18, 0.25})
+    {
+        vehicle.get_pitch_program().kick_angle = kick;
+        ascent_result result = vehicle.simulate(2000);
+        fmt::println("{:>8} {:>8} {:>8.1f} {:>10.1f} {:>10.1f} {:>10.1f} {:>10.0f}", kick, name(result.end), result.t,
+                     result.altitude / 1e3, result.apoapsis / 1e3, result.periapsis / 1e3, result.state[launch::mass]);
+    }
+
+    /// The phases restart exactly at the events, so the final state converges at the order of RK4
+    vehicle.get_pitch_program().kick_angle = 0.15;
+    vehicle.set_timestep(1. / 64);
+    ascent_result reference = vehicle.simulate(2000);
+    fmt::println("\nConvergence against dt = 1/64 s");
+    fmt::println("{:>8} {:>12} {:>14} {:>12} {:>14}", "dt", "cutoff time", "position (m)", "ms", "steps");
+    for (double dt : {4., 2., 1., 0.5, 0.25})
+    {
+        vehicle.set_timestep(dt);
+        vehicle.set_history(true);
+        ascent_result result;
+        double runtime = time_ms([&]
+                                 { result = vehicle.simulate(2000); });
+        double error = std::hypot(result.state[launch::x] - reference.state[launch::x], result.state[launch::y] - reference.state[launch::y]);
+        fmt::println("{:>8} {:>12.2e} {:>14.2e} {:>12.2f} {:>14}", dt, std::abs(result.t - reference.t), error, runtime,
+                     vehicle.get_times().size() - 1);
+    }
+
+    /// Repeated simulations, as inside an optimizer: no allocation once the buffers have grown
+    vehicle.set_timestep(0.5);
+    vehicle.set_history(false);
+    size_t allocations = debug::allocation_count(), runs = 1000;
+    double runtime = time_ms([&]
+                             {
+        for (size_t i = 0; i < runs; i++)
+        {
+            vehicle.get_pitch_program().kick_angle = 0.14 + 0.02 * i / runs;
+            vehicle.simulate(2000);
+        } });
+    fmt::println("\n{} simulations at dt = 0.5 s: {:.3f} ms each, {} buffer allocations", runs, runtime / runs,
+                 debug::allocation_count() - allocations);
+}
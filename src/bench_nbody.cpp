@@ -0,0 +1,111 @@
+#include "nbody/direct.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <functional>
+#include <random>
+
+/// Scalar reference, for the accuracy of the SIMD kernel
+double max_relative_error(direct_summation &kernel, const Eigen::VectorXd &x, const std::vector<double> &m, double ε)
+{
+    size_t N = m.size();
+    Eigen::VectorXd a;
+    kernel(0, x, a);
+    double error = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        vec3d ai(0.);
+        for (size_t j = 0; j < N; j++)
+        {
+            vec3d d = nbody_body(x, j) - nbody_body(x, i);
+            double r2 = d.dot(d) + ε * ε;
+            if (r2 > 0)
+                ai += m[j] / (r2 * std::sqrt(r2)) * d;
+        }
+        error = std::max(error, (nbody_body(a, i) - ai).norm() / ai.norm());
+    }
+    return error;
+}
+
+int main()
+{
+    std::mt19937 rng(42);
+    constexpr double ε = 1e-2;
+
+    fmt::println("Direct summation, {} lanes, {} hardware threads", native_lanes, thread_count());
+    {
+        size_t N = 2000;
+        std::vector<double> m(N, 1. / N);
+        direct_summation kernel(m, 1., ε);
+        Eigen::VectorXd x = nbody_state(random_ball(N, rng));
+        fmt::println("Max relative error vs scalar: {:.2e}", max_relative_error(kernel, x, m, ε));
+    }
+
+    /// Milliseconds per evaluation, repeated over about 4e8 pairs
+    auto ms_per_eval = [](direct_summation &kernel, const Eigen::VectorXd &x, size_t N)
+    {
+        Eigen::VectorXd a;
+        size_t repeats = std::max<size_t>(1, 4e8 / ((double)N * N));
+        return time_ms([&]
+                       {
+            for (size_t k = 0; k < repeats; k++)
+                kernel(0, x, a); }) / repeats;
+    };
+
+    fmt::println("{:>7} {:>8} {:>12} {:>12}", "N", "threads", "ms/eval", "Gpairs/s");
+    for (size_t N = 1000; N <= 64000; N *= 2)
+    {
+        std::vector<double> m(N, 1. / N);
+        direct_summation kernel(m, 1., ε);
+        Eigen::VectorXd x = nbody_state(random_ball(N, rng));
+        for (size_t threads : {size_t(1), thread_count()})
+        {
+            kernel.set_thread_count(threads);
+            double runtime = ms_per_eval(kernel, x, N);
+            fmt::println("{:>7} {:>8} {:>12.3f} {:>12.2f}", N, threads, runtime, (double)N * N / runtime * 1e-6);
+            if (thread_count() == 1)
+                break;
+        }
+    }
+
+    /// Every thread count up to the hardware one, speedup and parallel efficiency against 1 thread
+    {
+        size_t N = 32000;
+        std::vector<double> m(N, 1. / N);
+        direct_summation kernel(m, 1., ε);
+        Eigen::VectorXd x = nbody_state(random_ball(N, rng));
+        fmt::println("\nThread scaling, N = {}", N);
+        fmt::println("{:>8} {:>12} {:>10} {:>11}", "threads", "ms/eval", "speedup", "efficiency");
+        double serial = 0;
+        for (size_t threads = 1; threads <= thread_count(); threads++)
+        {
+            kernel.set_thread_count(threads);
+            double runtime = ms_per_eval(kernel, x, N);
+            if (threads == 1)
+                serial = runtime;
+            fmt::println("{:>8} {:>12.3f} {:>10.2f} {:>11.2f}", threads, runtime, serial / runtime, serial / runtime / threads);
+        }
+    }
+
+    /// Cold collapse of a softened ball: energy drift of the symplectic integrators using the kernel
+    size_t N = 1000;
+    std::vector<double> m(N, 1. / N);
+    direct_summation kernel(m, 1., 0.05);
+    Eigen::VectorXd x0 = nbody_state(random_ball(N, rng));
+    Eigen::VectorXd v0 = Eigen::VectorXd::Zero(3 * N);
+    double E0 = kernel.kinetic_energy(v0) + kernel.potential_energy(x0);
+    acceleration_inplace<Eigen::VectorXd> a = std::ref(kernel);
+
+    solver_degree_II<Eigen::VectorXd> solver;
+    solver.set_initial_state(0, x0, v0);
+    solver.set_timestep(1e-3);
+    for (const char *name : {"Verlet", "Yoshida 4th"})
+    {
+        Eigen::VectorXd x;
+        double runtime = time_ms([&]
+                                 { x = name[0] == 'V' ? solver.solve_verlet(0.5, a) : solver.solve_yoshida_4th(0.5, a); });
+        double E = kernel.kinetic_energy(solver.get_velocities().back()) + kernel.potential_energy(x);
+        fmt::println("{:<12} N = {}, 500 steps: {:.0f}ms, relative energy error {:.2e}",
+                     name, N, runtime, std::abs((E - E0) / E0));
+    }
+}
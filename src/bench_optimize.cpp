@@ -0,0 +1,181 @@
+#include "math/optimize.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <cmath>
+#include <random>
+
+/// Extended Rosenbrock: sum over pairs of 100 (x[2i+1] - x[2i]²)² + (1 - x[2i])², minimum 0 at 1
+double rosenbrock(const Eigen::VectorXd &x, Eigen::VectorXd &g)
+{
+    double f = 0;
+    g.setZero(x.size());
+    for (Eigen::Index i = 0; i + 1 < x.size(); i += 2)
+    {
+        double a = x[i + 1] - x[i] * x[i], b = 1 - x[i];
+        f += 100 * a * a + b * b;
+        g[i] += -400 * a * x[i] - 2 * b;
+        g[i + 1] += 200 * a;
+    }
+    return f;
+}
+
+/// Exact Hessian-vector product of the extended Rosenbrock, block diagonal
+void rosenbrock_hessian_vector(const Eigen::VectorXd &x, const Eigen::VectorXd &v, Eigen::VectorXd &Hv)
+{
+    Hv.setZero(x.size());
+    for (Eigen::Index i = 0; i + 1 < x.size(); i += 2)
+    {
+        double xx = 1200 * x[i] * x[i] - 400 * x[i + 1] + 2, xy = -400 * x[i];
+        Hv[i] = xx * v[i] + xy * v[i + 1];
+        Hv[i + 1] = xy * v[i] + 200 * v[i + 1];
+    }
+}
+
+/// The same as residuals 10 (x[2i+1] - x[2i]²), 1 - x[2i], so that f = ½ |r|² is half of it
+void rosenbrock_residuals(const Eigen::VectorXd &x, Eigen::VectorXd &r, Eigen::MatrixXd *J)
+{
+    Eigen::Index n = x.size();
+    r.resize(n);
+    if (J)
+        J->setZero(n, n);
+    for (Eigen::Index i = 0; i + 1 < n; i += 2)
+    {
+        r[i] = 10 * (x[i + 1] - x[i] * x[i]);
+        r[i + 1] = 1 - x[i];
+        if (J)
+        {
+            (*J)(i, i) = -20 * x[i];
+            (*J)(i, i + 1) = 10;
+            (*J)(i + 1, i) = -1;
+        }
+    }
+}
+
+/// Steepest descent with Armijo backtracking, the baseline
+optimize_result steepest_descent(const objective_function &f, Eigen::VectorXd x, size_t max_iterations)
+{
+    optimize_result result;
+    Eigen::VectorXd g(x.size()), g_new(x.size()), x_new;
+    result.f = f(x, g);
+    result.evaluations = 1;
+    double α = 1e-3;
+    for (result.iterations = 0; result.iterations < max_iterations && g.lpNorm<Eigen::Infinity>() > 1e-6; result.iterations++)
+    {
+        α *= 4;
+        for (;;)
+        {
+            x_new = x - α * g;
+            double f_new = f(x_new, g_new);
+            result.evaluations++;
+            if (f_new <= result.f - 1e-4 * α * g.squaredNorm() || α < 1e-20)
+            {
+                x = x_new;
+                result.f = f_new;
+                g = g_new;
+                break;
+            }
+            α /= 2;
+        }
+    }
+    result.x = x;
+    result.status = result.iterations < max_iterations ? optimize_status::gradient : optimize_status::max_iterations;
+    return result;
+}
+
+const char *name(optimize_status status)
+{
+    constexpr const char *names[] = {"gradient", "step", "function", "max_iterations", "line_search"};
+    return names[size_t(status)];
+}
+
+void print(const char *method, const optimize_result &result, double ms, double error)
+{
+    fmt::println("{:>22} {:>14} {:>8} {:>8} {:>12.3e} {:>12.3e} {:>10.3f}", method, name(result.status), result.iterations,
+                 result.evaluations, result.f, error, ms);
+}
+
+int main()
+{
+    optimize_options options;
+    options.max_iterations = 10000;
+    options.gradient_tolerance = 1e-6;
+    fmt::println("{:>22} {:>14} {:>8} {:>8} {:>12} {:>12} {:>10}", "method", "status", "iters", "evals", "f", "|x - x*|", "ms");
+
+    for (Eigen::Index n : {2, 100})
+    {
+        Eigen::VectorXd x0(n);
+        for (Eigen::Index i = 0; i < n; i += 2)
+        {
+            x0[i] = -1.2;
+            x0[i + 1] = 1;
+        }
+        Eigen::VectorXd ones = Eigen::VectorXd::Ones(n);
+        fmt::println("Rosenbrock, n = {}", n);
+        optimize_result result;
+        double ms = time_ms([&]
+                            { result = steepest_descent(rosenbrock, x0, options.max_iterations); });
+        print("steepest descent", result, ms, (result.x - ones).norm());
+        ms = time_ms([&]
+                     { result = lbfgs(rosenbrock, x0, options); });
+        print("L-BFGS", result, ms, (result.x - ones).norm());
+        ms = time_ms([&]
+                     { result = newton_cg(rosenbrock, x0, options); });
+        print("Newton-CG", result, ms, (result.x - ones).norm());
+        ms = time_ms([&]
+                     { result = newton_cg(rosenbrock, x0, options, rosenbrock_hessian_vector); });
+        print("Newton-CG, exact Hv", result, ms, (result.x - ones).norm());
+        ms = time_ms([&]
+                     { result = gauss_newton(rosenbrock_residuals, x0, options); });
+        print("Gauss-Newton", result, ms, (result.x - ones).norm());
+        ms = time_ms([&]
+                     { result = levenberg_marquardt(rosenbrock_residuals, x0, options); });
+        print("Levenberg-Marquardt", result, ms, (result.x - ones).norm());
+
+        /// x[2i] ≤ 0.5 cuts off the minimum: the constrained one is at x[2i] = 0.5, x[2i+1] = 0.25
+        Eigen::VectorXd lower = Eigen::VectorXd::Constant(n, -INFINITY), upper = Eigen::VectorXd::Constant(n, INFINITY), bounded(n);
+        for (Eigen::Index i = 0; i < n; i += 2)
+        {
+            upper[i] = 0.5;
+            bounded[i] = 0.5;
+            bounded[i + 1] = 0.25;
+        }
+        ms = time_ms([&]
+                     { result = lbfgsb(rosenbrock, x0, lower, upper, options); });
+        print("L-BFGS-B, x[2i] <= 0.5", result, ms, (result.x - bounded).norm());
+    }
+
+    /// Fit of y = a exp(-b t) + c to noisy samples
+    std::mt19937_64 generator(3);
+    std::normal_distribution<double> noise(0., 0.01);
+    size_t samples = 200;
+    Eigen::VectorXd t(samples), y(samples), truth(3);
+    truth << 2.5, 1.3, 0.5;
+    for (size_t i = 0; i < samples; i++)
+    {
+        t[i] = 5. * i / samples;
+        y[i] = truth[0] * std::exp(-truth[1] * t[i]) + truth[2] + noise(generator);
+    }
+    residual_function fit = [&](const Eigen::VectorXd &p, Eigen::VectorXd &r, Eigen::MatrixXd *J)
+    {
+        r.resize(samples);
+        if (J)
+            J->resize(samples, 3);
+        for (size_t i = 0; i < samples; i++)
+        {
+            double e = std::exp(-p[1] * t[i]);
+            r[i] = p[0] * e + p[2] - y[i];
+            if (J)
+                J->row(i) << e, -p[0] * t[i] * e, 1.;
+        }
+    };
+    Eigen::VectorXd p0(3);
+    p0 << 1., 0.1, 0.;
+    fmt::println("Exponential fit, {} samples, noise 0.01", samples);
+    optimize_result result;
+    double ms = time_ms([&]
+                        { result = gauss_newton(fit, p0, options); });
+    print("Gauss-Newton", result, ms, (result.x - truth).norm());
+    ms = time_ms([&]
+                 { result = levenberg_marquardt(fit, p0, options); });
+    print("Levenberg-Marquardt", result, ms, (result.x - truth).norm());
+}
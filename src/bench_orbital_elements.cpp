@@ -0,0 +1,136 @@
+#include "celest/orbital_elements.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+constexpr size_t N = 1000003; ///< Not a multiple of the lanes, so the scalar tail runs too
+constexpr double μ = 3.986004418e14;
+
+/// One span per element, sized N
+struct classical_history
+{
+    std::vector<double> a, e, i, Ω, ω, ν;
+    classical_history() : a(N), e(N), i(N), Ω(N), ω(N), ν(N) {}
+    classical_elements<std::span<double>> out() { return {a, e, i, Ω, ω, ν}; }
+    classical_elements<std::span<const double>> in() const { return {a, e, i, Ω, ω, ν}; }
+};
+
+struct equinoctial_history
+{
+    std::vector<double> p, f, g, h, k, L;
+    equinoctial_history() : p(N), f(N), g(N), h(N), k(N), L(N) {}
+    equinoctial_elements<std::span<double>> out() { return {p, f, g, h, k, L}; }
+    equinoctial_elements<std::span<const double>> in() const { return {p, f, g, h, k, L}; }
+};
+
+/// Max of |r' - r| / |r| and |v' - v| / |v|
+double state_error(const std::vector<vec3d> &r, const std::vector<vec3d> &v, const std::vector<vec3d> &r2, const std::vector<vec3d> &v2)
+{
+    double error = 0;
+    for (size_t j = 0; j < N; j++)
+        error = std::max({error, (r2[j] - r[j]).norm() / r[j].norm(), (v2[j] - v[j]).norm() / v[j].norm()});
+    return error;
+}
+
+double max_difference(const std::vector<double> &a, const std::vector<double> &b)
+{
+    double difference = 0;
+    for (size_t j = 0; j < N; j++)
+        difference = std::max(difference, std::abs(a[j] - b[j]) / std::max(1., std::abs(a[j])));
+    return difference;
+}
+
+int main()
+{
+    /// Elliptic orbits from LEO to GEO, a tenth hyperbolic, and a tenth each exactly circular
+    /// or exactly equatorial where the classical angles are undefined
+    std::mt19937_64 rng(7);
+    std::uniform_real_distribution<double> uniform(0., 1.);
+    std::vector<vec3d> r(N), v(N), r2(N), v2(N);
+    for (size_t j = 0; j < N; j++)
+    {
+        classical_elements<double> elements;
+        double kind = uniform(rng);
+        elements.e = kind < 0.1 ? 1.1 + 2 * uniform(rng) : kind < 0.2 ? 0. : 0.9 * uniform(rng);
+        elements.a = (7e6 + 35e6 * uniform(rng)) * (elements.e > 1 ? -1. : 1.);
+        elements.i = kind > 0.2 && kind < 0.3 ? 0. : 0.05 + 3. * uniform(rng);
+        elements.Ω = 2 * M_PI * uniform(rng);
+        elements.ω = 2 * M_PI * uniform(rng);
+        double ν_max = elements.e > 1 ? 0.8 * std::acos(-1 / elements.e) : M_PI;
+        elements.ν = ν_max * (2 * uniform(rng) - 1);
+        classical_to_state(elements, μ, r[j], v[j]);
+    }
+
+    classical_history classical, classical_scalar;
+    equinoctial_history equinoctial, equinoctial_scalar;
+    fmt::println("{} states (elliptic, hyperbolic, circular, equatorial), native_lanes = {}", N, native_lanes);
+    fmt::println("{:<36} {:>12} {:>10} {:>10} {:>8}", "conversion", "error", "scalar ms", "batch ms", "speedup");
+
+    auto row = [&](const char *name, double error, auto scalar, auto batched)
+    {
+        double t_scalar = time_ms(scalar), t_batched = time_ms(batched);
+        fmt::println("{:<36} {:>12.2e} {:>10.2f} {:>10.2f} {:>8.1f}", name, error, t_scalar, t_batched, t_scalar / t_batched);
+    };
+
+    /// The batched path converts once, the scalar loop once more for the comparison
+    auto to_classical = [&]
+    { state_to_classical(r, v, μ, classical.out()); };
+    auto to_classical_scalar = [&]
+    {
+        for (size_t j = 0; j < N; j++)
+            state_to_classical(r[j], v[j], μ).store(classical_scalar.out(), j);
+    };
+    to_classical();
+    to_classical_scalar();
+    double batch_classical = 0;
+    for (auto member : {&classical_history::a, &classical_history::e, &classical_history::i, &classical_history::Ω,
+                        &classical_history::ω, &classical_history::ν})
+        batch_classical = std::max(batch_classical, max_difference(classical.*member, classical_scalar.*member));
+    row("state -> classical", batch_classical, to_classical_scalar, to_classical);
+
+    auto from_classical = [&]
+    { classical_to_state(classical.in(), μ, r2, v2); };
+    auto from_classical_scalar = [&]
+    {
+        for (size_t j = 0; j < N; j++)
+            classical_to_state(classical_elements<double>::load(classical.in(), j), μ, r2[j], v2[j]);
+    };
+    from_classical();
+    row("state -> classical -> state", state_error(r, v, r2, v2), from_classical_scalar, from_classical);
+
+    auto to_equinoctial = [&]
+    { state_to_equinoctial(r, v, μ, equinoctial.out()); };
+    auto to_equinoctial_scalar = [&]
+    {
+        for (size_t j = 0; j < N; j++)
+            state_to_equinoctial(r[j], v[j], μ).store(equinoctial_scalar.out(), j);
+    };
+    to_equinoctial();
+    to_equinoctial_scalar();
+    double batch_equinoctial = 0;
+    for (auto member : {&equinoctial_history::p, &equinoctial_history::f, &equinoctial_history::g, &equinoctial_history::h,
+                        &equinoctial_history::k, &equinoctial_history::L})
+        batch_equinoctial = std::max(batch_equinoctial, max_difference(equinoctial.*member, equinoctial_scalar.*member));
+    row("state -> equinoctial", batch_equinoctial, to_equinoctial_scalar, to_equinoctial);
+
+    auto from_equinoctial = [&]
+    { equinoctial_to_state(equinoctial.in(), μ, r2, v2); };
+    auto from_equinoctial_scalar = [&]
+    {
+        for (size_t j = 0; j < N; j++)
+            equinoctial_to_state(equinoctial_elements<double>::load(equinoctial.in(), j), μ, r2[j], v2[j]);
+    };
+    from_equinoctial();
+    row("state -> equinoctial -> state", state_error(r, v, r2, v2), from_equinoctial_scalar, from_equinoctial);
+
+    /// Element to element conversions, checked through the states they give
+    for (size_t j = 0; j < N; j++)
+    {
+        classical_elements<double> elements = classical_elements<double>::load(classical.in(), j);
+        classical_to_state(equinoctial_to_classical(classical_to_equinoctial(elements)), μ, r2[j], v2[j]);
+    }
+    fmt::println("{:<36} {:>12.2e}", "classical -> equinoctial -> classical", state_error(r, v, r2, v2));
+    fmt::println("(batch errors: max difference of the elements between the batched and the scalar paths)");
+}
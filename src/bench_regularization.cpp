@@ -0,0 +1,81 @@
+#include "solver/regularization.h"
+#include "solver/solver.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <cmath>
+#include <functional>
+
+/// Kepler orbit with μ = a = 1 starting at periapsis, in a plane inclined by i on the x axis
+constexpr double μ = 1., i = 0.5;
+
+/// Exact position at t from Kepler's equation
+vec3 kepler_position(double e, double t)
+{
+    double M = std::fmod(t, 2 * M_PI), E = e > 0.8 ? M_PI : M;
+    for (size_t k = 0; k < 100; k++)
+    {
+        double dE = (E - e * std::sin(E) - M) / (1 - e * std::cos(E));
+        E -= dE;
+        if (std::abs(dE) < 1e-15)
+            break;
+    }
+    double x = std::cos(E) - e, y = std::sqrt(1 - e * e) * std::sin(E);
+    return vec3(x, y * std::cos(i), y * std::sin(i));
+}
+
+/// Fictitious time of one orbit for dt = r^α ds: ∫ r^(1-α) dE over an orbit, r = 1 - e cos E
+double fictitious_period(double e, double α)
+{
+    size_t n = 100000;
+    double s = 0;
+    for (size_t k = 0; k < n; k++)
+        s += std::pow(1 - e * std::cos(2 * M_PI * (k + 0.5) / n), 1 - α);
+    return s * 2 * M_PI / n;
+}
+
+template <typename R>
+void run(const char *name, R regularization, double e, double Δs, double tf, const vec3 &exact)
+{
+    double rp = 1 - e, vp = std::sqrt(μ * (1 + e) / rp);
+    regularized_solver<R> solver(std::move(regularization));
+    solver.set_initial_state(0, vec3(rp, 0., 0.), vec3(0., vp * std::cos(i), vp * std::sin(i)));
+    solver.set_timestep(Δs);
+    vec3 r;
+    double ms = time_ms([&]
+                        { r = solver.solve_RK4(tf); });
+    fmt::println("{:>8} {:>14} {:>10} {:>12.2e} {:>10.2f}", e, name, solver.get_states().size() - 1, (r - exact).norm(), ms);
+}
+
+int main()
+{
+    double orbits = 3.3, tf = orbits * 2 * M_PI;
+    size_t steps_per_orbit = 100, cowell_steps_per_orbit = 4000;
+    std::function<vec3(double, vec3)> gravity = [](double, vec3 r)
+    {
+        double n = r.norm();
+        return vec3(-μ / (n * n * n) * r);
+    };
+
+    fmt::println("Kepler orbits, {} orbits, final position error relative to a", orbits);
+    fmt::println("{} regularized RK4 steps per orbit, Cowell RK4 with {}", steps_per_orbit, cowell_steps_per_orbit);
+    fmt::println("{:>8} {:>14} {:>10} {:>12} {:>10}", "e", "method", "steps", "error", "ms");
+    for (double e : {0.9, 0.99, 0.999})
+    {
+        vec3 exact = kepler_position(e, tf);
+        run("KS", kustaanheimo_stiefel(μ), e, fictitious_period(e, 1.) / steps_per_orbit, tf, exact);
+        run("Sundman 1", sundman<3>(μ, 1.), e, fictitious_period(e, 1.) / steps_per_orbit, tf, exact);
+        /// α = 1 needs Δs below its max_step, 8π / √(1 - e) steps per orbit: 250 at e = 0.99, 800 at 0.999
+        run("Sundman 1 x10", sundman<3>(μ, 1.), e, fictitious_period(e, 1.) / (10 * steps_per_orbit), tf, exact);
+        run("Sundman 3/2", sundman<3>(μ, 1.5), e, fictitious_period(e, 1.5) / steps_per_orbit, tf, exact);
+
+        double rp = 1 - e, vp = std::sqrt(μ * (1 + e) / rp);
+        solver_degree_II<vec3> cowell;
+        cowell.set_initial_state(0, vec3(rp, 0., 0.), vec3(0., vp * std::cos(i), vp * std::sin(i)));
+        cowell.set_timestep(2 * M_PI / cowell_steps_per_orbit);
+        vec3 r;
+        double ms = time_ms([&]
+                            { r = cowell.solve_RK4(tf, gravity); });
+        fmt::println("{:>8} {:>14} {:>10} {:>12.2e} {:>10.2f}", e, "Cowell", size_t(orbits * cowell_steps_per_orbit),
+                     (r - exact).norm(), ms);
+    }
+}
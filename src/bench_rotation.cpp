@@ -0,0 +1,168 @@
+#include "math/mat3d.h"
+#include "math/quaternion.h"
+#include <fmt/format.h>
+#include <Eigen/Geometry>
+#include <algorithm>
+#include <chrono>
+#include <random>
+#include <vector>
+
+using namespace std::chrono;
+
+constexpr size_t N = 1000000;
+constexpr size_t repeats = 20;
+
+template <typename F>
+void time_it(const char *name, F f)
+{
+    auto t1 = high_resolution_clock::now();
+    double check = f();
+    auto t2 = high_resolution_clock::now();
+    double runtime = duration_cast<microseconds>(t2 - t1).count() / 1000.;
+    fmt::println("{:<26} {:>9.1f}ms  ({:.3g} ns/op, check {:.6f})", name, runtime, runtime * 1e6 / (N * repeats), check);
+}
+
+double max_error(const mat3d &a, const mat3d &b)
+{
+    double error = 0;
+    for (size_t i = 0; i < 3; i++)
+        for (size_t j = 0; j < 3; j++)
+            error = std::max(error, std::abs(a(i, j) - b(i, j)));
+    return error;
+}
+
+int main()
+{
+    std::mt19937_64 rng(42);
+    std::normal_distribution<double> normal;
+    std::vector<quaternion> q(N), p(N), pq(N);
+    std::vector<vec3d> v(N), out(N);
+    std::vector<Eigen::Quaterniond> q_eigen(N);
+    std::vector<Eigen::Vector3d> v_eigen(N), r(N);
+    for (size_t i = 0; i < N; i++)
+    {
+        q[i] = quaternion(normal(rng), normal(rng), normal(rng), normal(rng));
+        p[i] = quaternion(normal(rng), normal(rng), normal(rng), normal(rng));
+        q[i].normalize();
+        p[i].normalize();
+        v[i] = vec3d(normal(rng), normal(rng), normal(rng));
+        q_eigen[i] = Eigen::Quaterniond(q[i].w, q[i].x, q[i].y, q[i].z);
+        v_eigen[i] = Eigen::Vector3d(v[i].x, v[i].y, v[i].z);
+    }
+
+    /// Round trips and consistency, max errors over the random rotations
+    double round_trip = 0, orthonormal = 0, rotate = 0, eigen = 0, composition = 0, inverse = 0;
+    for (size_t i = 0; i < N; i++)
+    {
+        mat3d m = q[i].to_matrix();
+        quaternion back = quaternion::from_matrix(m);
+        if (back.dot(q[i]) < 0)
+            back = -back;
+        round_trip = std::max(round_trip, (back - q[i]).norm());
+        orthonormal = std::max(orthonormal, max_error(m.transpose() * m, mat3d::identity()));
+        rotate = std::max(rotate, (q[i].rotate(v[i]) - m * v[i]).norm() / v[i].norm());
+        r[i] = q_eigen[i] * v_eigen[i];
+        eigen = std::max(eigen, (q[i].rotate(v[i]) - vec3d(r[i][0], r[i][1], r[i][2])).norm() / v[i].norm());
+        vec3d composed = (p[i] * q[i]).rotate(v[i]);
+        composition = std::max(composition, (composed - p[i].rotate(q[i].rotate(v[i]))).norm() / v[i].norm());
+        composition = std::max(composition, (composed - (p[i].to_matrix() * m) * v[i]).norm() / v[i].norm());
+        mat3d a(v[i], p[i].vec() + 2 * vec3d::unitY(), q[i].vec() + 2 * vec3d::unitZ());
+        /// Relative to the conditioning, the random A are not all well conditioned
+        mat3d a_inverse = a.inverse();
+        double condition = max_error(a, mat3d()) * max_error(a_inverse, mat3d());
+        inverse = std::max(inverse, max_error(a_inverse * a, mat3d::identity()) / condition);
+    }
+    /// Half turns, trace -1: Shepperd's method must not divide by 1 + tr
+    double half_turn = 0;
+    for (vec3d axis : {vec3d::unitX(), vec3d::unitY(), vec3d::unitZ(), vec3d(1., 1., 0.), vec3d(1., -2., 3.)})
+    {
+        quaternion h = quaternion::from_axis_angle(axis, M_PI), back = quaternion::from_matrix(h.to_matrix());
+        if (back.dot(h) < 0)
+            back = -back;
+        half_turn = std::max(half_turn, (back - h).norm());
+    }
+    fmt::println("{} random rotations, max errors", N);
+    fmt::println("{:<40} {:.2e}", "quaternion -> matrix -> quaternion", round_trip);
+    fmt::println("{:<40} {:.2e}", "half turns round trip", half_turn);
+    fmt::println("{:<40} {:.2e}", "M^T M - I", orthonormal);
+    fmt::println("{:<40} {:.2e}", "q.rotate(v) against M v", rotate);
+    fmt::println("{:<40} {:.2e}", "q.rotate(v) against Eigen", eigen);
+    fmt::println("{:<40} {:.2e}", "(p q) v against p (q v) and M_p M_q v", composition);
+    fmt::println("{:<40} {:.2e}", "(A^-1 A - I) / cond(A)", inverse);
+
+    fmt::println("\n{} operations x {}", N, repeats);
+    time_it("quaternion rotate", [&]
+            {
+        double check = 0;
+        for (size_t k = 0; k < repeats; k++)
+        {
+            ::rotate(q, v, out);
+            check += out[k].x;
+        }
+        return check; });
+    time_it("Eigen quaternion rotate", [&]
+            {
+        double check = 0;
+        for (size_t k = 0; k < repeats; k++)
+        {
+            for (size_t i = 0; i < N; i++)
+                r[i] = q_eigen[i] * v_eigen[i];
+            check += r[k][0];
+        }
+        return check; });
+    time_it("batched rotate (matrix)", [&]
+            {
+        double check = 0;
+        for (size_t k = 0; k < repeats; k++)
+        {
+            q[k].rotate(v, out);
+            check += out[k].x;
+        }
+        return check; });
+    time_it("mat3d * vec3d", [&]
+            {
+        double check = 0;
+        mat3d m = q[0].to_matrix();
+        for (size_t k = 0; k < repeats; k++)
+        {
+            m.apply(v, out);
+            check += out[k].x;
+        }
+        return check; });
+    time_it("Eigen Matrix3d * Vector3d", [&]
+            {
+        double check = 0;
+        Eigen::Matrix3d m = q[0].to_matrix().to_eigen();
+        for (size_t k = 0; k < repeats; k++)
+        {
+            for (size_t i = 0; i < N; i++)
+                r[i] = m * v_eigen[i];
+            check += r[k][0];
+        }
+        return check; });
+    time_it("quaternion compose", [&]
+            {
+        double check = 0;
+        for (size_t k = 0; k < repeats; k++)
+        {
+            compose(p, q, pq);
+            check += pq[k].w;
+        }
+        return check; });
+    time_it("mat3d * mat3d", [&]
+            {
+        double check = 0;
+        mat3d m = q[0].to_matrix(), acc = mat3d::identity();
+        for (size_t k = 0; k < N * repeats; k++)
+            acc = m * acc;
+        check += acc(0, 0);
+        return check; });
+    time_it("Eigen Matrix3d * Matrix3d", [&]
+            {
+        double check = 0;
+        Eigen::Matrix3d m = q[0].to_matrix().to_eigen(), acc = Eigen::Matrix3d::Identity();
+        for (size_t k = 0; k < N * repeats; k++)
+            acc = m * acc;
+        check += acc(0, 0);
+        return check; });
+}
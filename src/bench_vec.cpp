@@ -0,0 +1,106 @@
+#include "solver/solver.h"
+#include "solver/coordinates.h"
+#include "math/vec2d.h"
+#include "math/vec3d.h"
+#include <fmt/format.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+using namespace std::chrono;
+
+constexpr size_t N = 20000000;
+constexpr double dt = 1e-3;
+
+template <typename V>
+V gravity(const V &x)
+{
+    double r = x.norm();
+    return -x / (r * r * r);
+}
+
+vec3d gravity(const vec3d &x)
+{
+    return -x.inv_norm_3() * x;
+}
+
+vec2d gravity(const vec2d &x)
+{
+    return -x.inv_norm_3() * x;
+}
+
+template <typename V>
+V RK4_kepler(V x, V v)
+{
+    V k1, k2, k3, k4, v2, v3, v4, x_i;
+    for (size_t i = 0; i < N; i++)
+    {
+        k1 = gravity(x);
+
+        set_stage(v2, v, dt / 2, k1);
+        set_stage(x_i, x, dt / 2, v);
+        k2 = gravity(x_i);
+
+        set_stage(v3, v, dt / 2, k2);
+        set_stage(x_i, x, dt / 2, v2);
+        k3 = gravity(x_i);
+
+        set_stage(v4, v, dt, k3);
+        set_stage(x_i, x, dt, v3);
+        k4 = gravity(x_i);
+
+        rk4_update(x, dt, v, v2, v3, v4);
+        rk4_update(v, dt, k1, k2, k3, k4);
+    }
+    return x;
+}
+
+template <typename V>
+V verlet_kepler(V x, V v)
+{
+    for (size_t i = 0; i < N; i++)
+    {
+        accumulate(v, dt / 2, gravity(x));
+        accumulate(x, dt, v);
+        accumulate(v, dt / 2, gravity(x));
+    }
+    return x;
+}
+
+/// Best of 3 runs, the single runs differ by several percent
+template <typename F>
+void time_it(const char *name, F f)
+{
+    double runtime = INFINITY, check = 0;
+    for (size_t run = 0; run < 3; run++)
+    {
+        auto t1 = high_resolution_clock::now();
+        check = f();
+        auto t2 = high_resolution_clock::now();
+        runtime = std::min(runtime, duration_cast<microseconds>(t2 - t1).count() / 1000.);
+    }
+    fmt::println("{:<14} {:>9.1f}ms  ({:.3g} ns/step, check {:.6f})", name, runtime, runtime * 1e6 / N, check);
+}
+
+int main()
+{
+    fmt::println("{} steps of dt = {}", N, dt);
+
+    time_it("RK4 vec2", []
+            { return RK4_kepler<vec2>({1., 0.}, {0., 1.})[0]; });
+    time_it("RK4 vec2d", []
+            { return RK4_kepler<vec2d>({1., 0.}, {0., 1.}).x; });
+    time_it("RK4 vec3", []
+            { return RK4_kepler<vec3>({1., 0., 0.}, {0., 1., 0.})[0]; });
+    time_it("RK4 vec3d", []
+            { return RK4_kepler<vec3d>({1., 0., 0.}, {0., 1., 0.}).x; });
+
+    time_it("Verlet vec2", []
+            { return verlet_kepler<vec2>({1., 0.}, {0., 1.})[0]; });
+    time_it("Verlet vec2d", []
+            { return verlet_kepler<vec2d>({1., 0.}, {0., 1.}).x; });
+    time_it("Verlet vec3", []
+            { return verlet_kepler<vec3>({1., 0., 0.}, {0., 1., 0.})[0]; });
+    time_it("Verlet vec3d", []
+            { return verlet_kepler<vec3d>({1., 0., 0.}, {0., 1., 0.}).x; });
+}
@@ -0,0 +1,71 @@
+#include "celest/wisdom_holman.h"
+#include "bench_common.h"
+#include <fmt/format.h>
+#include <cmath>
+#include <vector>
+
+constexpr double G = 6.67430e-11, AU = 1.495978707e11, julian_year = 3.15576e7;
+
+/// Sun and the outer planets, each at its perihelion with its own phase and a small inclination
+void outer_planets(std::vector<double> &masses, std::vector<vec3d> &x, std::vector<vec3d> &v)
+{
+    masses = {1.98892e30, 1.8982e27, 5.6834e26, 8.6810e25, 1.02413e26};
+    const double a[] = {5.2044, 9.5826, 19.2184, 30.11}, e[] = {0.0489, 0.0565, 0.0457, 0.0113};
+    const double phase[] = {0.3, 2.1, 4.0, 5.5}, inclination[] = {0.0228, 0.0434, 0.0135, 0.0309};
+    x.assign(5, vec3d(0.));
+    v.assign(5, vec3d(0.));
+    for (size_t i = 0; i < 4; i++)
+    {
+        double r = a[i] * AU * (1 - e[i]);
+        double speed = std::sqrt(G * (masses[0] + masses[i + 1]) * (1 + e[i]) / r);
+        double c = std::cos(phase[i]), s = std::sin(phase[i]), ci = std::cos(inclination[i]), si = std::sin(inclination[i]);
+        x[i + 1] = vec3d(r * c, r * s * ci, r * s * si);
+        v[i + 1] = vec3d(-speed * s, speed * c * ci, speed * c * si);
+    }
+    /// Barycentric frame
+    vec3d P(0.), X(0.);
+    double M = 0;
+    for (size_t i = 0; i < 5; i++)
+    {
+        P += masses[i] * v[i];
+        X += masses[i] * x[i];
+        M += masses[i];
+    }
+    for (size_t i = 0; i < 5; i++)
+    {
+        v[i] -= P / M;
+        x[i] -= X / M;
+    }
+}
+
+int main()
+{
+    std::vector<double> masses;
+    std::vector<vec3d> x0, v0;
+    outer_planets(masses, x0, v0);
+    double P_J = 2 * M_PI * std::sqrt(std::pow(5.2044 * AU, 3) / (G * (masses[0] + masses[1])));
+    size_t periods = 1000;
+
+    fmt::println("Sun and outer planets, {} Jupiter periods: max relative energy error (sampled every period)", periods);
+    fmt::println("{:>10} {:>10} {:>14} {:>10}", "dt", "corrector", "energy error", "ms");
+    for (double steps_per_period : {20., 40.})
+    {
+        for (size_t order : {0, 3, 5, 7})
+        {
+            wisdom_holman integrator(masses, G);
+            integrator.set_initial_state(0, x0, v0);
+            integrator.set_timestep(P_J / steps_per_period);
+            integrator.set_corrector_order(order);
+            double E0 = integrator.get_energy(), error = 0;
+            double runtime = time_ms([&]
+                                     {
+                for (size_t k = 1; k <= periods; k++)
+                {
+                    integrator.solve(k * P_J);
+                    error = std::max(error, std::abs((integrator.get_energy() - E0) / E0));
+                } });
+            fmt::println("{:>10} {:>10} {:>14.2e} {:>10.1f}", fmt::format("P_J/{:.0f}", steps_per_period), order, error, runtime);
+        }
+    }
+    fmt::println("({:.1f} years per Jupiter period)", P_J / julian_year);
+}
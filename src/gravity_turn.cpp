@@ -1,140 +1,142 @@
-#include <solver/coordinates.h>
-#include <solver/solver.h>
+#include <celest/atmosphere.h>
+#include <math/jacobian.h>
+#include <math/optimize.h>
+#include <vehicle/launch_vehicle.h>
 #include <matplot/matplot.h>
 #include <functional>
+#include <cassert>
+#include <cstdlib>
+#include <new>
 
 namespace plt = matplot;
 
-using state = coordinates<5>;
+#ifndef NDEBUG
+/// Every operator new of the program, to check that repeated propagations do not allocate. Eigen
+/// allocates through malloc, its allocations are caught by EIGEN_RUNTIME_NO_MALLOC instead.
+size_t heap_allocations = 0;
 
-namespace c
+void *operator new(size_t size)
 {
-    enum
-    {
-        x,
-        z,
-        vx,
-        vz,
-        alpha,
-    };
+    heap_allocations++;
+    if (void *p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc();
 }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+#endif
 
-double M = 3e6;
-double tf = 10000.;
-double dt = 1;
-double k = 16.25 * M;
-double g = 9.81;
-double γ = 1.0e-5 * M;
-double H = 8000.;
+double tf = 2000.;
+double dt = 0.5;
 
-state dsdt(double t, state state_i)
+launch_vehicle make_vehicle()
 {
-    state state_change;
-    double drag = γ * exp(-state_i[c::z] / H) / M;
-    double vx = state_i[c::vx];
-    double vz = state_i[c::vz];
-    double v = sqrt(vx * vx + vz * vz);
-    double α = state_i[c::alpha];
-
-    state_change[c::x] = vx;
-    state_change[c::z] = vz;
-    state_change[c::vx] = k / M * sin(α) - drag * vx * v;
-    state_change[c::vz] = k / M * cos(α) - drag * vz * v - g;
-    if (v != 0)
-    {
-        state_change[c::alpha] = drag * (sin(2 * α) * (vx * vx - vz * vz) + cos(2 * α) * vx * vz) / (2. * v);
-    }
-    else
-    {
-        state_change[c::alpha] = 0;
-    }
-
-    return state_change;
+    launch_stage first, second;
+    first.dry_mass = 25600;
+    first.propellant_mass = 395700;
+    first.propulsion = engine(8.2e6, 311., 5.9);
+    first.reference_area = 10.5;
+    first.drag_table.set({0., 0.8, 1.0, 1.2, 2., 4., 10.}, {0.30, 0.32, 0.50, 0.52, 0.40, 0.28, 0.25}, interpolation_method::monotone_cubic);
+    second.dry_mass = 3900;
+    second.propellant_mass = 92670;
+    second.propulsion = engine(981e3, 348.);
+    second.reference_area = 10.5;
+    second.coast_time = 3;
+    return launch_vehicle({first, second}, 15000);
 }
 
-std::vector<state> propagate(solver_degree_I<state> &solver, double α0)
+const ascent_result &propagate(launch_vehicle &vehicle, double α0)
 {
-    state X0 = {0., 0., 0., 0., α0};
-
-    solver.set_initial_state(0, X0);
-    solver.set_timestep(dt);
-    solver.solve_RK4(tf, dsdt);
-    auto result = solver.get_positions();
-    size_t i_max = get_maximum_index(parse(result, c::z));
-    return truncate_vector(result, i_max);
-}
-
-double gradient(solver_degree_I<state> &solver, double target, double α0, double dα)
-{
-    auto result = propagate(solver, α0 - 2 * dα);
-    double h_m2 = result.back()[c::z];
-    double L2_m2 = (h_m2 / target - 1) * (h_m2 / target - 1);
-
-    result = propagate(solver, α0 - dα);
-    double h_m1 = result.back()[c::z];
-    double L2_m1 = (h_m1 / target - 1) * (h_m1 / target - 1);
-
-    result = propagate(solver, α0 + dα);
-    double h_p1 = result.back()[c::z];
-    double L2_p1 = (h_p1 / target - 1) * (h_p1 / target - 1);
-
-    result = propagate(solver, α0 + 2 * dα);
-    double h_p2 = result.back()[c::z];
-    double L2_p2 = (h_p2 / target - 1) * (h_p2 / target - 1);
-
-    return (1. / 12 * L2_m2 - 2. / 3 * L2_m1 + 2. / 3 * L2_p1 - 1. / 12 * L2_p2) / dα;
+    static ascent_result result;
+    vehicle.get_pitch_program().kick_angle = α0;
+    result = vehicle.simulate(tf);
+    return result;
 }
 
 int main()
 {
-    double α0 = .8;
-
-    solver_degree_I<state> solver;
-    double dα = 0.000001;
-    double target = 50000;
-
-    double alpha = α0;
-    double grad = gradient(solver, target, α0, dα);
-    double n_alpha = alpha - grad * 1e-8;
-    for (size_t i = 0; i < 1000; i++)
+    double α0 = .12;
+
+    atmosphere air = atmosphere::us76();
+    launch_vehicle vehicle = make_vehicle();
+    vehicle.set_atmosphere(&air);
+    vehicle.set_cutoff_altitude(250e3);
+    vehicle.set_timestep(dt);
+    double target = 200000;
+
+    /// One vehicle per worker for the stencil points, evaluated in parallel
+    std::vector<launch_vehicle> workers(thread_count(), vehicle);
+    jacobian_engine jacobian(difference_scheme::fourth_order);
+    jacobian.set_typical(Eigen::VectorXd::Constant(1, 0.1));
+    jacobian_engine::function periapsis = [&](const Eigen::VectorXd &α, Eigen::VectorXd &r, size_t worker)
     {
-        double n_grad = gradient(solver, target, n_alpha, dα);
-        if (n_grad == grad)
-            break;
-        double η = 0.1 * abs((n_alpha - alpha) / (n_grad - grad));
-        grad = n_grad;
-        alpha = n_alpha;
-        n_alpha -= grad * η;
-        double z = propagate(solver, n_alpha).back()[c::z];
-        // fmt::println("I: {}, alpha: {:.10f}, eta: {:.2g}, Z: {:.6g}, grad: {:.2g}", i, n_alpha, η, z, grad);
-        if (abs(z - target) < 0.5 || std::isnan(α0) || std::isnan(η))
-            break;
-    }
-
-    auto result = propagate(solver, alpha);
-    auto time = truncate_vector(solver.get_timeline(tf), result.size() + 1);
+        r.resize(1);
+        workers[worker].get_pitch_program().kick_angle = α[0];
+        r[0] = workers[worker].simulate(tf).periapsis / target - 1;
+    };
 
-    fmt::println("Final height: {:.1f}, velocity: {:.1f}, time: {:.1f}", parse(result, c::z).back(), parse(result, c::vx).back(), time.back());
+    /// Targeting as least squares on the relative periapsis error
+    size_t propagations = 0;
+    residual_function residuals = [&](const Eigen::VectorXd &α, Eigen::VectorXd &r, Eigen::MatrixXd *J)
+    {
+        r.resize(1);
+        r[0] = propagate(vehicle, α[0]).periapsis / target - 1;
+        propagations++;
+        if (J)
+        {
+            jacobian.compute(periapsis, α, *J);
+            propagations += jacobian.evaluations();
+        }
+    };
+    optimize_options options;
+    options.step_tolerance = 1e-9;
+    options.gradient_tolerance = 1e-12;
+
+    optimize_result solution = levenberg_marquardt(residuals, Eigen::VectorXd::Constant(1, α0), options);
+    double alpha = solution.x[0];
+
+    vehicle.set_history(true);
+    auto result = propagate(vehicle, alpha);
+#ifndef NDEBUG
+    /// The second propagation of the same trajectory fills the history buffers of the first
+    size_t allocations = heap_allocations;
+    Eigen::internal::set_is_malloc_allowed(false);
+    result = propagate(vehicle, alpha);
+    Eigen::internal::set_is_malloc_allowed(true);
+    assert(heap_allocations == allocations && "propagate() should reuse the vehicle buffers");
+#endif
+    const std::vector<launch_state> &states = vehicle.get_states();
+    const std::vector<double> &time = vehicle.get_times();
+
+    fmt::println("Kick angle: {:.6f} after {} iterations, {} propagations", alpha, solution.iterations, propagations);
+    fmt::println("Periapsis: {:.1f}, apoapsis: {:.1f}, mass: {:.0f}, time: {:.1f}", result.periapsis, result.apoapsis,
+                 result.state[launch::mass], result.t);
 
     if (false)
     {
+        std::vector<double> downrange, altitude;
+        for (size_t i = 0; i < states.size(); i++)
+        {
+            downrange.push_back(vehicle.downrange(time[i], states[i]));
+            altitude.push_back(vehicle.altitude(states[i]));
+        }
         auto fig = plt::figure();
         fig->size(1920, 1080);
         plt::subplot(2, 2, 0);
-        plt::plot(parse(result, c::x), parse(result, c::z));
-        plt::title("Trajectory z(x)");
+        plt::plot(downrange, altitude);
+        plt::title("Trajectory h(downrange)");
 
         plt::subplot(2, 2, 1);
-        plt::plot(time, parse(result, c::alpha));
-        plt::title("Angle α(t)");
+        plt::plot(time, parse(states, launch::mass));
+        plt::title("Mass m(t)");
 
         plt::subplot(2, 2, 2);
-        plt::plot(time, parse(result, c::z));
-        plt::title("Alitutde z(t)");
+        plt::plot(time, altitude);
+        plt::title("Alitutde h(t)");
 
         plt::subplot(2, 2, 3);
-        plt::plot(time, parse(result, c::vx));
-        plt::title("Ortho velocity vx(t)");
+        plt::plot(time, parse(states, launch::vx));
+        plt::title("Inertial velocity vx(t)");
 
         plt::show();
     }
@@ -48,6 +48,15 @@ int main()
     solver.solve_RK4(tf, a);
     XY = solver.get_positions();
     plt::plot(parse(XY, 0), parse(XY, 1), "--")->display_name("RK4");
+    fmt::println("RK4 position error after one period: {:.3g} m", (XY.back() - orbit.state_at(tf).position).norm());
+
+    std::vector<xy> exact_positions(XY.size());
+    std::vector<xy> exact_velocities(XY.size());
+    orbit.get_trajectory(0, tf, exact_positions, exact_velocities);
+    double max_error = 0;
+    for (size_t i = 0; i < XY.size(); i++)
+        max_error = std::max(max_error, (XY[i] - exact_positions[i]).norm());
+    fmt::println("RK4 maximum position error over the period: {:.3g} m", max_error);
 
     auto exact_trajectory = orbit.get_trajectory(1000);
     auto plot = plt::plot(parse(exact_trajectory, 0), parse(exact_trajectory, 1));
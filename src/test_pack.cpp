@@ -0,0 +1,183 @@
+#include "math/vec_pack.h"
+#include <fmt/format.h>
+#include <array>
+#include <cmath>
+#include <cstring>
+#include <random>
+
+/// Lane by lane checks of double_pack, mask_pack, vec2d_pack and vec3d_pack against the scalar
+/// code. Widths that are not multiples of 8 or 4 leave tail lanes after the AVX-512 and AVX2
+/// chunks; every value visits every lane.
+
+size_t failures = 0;
+
+void check(bool ok, const char *what, size_t W, size_t lane, double got, double expected)
+{
+    if (ok)
+        return;
+    failures++;
+    if (failures <= 20)
+        fmt::println("ERROR: {} W = {} lane {}: got {}, expected {}", what, W, lane, got, expected);
+}
+
+/// Same value, same sign for zeros and infinities, or both NaN
+bool same(double a, double b)
+{
+    return (std::isnan(a) && std::isnan(b)) || (a == b && std::signbit(a) == std::signbit(b));
+}
+
+bool close(double a, double b, double tolerance)
+{
+    if (!std::isfinite(b) || b == 0)
+        return same(a, b);
+    return std::abs(a - b) <= tolerance * std::abs(b);
+}
+
+/// Zeros, infinities, values outside the float range (AVX2 rsqrt fallback) and ordinary values
+constexpr std::array<double, 13> values = {0., -0., INFINITY, 1e-300, 1e300, 1e-40, 1e40, 2., 0.5, 3.7, 123.456, 1e-5, 7e6};
+
+template <size_t W>
+double_pack<W> lanes_from(size_t shift)
+{
+    double_pack<W> out;
+    for (size_t i = 0; i < W; i++)
+        out[i] = values[(i + shift) % values.size()];
+    return out;
+}
+
+template <size_t W>
+void check_double_pack()
+{
+    for (size_t shift = 0; shift < values.size(); shift++)
+    {
+        double_pack<W> a = lanes_from<W>(shift), b = lanes_from<W>(shift + 5);
+        double_pack<W> sqrt_a = sqrt(a), rsqrt_a = rsqrt(a);
+        double_pack<W> sum = a + b, difference = a - b, product = a * b, quotient = a / b, negated = -a;
+        double_pack<W> min_ab = min(a, b), max_ab = max(a, b), abs_a = abs(negated);
+        mask_pack<W> less = a < b, equal = a == b;
+        double_pack<W> selected = select(less, a, b);
+        for (size_t i = 0; i < W; i++)
+        {
+            double x = a[i], y = b[i];
+            check(same(sqrt_a[i], std::sqrt(x)), "sqrt", W, i, sqrt_a[i], std::sqrt(x));
+            check(close(rsqrt_a[i], 1 / std::sqrt(x), 1e-15), "rsqrt", W, i, rsqrt_a[i], 1 / std::sqrt(x));
+            check(same(rsqrt_a[i], rsqrt(x)) || close(rsqrt_a[i], rsqrt(x), 1e-15), "rsqrt vs scalar", W, i, rsqrt_a[i], rsqrt(x));
+            check(same(sum[i], x + y), "+", W, i, sum[i], x + y);
+            check(same(difference[i], x - y), "-", W, i, difference[i], x - y);
+            check(same(product[i], x * y), "*", W, i, product[i], x * y);
+            check(same(quotient[i], x / y), "/", W, i, quotient[i], x / y);
+            check(same(negated[i], -x), "negation", W, i, negated[i], -x);
+            check(min_ab[i] == std::min(x, y), "min", W, i, min_ab[i], std::min(x, y));
+            check(max_ab[i] == std::max(x, y), "max", W, i, max_ab[i], std::max(x, y));
+            check(same(abs_a[i], std::abs(x)), "abs", W, i, abs_a[i], std::abs(x));
+            check(less[i] == (x < y), "<", W, i, less[i], x < y);
+            check(equal[i] == (x == y), "==", W, i, equal[i], x == y);
+            check(same(selected[i], x < y ? x : y), "select", W, i, selected[i], x < y ? x : y);
+        }
+
+        double scalar_sum = 0, scalar_min = a[0], scalar_max = a[0];
+        for (size_t i = 0; i < W; i++)
+        {
+            scalar_sum += a[i];
+            scalar_min = std::fmin(scalar_min, a[i]);
+            scalar_max = std::fmax(scalar_max, a[i]);
+        }
+        check(same(a.hsum(), scalar_sum), "hsum", W, 0, a.hsum(), scalar_sum);
+        /// The sign of fmin(0, -0) is unspecified, so are the ones of hmin and hmax
+        check(a.hmin() == scalar_min, "hmin", W, 0, a.hmin(), scalar_min);
+        check(a.hmax() == scalar_max, "hmax", W, 0, a.hmax(), scalar_max);
+
+        double_pack<W> assigned = a;
+        assigned.masked_assign(less, b);
+        for (size_t i = 0; i < W; i++)
+            check(same(assigned[i], less[i] ? b[i] : a[i]), "masked_assign", W, i, assigned[i], less[i] ? b[i] : a[i]);
+    }
+
+    /// get() and set() on every lane, only defined for power of two widths
+    if constexpr (std::has_single_bit(W))
+    {
+        double_pack<W> a = lanes_from<W>(3), b;
+        typename double_pack<W>::vector_type vector = a.get();
+        for (size_t i = 0; i < W; i++)
+        {
+            check(same(vector[i], a[i]), "get", W, i, vector[i], a[i]);
+            vector[i] = 100. + i;
+        }
+        b.set(vector);
+        for (size_t i = 0; i < W; i++)
+            check(b[i] == 100. + i, "set", W, i, b[i], 100. + i);
+
+        mask_pack<W> m;
+        for (size_t i = 0; i < W; i++)
+            m[i] = i % 3 == 0;
+        typename mask_pack<W>::vector_type bits = m.get();
+        for (size_t i = 0; i < W; i++)
+        {
+            check(bits[i] == m.m[i], "mask get", W, i, bits[i], m.m[i]);
+            bits[i] = i % 2;
+        }
+        m.set(bits);
+        for (size_t i = 0; i < W; i++)
+            check(m.m[i] == int64_t(i % 2), "mask set", W, i, m.m[i], i % 2);
+    }
+}
+
+template <size_t W>
+void check_vec_pack(std::mt19937_64 &rng)
+{
+    std::uniform_real_distribution<double> uniform(-10., 10.);
+    std::vector<vec2d> u2(W), out2(W);
+    std::vector<vec3d> u3(W), out3(W);
+    for (size_t i = 0; i < W; i++)
+    {
+        u2[i] = vec2d(uniform(rng), uniform(rng));
+        u3[i] = vec3d(uniform(rng), uniform(rng), uniform(rng));
+    }
+    /// A zero vector in the last lane, left untouched by normalize
+    u2[W - 1] = vec2d(0., 0.);
+    u3[W - 1] = vec3d(0., 0., 0.);
+
+    vec2d_pack<W> p2 = vec2d_pack<W>::gather(u2, size_t(0)), q2;
+    vec3d_pack<W> p3 = vec3d_pack<W>::gather(u3, size_t(0)), q3;
+    for (size_t i = 0; i < W; i++)
+    {
+        q2.set(i, p2.get(i));
+        q3.set(i, p3.get(i));
+    }
+    q2.scatter(out2, size_t(0));
+    q3.scatter(out3, size_t(0));
+    double_pack<W> inv2 = p2.inv_norm_3(), inv3 = p3.inv_norm_3(), dot3 = p3.dot(p3);
+    vec2d_pack<W> n2 = p2;
+    vec3d_pack<W> n3 = p3;
+    n2.normalize();
+    n3.normalize();
+    for (size_t i = 0; i < W; i++)
+    {
+        check(out2[i] == u2[i], "vec2d_pack get/set", W, i, out2[i].x, u2[i].x);
+        check(out3[i] == u3[i], "vec3d_pack get/set", W, i, out3[i].x, u3[i].x);
+        check(close(inv2[i], u2[i].inv_norm_3(), 1e-15), "vec2d_pack inv_norm_3", W, i, inv2[i], u2[i].inv_norm_3());
+        check(close(inv3[i], u3[i].inv_norm_3(), 1e-15), "vec3d_pack inv_norm_3", W, i, inv3[i], u3[i].inv_norm_3());
+        check(close(dot3[i], u3[i].dot(u3[i]), 1e-15), "vec3d_pack dot", W, i, dot3[i], u3[i].dot(u3[i]));
+        vec2d m2 = u2[i];
+        vec3d m3 = u3[i];
+        m2.normalize();
+        m3.normalize();
+        check((n2.get(i) - m2).norm() <= 1e-15, "vec2d_pack normalize", W, i, n2.get(i).x, m2.x);
+        check((n3.get(i) - m3).norm() <= 1e-15, "vec3d_pack normalize", W, i, n3.get(i).x, m3.x);
+    }
+}
+
+template <size_t... W>
+void check_widths(std::mt19937_64 &rng)
+{
+    (check_double_pack<W>(), ...);
+    (check_vec_pack<W>(rng), ...);
+}
+
+int main()
+{
+    std::mt19937_64 rng(3);
+    check_widths<1, 2, 3, 4, 5, 7, 8, 9, 12, 13, 16>(rng);
+    fmt::println("native_lanes = {}, {} failures", native_lanes, failures);
+    return failures != 0;
+}